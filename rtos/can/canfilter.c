@@ -0,0 +1,443 @@
+/* canfilter.c : CAN filter bank compiler
+ * Warren W. Gay VE3WWG
+ *
+ * Lays the IDs and ID ranges a node subscribes to out over the bxCAN
+ * filter banks. Each range is split into aligned power of two blocks:
+ * one ID of one frame type becomes an identifier list entry, anything
+ * larger an ID/mask pair. Standard IDs pack four to a bank as 16 bit
+ * list entries or two as 16 bit masks, extended IDs two to a bank as
+ * 32 bit list entries or one as a 32 bit mask. An odd mask or 32 bit
+ * list bank takes a spare standard list ID in its free slot.
+ *
+ * When the banks run out, the two filters of a class (FIFO, IDE and
+ * frame type) whose merged block adds the fewest IDs are merged, until
+ * the layout fits. The frames then accepted without being asked for
+ * are reported as leakage.
+ *
+ * Rules of the most urgent priority present go to FIFO 0, the rest to
+ * FIFO 1, so that routine traffic cannot overrun urgent messages.
+ * A merged filter may still take a frame of the other FIFO's rules.
+ *
+ * fmi_rule[] names the rule behind each filter match index, or is
+ * CANF_MERGED where a filter serves more than one rule.
+ */
+#include <string.h>
+
+#include "canfilter.h"
+
+#define STD_BITS	11
+#define EXT_BITS	29
+
+struct s_entry {
+	uint32_t	base;		// First ID of the aligned block
+	uint8_t		bits;		// Block holds 2^bits IDs
+	uint8_t		ext : 1;	// Extended IDs
+	uint8_t		frames : 2;	// enum CanfFrames
+	uint8_t		fifo : 1;	// FIFO 0 or 1
+	uint8_t		rule;		// Rule index, or CANF_MERGED
+};
+
+static struct s_entry ent[CANF_ENTRIES];
+static unsigned nent;
+
+/*********************************************************************
+ * Internal: Same class (these may be merged)
+ *********************************************************************/
+
+static bool
+same_class(const struct s_entry *a,const struct s_entry *b) {
+	return a->ext == b->ext && a->frames == b->frames && a->fifo == b->fifo;
+}
+
+/*********************************************************************
+ * Internal: Block b lies within block a
+ *********************************************************************/
+
+static bool
+contains(const struct s_entry *a,const struct s_entry *b) {
+	return b->bits <= a->bits && (b->base >> a->bits) == (a->base >> a->bits);
+}
+
+/*********************************************************************
+ * Internal: Merge the cheapest pair of one class. Blocks inside the
+ * merged block are dropped with it.
+ *********************************************************************/
+
+static bool
+merge_one(struct s_canfilt *cf) {
+	int64_t cost, best = -1;
+	unsigned bi = 0, bbits = 0, n;
+
+	for ( unsigned ux=0; ux<nent; ++ux ) {
+		for ( unsigned vx=ux+1; vx<nent; ++vx ) {
+			if ( !same_class(&ent[ux],&ent[vx]) )
+				continue;
+			n = ent[ux].bits > ent[vx].bits ? ent[ux].bits : ent[vx].bits;
+			while ( (ent[ux].base >> n) != (ent[vx].base >> n) )
+				++n;
+			cost = (1LL << n) - (1LL << ent[ux].bits) - (1LL << ent[vx].bits);
+			if ( best < 0 || cost < best ) {
+				best = cost < 0 ? 0 : cost;
+				bi = ux;
+				bbits = n;
+			}
+		}
+	}
+	if ( best < 0 )
+		return false;
+
+	ent[bi].bits = bbits;
+	ent[bi].base &= ~((1u << bbits) - 1);
+	for ( unsigned ux=0; ux<nent; ) {
+		if ( ux != bi && same_class(&ent[bi],&ent[ux]) && contains(&ent[bi],&ent[ux]) ) {
+			if ( ent[ux].rule != ent[bi].rule )
+				ent[bi].rule = CANF_MERGED;
+			ent[ux] = ent[--nent];
+			if ( bi == nent )
+				bi = ux;
+			++cf->merges;
+		} else	++ux;
+	}
+	return true;
+}
+
+/*********************************************************************
+ * Internal: Add a block, merging first if the table is full
+ *********************************************************************/
+
+static bool
+add(struct s_canfilt *cf,const struct s_entry *e) {
+
+	for ( unsigned ux=0; ux<nent; ++ux )
+		if ( same_class(&ent[ux],e) && contains(&ent[ux],e) )
+			return true;			// Already accepted
+	if ( nent >= CANF_ENTRIES && !merge_one(cf) )
+		return false;
+	ent[nent++] = *e;
+	return true;
+}
+
+/*********************************************************************
+ * Internal: Register images of a filter
+ *********************************************************************/
+
+static uint16_t
+fr16(const struct s_entry *e,bool mask) {
+
+	if ( !mask )
+		return e->base << 5 | (e->frames == CANF_RTR) << 4;
+	return (~((1u << e->bits) - 1) & 0x7FF) << 5 | (e->frames != CANF_ANY) << 4 | 1 << 3;
+}
+
+static uint32_t
+fr32(const struct s_entry *e,bool mask) {
+	uint32_t blk = ~((1u << e->bits) - 1);
+
+	if ( !mask )
+		return (e->ext ? e->base << 3 | 4 : e->base << 21) | (e->frames == CANF_RTR) << 1;
+	return (e->ext ? (blk & 0x1FFFFFFF) << 3 : (blk & 0x7FF) << 21) | 4 | (e->frames != CANF_ANY) << 1;
+}
+
+/*********************************************************************
+ * Internal: Count (and when emit, write out) one bank
+ *********************************************************************/
+
+struct s_pack {
+	struct s_canfilt *cf;
+	unsigned	nbanks;
+	bool		emit;
+};
+
+static void
+put_bank(struct s_pack *pk,unsigned fifo,bool scale32,bool list,uint32_t fr1,uint32_t fr2,
+  const struct s_entry **filters,unsigned nfilters) {
+	struct s_canfilt *cf = pk->cf;
+	struct s_canfilt_bank *bk;
+
+	if ( pk->emit && pk->nbanks < CANF_BANKS ) {
+		bk = &cf->bank[pk->nbanks];
+		bk->fr1 = fr1;
+		bk->fr2 = fr2;
+		bk->scale32 = scale32;
+		bk->list = list;
+		bk->fifo = fifo;
+		for ( unsigned ux=0; ux<nfilters; ++ux )
+			cf->fmi_rule[fifo][cf->nfmi[fifo]++] = filters[ux]->rule;
+		cf->nbanks = pk->nbanks + 1;
+	}
+	++pk->nbanks;
+}
+
+/*********************************************************************
+ * Internal: Lay out the filters, returning the banks needed
+ *********************************************************************/
+
+static unsigned
+pack(struct s_canfilt *cf,bool emit) {
+	struct s_pack pk = { cf, 0, emit };
+	const struct s_entry *L[CANF_ENTRIES], *M[CANF_ENTRIES], *X[CANF_ENTRIES], *Y[CANF_ENTRIES];
+	const struct s_entry *f[4];
+	unsigned nl, nm, nx, ny, li;
+
+	for ( unsigned fifo=0; fifo<2; ++fifo ) {
+		nl = nm = nx = ny = li = 0;
+		for ( unsigned ux=0; ux<nent; ++ux ) {
+			const struct s_entry *e = &ent[ux];
+			bool list = e->bits == 0 && e->frames != CANF_ANY;
+
+			if ( e->fifo != fifo )
+				continue;
+			if ( !e->ext ) {
+				if ( list )
+					L[nl++] = e;
+				else	M[nm++] = e;
+			} else if ( list )
+				X[nx++] = e;
+			else	Y[ny++] = e;
+		}
+
+		// Standard IDs, four to a 16 bit list bank:
+		for ( ; nl - li >= 4; li += 4 ) {
+			put_bank(&pk,fifo,false,true,
+				(uint32_t)fr16(L[li+1],false) << 16 | fr16(L[li],false),
+				(uint32_t)fr16(L[li+3],false) << 16 | fr16(L[li+2],false),
+				&L[li],4);
+		}
+
+		// Standard masks, two to a bank (or one and a spare ID):
+		for ( unsigned ux=0; ux<nm; ux += 2 ) {
+			f[0] = M[ux];
+			f[1] = ux + 1 < nm ? M[ux+1] : li < nl ? L[li++] : M[ux];
+			put_bank(&pk,fifo,false,false,
+				(uint32_t)fr16(f[0],true) << 16 | fr16(f[0],false),
+				(uint32_t)fr16(f[1],true) << 16 | fr16(f[1],false),
+				f,2);
+		}
+
+		// Extended IDs, two to a 32 bit list bank (or one and a spare ID):
+		for ( unsigned ux=0; ux<nx; ux += 2 ) {
+			f[0] = X[ux];
+			f[1] = ux + 1 < nx ? X[ux+1] : li < nl ? L[li++] : X[ux];
+			put_bank(&pk,fifo,true,true,fr32(f[0],false),fr32(f[1],false),f,2);
+		}
+
+		// Extended masks:
+		for ( unsigned ux=0; ux<ny; ++ux )
+			put_bank(&pk,fifo,true,false,fr32(Y[ux],false),fr32(Y[ux],true),&Y[ux],1);
+
+		// Spare standard IDs, padded by repeating the last:
+		if ( li < nl ) {
+			for ( unsigned ux=0; ux<4; ++ux )
+				f[ux] = L[li + ux < nl ? li + ux : nl - 1];
+			put_bank(&pk,fifo,false,true,
+				(uint32_t)fr16(f[1],false) << 16 | fr16(f[0],false),
+				(uint32_t)fr16(f[3],false) << 16 | fr16(f[2],false),
+				f,4);
+		}
+	}
+	return pk.nbanks;
+}
+
+/*********************************************************************
+ * Internal: IDs in [lo,hi] wanted by some rule (ext, frame type t)
+ *********************************************************************/
+
+static uint32_t
+wanted(const struct s_canfilt_rule *rules,unsigned nrules,bool ext,unsigned t,uint32_t lo,uint32_t hi) {
+	uint32_t cur = lo, count = 0, end, next;
+	bool covered, more;
+
+	for (;;) {
+		// Extend through the rule reaching furthest from cur, else skip to the next one
+		covered = more = false;
+		end = next = 0;
+		for ( unsigned ux=0; ux<nrules; ++ux ) {
+			const struct s_canfilt_rule *r = &rules[ux];
+
+			if ( r->ext != ext || !(r->frames & t) || r->last < cur || r->first > hi )
+				continue;
+			if ( r->first <= cur ) {
+				if ( !covered || r->last > end )
+					end = r->last;
+				covered = true;
+			} else if ( !more || r->first < next ) {
+				next = r->first;
+				more = true;
+			}
+		}
+		if ( covered ) {
+			if ( end >= hi )
+				return count + (hi - cur + 1);
+			count += end - cur + 1;
+			cur = end + 1;
+		} else if ( more ) {
+			cur = next;
+		} else	return count;
+	}
+}
+
+/*********************************************************************
+ * Internal: Frames accepted that no rule asked for
+ *********************************************************************/
+
+static uint32_t
+leakage(const struct s_canfilt_rule *rules,unsigned nrules,bool ext) {
+	uint32_t leak = 0, size;
+	bool outer;
+
+	for ( unsigned t=CANF_DATA; t<=CANF_RTR; ++t ) {
+		for ( unsigned ux=0; ux<nent; ++ux ) {
+			const struct s_entry *e = &ent[ux];
+
+			if ( e->ext != ext || !(e->frames & t) )
+				continue;
+			outer = true;			// Count each accepted ID once
+			for ( unsigned vx=0; vx<nent && outer; ++vx ) {
+				const struct s_entry *o = &ent[vx];
+
+				if ( vx == ux || o->ext != ext || !(o->frames & t) )
+					continue;
+				if ( contains(o,e) && (o->bits > e->bits || vx < ux) )
+					outer = false;
+			}
+			if ( !outer )
+				continue;
+			size = 1u << e->bits;
+			leak += size - wanted(rules,nrules,ext,t,e->base,e->base + size - 1);
+		}
+	}
+	return leak;
+}
+
+/*********************************************************************
+ * Compile rules into a filter bank layout. Returns false for a bad
+ * rule (last < first, ID out of range, or more than 254 rules).
+ *********************************************************************/
+
+bool
+canfilt_compile(struct s_canfilt *cf,const struct s_canfilt_rule *rules,unsigned nrules) {
+	const struct s_canfilt_rule *r;
+	struct s_entry e;
+	uint8_t urgent = 0xFF;
+	unsigned maxbits;
+
+	memset(cf,0,sizeof *cf);
+	nent = 0;
+
+	if ( nrules >= CANF_MERGED )
+		return false;
+	for ( unsigned ux=0; ux<nrules; ++ux ) {
+		r = &rules[ux];
+		if ( r->last < r->first || r->last >> (r->ext ? EXT_BITS : STD_BITS) || !r->frames )
+			return false;
+		if ( r->prio < urgent )
+			urgent = r->prio;
+	}
+
+	for ( unsigned ux=0; ux<nrules; ++ux ) {
+		r = &rules[ux];
+		maxbits = r->ext ? EXT_BITS : STD_BITS;
+		e.ext = r->ext;
+		e.frames = r->frames;
+		e.fifo = r->prio != urgent;
+		e.rule = ux;
+
+		// Split [first,last] into aligned blocks:
+		for ( uint32_t a = r->first; ; a += 1u << e.bits ) {
+			e.base = a;
+			e.bits = 0;
+			while ( e.bits < maxbits && !(a & (1u << e.bits)) && a + (2u << e.bits) - 1 <= r->last )
+				++e.bits;
+			if ( e.bits == 1 && e.frames != CANF_ANY ) {
+				// Two list IDs pack as densely as one mask, and fill odd banks
+				e.bits = 0;
+				if ( !add(cf,&e) )
+					return false;
+				e.base = a + 1;
+				if ( !add(cf,&e) )
+					return false;
+				e.bits = 1;
+			} else if ( !add(cf,&e) )
+				return false;
+			if ( a + (1u << e.bits) - 1 >= r->last )
+				break;
+		}
+	}
+
+	while ( pack(cf,false) > CANF_BANKS )
+		if ( !merge_one(cf) )
+			return false;
+
+	// A filter grown over another rule's IDs can't name one rule:
+	for ( unsigned ux=0; ux<nent; ++ux ) {
+		struct s_entry *e = &ent[ux];
+		uint32_t hi = e->base + (1u << e->bits) - 1;
+
+		for ( unsigned rx=0; rx<nrules && e->rule != CANF_MERGED; ++rx ) {
+			r = &rules[rx];
+			if ( rx != e->rule && r->ext == e->ext && (r->frames & e->frames)
+			  && r->first <= hi && r->last >= e->base )
+				e->rule = CANF_MERGED;
+		}
+	}
+	pack(cf,true);
+
+	cf->leak_std = leakage(rules,nrules,false);
+	cf->leak_ext = leakage(rules,nrules,true);
+	return true;
+}
+
+/*********************************************************************
+ * Match a frame against a layout as the controller would: 32 bit
+ * filters before 16 bit, list before mask, then the lowest bank.
+ * Returns true if accepted, with its FIFO and filter match index.
+ *********************************************************************/
+
+bool
+canfilt_accepts(const struct s_canfilt *cf,uint32_t id,bool ext,bool rtr,unsigned *fifo,unsigned *fmi) {
+	unsigned nfmi[2] = { 0, 0 }, n, score, best = 0;
+	uint32_t w32, val, mask;
+	uint16_t w16;
+
+	w32 = (ext ? id << 3 | 4 : id << 21) | (uint32_t)rtr << 1;
+	w16 = (ext ? (id >> 18) << 5 | 1 << 3 | ((id >> 15) & 7) : id << 5) | rtr << 4;
+
+	for ( unsigned bx=0; bx<cf->nbanks; ++bx ) {
+		const struct s_canfilt_bank *bk = &cf->bank[bx];
+
+		n = bk->scale32 ? (bk->list ? 2 : 1) : (bk->list ? 4 : 2);
+		for ( unsigned ux=0; ux<n; ++ux ) {
+			if ( bk->scale32 ) {
+				if ( bk->list ) {
+					val = ux ? bk->fr2 : bk->fr1;
+					mask = 0xFFFFFFFE;
+				} else	{
+					val = bk->fr1;
+					mask = bk->fr2;
+				}
+				if ( (w32 ^ val) & mask )
+					continue;
+			} else	{
+				if ( bk->list ) {
+					val = ((ux & 2) ? bk->fr2 : bk->fr1) >> ((ux & 1) * 16) & 0xFFFF;
+					mask = 0xFFFF;
+				} else	{
+					val = (ux ? bk->fr2 : bk->fr1) & 0xFFFF;
+					mask = (ux ? bk->fr2 : bk->fr1) >> 16;
+				}
+				if ( (w16 ^ val) & mask )
+					continue;
+			}
+			score = 1 + bk->scale32 * 2 + bk->list;
+			if ( score > best ) {
+				best = score;
+				*fifo = bk->fifo;
+				*fmi = nfmi[bk->fifo] + ux;
+			}
+		}
+		nfmi[bk->fifo] += n;
+	}
+	return best > 0;
+}
+
+// canfilter.c
@@ -0,0 +1,51 @@
+/* canfilter.h : CAN filter bank compiler
+ * Warren W. Gay VE3WWG
+ */
+#ifndef CANFILTER_H
+#define CANFILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CANF_BANKS	14		// Filter banks (CAN1 alone)
+#define CANF_ENTRIES	48		// Working filters while compiling
+#define CANF_MAX_FMI	(CANF_BANKS * 4)
+#define CANF_MERGED	0xFF		// FMI serves several rules
+
+enum CanfFrames {
+	CANF_DATA = 1,			// Data frames
+	CANF_RTR = 2,			// Remote frames
+	CANF_ANY = 3			// Either
+};
+
+struct s_canfilt_rule {
+	uint32_t	first;		// First message ID
+	uint32_t	last;		// Last message ID (>= first)
+	uint8_t		ext : 1;	// Extended (29 bit) IDs
+	uint8_t		frames : 2;	// enum CanfFrames
+	uint8_t		prio;		// 0 is most urgent
+};
+
+struct s_canfilt_bank {
+	uint32_t	fr1, fr2;	// CAN_FiR1, CAN_FiR2
+	uint8_t		scale32 : 1;	// 32 bit scale, else two 16 bit
+	uint8_t		list : 1;	// Identifier list, else mask mode
+	uint8_t		fifo : 1;	// FIFO assignment
+};
+
+struct s_canfilt {
+	struct s_canfilt_bank bank[CANF_BANKS];
+	uint8_t		nbanks;		// Banks used (from bank 0)
+	uint8_t		nfmi[2];	// Filter numbers in each FIFO
+	uint8_t		fmi_rule[2][CANF_MAX_FMI]; // Rule index by FIFO and FMI
+	uint16_t	merges;		// Filters merged to fit the banks
+	uint32_t	leak_std;	// Unwanted standard frames accepted
+	uint32_t	leak_ext;	// Unwanted extended frames accepted
+};
+
+bool canfilt_compile(struct s_canfilt *cf,const struct s_canfilt_rule *rules,unsigned nrules);
+bool canfilt_accepts(const struct s_canfilt *cf,uint32_t id,bool ext,bool rtr,unsigned *fifo,unsigned *fmi);
+
+#endif // CANFILTER_H
+
+// canfilter.h
@@ -2,53 +2,451 @@
  * Warren W. Gay VE3WWG
  * Sun May 21 17:03:55 2017
  */
+#include <string.h>
+
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/f1/nvic.h>
+#include <libopencm3/cm3/dwt.h>
 
 #include "FreeRTOS.h"
+#include "semphr.h"
 #include "canmsgs.h"
 
-static QueueHandle_t canrxq = 0;
+#define TX_MBOXES	3
+#define TSR_TME		(CAN_TSR_TME0|CAN_TSR_TME1|CAN_TSR_TME2)
+#define TSR_RQCP(mb)	(CAN_TSR_RQCP0 << (mb) * 8)
+#define TSR_TXOK(mb)	(CAN_TSR_TXOK0 << (mb) * 8)
+#define TSR_ABRQ(mb)	(CAN_TSR_ABRQ0 << (mb) * 8)
+
+// Receive FIFO register (CAN_RF0R or CAN_RF1R, same layout), read
+// afresh on each use:
+#define CAN_RFR(fifo)	(*((fifo) ? &CAN_RF1R(CAN1) : &CAN_RF0R(CAN1)))
+
+// CAN_BTR fields for can_init(), from s_cantiming tq counts:
+#define BTR_SJW(t)	((uint32_t)((t)->sjw - 1) << CAN_BTR_SJW_SHIFT)
+#define BTR_TS1(t)	((uint32_t)((t)->ts1 - 1) << CAN_BTR_TS1_SHIFT)
+#define BTR_TS2(t)	((uint32_t)((t)->ts2 - 1) << CAN_BTR_TS2_SHIFT)
+
+/*********************************************************************
+ * A queued frame. Frames stay on the txhead list, in arbitration
+ * order, until they complete. One in a mailbox has mbox >= 0.
+ *********************************************************************/
+
+struct s_cantx {
+	struct s_cantx	*next;		// Next in priority order
+	uint32_t	key;		// Arbitration key (lower wins)
+	uint32_t	id;		// Message ID
+	uint8_t		length;		// Data length
+	uint8_t		data[8];	// Data to send
+	uint8_t		ext : 1;	// Extended message ID
+	uint8_t		rtr : 1;	// Remote transmission request
+	int8_t		mbox;		// Mailbox, or -1 when waiting
+};
+
+#define RXHASH_SIZE	16
+
+static struct s_canmsg rxring[CAN_RXRING];	// Received frames
+static volatile uint16_t rxhead = 0;		// Next slot to fill (ISR)
+static volatile uint16_t rxtail = 0;		// Next slot to dispatch (task)
+static TaskHandle_t rxtask = 0;
+static struct s_canrx_stats rxstats;
+static const struct s_canfilt_rule *rxrules = 0;
+static const can_handler_t *rxhandlers = 0;
+static unsigned rxnrules = 0;
+
+static struct s_canbus_policy buspolicy = { 50, 2000, 5000, true };
+static struct s_canbus_stats busstats;
+static uint8_t histnext = 0;			// Next busstats.hist[] slot
+static volatile uint32_t busbits = 0;		// Bits seen, this load period
+static TaskHandle_t bustask = 0;
+
+static struct {
+	uint32_t	key;			// msgid << 2 | ext << 1 | rtr
+	uint8_t		rule;			// Rule, or CANF_MERGED if none
+} rxhash[RXHASH_SIZE];
+
+static struct s_cantx txslots[CAN_TXQ_DEPTH];
+static struct s_cantx *txhead = 0;		// Queued frames
+static struct s_cantx *txfree = 0;		// Unused slots
+static struct s_cantx *txmbox[TX_MBOXES];	// Frame in each mailbox
+static SemaphoreHandle_t txsem = 0;		// Counts unused slots
+static struct s_cantx_stats txstats;
+static unsigned txcount = 0;			// Frames on txhead
+static uint8_t aborting = 0;			// Mailboxes being aborted
+static bool txhold = false;			// Don't load mailboxes
+static bool can_nart, can_locked;		// For can_configure()
+static struct s_canfilt canfilt;		// Filter bank layout
+static can_txhook_t txhook = 0;			// Called by the TX ISR
+
+/*********************************************************************
+ * Bits a frame occupies on the bus: the stuffed part, with worst case
+ * stuffing, then CRC delimiter, ACK, EOF and interframe space.
+ *********************************************************************/
+
+static uint32_t
+frame_bits(bool ext,bool rtr,unsigned length) {
+	unsigned n = (ext ? 54 : 34) + (rtr ? 0 : length * 8);
+
+	return n + (n - 1) / 4 + 13;
+}
+
+/*********************************************************************
+ * The key sorts frames as the bus arbitrates them: base ID, then
+ * RTR (SRR for extended), IDE, extended ID bits and RTR.
+ *********************************************************************/
+
+static uint32_t
+tx_key(uint32_t id,bool ext,bool rtr) {
+
+	if ( !ext )
+		return (id & 0x7FF) << 21 | (uint32_t)rtr << 20;
+	return (id & 0x1FFC0000) << 3 | 3 << 19 | (id & 0x3FFFF) << 1 | rtr;
+}
+
+/*********************************************************************
+ * True if a frame with this key is in a mailbox. The controller sends
+ * equal IDs lowest mailbox first, so only one is loaded at a time to
+ * keep their order.
+ *********************************************************************/
+
+static bool
+tx_inbox(uint32_t key) {
+
+	for ( unsigned ux=0; ux<TX_MBOXES; ++ux )
+		if ( txmbox[ux] && txmbox[ux]->key == key )
+			return true;
+	return false;
+}
+
+/*********************************************************************
+ * Retire completed mailboxes, then load waiting frames. When all
+ * mailboxes are busy, the lowest priority one is aborted in favour
+ * of a higher priority waiting frame. Called from the TX ISR, or in
+ * a critical section. Returns the number of slots freed.
+ *********************************************************************/
+
+static unsigned
+tx_service(void) {
+	uint32_t tsr = CAN_TSR(CAN1);
+	struct s_cantx *p, **pp;
+	unsigned freed = 0;
+	int mb, worst;
+
+	for ( mb=0; mb<TX_MBOXES; ++mb ) {
+		if ( !(tsr & TSR_RQCP(mb)) )
+			continue;
+		CAN_TSR(CAN1) = TSR_RQCP(mb);		// rc_w1: clears RQCP, TXOK etc.
+		if ( !(p = txmbox[mb]) )
+			continue;
+		txmbox[mb] = 0;
+		p->mbox = -1;
+
+		if ( !(tsr & TSR_TXOK(mb)) && (aborting & 1 << mb) ) {
+			++txstats.aborted;		// Stays queued
+		} else	{
+			if ( tsr & TSR_TXOK(mb) ) {
+				++txstats.sent;
+				busbits += frame_bits(p->ext,p->rtr,p->length);
+			} else	++txstats.failed;
+			for ( pp = &txhead; *pp != p; pp = &(*pp)->next )
+				;
+			*pp = p->next;
+			p->next = txfree;
+			txfree = p;
+			--txcount;
+			++freed;
+		}
+		aborting &= ~(1 << mb);
+	}
+
+	if ( txhold )
+		return freed;
+
+	for ( p = txhead; p; p = p->next ) {
+		if ( p->mbox >= 0 || tx_inbox(p->key) )
+			continue;
+		mb = can_transmit(CAN1,p->id,p->ext,p->rtr,p->length,p->data);
+		if ( mb < 0 )
+			break;
+		p->mbox = mb;
+		txmbox[mb] = p;
+	}
+
+	if ( p && !aborting ) {
+		// p waits with all mailboxes busy
+		worst = -1;
+		for ( mb=0; mb<TX_MBOXES; ++mb )
+			if ( txmbox[mb] && txmbox[mb]->key > p->key
+			  && (worst < 0 || txmbox[mb]->key > txmbox[worst]->key) )
+				worst = mb;
+		if ( worst >= 0 ) {
+			aborting |= 1 << worst;
+			CAN_TSR(CAN1) = TSR_ABRQ(worst);
+		}
+	}
+	return freed;
+}
+
+/*********************************************************************
+ * CAN TX mailbox empty ISR (RQCPx set)
+ *********************************************************************/
+
+void
+usb_hp_can_tx_isr(void) {
+	BaseType_t woken = pdFALSE;
+	unsigned freed = tx_service();
+
+	while ( freed-- > 0 )
+		xSemaphoreGiveFromISR(txsem,&woken);
+	if ( txhook )
+		txhook(&woken);			// Paced senders (ISO-TP)
+	portYIELD_FROM_ISR(woken);
+}
+
+/*********************************************************************
+ * Internal: Put a frame on the queue, with a slot already taken from
+ * txsem. Called in a critical section. Returns slots freed.
+ *********************************************************************/
+
+static unsigned
+tx_enqueue(uint32_t id,bool ext,bool rtr,uint8_t length,const void *data) {
+	struct s_cantx *p, **pp;
+
+	if ( length > 8 )
+		length = 8;
+
+	p = txfree;
+	txfree = p->next;
+	p->key = tx_key(id,ext,rtr);
+	p->id = id;
+	p->ext = ext;
+	p->rtr = rtr;
+	p->length = length;
+	p->mbox = -1;
+	if ( length > 0 )
+		memcpy(p->data,data,length);
+
+	// After all frames of the same or higher priority:
+	for ( pp = &txhead; *pp && (*pp)->key <= p->key; pp = &(*pp)->next )
+		;
+	p->next = *pp;
+	*pp = p;
+
+	++txstats.queued;
+	if ( ++txcount > txstats.hiwater )
+		txstats.hiwater = txcount;
+	return tx_service();
+}
+
+/*********************************************************************
+ * Queue a CAN message to be sent, waiting up to ticks for room
+ * (0 to not wait). Returns false if the queue stayed full.
+ *********************************************************************/
+
+bool
+can_xmit_wait(uint32_t id,bool ext,bool rtr,uint8_t length,const void *data,TickType_t ticks) {
+	unsigned freed;
+
+	if ( xSemaphoreTake(txsem,ticks) != pdTRUE ) {
+		taskENTER_CRITICAL();
+		++txstats.full;
+		taskEXIT_CRITICAL();
+		return false;
+	}
+
+	taskENTER_CRITICAL();
+	freed = tx_enqueue(id,ext,rtr,length,data);
+	taskEXIT_CRITICAL();
+
+	while ( freed-- > 0 )
+		xSemaphoreGive(txsem);
+	return true;
+}
+
+/*********************************************************************
+ * Queue a CAN message from an ISR, or from a critical section (never
+ * waits). Returns false if the queue is full.
+ *********************************************************************/
+
+bool
+can_xmit_isr(uint32_t id,bool ext,bool rtr,uint8_t length,const void *data,BaseType_t *woken) {
+	UBaseType_t mask;
+	unsigned freed;
+	bool ok;
+
+	mask = taskENTER_CRITICAL_FROM_ISR();
+	if ( (ok = xSemaphoreTakeFromISR(txsem,woken) == pdTRUE) )
+		freed = tx_enqueue(id,ext,rtr,length,data);
+	else	{
+		++txstats.full;
+		freed = 0;
+	}
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	while ( freed-- > 0 )
+		xSemaphoreGiveFromISR(txsem,woken);
+	return ok;
+}
+
+/*********************************************************************
+ * Call hook at the end of each TX mailbox interrupt (0 to remove),
+ * to queue more frames as mailboxes free up.
+ *********************************************************************/
+
+void
+can_tx_hook(can_txhook_t hook) {
+
+	taskENTER_CRITICAL();
+	txhook = hook;
+	taskEXIT_CRITICAL();
+}
 
 /*********************************************************************
- * Queue a CAN message to be sent:
+ * Queue a CAN message to be sent (waits for room)
  *********************************************************************/
 
 void
 can_xmit(uint32_t id,bool ext,bool rtr,uint8_t length,void *data) {
 
-	while ( can_transmit(CAN1,id,ext,rtr,length,(uint8_t*)data) == -1 )
-		taskYIELD();
+	can_xmit_wait(id,ext,rtr,length,data,portMAX_DELAY);
+}
+
+/*********************************************************************
+ * Return TX counters, optionally resetting them
+ *********************************************************************/
+
+void
+can_tx_stats(struct s_cantx_stats *stats,bool reset) {
+
+	taskENTER_CRITICAL();
+	*stats = txstats;
+	if ( reset ) {
+		memset(&txstats,0,sizeof txstats);
+		txstats.hiwater = txcount;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/*********************************************************************
+ * Change bit timing (CAN_BTR_SJW_xTQ etc. and prescaler brp), with
+ * loopback selecting silent loopback mode. Frames in the mailboxes
+ * are aborted first and sent again after.
+ *********************************************************************/
+
+void
+can_configure(uint32_t sjw,uint32_t ts1,uint32_t ts2,uint32_t brp,bool loopback) {
+	unsigned freed;
+
+	taskENTER_CRITICAL();
+	txhold = true;
+	for ( int mb=0; mb<TX_MBOXES; ++mb ) {
+		if ( txmbox[mb] ) {
+			aborting |= 1 << mb;
+			CAN_TSR(CAN1) = TSR_ABRQ(mb);
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	while ( (CAN_TSR(CAN1) & TSR_TME) != TSR_TME || txmbox[0] || txmbox[1] || txmbox[2] )
+		taskYIELD();				// ISR retires them
+
+	can_init(
+		CAN1,
+		false,					// ttcm=off
+		false,					// auto bus off management (can_bus_task)
+		true,					// Automatic wakeup mode.
+		can_nart,				// No automatic retransmission.
+		can_locked,				// Receive FIFO locked mode
+		false,					// Transmit FIFO priority (msg id)
+		sjw,
+		ts1,
+		ts2,
+		brp,
+		loopback,				// Loopback
+		loopback);				// Silent
+
+	taskENTER_CRITICAL();
+	txhold = false;
+	freed = tx_service();
+	taskEXIT_CRITICAL();
+
+	while ( freed-- > 0 )
+		xSemaphoreGive(txsem);
+}
+
+/*********************************************************************
+ * Change to bitrate, sampling at CANT_SAMPLE, as can_configure().
+ * Returns false (unchanged) if the APB1 clock can't make it. The
+ * timing used is returned in timing when not null.
+ *********************************************************************/
+
+bool
+can_set_bitrate(uint32_t bitrate,bool loopback,struct s_cantiming *timing) {
+	struct s_cantiming t;
+
+	if ( !cantiming_calc(&t,rcc_apb1_frequency,bitrate,CANT_SAMPLE) )
+		return false;
+	can_configure(BTR_SJW(&t),BTR_TS1(&t),BTR_TS2(&t),t.brp,loopback);
+	if ( timing )
+		*timing = t;
+	return true;
 }
 
 /*********************************************************************
- * Main CAN RX ISR routine for FIFO x
+ * Main CAN RX ISR routine for FIFO x. Frames are decoded from the
+ * FIFO registers straight into the ring, where the handler reads
+ * them. Both RX ISRs run at one priority, so only one fills the ring.
  *********************************************************************/
 
 static void
-can_rx_isr(uint8_t fifo,unsigned msgcount) {
-        struct s_canmsg cmsg;
-        bool xmsgidf, rtrf;
-
-        while ( msgcount-- > 0 ) {
-                can_receive(
-                        CAN1,
-                        fifo,                   // FIFO # 1
-                        true,                   // Release      
-                        &cmsg.msgid,
-                        &xmsgidf,               // true if msgid is extended
-                        &rtrf,                  // true if requested transmission
-                        (uint8_t *)&cmsg.fmi,   // Matched filter index
-                        &cmsg.length,           // Returned length
-                        cmsg.data,
-                        NULL);			// Unused timestamp
-                cmsg.xmsgidf = xmsgidf;
-                cmsg.rtrf = rtrf;
-                cmsg.fifo = fifo;
-                // If the queue is full, the message is lost
-                xQueueSendToBackFromISR(canrxq,&cmsg,NULL);
-        }
+can_rx_isr(uint8_t fifo) {
+	uint32_t mbox = fifo ? CAN_FIFO1 : CAN_FIFO0;
+	uint32_t rir, rdtr, word, stamp = dwt_read_cycle_counter();
+	BaseType_t woken = pdFALSE;
+	struct s_canmsg *msg;
+	uint16_t head = rxhead;
+
+	if ( CAN_RFR(fifo) & CAN_RF0R_FOVR0 ) {
+		++rxstats.overruns;			// A frame was lost in hardware
+		CAN_RFR(fifo) = CAN_RF0R_FOVR0;		// rc_w1 (same bits in RF1R)
+	}
+
+	while ( CAN_RFR(fifo) & CAN_RF0R_FMP0_MASK ) {
+		if ( (uint16_t)(head - rxtail) >= CAN_RXRING ) {
+			++rxstats.dropped;		// Ring full
+		} else	{
+			msg = &rxring[head++ % CAN_RXRING];
+			rir = CAN_RIxR(CAN1,mbox);
+			rdtr = CAN_RDTxR(CAN1,mbox);
+			msg->msgid = rir & CAN_RIxR_IDE ? rir >> CAN_RIxR_EXID_SHIFT : rir >> CAN_RIxR_STID_SHIFT;
+			msg->fmi = (rdtr & CAN_RDTxR_FMI_MASK) >> CAN_RDTxR_FMI_SHIFT;
+			msg->length = rdtr & CAN_RDTxR_DLC_MASK;
+			if ( msg->length > 8 )
+				msg->length = 8;
+			word = CAN_RDLxR(CAN1,mbox);
+			memcpy(msg->data,&word,4);
+			word = CAN_RDHxR(CAN1,mbox);
+			memcpy(msg->data+4,&word,4);
+			msg->xmsgidf = !!(rir & CAN_RIxR_IDE);
+			msg->rtrf = !!(rir & CAN_RIxR_RTR);
+			msg->fifo = fifo;
+			msg->stamp = stamp;
+			++rxstats.received;
+			busbits += frame_bits(msg->xmsgidf,msg->rtrf,msg->length);
+		}
+		CAN_RFR(fifo) = CAN_RF0R_RFOM0;		// Release the FIFO mailbox
+		while ( CAN_RFR(fifo) & CAN_RF0R_RFOM0 )
+			;
+	}
+
+	if ( (uint16_t)(head - rxtail) > rxstats.hiwater )
+		rxstats.hiwater = head - rxtail;
+	__asm__ __volatile__("" ::: "memory");	// Frame before head
+	rxhead = head;
+
+	vTaskNotifyGiveFromISR(rxtask,&woken);
+	portYIELD_FROM_ISR(woken);
 }
 
 /*********************************************************************
@@ -57,7 +455,7 @@ can_rx_isr(uint8_t fifo,unsigned msgcount) {
 
 void
 usb_lp_can_rx0_isr(void) {
-        can_rx_isr(0,CAN_RF0R(CAN1)&3);
+	can_rx_isr(0);
 }
 
 /*********************************************************************
@@ -66,29 +464,330 @@ usb_lp_can_rx0_isr(void) {
 
 void
 can_rx1_isr(void) {
-        can_rx_isr(1,CAN_RF1R(CAN1)&3);
+	can_rx_isr(1);
+}
+
+/*********************************************************************
+ * True if rule asks for this frame
+ *********************************************************************/
+
+static bool
+rx_wants(const struct s_canfilt_rule *rule,const struct s_canmsg *msg) {
+	return rule->ext == msg->xmsgidf && msg->msgid >= rule->first && msg->msgid <= rule->last
+		&& (rule->frames & (msg->rtrf ? CANF_RTR : CANF_DATA));
+}
+
+/*********************************************************************
+ * Find the rule wanting a frame, through a small cache hashed on the
+ * ID. Used when the filter that took it serves several rules.
+ *********************************************************************/
+
+static unsigned
+rx_lookup(const struct s_canmsg *msg) {
+	uint32_t key = msg->msgid << 2 | msg->xmsgidf << 1 | msg->rtrf;
+	unsigned hx = (msg->msgid ^ msg->msgid >> 5 ^ msg->msgid >> 10) % RXHASH_SIZE;
+
+	if ( rxhash[hx].key != key ) {
+		rxhash[hx].key = key;
+		rxhash[hx].rule = CANF_MERGED;
+		for ( unsigned ux=0; ux<rxnrules; ++ux ) {
+			if ( rx_wants(&rxrules[ux],msg) ) {
+				rxhash[hx].rule = ux;
+				break;
+			}
+		}
+	}
+	return rxhash[hx].rule;
+}
+
+/*********************************************************************
+ * Hand a frame to its rule's handler (table indexed by FMI)
+ *********************************************************************/
+
+static void
+can_dispatch(struct s_canmsg *msg) {
+	unsigned rule = CANF_MERGED;
+	can_handler_t handler;
+	uint32_t lat;
+
+	if ( msg->fmi < canfilt.nfmi[msg->fifo] )
+		rule = canfilt.fmi_rule[msg->fifo][msg->fmi];
+	if ( rule == CANF_MERGED )
+		rule = rx_lookup(msg);
+	else if ( !rx_wants(&rxrules[rule],msg) )
+		rule = CANF_MERGED;		// Leaked through the rule's filter
+
+	lat = dwt_read_cycle_counter() - msg->stamp;
+	if ( !rxstats.dispatched || lat < rxstats.lat_min )
+		rxstats.lat_min = lat;
+	if ( lat > rxstats.lat_max )
+		rxstats.lat_max = lat;
+	rxstats.lat_sum += lat;
+	++rxstats.dispatched;
+
+	if ( rule == CANF_MERGED ) {
+		++rxstats.unwanted;
+		return;
+	}
+	if ( (handler = rxhandlers[rule]) != 0 )
+		handler(msg);
 }
 
 /*********************************************************************
- * Issue can_rx_callback() for each CAN message received
+ * Dispatch each CAN message received, in place in the ring
  *********************************************************************/
 
 static void
 can_rx_task(void *arg __attribute((unused))) {
-        struct s_canmsg cmsg;
 
-        for (;;) {
-                if ( xQueueReceive(canrxq,&cmsg,portMAX_DELAY) == pdPASS )
-			can_recv(&cmsg);
-        }
+	for (;;) {
+		ulTaskNotifyTake(pdTRUE,portMAX_DELAY);
+		while ( rxtail != rxhead ) {
+			can_dispatch(&rxring[rxtail % CAN_RXRING]);
+			__asm__ __volatile__("" ::: "memory");
+			rxtail = rxtail + 1;		// Slot may now be refilled
+		}
+	}
+}
+
+/*********************************************************************
+ * Return RX counters, optionally resetting them
+ *********************************************************************/
+
+void
+can_rx_stats(struct s_canrx_stats *stats,bool reset) {
+
+	taskENTER_CRITICAL();
+	*stats = rxstats;
+	if ( reset )
+		memset(&rxstats,0,sizeof rxstats);
+	taskEXIT_CRITICAL();
+}
+
+/*********************************************************************
+ * Bit rate from CAN_BTR and the APB1 clock
+ *********************************************************************/
+
+static uint32_t
+can_bitrate(void) {
+	uint32_t btr = CAN_BTR(CAN1);
+	uint32_t brp = (btr & CAN_BTR_BRP_MASK) + 1;
+	uint32_t tq = 3 + (btr >> CAN_BTR_TS1_SHIFT & 0xF) + (btr >> CAN_BTR_TS2_SHIFT & 0x7);
+
+	return rcc_apb1_frequency / (brp * tq);
+}
+
+/*********************************************************************
+ * Note a change of error state. Called from the SCE ISR, or from the
+ * bus task in a critical section. Returns true on going bus-off.
+ *********************************************************************/
+
+static bool
+bus_note(uint32_t esr,uint32_t tick) {
+	unsigned state = CAN_ERROR_ACTIVE;
+	struct s_canerr_event *ev;
+
+	if ( esr & CAN_ESR_BOFF )
+		state = CAN_BUS_OFF;
+	else if ( esr & CAN_ESR_EPVF )
+		state = CAN_ERROR_PASSIVE;
+	else if ( esr & CAN_ESR_EWGF )
+		state = CAN_ERROR_WARNING;
+
+	if ( state == busstats.state )
+		return false;
+
+	if ( state > busstats.state ) {
+		if ( state == CAN_ERROR_WARNING )
+			++busstats.warnings;
+		else if ( state == CAN_ERROR_PASSIVE )
+			++busstats.passives;
+		else	++busstats.busoffs;
+	}
+	busstats.state = state;
+
+	ev = &busstats.hist[histnext];		// Kept as a ring here
+	histnext = (histnext + 1) % CAN_ERRHIST;
+	if ( busstats.nhist < CAN_ERRHIST )
+		++busstats.nhist;
+	ev->tick = tick;
+	ev->state = state;
+	ev->lec = (esr & CAN_ESR_LEC_MASK) >> CAN_ESR_LEC_SHIFT;
+	ev->tec = esr >> 16;
+	ev->rec = esr >> 24;
+	return state == CAN_BUS_OFF;
+}
+
+/*********************************************************************
+ * CAN status change/error ISR (EWG, EPV, BOF and LEC)
+ *********************************************************************/
+
+void
+can_sce_isr(void) {
+	BaseType_t woken = pdFALSE;
+	uint32_t esr = CAN_ESR(CAN1);
+	unsigned lec = (esr & CAN_ESR_LEC_MASK) >> CAN_ESR_LEC_SHIFT;
+
+	CAN_MSR(CAN1) = CAN_MSR_ERRI;			// rc_w1
+	if ( lec != 0 && lec != 7 ) {
+		++busstats.lec[lec];
+		CAN_ESR(CAN1) = CAN_ESR_LEC_USER;	// Seen: hardware rewrites it
+	}
+	if ( bus_note(esr,xTaskGetTickCountFromISR()) )
+		vTaskNotifyGiveFromISR(bustask,&woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+/*********************************************************************
+ * One bus-off recovery attempt: enter and leave initialization mode,
+ * then the controller waits for 128 x 11 recessive bits. Returns
+ * true if it is back on the bus.
+ *********************************************************************/
+
+static bool
+bus_recover(void) {
+	uint32_t bitrate = can_bitrate();
+	TickType_t t0, limit;
+
+	++busstats.attempts;
+	CAN_MCR(CAN1) |= CAN_MCR_INRQ;
+	t0 = xTaskGetTickCount();
+	while ( !(CAN_MSR(CAN1) & CAN_MSR_INAK) && xTaskGetTickCount() - t0 <= pdMS_TO_TICKS(10) )
+		taskYIELD();
+	CAN_MCR(CAN1) &= ~CAN_MCR_INRQ;
+
+	limit = pdMS_TO_TICKS(10 + (bitrate ? 128 * 11 * 1000 / bitrate : 1000));
+	for ( t0 = xTaskGetTickCount(); (CAN_ESR(CAN1) & CAN_ESR_BOFF) || (CAN_MSR(CAN1) & CAN_MSR_INAK); ) {
+		if ( xTaskGetTickCount() - t0 > limit )
+			return false;
+		vTaskDelay(1);
+	}
+	return true;
+}
+
+/*********************************************************************
+ * Bus task: recovers from bus-off with a doubling back-off (reset
+ * after stable_ms on the bus), notes error states falling back, and
+ * measures bus load. Load counts the frames this node sends and
+ * receives (after filtering), so it is a lower bound.
+ *********************************************************************/
+
+static void
+can_bus_task(void *arg __attribute((unused))) {
+	TickType_t now, t_load = xTaskGetTickCount(), t_ok = t_load, t_off;
+	uint32_t backoff = buspolicy.first_ms, bits, bitrate, ms, load;
+
+	for (;;) {
+		ulTaskNotifyTake(pdTRUE,pdMS_TO_TICKS(100));
+		now = xTaskGetTickCount();
+
+		if ( CAN_ESR(CAN1) & CAN_ESR_BOFF ) {
+			t_off = now;
+			do	{
+				vTaskDelay(pdMS_TO_TICKS(backoff));
+				backoff = backoff * 2 < buspolicy.max_ms ? backoff * 2 : buspolicy.max_ms;
+			} while ( !bus_recover() );
+
+			t_ok = now = xTaskGetTickCount();
+			taskENTER_CRITICAL();
+			++busstats.recoveries;
+			busstats.offline_ms += (now - t_off) * portTICK_PERIOD_MS;
+			bus_note(CAN_ESR(CAN1),now);
+			taskEXIT_CRITICAL();
+		} else	{
+			taskENTER_CRITICAL();
+			bus_note(CAN_ESR(CAN1),now);	// Counters fall without an interrupt
+			taskEXIT_CRITICAL();
+			if ( now - t_ok >= pdMS_TO_TICKS(buspolicy.stable_ms) )
+				backoff = buspolicy.first_ms;
+		}
+
+		if ( now - t_load >= pdMS_TO_TICKS(CAN_LOAD_MS) ) {
+			taskENTER_CRITICAL();
+			bits = busbits;
+			busbits = 0;
+			taskEXIT_CRITICAL();
+
+			ms = (now - t_load) * portTICK_PERIOD_MS;
+			bitrate = can_bitrate();
+			load = bitrate ? (uint64_t)bits * 1000000u / ((uint64_t)bitrate * ms) : 0;
+			if ( load > 1000 )
+				load = 1000;
+			busstats.load = load;
+			if ( load > busstats.load_max )
+				busstats.load_max = load;
+			t_load = now;
+		}
+	}
 }
 
 /*********************************************************************
- * Initialize for CAN I/O
+ * Set the bus-off recovery policy
  *********************************************************************/
 
 void
-initialize_can(bool nart,bool locked,bool altcfg) {
+can_bus_policy(const struct s_canbus_policy *policy) {
+
+	taskENTER_CRITICAL();
+	buspolicy = *policy;
+	if ( buspolicy.first_ms < 1 )
+		buspolicy.first_ms = 1;
+	if ( buspolicy.max_ms < buspolicy.first_ms )
+		buspolicy.max_ms = buspolicy.first_ms;
+	if ( buspolicy.lec_irq )
+		can_enable_irq(CAN1,CAN_IER_LECIE);
+	else	can_disable_irq(CAN1,CAN_IER_LECIE);
+	taskEXIT_CRITICAL();
+}
+
+/*********************************************************************
+ * Return bus health, optionally resetting the counters and history
+ *********************************************************************/
+
+void
+can_bus_stats(struct s_canbus_stats *stats,bool reset) {
+	unsigned first;
+	uint32_t esr;
+
+	taskENTER_CRITICAL();
+	*stats = busstats;
+	first = busstats.nhist < CAN_ERRHIST ? 0 : histnext;
+	for ( unsigned ux=0; ux<busstats.nhist; ++ux )
+		stats->hist[ux] = busstats.hist[(first + ux) % CAN_ERRHIST];
+	if ( reset ) {
+		uint8_t state = busstats.state;
+
+		memset(&busstats,0,sizeof busstats);
+		busstats.state = state;
+		histnext = 0;
+	}
+	taskEXIT_CRITICAL();
+
+	esr = CAN_ESR(CAN1);
+	stats->tec = esr >> 16;
+	stats->rec = esr >> 24;
+	stats->bitrate = can_bitrate();
+}
+
+/*********************************************************************
+ * The filter bank layout in use
+ *********************************************************************/
+
+const struct s_canfilt *
+can_filter_layout(void) {
+	return &canfilt;
+}
+
+/*********************************************************************
+ * Initialize for CAN I/O at bitrate (CAN_BITRATE if APB1 can't make
+ * it), receiving what rules[] subscribes to and dispatching it to the
+ * matching handlers[]
+ *********************************************************************/
+
+void
+initialize_can(bool nart,bool locked,bool altcfg,uint32_t bitrate,
+  const struct s_canfilt_rule *rules,const can_handler_t *handlers,unsigned nrules) {
+	struct s_cantiming timing;
 
         rcc_periph_clock_enable(RCC_AFIO);
         rcc_peripheral_enable_clock(&RCC_APB1ENR, RCC_APB1ENR_CAN1EN);
@@ -116,43 +815,72 @@ initialize_can(bool nart,bool locked,bool altcfg) {
 			AFIO_MAPR_CAN1_REMAP_PORTA);            // CAN_RX=PA11, CAN_TX=PA12
 	}
 
+	if ( !cantiming_calc(&timing,rcc_apb1_frequency,bitrate,CANT_SAMPLE) )
+		cantiming_calc(&timing,rcc_apb1_frequency,CAN_BITRATE,CANT_SAMPLE);
+
 	can_reset(CAN1);
         can_init(
                 CAN1,
                 false,                                  // ttcm=off
-                false,                                  // auto bus off management
+                false,                                  // auto bus off management (can_bus_task)
                 true,                                   // Automatic wakeup mode.
                 nart,                                   // No automatic retransmission.
                 locked,                                 // Receive FIFO locked mode
                 false,                                  // Transmit FIFO priority (msg id)
-                PARM_SJW,	                        // Resynchronization time quanta jump width (0..3)
-                PARM_TS1,				// segment 1 time quanta width
-                PARM_TS2,	                        // Time segment 2 time quanta width
-		PARM_BRP,				// Baud rate prescaler for 33.333 kbs
+                BTR_SJW(&timing),                       // Resynchronization time quanta jump width
+                BTR_TS1(&timing),			// segment 1 time quanta width
+                BTR_TS2(&timing),                       // Time segment 2 time quanta width
+		timing.brp,				// Baud rate prescaler
 		false,					// Loopback
 		false);					// Silent
 
-	can_filter_id_mask_16bit_init(
-		0,					// Filter bank 0
-		0x000 << 5, 0x001 << 5,			// LSB == 0
-		0x000 << 5, 0x001 << 5,			// Not used
-		0,					// FIFO 0
-		true);
+	/*************************************************************
+	 * Only the subscribed IDs (rules) reach the FIFOs, and a frame
+	 * goes to handlers[rule]. With a bad rule, everything goes to
+	 * FIFO 0 and is sorted out by rx_lookup().
+	 *************************************************************/
+	rxrules = rules;
+	rxhandlers = handlers;
+	rxnrules = nrules;
+	for ( unsigned ux=0; ux<RXHASH_SIZE; ++ux )
+		rxhash[ux].key = ~0u;			// Matches no frame
+
+	if ( !canfilt_compile(&canfilt,rules,nrules) ) {
+		memset(&canfilt,0,sizeof canfilt);
+		canfilt.nbanks = 1;
+		canfilt.bank[0].scale32 = true;		// 32 bit mask of 0
+		canfilt.nfmi[0] = 1;
+		canfilt.fmi_rule[0][0] = CANF_MERGED;
+	}
+	for ( unsigned ux=0; ux<CANF_BANKS; ++ux ) {
+		const struct s_canfilt_bank *bk = &canfilt.bank[ux];
 
-	can_filter_id_mask_16bit_init(
-		1,					// Filter bank 1
-		0x010 << 5, 0x001 << 5,			// LSB == 1 (no match)
-		0x001 << 5, 0x001 << 5,			// Match when odd
-		1,					// FIFO 1
-		true);
+		can_filter_init(ux,bk->scale32,bk->list,bk->fr1,bk->fr2,bk->fifo,ux < canfilt.nbanks);
+	}
 
-	canrxq = xQueueCreate(33,sizeof(struct s_canmsg));
+	dwt_enable_cycle_counter();			// RX latency
+	can_nart = nart;
+	can_locked = locked;
+	for ( unsigned ux=0; ux<CAN_TXQ_DEPTH; ++ux ) {
+		txslots[ux].next = txfree;
+		txfree = &txslots[ux];
+	}
+	txsem = xSemaphoreCreateCounting(CAN_TXQ_DEPTH,CAN_TXQ_DEPTH);
 
+	nvic_set_priority(NVIC_USB_LP_CAN_RX0_IRQ,configMAX_SYSCALL_INTERRUPT_PRIORITY);
+	nvic_set_priority(NVIC_CAN_RX1_IRQ,configMAX_SYSCALL_INTERRUPT_PRIORITY);
 	nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
 	nvic_enable_irq(NVIC_CAN_RX1_IRQ);
-	can_enable_irq(CAN1,CAN_IER_FMPIE0|CAN_IER_FMPIE1);
+	nvic_set_priority(NVIC_USB_HP_CAN_TX_IRQ,configMAX_SYSCALL_INTERRUPT_PRIORITY);
+	nvic_enable_irq(NVIC_USB_HP_CAN_TX_IRQ);
+	nvic_set_priority(NVIC_CAN_SCE_IRQ,configMAX_SYSCALL_INTERRUPT_PRIORITY);
+	nvic_enable_irq(NVIC_CAN_SCE_IRQ);
 
-	xTaskCreate(can_rx_task,"canrx",400,NULL,configMAX_PRIORITIES-1,NULL);
+	xTaskCreate(can_rx_task,"canrx",400,NULL,configMAX_PRIORITIES-1,&rxtask);
+	xTaskCreate(can_bus_task,"canbus",200,NULL,configMAX_PRIORITIES-1,&bustask);
+	can_enable_irq(CAN1,CAN_IER_FMPIE0|CAN_IER_FOVIE0|CAN_IER_FMPIE1|CAN_IER_FOVIE1|CAN_IER_TMEIE
+		|CAN_IER_ERRIE|CAN_IER_EWGIE|CAN_IER_EPVIE|CAN_IER_BOFIE
+		|(buspolicy.lec_irq ? CAN_IER_LECIE : 0));
 }
 
 // canmsgs.c
@@ -11,11 +11,15 @@
 
 #include "task.h"
 #include "queue.h"
+#include "canfilter.h"
+#include "cantiming.h"
 
-#define PARM_SJW	CAN_BTR_SJW_1TQ
-#define PARM_TS1	CAN_BTR_TS1_6TQ
-#define PARM_TS2	CAN_BTR_TS2_7TQ
-#define PARM_BRP	78		// 33.333 kbps
+#define CAN_BITRATE	33333		// Network bit rate (all nodes)
+
+#define CAN_TXQ_DEPTH	16		// Frames in the software TX queue
+#define CAN_RXRING	32		// Received frames (power of 2)
+#define CAN_ERRHIST	16		// Error state changes remembered
+#define CAN_LOAD_MS	1000		// Bus load measuring period
 
 struct s_canmsg {
 	uint32_t	msgid;		// Message ID
@@ -25,6 +29,69 @@ struct s_canmsg {
 	uint8_t		xmsgidf : 1;	// Extended message flag
 	uint8_t		rtrf : 1;	// RTR flag
 	uint8_t		fifo : 1;	// RX Fifo 0 or 1
+	uint32_t	stamp;		// DWT cycle count at receipt
+};
+
+typedef void (*can_handler_t)(struct s_canmsg *msg);
+typedef void (*can_txhook_t)(BaseType_t *woken);
+
+struct s_canrx_stats {
+	uint32_t	received;	// Frames taken from the FIFOs
+	uint32_t	dropped;	// Lost with the ring full
+	uint32_t	overruns;	// Lost to a hardware FIFO overrun
+	uint32_t	unwanted;	// Matched no rule (filter leakage)
+	uint32_t	dispatched;	// Frames handed to a handler
+	uint32_t	lat_min;	// ISR to dispatch, in CPU cycles
+	uint32_t	lat_max;
+	uint64_t	lat_sum;	// For the mean (lat_sum / dispatched)
+	uint16_t	hiwater;	// Most frames in the ring at once
+};
+
+struct s_cantx_stats {
+	uint32_t	queued;		// Frames accepted by can_xmit_wait()
+	uint32_t	sent;		// Frames transmitted (TXOK)
+	uint32_t	aborted;	// Mailbox aborts (frame was requeued)
+	uint32_t	failed;		// Frames dropped (nart, or bus error)
+	uint32_t	full;		// Enqueues refused or timed out
+	uint16_t	hiwater;	// Most frames queued at once
+};
+
+enum CanBusState {
+	CAN_ERROR_ACTIVE = 0,		// TEC and REC below 96
+	CAN_ERROR_WARNING,		// TEC or REC >= 96
+	CAN_ERROR_PASSIVE,		// TEC or REC > 127
+	CAN_BUS_OFF			// TEC > 255: off the bus
+};
+
+struct s_canerr_event {
+	uint32_t	tick;		// Tick count when it happened
+	uint8_t		state;		// enum CanBusState entered
+	uint8_t		lec;		// Last error code at the time
+	uint8_t		tec, rec;	// Error counters at the time
+};
+
+struct s_canbus_stats {
+	uint8_t		state;		// enum CanBusState now
+	uint8_t		tec, rec;	// Error counters now
+	uint8_t		nhist;		// Events in hist[]
+	uint32_t	warnings;	// Entries into error warning
+	uint32_t	passives;	// Entries into error passive
+	uint32_t	busoffs;	// Bus-off events
+	uint32_t	recoveries;	// Returns to the bus after bus-off
+	uint32_t	attempts;	// Recovery attempts
+	uint32_t	offline_ms;	// Time spent bus-off
+	uint32_t	lec[8];		// Errors by last error code
+	uint32_t	bitrate;	// From CAN_BTR
+	uint16_t	load;		// Bus load, per mille, last period
+	uint16_t	load_max;	// Highest load seen
+	struct s_canerr_event hist[CAN_ERRHIST]; // Oldest first
+};
+
+struct s_canbus_policy {
+	uint16_t	first_ms;	// Wait before the first recovery attempt
+	uint16_t	max_ms;		// Limit of the doubling back-off
+	uint16_t	stable_ms;	// Time on the bus that resets the back-off
+	bool		lec_irq;	// Interrupt on every bus error (LECIE)
 };
 
 enum MsgID {
@@ -35,7 +102,9 @@ enum MsgID {
 	ID_Flash,			// Inverts signal bulb flash
 	ID_Temp,			// Temperature
 	ID_HeartBeat = 200,		// Heartbeat signal (s_lamp_status)
-	ID_HeartBeat2			// Rear unit heartbeat
+	ID_HeartBeat2,			// Rear unit heartbeat
+	ID_IsotpMain = 0x7E0,		// ISO-TP, main to rear
+	ID_IsotpRear = 0x7E8		// ISO-TP, rear to main
 };
 
 struct s_lamp_en {
@@ -56,9 +125,19 @@ struct s_lamp_status {
 	uint8_t		reserved : 4;
 };
 
-void initialize_can(bool nart,bool locked,bool altcfg);
-void can_recv(struct s_canmsg *msg);
+void initialize_can(bool nart,bool locked,bool altcfg,uint32_t bitrate,
+	const struct s_canfilt_rule *rules,const can_handler_t *handlers,unsigned nrules);
+const struct s_canfilt *can_filter_layout(void);
+void can_rx_stats(struct s_canrx_stats *stats,bool reset);
 void can_xmit(uint32_t id,bool ext,bool rtr,uint8_t length,void *data);
+bool can_xmit_wait(uint32_t id,bool ext,bool rtr,uint8_t length,const void *data,TickType_t ticks);
+bool can_xmit_isr(uint32_t id,bool ext,bool rtr,uint8_t length,const void *data,BaseType_t *woken);
+void can_tx_hook(can_txhook_t hook);
+void can_tx_stats(struct s_cantx_stats *stats,bool reset);
+void can_configure(uint32_t sjw,uint32_t ts1,uint32_t ts2,uint32_t brp,bool loopback);
+bool can_set_bitrate(uint32_t bitrate,bool loopback,struct s_cantiming *timing);
+void can_bus_policy(const struct s_canbus_policy *policy);
+void can_bus_stats(struct s_canbus_stats *stats,bool reset);
 
 #endif // CANMSGS_H
 
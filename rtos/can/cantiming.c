@@ -0,0 +1,79 @@
+/* cantiming.c : CAN bit timing calculator
+ * Warren W. Gay VE3WWG
+ *
+ * Finds the bxCAN prescaler and segments for a bit rate, from the
+ * peripheral clock (APB1). Every bit length from CANT_TQ_MAX down to
+ * CANT_TQ_MIN tq is tried with its nearest prescaler, and the sample
+ * point is placed nearest the one asked for. The smallest bit rate
+ * error wins, then the closest sample point, except that any within
+ * CANT_SAMPLE_TOL count as equal and the most tq wins (finer
+ * resynchronization, larger SJW). Plain C, so the host can generate
+ * tables.
+ */
+#include <stdlib.h>
+
+#include "cantiming.h"
+
+/*********************************************************************
+ * Compute timing for bitrate from clock Hz, sampling at sample per
+ * mille (0 for CANT_SAMPLE). Returns false if no prescaler fits.
+ *********************************************************************/
+
+bool
+cantiming_calc(struct s_cantiming *t,uint32_t clock,uint32_t bitrate,unsigned sample) {
+	uint32_t brp, ts1, ts2, sp, sp_err, best_err = ~0u, best_sp = ~0u, err;
+	uint64_t bit_clocks;
+	int64_t diff;
+	bool found = false;
+
+	if ( !bitrate || !clock )
+		return false;
+	if ( !sample || sample >= 1000 )
+		sample = CANT_SAMPLE;
+
+	for ( uint32_t tq=CANT_TQ_MAX; tq>=CANT_TQ_MIN; --tq ) {
+		brp = (clock + (uint64_t)bitrate * tq / 2) / ((uint64_t)bitrate * tq);
+		if ( brp < 1 || brp > CANT_BRP_MAX )
+			continue;
+
+		// Sample after 1 + ts1 tq
+		ts1 = (sample * tq + 500) / 1000;
+		ts1 = ts1 > 1 ? ts1 - 1 : 1;
+		if ( ts1 > CANT_TS1_MAX )
+			ts1 = CANT_TS1_MAX;
+		ts2 = tq - 1 - ts1;
+		if ( ts2 > CANT_TS2_MAX ) {
+			ts2 = CANT_TS2_MAX;
+			ts1 = tq - 1 - ts2;
+		} else if ( ts2 < 1 ) {
+			ts2 = 1;
+			ts1 = tq - 2;
+		}
+		if ( ts1 > CANT_TS1_MAX )
+			continue;
+
+		bit_clocks = (uint64_t)brp * tq;
+		diff = (int64_t)clock - (int64_t)(bitrate * bit_clocks);
+		err = llabs(diff) * 1000000 / (bitrate * bit_clocks);
+		sp = (1 + ts1) * 1000 / tq;
+		sp_err = abs((int)sp - (int)sample);
+		if ( sp_err <= CANT_SAMPLE_TOL )
+			sp_err = 0;
+		if ( err > best_err || (err == best_err && sp_err >= best_sp) )
+			continue;
+
+		best_err = err;
+		best_sp = sp_err;
+		t->brp = brp;
+		t->ts1 = ts1;
+		t->ts2 = ts2;
+		t->sjw = ts2 < CANT_SJW_MAX ? ts2 : CANT_SJW_MAX;
+		t->bitrate = (clock + bit_clocks / 2) / bit_clocks;
+		t->error_ppm = diff * 1000000 / (int64_t)(bitrate * bit_clocks);
+		t->sample = sp;
+		found = true;
+	}
+	return found;
+}
+
+// cantiming.c
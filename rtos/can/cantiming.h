@@ -0,0 +1,38 @@
+/* cantiming.h : CAN bit timing calculator
+ * Warren W. Gay VE3WWG
+ */
+#ifndef CANTIMING_H
+#define CANTIMING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CANT_BRP_MAX	1024		// Prescaler 1..1024
+#define CANT_TS1_MAX	16		// Time segment 1, 1..16 tq
+#define CANT_TS2_MAX	8		// Time segment 2, 1..8 tq
+#define CANT_SJW_MAX	4		// Resync jump width, 1..4 tq
+#define CANT_TQ_MIN	8		// Fewest tq per bit (ISO 11898)
+#define CANT_TQ_MAX	25		// 1 + 16 + 8
+#define CANT_SAMPLE	875		// Default sample point (per mille)
+#define CANT_SAMPLE_TOL	20		// Sample point error taken as exact
+
+/*********************************************************************
+ * Segment lengths are in time quanta (not register codes): a bit is
+ * 1 + ts1 + ts2 tq of brp clocks, sampled after 1 + ts1.
+ *********************************************************************/
+
+struct s_cantiming {
+	uint16_t	brp;		// Prescaler
+	uint8_t		ts1;		// Time segment 1 (tq)
+	uint8_t		ts2;		// Time segment 2 (tq)
+	uint8_t		sjw;		// Resync jump width (tq)
+	uint32_t	bitrate;	// Actual bit rate
+	int32_t		error_ppm;	// Bit rate error
+	uint16_t	sample;		// Actual sample point (per mille)
+};
+
+bool cantiming_calc(struct s_cantiming *t,uint32_t clock,uint32_t bitrate,unsigned sample);
+
+#endif // CANTIMING_H
+
+// cantiming.h
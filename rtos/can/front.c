@@ -87,30 +87,28 @@ lamp_enable(enum MsgID id,bool enable) {
 }
 
 /*********************************************************************
- * CAN Receive Callback
+ * CAN Receive Handler: lamp commands
  *********************************************************************/
-void
-can_recv(struct s_canmsg *msg) {
+static void
+lamp_rx(struct s_canmsg *msg) {
 	union u_msg {
 		struct s_lamp_en	lamp;
 	} *msgp = (union u_msg *)msg->data;
 
 	gpio_toggle(GPIO_PORT_LED,GPIO_LED);
-
-	if ( !msg->rtrf ) {
-		switch ( msg->msgid ) {
-		case ID_LeftEn:
-		case ID_RightEn:
-		case ID_ParkEn:
-		case ID_Flash:
-			lamp_enable((enum MsgID)msg->msgid,msgp->lamp.enable);
-			break;
-		default:
-			break;
-		}
-	}
+	lamp_enable((enum MsgID)msg->msgid,msgp->lamp.enable);
 }
 
+static const struct s_canfilt_rule can_rules[] = {
+	{ ID_LeftEn, ID_ParkEn, 0, CANF_DATA, 0 },	// Lamp commands
+	{ ID_Flash, ID_Flash, 0, CANF_DATA, 0 },
+};
+
+static const can_handler_t can_handlers[] = {
+	lamp_rx,
+	lamp_rx,
+};
+
 /*********************************************************************
  * Monitor task:
  *********************************************************************/
@@ -145,7 +143,8 @@ main(void) {
 	gpio_clear(GPIO_PORT_LED,GPIO_LED);
 
 	// Initialize CAN
-	initialize_can(false,true,false);		// !nart, locked, altcfg=false PA11/PA12
+	initialize_can(false,true,false,CAN_BITRATE,	// !nart, locked, altcfg=false PA11/PA12
+		can_rules,can_handlers,sizeof can_rules/sizeof can_rules[0]);
 
 	xTaskCreate(controller_task,"front",300,NULL,configMAX_PRIORITIES-1,NULL);
 	vTaskStartScheduler();
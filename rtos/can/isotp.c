@@ -0,0 +1,381 @@
+/* isotp.c : ISO 15765-2 (ISO-TP) transport over CAN
+ * Warren W. Gay VE3WWG
+ *
+ * Single (SF), first (FF), consecutive (CF) and flow control (FC)
+ * frames with normal addressing, 8 byte frames and up to 4095 bytes
+ * per message. Nothing here blocks or knows about FreeRTOS: frames
+ * arrive through isotp_frame(), go out through the session's xmit()
+ * and isotp_poll() sends what is due. Call isotp_poll() when a TX
+ * mailbox frees up (or the CAN queue has room) and by the time it
+ * returns. Times are microseconds, wrapping.
+ */
+#include <string.h>
+
+#include "isotp.h"
+
+#define PCI_SF		0x00
+#define PCI_FF		0x10
+#define PCI_CF		0x20
+#define PCI_FC		0x30
+
+#define FS_CTS		0		// Continue to send
+#define FS_WAIT		1
+#define FS_OVFLW	2
+
+enum {
+	TX_IDLE = 0,
+	TX_SF,				// Single frame not yet queued
+	TX_FF,				// First frame not yet queued
+	TX_WAIT_FC,			// Waiting for flow control
+	TX_CF				// Sending consecutive frames
+};
+
+enum {
+	RX_IDLE = 0,
+	RX_CF				// Receiving consecutive frames
+};
+
+static uint32_t service(struct s_isotp *s,uint32_t now);
+
+/*********************************************************************
+ * Internal: Time t has come
+ *********************************************************************/
+
+static bool
+due(uint32_t t,uint32_t now) {
+	return (int32_t)(now - t) >= 0;
+}
+
+/*********************************************************************
+ * STmin in microseconds (reserved values mean 127 ms)
+ *********************************************************************/
+
+uint32_t
+isotp_stmin_us(uint8_t stmin) {
+
+	if ( stmin <= 0x7F )
+		return stmin * 1000u;
+	if ( stmin >= 0xF1 && stmin <= 0xF9 )
+		return (stmin - 0xF0) * 100u;
+	return 127000u;
+}
+
+/*********************************************************************
+ * Internal: Queue one frame, padded to 8 bytes
+ *********************************************************************/
+
+static bool
+put(struct s_isotp *s,uint8_t *frame,unsigned length) {
+
+	if ( length < 8 )
+		memset(frame + length,s->pad,8 - length);
+	return s->xmit(s->arg,s->tx_id,s->ext,frame,8);
+}
+
+/*********************************************************************
+ * Initialize a session (block size 8, STmin 0)
+ *********************************************************************/
+
+void
+isotp_init(struct s_isotp *s,uint32_t tx_id,uint32_t rx_id,bool ext,isotp_xmit_t xmit,void *arg) {
+
+	memset(s,0,sizeof *s);
+	s->tx_id = tx_id;
+	s->rx_id = rx_id;
+	s->ext = ext;
+	s->bs = 8;
+	s->pad = 0xCC;
+	s->xmit = xmit;
+	s->arg = arg;
+}
+
+/*********************************************************************
+ * Add a session to a node
+ *********************************************************************/
+
+void
+isotp_attach(struct s_isotp_node *node,struct s_isotp *s) {
+
+	s->next = node->sessions;
+	node->sessions = s;
+}
+
+/*********************************************************************
+ * Start sending length bytes from data. done() is called once the
+ * last frame is queued, or on failure.
+ *********************************************************************/
+
+int
+isotp_send(struct s_isotp *s,const void *data,unsigned length,isotp_done_t done,uint32_t now) {
+
+	if ( s->txstate != TX_IDLE )
+		return ISOTP_BUSY;
+	if ( length < 1 || length > ISOTP_MAX_LEN )
+		return ISOTP_BADLEN;
+
+	s->txbuf = data;
+	s->txlen = length;
+	s->txpos = 0;
+	s->txdone = done;
+	s->txdue = now;
+	s->txstate = length <= 7 ? TX_SF : TX_FF;
+	service(s,now);				// Queue the SF or FF now
+	return ISOTP_OK;
+}
+
+/*********************************************************************
+ * Supply the buffer for the next message received. done() gets its
+ * length. A message arriving without a buffer is refused (FF) or
+ * dropped (SF). A message interrupted by a new FF or SF ends with
+ * ISOTP_ABORTED, but its buffer stays armed for the new one: supplying
+ * that buffer again is then not busy.
+ *********************************************************************/
+
+int
+isotp_recv(struct s_isotp *s,void *buf,unsigned size,isotp_done_t done) {
+
+	if ( s->rxstate != RX_IDLE )
+		return buf == s->rxbuf ? ISOTP_OK : ISOTP_BUSY;
+	s->rxbuf = buf;
+	s->rxsize = size > ISOTP_MAX_LEN ? ISOTP_MAX_LEN : size;
+	s->rxdone = done;
+	return ISOTP_OK;
+}
+
+/*********************************************************************
+ * Internal: Finish a send or a receive
+ *********************************************************************/
+
+static void
+tx_end(struct s_isotp *s,int result) {
+
+	s->txstate = TX_IDLE;
+	if ( s->txdone )
+		s->txdone(s,result,s->txpos);
+}
+
+static void
+rx_end(struct s_isotp *s,int result) {
+	isotp_done_t done = s->rxdone;
+
+	s->rxstate = RX_IDLE;
+	s->rxbuf = 0;				// Taken: caller re-arms
+	s->rxdone = 0;
+	if ( done )
+		done(s,result,s->rxlen);
+}
+
+/*********************************************************************
+ * Internal: A new FF or SF ends the message being received, keeping
+ * its buffer for the new one
+ *********************************************************************/
+
+static void
+rx_restart(struct s_isotp *s) {
+
+	s->rxstate = RX_IDLE;
+	if ( s->rxdone )
+		s->rxdone(s,ISOTP_ABORTED,s->rxpos);
+}
+
+/*********************************************************************
+ * Internal: A frame for session s
+ *********************************************************************/
+
+static void
+rx_frame(struct s_isotp *s,const uint8_t *data,unsigned length,uint32_t now) {
+	unsigned n;
+
+	switch ( data[0] & 0xF0 ) {
+	case PCI_SF:
+		n = data[0] & 0x0F;
+		if ( n < 1 || n > 7 || n > length - 1 )
+			break;
+		if ( s->rxstate != RX_IDLE )
+			rx_restart(s);
+		if ( !s->rxbuf || n > s->rxsize )
+			break;
+		memcpy(s->rxbuf,data + 1,n);
+		s->rxlen = n;
+		rx_end(s,ISOTP_OK);
+		return;
+
+	case PCI_FF:
+		n = (data[0] & 0x0F) << 8 | data[1];
+		if ( n <= 7 || length < 8 )
+			break;
+		if ( s->rxstate != RX_IDLE )
+			rx_restart(s);
+		if ( !s->rxbuf || n > s->rxsize ) {
+			s->fc = FS_OVFLW + 1;
+			break;
+		}
+		memcpy(s->rxbuf,data + 2,6);
+		s->rxlen = n;
+		s->rxpos = 6;
+		s->rxsn = 1;
+		s->rxbs = s->bs;
+		s->rxdue = now + ISOTP_N_CR_US;
+		s->rxstate = RX_CF;
+		s->fc = FS_CTS + 1;
+		return;
+
+	case PCI_CF:
+		if ( s->rxstate != RX_CF )
+			break;
+		if ( (data[0] & 0x0F) != s->rxsn ) {
+			rx_end(s,ISOTP_SEQUENCE);
+			return;
+		}
+		n = s->rxlen - s->rxpos < 7 ? s->rxlen - s->rxpos : 7;
+		if ( n > length - 1 )
+			break;
+		memcpy(s->rxbuf + s->rxpos,data + 1,n);
+		s->rxpos += n;
+		s->rxsn = (s->rxsn + 1) & 0x0F;
+		s->rxdue = now + ISOTP_N_CR_US;
+		if ( s->rxpos >= s->rxlen )
+			rx_end(s,ISOTP_OK);
+		else if ( s->bs && --s->rxbs == 0 ) {
+			s->rxbs = s->bs;
+			s->fc = FS_CTS + 1;
+		}
+		return;
+
+	case PCI_FC:
+		if ( s->txstate != TX_WAIT_FC || length < 3 )
+			break;
+		switch ( data[0] & 0x0F ) {
+		case FS_CTS:
+			s->peer_bs = s->txbs = data[1];
+			s->txgap = isotp_stmin_us(data[2]);
+			s->txdue = now;
+			s->txstate = TX_CF;
+			break;
+		case FS_WAIT:
+			s->txdue = now + ISOTP_N_BS_US;
+			break;
+		default:
+			tx_end(s,ISOTP_OVERFLOW);
+		}
+		return;
+	}
+	++s->dropped;
+}
+
+/*********************************************************************
+ * Take a received frame. Returns false if no session receives on id.
+ *********************************************************************/
+
+bool
+isotp_frame(struct s_isotp_node *node,uint32_t id,bool ext,const uint8_t *data,unsigned length,uint32_t now) {
+
+	if ( length < 1 )
+		return false;
+	for ( struct s_isotp *s = node->sessions; s; s = s->next ) {
+		if ( s->rx_id == id && s->ext == ext ) {
+			rx_frame(s,data,length,now);
+			isotp_poll(node,now);		// FC, or the first CF
+			return true;
+		}
+	}
+	return false;
+}
+
+/*********************************************************************
+ * Internal: Send what is due for one session. Returns the time until
+ * its next deadline, or ISOTP_IDLE. A frame refused by xmit() waits
+ * for the next poll, from the TX ISR.
+ *********************************************************************/
+
+static uint32_t
+service(struct s_isotp *s,uint32_t now) {
+	uint32_t next = ISOTP_IDLE;
+	uint8_t frame[8];
+	unsigned n;
+
+	if ( s->fc ) {
+		frame[0] = PCI_FC | (s->fc - 1);
+		frame[1] = s->bs;
+		frame[2] = s->stmin;
+		if ( put(s,frame,3) )
+			s->fc = 0;
+	}
+
+	if ( s->rxstate == RX_CF ) {
+		if ( due(s->rxdue,now) )
+			rx_end(s,ISOTP_TIMEOUT);
+		else	next = s->rxdue - now;
+	}
+
+	switch ( s->txstate ) {
+	case TX_SF:
+		frame[0] = PCI_SF | s->txlen;
+		memcpy(frame + 1,s->txbuf,s->txlen);
+		if ( put(s,frame,1 + s->txlen) ) {
+			s->txpos = s->txlen;
+			tx_end(s,ISOTP_OK);
+		}
+		break;
+	case TX_FF:
+		frame[0] = PCI_FF | s->txlen >> 8;
+		frame[1] = s->txlen;
+		memcpy(frame + 2,s->txbuf,6);
+		if ( put(s,frame,8) ) {
+			s->txpos = 6;
+			s->txsn = 1;
+			s->txdue = now + ISOTP_N_BS_US;
+			s->txstate = TX_WAIT_FC;
+		}
+		break;
+	case TX_WAIT_FC:
+		if ( due(s->txdue,now) ) {
+			tx_end(s,ISOTP_TIMEOUT);
+			break;
+		}
+		if ( s->txdue - now < next )
+			next = s->txdue - now;
+		break;
+	case TX_CF:
+		while ( due(s->txdue,now) ) {
+			n = s->txlen - s->txpos < 7 ? s->txlen - s->txpos : 7;
+			frame[0] = PCI_CF | s->txsn;
+			memcpy(frame + 1,s->txbuf + s->txpos,n);
+			if ( !put(s,frame,1 + n) )
+				return next;		// Retried from the TX ISR
+			s->txpos += n;
+			s->txsn = (s->txsn + 1) & 0x0F;
+			if ( s->txpos >= s->txlen ) {
+				tx_end(s,ISOTP_OK);
+				return next;
+			}
+			if ( s->peer_bs && --s->txbs == 0 ) {
+				s->txdue = now + ISOTP_N_BS_US;
+				s->txstate = TX_WAIT_FC;
+				break;
+			}
+			s->txdue = now + s->txgap;
+		}
+		if ( s->txdue - now < next )
+			next = s->txdue - now;
+		break;
+	}
+	return next;
+}
+
+/*********************************************************************
+ * Send what is due on all sessions. Returns the microseconds until
+ * the next call is needed, or ISOTP_IDLE.
+ *********************************************************************/
+
+uint32_t
+isotp_poll(struct s_isotp_node *node,uint32_t now) {
+	uint32_t next = ISOTP_IDLE, t;
+
+	for ( struct s_isotp *s = node->sessions; s; s = s->next )
+		if ( (t = service(s,now)) < next )
+			next = t;
+	return next;
+}
+
+// isotp.c
@@ -0,0 +1,84 @@
+/* isotp.h : ISO 15765-2 (ISO-TP) transport over CAN
+ * Warren W. Gay VE3WWG
+ */
+#ifndef ISOTP_H
+#define ISOTP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ISOTP_MAX_LEN	4095		// Longest message (12 bit length)
+#define ISOTP_N_BS_US	1000000u	// Wait for flow control
+#define ISOTP_N_CR_US	1000000u	// Wait for a consecutive frame
+#define ISOTP_IDLE	0xFFFFFFFFu	// isotp_poll(): nothing timed
+
+enum IsotpResult {
+	ISOTP_OK = 0,
+	ISOTP_BUSY,			// Send already in progress
+	ISOTP_BADLEN,			// Empty or too long
+	ISOTP_TIMEOUT,			// N_Bs or N_Cr expired
+	ISOTP_OVERFLOW,			// Receiver has no room
+	ISOTP_SEQUENCE,			// Consecutive frame out of order
+	ISOTP_ABORTED			// New message interrupted this one
+};
+
+struct s_isotp;
+
+typedef bool (*isotp_xmit_t)(void *arg,uint32_t id,bool ext,const uint8_t *data,uint8_t length);
+typedef void (*isotp_done_t)(struct s_isotp *s,int result,unsigned length);
+
+/*********************************************************************
+ * One session: a pair of CAN IDs, full duplex. Messages are sent from
+ * and reassembled into the caller's buffers, which must stay put
+ * until the done callback.
+ *********************************************************************/
+
+struct s_isotp {
+	uint32_t	tx_id;		// ID we send on
+	uint32_t	rx_id;		// ID we receive on
+	uint8_t		ext : 1;	// Extended IDs
+	uint8_t		bs;		// Block size we grant (0 = no limit)
+	uint8_t		stmin;		// STmin we ask for (ISO-TP coded)
+	uint8_t		pad;		// Fill byte of short frames
+	isotp_xmit_t	xmit;		// Queue a frame, false if no room
+	void		*arg;		// For xmit()
+	void		*user;		// For the caller
+
+	const uint8_t	*txbuf;		// Message being sent
+	uint16_t	txlen, txpos;
+	uint8_t		txstate;
+	uint8_t		txsn;		// Next sequence number
+	uint8_t		txbs;		// Frames left in this block
+	uint8_t		peer_bs;	// Block size granted by the peer
+	uint32_t	txgap;		// Peer STmin (us)
+	uint32_t	txdue;		// Next frame, or N_Bs timeout
+	isotp_done_t	txdone;
+
+	uint8_t		*rxbuf;		// Buffer for the next message
+	uint16_t	rxsize, rxlen, rxpos;
+	uint8_t		rxstate;
+	uint8_t		rxsn;		// Expected sequence number
+	uint8_t		rxbs;		// Frames left before our next FC
+	uint8_t		fc;		// Flow control to send (FS + 1), else 0
+	uint32_t	rxdue;		// N_Cr timeout
+	isotp_done_t	rxdone;
+
+	uint32_t	dropped;	// Frames ignored (no buffer, bad PCI)
+	struct s_isotp	*next;		// Sessions of a node
+};
+
+struct s_isotp_node {
+	struct s_isotp	*sessions;
+};
+
+void isotp_init(struct s_isotp *s,uint32_t tx_id,uint32_t rx_id,bool ext,isotp_xmit_t xmit,void *arg);
+void isotp_attach(struct s_isotp_node *node,struct s_isotp *s);
+int isotp_send(struct s_isotp *s,const void *data,unsigned length,isotp_done_t done,uint32_t now);
+int isotp_recv(struct s_isotp *s,void *buf,unsigned size,isotp_done_t done);
+bool isotp_frame(struct s_isotp_node *node,uint32_t id,bool ext,const uint8_t *data,unsigned length,uint32_t now);
+uint32_t isotp_poll(struct s_isotp_node *node,uint32_t now);
+uint32_t isotp_stmin_us(uint8_t stmin);
+
+#endif // ISOTP_H
+
+// isotp.h
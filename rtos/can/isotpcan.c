@@ -0,0 +1,283 @@
+/* isotpcan.c : ISO-TP sessions on canmsgs
+ * Warren W. Gay VE3WWG
+ *
+ * Runs the isotp.c sessions of this node on the CAN queue. Received
+ * frames come from isotp_can_rx(), used as the can_handler_t of the
+ * filter rules for the sessions' rx IDs. Consecutive frames are queued
+ * from the TX mailbox interrupt as the queue drains, and by the "isotp"
+ * task when STmin or a timeout falls due. A send or receive may end
+ * in the TX ISR, so the results are held here and the done callbacks
+ * are made by the "isotp" task, outside any critical section: they
+ * may use the task level FreeRTOS API, but should not block.
+ */
+#include <string.h>
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/cm3/dwt.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "isotpcan.h"
+
+#define TP_TX		0x01		// Pending: send ended
+#define TP_RX		0x02		// Pending: receive ended
+#define TP_ABORT	0x04		// Pending: receive restarted
+
+struct s_tpdone {
+	struct s_isotp	*s;		// Session, null if free
+	isotp_done_t	txdone, rxdone;	// The caller's
+	uint8_t		pending;	// TP_TX, TP_RX, TP_ABORT
+	int		txresult, rxresult;
+	unsigned	txlength, rxlength;
+	unsigned	abortlength;	// Received before the restart
+};
+
+static struct s_isotp_node node;
+static struct s_tpdone tpdone[ISOTP_CAN_SESSIONS];
+static TaskHandle_t tptask = 0;
+static BaseType_t *txwoken = 0;			// For xmit(), in the caller
+static uint32_t clock_us = 0;			// Microseconds, wrapping
+static uint32_t clock_cyc = 0;			// DWT count at clock_us
+
+/*********************************************************************
+ * Internal: Microsecond clock, from the DWT cycle counter. Called in
+ * a critical section, at least once per counter wrap (59 s).
+ *********************************************************************/
+
+static uint32_t
+now_us(void) {
+	const uint32_t per_us = rcc_ahb_frequency / 1000000u;
+	uint32_t us = (dwt_read_cycle_counter() - clock_cyc) / per_us;
+
+	clock_cyc += us * per_us;
+	return clock_us += us;
+}
+
+uint32_t
+isotp_can_now(void) {
+	uint32_t now;
+
+	taskENTER_CRITICAL();
+	now = now_us();
+	taskEXIT_CRITICAL();
+	return now;
+}
+
+/*********************************************************************
+ * Internal: isotp_xmit_t for the CAN queue
+ *********************************************************************/
+
+static bool
+xmit(void *arg __attribute((unused)),uint32_t id,bool ext,const uint8_t *data,uint8_t length) {
+	BaseType_t woken = pdFALSE;		// Task level: yields later
+
+	return can_xmit_isr(id,ext,false,length,data,txwoken ? txwoken : &woken);
+}
+
+/*********************************************************************
+ * Internal: Session of s, or null
+ *********************************************************************/
+
+static struct s_tpdone *
+lookup(struct s_isotp *s) {
+
+	for ( unsigned ux=0; ux<ISOTP_CAN_SESSIONS; ++ux )
+		if ( tpdone[ux].s == s )
+			return &tpdone[ux];
+	return 0;
+}
+
+/*********************************************************************
+ * Internal: isotp_done_t of every session: hold the result for the
+ * "isotp" task (in a critical section, or the TX ISR)
+ *********************************************************************/
+
+static void
+tx_ended(struct s_isotp *s,int result,unsigned length) {
+	struct s_tpdone *d = lookup(s);
+
+	d->txresult = result;
+	d->txlength = length;
+	d->pending |= TP_TX;
+}
+
+static void
+rx_ended(struct s_isotp *s,int result,unsigned length) {
+	struct s_tpdone *d = lookup(s);
+
+	if ( result == ISOTP_ABORTED ) {
+		// Reported ahead of the message that restarted it
+		d->abortlength = length;
+		d->pending |= TP_ABORT;
+		return;
+	}
+	d->rxresult = result;
+	d->rxlength = length;
+	d->pending |= TP_RX;
+}
+
+/*********************************************************************
+ * Internal: Make the done callbacks held (from the "isotp" task)
+ *********************************************************************/
+
+static void
+report(void) {
+	struct s_tpdone *d, r;
+
+	for ( unsigned ux=0; ux<ISOTP_CAN_SESSIONS; ++ux ) {
+		d = &tpdone[ux];
+		if ( !d->pending )
+			continue;
+		taskENTER_CRITICAL();
+		r = *d;
+		d->pending = 0;
+		taskEXIT_CRITICAL();
+
+		if ( (r.pending & TP_TX) && r.txdone )
+			r.txdone(r.s,r.txresult,r.txlength);
+		if ( (r.pending & TP_ABORT) && r.rxdone )
+			r.rxdone(r.s,ISOTP_ABORTED,r.abortlength);
+		if ( (r.pending & TP_RX) && r.rxdone )
+			r.rxdone(r.s,r.rxresult,r.rxlength);
+	}
+}
+
+static bool
+reporting(void) {
+
+	for ( unsigned ux=0; ux<ISOTP_CAN_SESSIONS; ++ux )
+		if ( tpdone[ux].pending )
+			return true;
+	return false;
+}
+
+/*********************************************************************
+ * Internal: TX mailbox freed, queue what is due
+ *********************************************************************/
+
+static void
+tx_hook(BaseType_t *woken) {
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+	bool wake;
+
+	txwoken = woken;
+	wake = isotp_poll(&node,now_us()) != ISOTP_IDLE || reporting();
+	txwoken = 0;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	if ( wake )
+		vTaskNotifyGiveFromISR(tptask,woken);	// New deadline, or done
+}
+
+/*********************************************************************
+ * Received frame for a session (can_handler_t)
+ *********************************************************************/
+
+void
+isotp_can_rx(struct s_canmsg *msg) {
+
+	if ( msg->rtrf )
+		return;
+	taskENTER_CRITICAL();
+	isotp_frame(&node,msg->msgid,msg->xmsgidf,msg->data,msg->length,now_us());
+	taskEXIT_CRITICAL();
+	xTaskNotifyGive(tptask);
+}
+
+/*********************************************************************
+ * Send length bytes from data (must stay put until done()). Busy
+ * until the last send's done() is made.
+ *********************************************************************/
+
+int
+isotp_can_send(struct s_isotp *s,const void *data,unsigned length,isotp_done_t done) {
+	struct s_tpdone *d = lookup(s);
+	int rc = ISOTP_BUSY;
+
+	taskENTER_CRITICAL();
+	if ( d && !(d->pending & TP_TX) ) {
+		d->txdone = done;
+		rc = isotp_send(s,data,length,tx_ended,now_us());
+	}
+	taskEXIT_CRITICAL();
+	xTaskNotifyGive(tptask);
+	return rc;
+}
+
+/*********************************************************************
+ * Receive the next message into buf (re-arm after each done()). Busy
+ * until the last receive's done() is made. After ISOTP_ABORTED, buf
+ * is still armed for the message that restarted the receive.
+ *********************************************************************/
+
+int
+isotp_can_recv(struct s_isotp *s,void *buf,unsigned size,isotp_done_t done) {
+	struct s_tpdone *d = lookup(s);
+	int rc = ISOTP_BUSY;
+
+	taskENTER_CRITICAL();
+	if ( d && !(d->pending & TP_RX) ) {
+		d->rxdone = done;
+		rc = isotp_recv(s,buf,size,rx_ended);
+	}
+	taskEXIT_CRITICAL();
+	return rc;
+}
+
+/*********************************************************************
+ * Set up a session and add it to this node. Change bs, stmin or pad
+ * before the first transfer. Returns false when this node already has
+ * ISOTP_CAN_SESSIONS sessions.
+ *********************************************************************/
+
+bool
+isotp_can_session(struct s_isotp *s,uint32_t tx_id,uint32_t rx_id,bool ext) {
+	struct s_tpdone *d;
+
+	isotp_init(s,tx_id,rx_id,ext,xmit,0);
+	taskENTER_CRITICAL();
+	if ( (d = lookup(0)) != 0 ) {
+		memset(d,0,sizeof *d);
+		d->s = s;
+		isotp_attach(&node,s);
+	}
+	taskEXIT_CRITICAL();
+	return d != 0;
+}
+
+/*********************************************************************
+ * Timer task: STmin gaps and timeouts, and the done callbacks
+ *********************************************************************/
+
+static void
+isotp_task(void *arg __attribute((unused))) {
+	uint32_t next;
+	TickType_t ticks;
+
+	for (;;) {
+		taskENTER_CRITICAL();
+		next = isotp_poll(&node,now_us());
+		taskEXIT_CRITICAL();
+		report();
+
+		if ( next == ISOTP_IDLE )
+			ticks = pdMS_TO_TICKS(30000);	// Keeps the clock current
+		else if ( (ticks = pdMS_TO_TICKS((next + 999) / 1000)) < 1 )
+			ticks = 1;
+		ulTaskNotifyTake(pdTRUE,ticks);
+	}
+}
+
+/*********************************************************************
+ * Start ISO-TP (after initialize_can())
+ *********************************************************************/
+
+void
+isotp_can_init(void) {
+
+	clock_cyc = dwt_read_cycle_counter();
+	xTaskCreate(isotp_task,"isotp",200,NULL,configMAX_PRIORITIES-1,&tptask);
+	can_tx_hook(tx_hook);
+}
+
+// isotpcan.c
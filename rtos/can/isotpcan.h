@@ -0,0 +1,21 @@
+/* isotpcan.h : ISO-TP sessions on canmsgs
+ * Warren W. Gay VE3WWG
+ */
+#ifndef ISOTPCAN_H
+#define ISOTPCAN_H
+
+#include "canmsgs.h"
+#include "isotp.h"
+
+#define ISOTP_CAN_SESSIONS	2	// Sessions per node
+
+void isotp_can_init(void);
+bool isotp_can_session(struct s_isotp *s,uint32_t tx_id,uint32_t rx_id,bool ext);
+void isotp_can_rx(struct s_canmsg *msg);
+int isotp_can_send(struct s_isotp *s,const void *data,unsigned length,isotp_done_t done);
+int isotp_can_recv(struct s_isotp *s,void *buf,unsigned size,isotp_done_t done);
+uint32_t isotp_can_now(void);
+
+#endif // ISOTPCAN_H
+
+// isotpcan.h
@@ -25,6 +25,7 @@
 #include "mcuio.h"
 #include "miniprintf.h"
 #include "canmsgs.h"
+#include "isotpcan.h"
 #include "monitor.h"
 
 #define FLASH_MS		400		// Signal flash time in ms
@@ -34,6 +35,9 @@
 static SemaphoreHandle_t mutex;			// Handle to mutex
 struct s_lamp_status lamp_status = { 0, 0, 0, 0, 0, 0 };
 static volatile bool show_rx = false;
+static struct s_isotp tp;			// ISO-TP session with rear
+static TaskHandle_t console_handle;
+
 
 /*********************************************************************
  * Set PC13 LED On/Off
@@ -59,13 +63,10 @@ display_temp(int temp100) {
 }
 
 /*********************************************************************
- * CAN Receive Callback
+ * Show a received message (verbose mode)
  *********************************************************************/
-void
-can_recv(struct s_canmsg *msg) {
-	union u_msg {
-		struct s_temp100 temp;
-	} *msgp = (union u_msg *)msg->data;
+static void
+show_msg(struct s_canmsg *msg) {
 
 	if ( show_rx ) {
 		std_printf("[%4u(%d/%u):%c,$%02X]\n",
@@ -74,18 +75,35 @@ can_recv(struct s_canmsg *msg) {
 			msg->rtrf ? 'R' : 'D',
 			msg->data[0]);
 	}
+}
 
-	if ( !msg->rtrf ) {
-		switch ( msg->msgid ) {
-		case ID_Temp:
-			display_temp(msgp->temp.celciusx100);
-			break;
-		default:
-			break;
-		}
-	}
+/*********************************************************************
+ * CAN Receive Handlers
+ *********************************************************************/
+static void
+temp_rx(struct s_canmsg *msg) {
+	union u_msg {
+		struct s_temp100 temp;
+	} *msgp = (union u_msg *)msg->data;
+
+	show_msg(msg);
+	display_temp(msgp->temp.celciusx100);
 }
 
+static const struct s_canfilt_rule can_rules[] = {
+	{ ID_Temp, ID_Temp, 0, CANF_DATA, 0 },		// Temperature
+	{ ID_HeartBeat, ID_HeartBeat2, 0, CANF_DATA, 1 }, // Heartbeats
+	{ 0x700, 0x707, 0, CANF_DATA, 1 },		// tx_bench() loopback
+	{ ID_IsotpRear, ID_IsotpRear, 0, CANF_DATA, 1 }, // ISO-TP from rear
+};
+
+static const can_handler_t can_handlers[] = {
+	temp_rx,
+	show_msg,
+	show_msg,
+	isotp_can_rx,
+};
+
 /*********************************************************************
  * Signal Flash task
  *********************************************************************/
@@ -127,6 +145,159 @@ request_temp(void) {
 	can_xmit(ID_Temp,false,true/*RTR*/,0,&temp_msg);
 }
 
+/*********************************************************************
+ * TX queue bench: send frames in silent loopback mode and report
+ * frames per second at 250, 500 and 1000 kbps.
+ *********************************************************************/
+static void
+tx_bench(void) {
+	static const uint32_t rates[] = { 250000, 500000, 1000000 };
+	struct s_cantiming timing;
+	struct s_cantx_stats stats;
+	uint8_t data[8];
+	TickType_t t0, t1;
+	unsigned frames = 2000, ms;
+
+	for ( unsigned rx=0; rx<sizeof rates/sizeof rates[0]; ++rx ) {
+		if ( !can_set_bitrate(rates[rx],true,&timing) ) {
+			std_printf("%4u kbps: no bit timing\n",(unsigned)(rates[rx] / 1000));
+			continue;
+		}
+		can_tx_stats(&stats,true);
+
+		t0 = xTaskGetTickCount();
+		for ( unsigned ux=0; ux<frames; ++ux ) {
+			memset(data,ux,sizeof data);
+			can_xmit(0x700+(ux&7),false,false,sizeof data,data);
+		}
+		do	{
+			taskYIELD();
+			can_tx_stats(&stats,false);
+		} while ( stats.sent + stats.failed < frames
+		  && xTaskGetTickCount() - t0 < pdMS_TO_TICKS(5000) );
+		t1 = xTaskGetTickCount();
+
+		ms = (t1 - t0) * portTICK_PERIOD_MS;
+		std_printf("%4u kbps: %u frames in %u ms, %u frames/s\n",
+			(unsigned)(rates[rx] / 1000),(unsigned)stats.sent,ms,
+			ms ? (unsigned)(stats.sent * 1000u / ms) : 0u);
+		std_printf("  BRP %u, TS1 %u, TS2 %u, SJW %u tq, sample %u.%u%%, error %d ppm\n",
+			timing.brp,timing.ts1,timing.ts2,timing.sjw,
+			timing.sample/10,timing.sample%10,(int)timing.error_ppm);
+		std_printf("  queued %u, sent %u, aborted %u, failed %u, full %u, hiwater %u\n",
+			(unsigned)stats.queued,(unsigned)stats.sent,(unsigned)stats.aborted,
+			(unsigned)stats.failed,(unsigned)stats.full,(unsigned)stats.hiwater);
+	}
+	can_set_bitrate(CAN_BITRATE,false,NULL);
+}
+
+/*********************************************************************
+ * ISO-TP echo: send a message to rear, which sends it back
+ *********************************************************************/
+static void
+tp_done(struct s_isotp *s __attribute((unused)),int result,unsigned length) {
+
+	xTaskNotify(console_handle,result == ISOTP_OK ? length : 0x10000u | result,eSetValueWithOverwrite);
+}
+
+static void
+tp_echo(void) {
+	static uint8_t out[1024], in[1024];
+	uint32_t sent = 0, got = 0;
+	TickType_t t0, ms;
+
+	for ( unsigned ux=0; ux<sizeof out; ++ux )
+		out[ux] = ux * 7 + 3;
+	memset(in,0,sizeof in);
+	xTaskNotifyWait(0,~0u,NULL,0);			// Clear any stale result
+
+	t0 = xTaskGetTickCount();
+	isotp_can_recv(&tp,in,sizeof in,tp_done);
+	if ( isotp_can_send(&tp,out,sizeof out,tp_done) == ISOTP_OK
+	  && xTaskNotifyWait(0,0,&sent,pdMS_TO_TICKS(5000)) == pdTRUE && sent == sizeof out )
+		xTaskNotifyWait(0,0,&got,pdMS_TO_TICKS(5000));
+	ms = (xTaskGetTickCount() - t0) * portTICK_PERIOD_MS;
+
+	if ( got != sizeof out || memcmp(in,out,sizeof out) != 0 )
+		std_printf("ISO-TP echo failed (sent $%X, received $%X)\n",
+			(unsigned)sent,(unsigned)got);
+	else	std_printf("ISO-TP echo: %u bytes each way in %u ms, %u bytes/s\n",
+			(unsigned)got,(unsigned)ms,ms ? (unsigned)(2000u * got / ms) : 0u);
+	std_printf("  %u frames dropped\n",(unsigned)tp.dropped);
+}
+
+/*********************************************************************
+ * Show the filter bank layout
+ *********************************************************************/
+static void
+show_filters(void) {
+	const struct s_canfilt *cf = can_filter_layout();
+
+	for ( unsigned ux=0; ux<cf->nbanks; ++ux ) {
+		const struct s_canfilt_bank *bk = &cf->bank[ux];
+
+		std_printf("  Bank %2u: %s bit %s, FIFO %u, FR1 $%08X FR2 $%08X\n",
+			ux,bk->scale32 ? "32" : "16",bk->list ? "list" : "mask",
+			bk->fifo,(unsigned)bk->fr1,(unsigned)bk->fr2);
+	}
+	std_printf("  %u banks, FMIs %u/%u, %u merges, leakage %u std %u ext frames\n",
+		cf->nbanks,cf->nfmi[0],cf->nfmi[1],cf->merges,
+		(unsigned)cf->leak_std,(unsigned)cf->leak_ext);
+}
+
+/*********************************************************************
+ * Show (and reset) the receive and transmit counters
+ *********************************************************************/
+static void
+show_stats(void) {
+	const unsigned mhz = configCPU_CLOCK_HZ / 1000000;
+	struct s_canrx_stats rx;
+	struct s_cantx_stats tx;
+
+	can_rx_stats(&rx,true);
+	can_tx_stats(&tx,true);
+
+	std_printf("  RX: %u received, %u dropped, %u overruns, %u unwanted, ring hiwater %u\n",
+		(unsigned)rx.received,(unsigned)rx.dropped,(unsigned)rx.overruns,
+		(unsigned)rx.unwanted,rx.hiwater);
+	if ( rx.dispatched > 0 )
+		std_printf("  RX latency: min %u, mean %u, max %u us\n",
+			(unsigned)(rx.lat_min / mhz),
+			(unsigned)(rx.lat_sum / rx.dispatched / mhz),
+			(unsigned)(rx.lat_max / mhz));
+	std_printf("  TX: %u queued, %u sent, %u aborted, %u failed, %u full, hiwater %u\n",
+		(unsigned)tx.queued,(unsigned)tx.sent,(unsigned)tx.aborted,
+		(unsigned)tx.failed,(unsigned)tx.full,tx.hiwater);
+}
+
+/*********************************************************************
+ * Show bus health: error state, counters, history and load
+ *********************************************************************/
+static void
+show_health(void) {
+	static const char *states[] = { "active", "warning", "passive", "bus-off" };
+	static const char *lecs[] = { "none", "stuff", "form", "ack", "bit1", "bit0", "crc", "user" };
+	struct s_canbus_stats st;
+
+	can_bus_stats(&st,false);
+
+	std_printf("  Error %s, TEC %u, REC %u, %u bps, load %u.%u%% (max %u.%u%%)\n",
+		states[st.state],st.tec,st.rec,(unsigned)st.bitrate,
+		st.load/10,st.load%10,st.load_max/10,st.load_max%10);
+	std_printf("  %u warning, %u passive, %u bus-off, %u/%u recovered, %u ms off\n",
+		(unsigned)st.warnings,(unsigned)st.passives,(unsigned)st.busoffs,
+		(unsigned)st.recoveries,(unsigned)st.attempts,(unsigned)st.offline_ms);
+	std_printf("  Errors:");
+	for ( unsigned ux=1; ux<7; ++ux )
+		std_printf(" %s %u",lecs[ux],(unsigned)st.lec[ux]);
+	std_printf("\n");
+	for ( unsigned ux=0; ux<st.nhist; ++ux )
+		std_printf("  %8u ms: %s, TEC %3u REC %3u (%s)\n",
+			(unsigned)(st.hist[ux].tick * portTICK_PERIOD_MS),
+			states[st.hist[ux].state],st.hist[ux].tec,st.hist[ux].rec,
+			lecs[st.hist[ux].lec]);
+}
+
 /*********************************************************************
  * Display a menu:
  *********************************************************************/
@@ -139,7 +310,12 @@ show_menu(void) {
 		"  P - Turn on parking lights\n"
 		"  B - Activate brake lights\n"
 		"  Lower case the above to turn OFF\n\n"
-		"  V - Verbose mode (show received messages)\n\n");
+		"  V - Verbose mode (show received messages)\n"
+		"  T - TX queue bench (loopback)\n"
+		"  I - Show receive filter layout\n"
+		"  S - Show (and reset) RX/TX statistics\n"
+		"  H - Show bus health\n"
+		"  X - ISO-TP echo through rear\n\n");
 }
 
 /*********************************************************************
@@ -197,6 +373,21 @@ console_task(void *arg __attribute__((unused))) {
 			// Toggle show messages received (verbose mode)
 			show_rx ^= true;
 			break;
+		case 'T':
+			tx_bench();
+			break;
+		case 'I':
+			show_filters();
+			break;
+		case 'S':
+			show_stats();
+			break;
+		case 'H':
+			show_health();
+			break;
+		case 'X':
+			tp_echo();
+			break;
 		case '\r':
 			break;
 		default:
@@ -236,10 +427,14 @@ main(void) {
 	std_set_device(mcu_uart1);			// Use UART1 for std I/O
         open_uart(1,115200,"8N1","rw",1,1);
 
-	initialize_can(false,true,true);		// !nart, locked, altcfg=true PB8/PB9
+	initialize_can(false,true,true,CAN_BITRATE,	// !nart, locked, altcfg=true PB8/PB9
+		can_rules,can_handlers,sizeof can_rules/sizeof can_rules[0]);
 
 	led(false);
-	xTaskCreate(console_task,"console",200,NULL,configMAX_PRIORITIES-1,NULL);
+	isotp_can_session(&tp,ID_IsotpMain,ID_IsotpRear,false);
+	isotp_can_init();
+
+	xTaskCreate(console_task,"console",200,NULL,configMAX_PRIORITIES-1,&console_handle);
 
 	mutex = xSemaphoreCreateMutex();
 	xTaskCreate(flash_task,"flash",100,NULL,configMAX_PRIORITIES-1,NULL);
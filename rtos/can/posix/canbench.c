@@ -0,0 +1,671 @@
+/* canbench.c -- front.c and rear.c on a virtual CAN bus
+ * Warren W. Gay VE3WWG
+ *
+ * Runs the unmodified front (node 1) and rear (node 2) firmware, with
+ * their own copies of canmsgs.c and isotpcan.c, on the virtual bxCAN
+ * bus of vcan.c (see hosted.h). Node 0 plays main.c: it sends the
+ * lamp commands and takes the temperature, heartbeats and ISO-TP
+ * echo. Node 3 disturbs the bus in some scenarios:
+ *
+ *	lamps	Lamp commands reach the lamps, temperature request,
+ *		1024 byte ISO-TP echo and heartbeats
+ *	flood	Node 3 floods ID_HeartBeat: lamp command latency, RX
+ *		load and the starved ID_HeartBeat2
+ *	mask	The flood with node 0 spending 2 ms in a critical
+ *		section every 10 ms: FIFO overruns, counted by canmsgs.c
+ *		as by the bxCAN
+ *	busoff	Node 3 sends at half the bit rate: its bus-off and
+ *		recovery, while the others carry on
+ *	txbench	main.c's TX queue bench (silent loopback)
+ *
+ * Without -s, each scenario runs in a child process of its own (the
+ * firmware's statics can't be reset).
+ *
+ * Usage: canbench [-s scenario] [-b bitrate] [-t seconds] [-i isr_us] [-w handler_us]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <libopencm3/stm32/gpio.h>
+
+#include "hosted.h"
+#include "vcan.h"
+#include "vnodeapi.h"
+
+#define LAMP_LEFT	GPIO14		// On GPIOB of front and rear
+#define LAMP_RIGHT	GPIO13
+#define LAMP_PARK	GPIO12
+#define LAMPS		(LAMP_LEFT|LAMP_RIGHT|LAMP_PARK)
+
+#define TP_SIZE		1024		// ISO-TP echo
+#define TX_FRAMES	2000		// txbench frames per bit rate
+#define TX_RATES	3
+#define NS_PER_MS	1000000ull
+#define LAT_FRAMES	3		// Lamp latency limit, in 8 byte frames
+
+enum {
+	N3_NONE = 0,			// Node 3 not booted
+	N3_FLOOD,			// Floods ID_HeartBeat
+	N3_SLOW				// Half bit rate, ID 0x050
+};
+
+struct s_scenario {
+	const char	*name;
+	unsigned	seconds;	// Default run time (0 = until done)
+	unsigned	node3;		// N3_x
+	unsigned	(*task)(void);	// Node 0, returns failures
+	unsigned	(*report)(void);// Main thread, after the run
+};
+
+struct s_txrun {
+	uint32_t	rate;
+	uint32_t	sent;
+	uint64_t	ns;		// First frame queued to all sent
+};
+
+static uint32_t bitrate = 500000;
+static unsigned seconds = 0;		// -t
+static unsigned handler_us = 0;		// -w
+static const struct s_scenario *scenario;
+static uint64_t t_start;		// After boot
+static TaskHandle_t bench_handle;
+static volatile bool done = false;
+static unsigned task_fails = 0;
+
+// Node 0 receives:
+static int temp = 0;
+static unsigned temps = 0;
+static unsigned heartbeats[2];		// ID_HeartBeat, ID_HeartBeat2
+static unsigned loopbacks = 0;
+static struct s_isotp tp;
+
+// Lamp command latency (issued to GPIOB change, front and rear):
+static uint64_t cmd_ns;
+static bool lat_pending[HOST_NODES];
+static unsigned lat_n = 0, lat_missed = 0;
+static uint64_t lat_max = 0, lat_sum = 0;
+static unsigned cmds = 0, cmds_ok = 0;
+
+static struct s_txrun txruns[TX_RATES];
+
+/*********************************************************************
+ * Report one check
+ *********************************************************************/
+
+static unsigned
+check(const char *what,bool ok) {
+
+	printf("  %-44s %s\n",what,ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/*********************************************************************
+ * Node 0 CAN receive handlers (main.c's rules)
+ *********************************************************************/
+
+static void
+temp_rx(struct s_canmsg *msg) {
+	struct s_temp100 t;
+
+	memcpy(&t,msg->data,sizeof t);
+	temp = t.celciusx100;
+	++temps;
+}
+
+static void
+heartbeat_rx(struct s_canmsg *msg) {
+
+	++heartbeats[msg->msgid == ID_HeartBeat2];
+	if ( handler_us > 0 )
+		host_busy(handler_us * 1000ull);
+}
+
+static void
+loopback_rx(struct s_canmsg *msg __attribute((unused))) {
+	++loopbacks;
+}
+
+static void
+isotp_rx(struct s_canmsg *msg) {
+	vn0_api.tp_rx(msg);
+}
+
+static const struct s_canfilt_rule main_rules[] = {
+	{ ID_Temp, ID_Temp, 0, CANF_DATA, 0 },		// Temperature
+	{ ID_HeartBeat, ID_HeartBeat2, 0, CANF_DATA, 1 }, // Heartbeats
+	{ 0x700, 0x707, 0, CANF_DATA, 1 },		// txbench loopback
+	{ ID_IsotpRear, ID_IsotpRear, 0, CANF_DATA, 1 }, // ISO-TP from rear
+};
+
+static const can_handler_t main_handlers[] = {
+	temp_rx,
+	heartbeat_rx,
+	loopback_rx,
+	isotp_rx,
+};
+
+/*********************************************************************
+ * Lamp commands, and the lamps of node n (bits of LAMPS that are on)
+ *********************************************************************/
+
+static void
+lamp_cmd(enum MsgID id,bool enable) {
+	struct s_lamp_en msg;
+
+	msg.enable = enable;
+	msg.reserved = 0;
+	cmd_ns = host_now_ns();
+	lat_missed += lat_pending[1] + lat_pending[2];
+	lat_pending[1] = lat_pending[2] = true;
+	vn0_api.xmit(id,false,false,sizeof msg,&msg);
+}
+
+static uint16_t
+lamps(unsigned node) {
+	return ~host_gpio(node,GPIOB) & LAMPS;	// Active low
+}
+
+static void
+gpio_changed(unsigned node,uint32_t gpioport,uint16_t levels __attribute((unused))) {
+	uint64_t ns;
+
+	if ( gpioport != GPIOB || !lat_pending[node] )
+		return;
+	lat_pending[node] = false;
+	ns = host_now_ns() - cmd_ns;
+	lat_sum += ns;
+	if ( ns > lat_max )
+		lat_max = ns;
+	++lat_n;
+}
+
+/*********************************************************************
+ * ISO-TP echo with rear: send TP_SIZE bytes, and get them back
+ *********************************************************************/
+
+static void
+tp_done(struct s_isotp *s __attribute((unused)),int result,unsigned length) {
+
+	xTaskNotify(bench_handle,result == ISOTP_OK ? length : 0x10000u | result,eSetValueWithOverwrite);
+}
+
+static unsigned
+tp_echo(void) {
+	static uint8_t out[TP_SIZE], in[TP_SIZE];
+	uint32_t sent = 0, got = 0;
+	uint64_t t0 = host_now_ns(), ns;
+
+	for ( unsigned ux=0; ux<sizeof out; ++ux )
+		out[ux] = ux * 7 + 3;
+	xTaskNotifyWait(0,~0u,NULL,0);
+
+	vn0_api.tp_recv(&tp,in,sizeof in,tp_done);
+	if ( vn0_api.tp_send(&tp,out,sizeof out,tp_done) == ISOTP_OK
+	  && xTaskNotifyWait(0,0,&sent,pdMS_TO_TICKS(5000)) == pdTRUE && sent == sizeof out )
+		xTaskNotifyWait(0,0,&got,pdMS_TO_TICKS(5000));
+	ns = host_now_ns() - t0;
+
+	printf("  ISO-TP echo: %u bytes each way in %u us\n",(unsigned)got,(unsigned)(ns / 1000));
+	return check("ISO-TP echo from rear",got == sizeof out && memcmp(in,out,sizeof out) == 0);
+}
+
+/*********************************************************************
+ * lamps: each command reaches both lamp sets
+ *********************************************************************/
+
+static unsigned
+lamps_step(const char *what,enum MsgID id,bool enable,uint16_t want) {
+
+	lamp_cmd(id,enable);
+	vTaskDelay(pdMS_TO_TICKS(20));
+	return check(what,lamps(1) == want && lamps(2) == want);
+}
+
+static unsigned
+lamps_task(void) {
+	struct s_temp100 t;
+	unsigned fails = 0;
+
+	fails += lamps_step("LeftEn on: left lamps",ID_LeftEn,true,LAMP_LEFT);
+	fails += lamps_step("ParkEn on: parking lamps",ID_ParkEn,true,LAMP_LEFT|LAMP_PARK);
+	fails += lamps_step("Flash: left lamps off",ID_Flash,true,LAMP_PARK);
+	fails += lamps_step("Flash: left lamps on",ID_Flash,true,LAMP_LEFT|LAMP_PARK);
+	fails += lamps_step("RightEn on: right lamps",ID_RightEn,true,LAMPS);
+	fails += lamps_step("LeftEn off",ID_LeftEn,false,LAMP_RIGHT|LAMP_PARK);
+	fails += lamps_step("RightEn off",ID_RightEn,false,LAMP_PARK);
+	fails += lamps_step("ParkEn off: all lamps off",ID_ParkEn,false,0);
+
+	vn0_api.xmit(ID_Temp,false,true,0,&t);		// RTR
+	vTaskDelay(pdMS_TO_TICKS(20));
+	printf("  Temperature %d.%02d C\n",temp / 100,temp % 100);
+	fails += check("Temperature reply from rear",temps == 1 && temp == 2472);
+
+	fails += tp_echo();
+
+	vTaskDelay(pdMS_TO_TICKS(2100) - (host_now_ns() - t_start) / NS_PER_MS);
+	printf("  Heartbeats: %u front, %u rear\n",heartbeats[0],heartbeats[1]);
+	fails += check("Heartbeats from front and rear",heartbeats[0] >= 4 && heartbeats[1] >= 4);
+	return fails;
+}
+
+/*********************************************************************
+ * Report on lamp command latency (all scenarios)
+ *********************************************************************/
+
+static void
+latency_report(void) {
+
+	if ( lat_n > 0 )
+		printf("  Lamp command to lamp: %u, mean %u us, max %u us (%u missed)\n",
+			lat_n,(unsigned)(lat_sum / lat_n / 1000),(unsigned)(lat_max / 1000),lat_missed);
+}
+
+static unsigned
+latency_check(void) {
+	static const uint8_t data[8] = { 0 };
+	uint64_t limit = LAT_FRAMES * vcan_frame_bits(ID_HeartBeat,false,false,8,data) * 1000000000ull / bitrate;
+	char what[64];
+
+	snprintf(what,sizeof what,"Lamp command latency under %u us",(unsigned)(limit / 1000));
+	return check(what,lat_n > 0 && lat_max < limit);
+}
+
+static unsigned
+lamps_report(void) {
+
+	latency_report();
+	return latency_check();
+}
+
+/*********************************************************************
+ * flood and mask: park lamps toggled every 100 ms, through the flood
+ *********************************************************************/
+
+static void
+hog_task(void *arg __attribute((unused))) {
+
+	for (;;) {
+		vTaskDelay(pdMS_TO_TICKS(10));
+		taskENTER_CRITICAL();
+		host_busy(2 * NS_PER_MS);		// Interrupts masked
+		taskEXIT_CRITICAL();
+	}
+}
+
+static unsigned
+flood_task(void) {
+	bool on = false;
+
+	if ( !strcmp(scenario->name,"mask") )
+		xTaskCreate(hog_task,"hog",200,NULL,configMAX_PRIORITIES-1,NULL);
+
+	while ( host_now_ns() - t_start < seconds * 1000 * NS_PER_MS ) {
+		on = !on;
+		lamp_cmd(ID_ParkEn,on);
+		++cmds;
+		vTaskDelay(pdMS_TO_TICKS(100));
+		if ( lamps(1) == (on ? LAMP_PARK : 0) && lamps(2) == (on ? LAMP_PARK : 0) )
+			++cmds_ok;
+	}
+	return 0;
+}
+
+/*********************************************************************
+ * Report on node 0 reception, the bus and the CPU
+ *********************************************************************/
+
+static void
+rx_report(struct s_canrx_stats *rx) {
+	struct s_vcan_stats bus;
+	struct s_host_cpu cpu;
+	uint64_t ns = host_now_ns();			// Counted from boot
+
+	host_select(0);
+	vn0_api.rx_stats(rx,false);
+	vcan_stats(&bus);
+	host_cpu(0,&cpu,false);
+
+	printf("  Bus: %u frames, %u errors, load %u.%u%%\n",(unsigned)bus.frames,(unsigned)bus.errors,
+		(unsigned)(bus.busy_ns * 1000 / ns / 10),(unsigned)(bus.busy_ns * 1000 / ns % 10));
+	printf("  Node 0 RX: %u dispatched, %u dropped, %u overruns, latency mean %u us, max %u us\n",
+		(unsigned)rx->dispatched,(unsigned)rx->dropped,(unsigned)rx->overruns,
+		rx->dispatched ? (unsigned)(rx->lat_sum / rx->dispatched / 72) : 0u,
+		(unsigned)(rx->lat_max / 72));
+	printf("  Node 0 CPU: %u interrupts, %u.%u%% in ISRs, %u.%u%% in tasks\n",(unsigned)cpu.isrs,
+		(unsigned)(cpu.isr_ns * 1000 / ns / 10),(unsigned)(cpu.isr_ns * 1000 / ns % 10),
+		(unsigned)(cpu.work_ns * 1000 / ns / 10),(unsigned)(cpu.work_ns * 1000 / ns % 10));
+}
+
+static unsigned
+flood_report(void) {
+	struct s_canrx_stats rx;
+	struct s_cantx_stats tx;
+	char what[64];
+
+	rx_report(&rx);
+	host_select(2);
+	vn2_api.tx_stats(&tx,false);
+	printf("  HeartBeat2: %u received, rear sent %u of %u queued\n",
+		heartbeats[1],(unsigned)tx.sent,(unsigned)tx.queued);
+	latency_report();
+
+	snprintf(what,sizeof what,"Lamp commands effective (%u of %u)",cmds_ok,cmds);
+	return check(what,cmds > 0 && cmds_ok == cmds)
+		+ latency_check()
+		+ check("Flood received by node 0",rx.dispatched > 0);
+}
+
+static unsigned
+mask_report(void) {
+	struct s_vcan_node_stats vs;
+	struct s_canrx_stats rx;
+	char what[64];
+
+	rx_report(&rx);
+	vcan_node_stats(0,&vs);
+	printf("  bxCAN: %u + %u overruns, %u + %u frames lost (FIFO 0 + 1)\n",
+		(unsigned)vs.overruns[0],(unsigned)vs.overruns[1],(unsigned)vs.lost[0],(unsigned)vs.lost[1]);
+	latency_report();
+
+	snprintf(what,sizeof what,"Lamp commands effective (%u of %u)",cmds_ok,cmds);
+	return check("FIFO overruns while masked",vs.overruns[0] + vs.overruns[1] > 0)
+		+ check("Overruns counted by canmsgs.c",rx.overruns == vs.overruns[0] + vs.overruns[1])
+		+ check(what,cmds > 0 && cmds_ok == cmds);
+}
+
+/*********************************************************************
+ * busoff: node 3 (at half rate) goes bus-off and back, repeatedly
+ *********************************************************************/
+
+static unsigned
+busoff_task(void) {
+
+	vTaskDelay(pdMS_TO_TICKS(seconds * 1000));
+	return 0;
+}
+
+static unsigned
+busoff_report(void) {
+	static const char *states[] = { "active", "warning", "passive", "bus-off" };
+	const struct s_vnode_api *apis[] = { &vn0_api, &vn1_api, &vn2_api };
+	struct s_canbus_stats bs;
+	struct s_vcan_node_stats vs;
+	unsigned good_offs = 0, want = seconds * 2 * 2, fails = 0;
+	char what[64];
+
+	for ( unsigned nx=0; nx<3; ++nx ) {
+		host_select(nx);
+		apis[nx]->bus_stats(&bs,false);
+		vcan_node_stats(nx,&vs);
+		good_offs += bs.busoffs + vs.busoffs;
+	}
+
+	host_select(3);
+	vn3_api.bus_stats(&bs,false);
+	vcan_node_stats(3,&vs);
+	printf("  Node 3: %u busoffs, %u recoveries, %u ms off, %u warnings, %u passives\n",
+		(unsigned)bs.busoffs,(unsigned)bs.recoveries,(unsigned)bs.offline_ms,
+		(unsigned)bs.warnings,(unsigned)bs.passives);
+	for ( unsigned ux=0; ux<bs.nhist; ++ux )
+		printf("    %6u ms  %-8s lec %u, tec %u, rec %u\n",(unsigned)bs.hist[ux].tick,
+			states[bs.hist[ux].state & 3],bs.hist[ux].lec,bs.hist[ux].tec,bs.hist[ux].rec);
+	printf("  Heartbeats: %u front, %u rear\n",heartbeats[0],heartbeats[1]);
+
+	fails += check("Node 3 bus-off 3 times or more",bs.busoffs >= 3 && vs.busoffs == bs.busoffs);
+	fails += check("Node 3 recovered",bs.recoveries + 1 >= bs.busoffs);
+	fails += check("Nodes 0 to 2 never bus-off",good_offs == 0);
+	snprintf(what,sizeof what,"Heartbeats delivered (%u of %u)",heartbeats[0] + heartbeats[1],want);
+	fails += check(what,(heartbeats[0] + heartbeats[1]) * 10 >= want * 9);
+	return fails;
+}
+
+/*********************************************************************
+ * txbench: as main.c tx_bench(), timed on virtual time
+ *********************************************************************/
+
+static unsigned
+txbench_task(void) {
+	static const uint32_t rates[TX_RATES] = { 250000, 500000, 1000000 };
+	struct s_cantx_stats stats;
+	uint8_t data[8];
+	uint64_t t0;
+
+	for ( unsigned rx=0; rx<TX_RATES; ++rx ) {
+		txruns[rx].rate = rates[rx];
+		if ( !vn0_api.set_bitrate(rates[rx],true,NULL) )
+			continue;
+		vn0_api.tx_stats(&stats,true);
+
+		t0 = host_now_ns();
+		for ( unsigned ux=0; ux<TX_FRAMES; ++ux ) {
+			memset(data,ux,sizeof data);
+			vn0_api.xmit(0x700+(ux&7),false,false,sizeof data,data);
+		}
+		do	{
+			vTaskDelay(1);
+			vn0_api.tx_stats(&stats,false);
+		} while ( stats.sent + stats.failed < TX_FRAMES && host_now_ns() - t0 < 5000 * NS_PER_MS );
+		txruns[rx].sent = stats.sent;
+		txruns[rx].ns = host_now_ns() - t0;
+	}
+	vn0_api.set_bitrate(bitrate,false,NULL);
+	return 0;
+}
+
+static unsigned
+txbench_report(void) {
+	uint8_t data[8];
+	uint64_t bits = 0;
+	unsigned fails = 0, fps, theory;
+	char what[64];
+
+	for ( unsigned ux=0; ux<TX_FRAMES; ++ux ) {
+		memset(data,ux,sizeof data);
+		bits += vcan_frame_bits(0x700+(ux&7),false,false,sizeof data,data);
+	}
+	for ( unsigned rx=0; rx<TX_RATES; ++rx ) {
+		const struct s_txrun *r = &txruns[rx];
+
+		fps = r->ns ? (unsigned)(r->sent * 1000000000ull / r->ns) : 0;
+		theory = (unsigned)((uint64_t)TX_FRAMES * r->rate / bits);
+		printf("  %4u kbps: %u frames in %u us, %u frames/s (bus limit %u)\n",
+			(unsigned)(r->rate / 1000),(unsigned)r->sent,(unsigned)(r->ns / 1000),fps,theory);
+		snprintf(what,sizeof what,"%u kbps: all sent, 95%% of the bus limit",(unsigned)(r->rate / 1000));
+		fails += check(what,r->sent == TX_FRAMES && fps * 100ull >= theory * 95ull);
+	}
+	printf("  %u frames looped back\n",loopbacks);
+	return fails;
+}
+
+static const struct s_scenario scenarios[] = {
+	{ "lamps", 3, N3_NONE, lamps_task, lamps_report },
+	{ "flood", 3, N3_FLOOD, flood_task, flood_report },
+	{ "mask", 3, N3_FLOOD, flood_task, mask_report },
+	{ "busoff", 10, N3_SLOW, busoff_task, busoff_report },
+	{ "txbench", 0, N3_NONE, txbench_task, txbench_report },
+};
+
+/*********************************************************************
+ * Node 0: main.c's part, running the scenario
+ *********************************************************************/
+
+static void
+bench_task(void *arg __attribute((unused))) {
+
+	vTaskDelay(pdMS_TO_TICKS(50));			// Let the nodes start
+	t_start = host_now_ns();
+	task_fails = scenario->task();
+	done = true;
+	for (;;)
+		vTaskDelay(portMAX_DELAY);
+}
+
+static int
+main0(void) {
+
+	vn0_api.init(false,true,true,bitrate,main_rules,main_handlers,sizeof main_rules/sizeof main_rules[0]);
+	vn0_api.tp_session(&tp,ID_IsotpMain,ID_IsotpRear,false);
+	tp.bs = 0;			// Rear's echo outruns its TX queue: ends in its TX ISR
+	vn0_api.tp_init();
+	xTaskCreate(bench_task,"bench",400,NULL,configMAX_PRIORITIES-1,&bench_handle);
+	vTaskStartScheduler();
+	return 0;
+}
+
+/*********************************************************************
+ * Node 3: the flood, or frames at the wrong bit rate
+ *********************************************************************/
+
+static void
+ignore_rx(struct s_canmsg *msg __attribute((unused))) {
+}
+
+static const struct s_canfilt_rule node3_rules[] = {
+	{ 0x7FF, 0x7FF, 0, CANF_DATA, 0 },
+};
+
+static const can_handler_t node3_handlers[] = {
+	ignore_rx,
+};
+
+static void
+node3_task(void *arg __attribute((unused))) {
+	uint8_t data[8];
+
+	memset(data,0,sizeof data);
+	for ( unsigned ux=0;; ++ux ) {
+		if ( scenario->node3 == N3_FLOOD ) {
+			data[0] = ux;
+			vn3_api.xmit(ID_HeartBeat,false,false,sizeof data,data);
+		} else	{
+			vn3_api.xmit_wait(0x050,false,false,sizeof data,data,0);
+			vTaskDelay(pdMS_TO_TICKS(20));
+		}
+	}
+}
+
+static int
+main3(void) {
+	uint32_t rate = scenario->node3 == N3_SLOW ? bitrate / 2 : bitrate;
+
+	vn3_api.init(false,true,false,rate,node3_rules,node3_handlers,1);
+	xTaskCreate(node3_task,"node3",200,NULL,configMAX_PRIORITIES-1,NULL);
+	vTaskStartScheduler();
+	return 0;
+}
+
+/*********************************************************************
+ * Run one scenario: returns failures
+ *********************************************************************/
+
+static unsigned
+run(const struct s_scenario *sc) {
+	uint64_t limit;
+	unsigned fails;
+
+	scenario = sc;
+	if ( seconds == 0 )
+		seconds = sc->seconds;
+	printf("\n%s at %u bit/s:\n",sc->name,(unsigned)bitrate);
+
+	vcan_bitrate(bitrate);
+	host_gpio_watch(gpio_changed);
+	host_boot(1,&vn1_api,vn1_main);
+	host_boot(2,&vn2_api,vn2_main);
+	host_run(0);
+
+	// front.c and rear.c boot at CAN_BITRATE: move them to the bench's
+	host_select(1);
+	vn1_api.set_bitrate(bitrate,false,NULL);
+	host_select(2);
+	vn2_api.set_bitrate(bitrate,false,NULL);
+
+	host_boot(0,&vn0_api,main0);
+	if ( sc->node3 != N3_NONE )
+		host_boot(3,&vn3_api,main3);
+
+	limit = ((sc->seconds ? seconds : 30) + 1) * 1000 * NS_PER_MS;
+	while ( !done && host_now_ns() < limit )
+		host_run(host_now_ns() + 10 * NS_PER_MS);
+
+	fails = task_fails + check("Scenario completed",done);
+	if ( done )
+		fails += sc->report();
+	fflush(stdout);
+	return fails;
+}
+
+/*********************************************************************
+ * Main program
+ *********************************************************************/
+
+int
+main(int argc,char **argv) {
+	const char *name = 0;
+	unsigned fails = 0, nsc = sizeof scenarios / sizeof scenarios[0];
+	int optch, status, rc;
+	pid_t pid;
+
+	while ( (optch = getopt(argc,argv,"s:b:t:i:w:h")) != -1 ) {
+		switch ( optch ) {
+		case 's':
+			name = optarg;
+			break;
+		case 'b':
+			bitrate = strtoul(optarg,0,10);
+			break;
+		case 't':
+			seconds = strtoul(optarg,0,10);
+			break;
+		case 'i':
+			host_isr_ns(strtoul(optarg,0,10) * 1000ull);
+			break;
+		case 'w':
+			handler_us = strtoul(optarg,0,10);
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-s scenario] [-b bitrate] [-t seconds] [-i isr_us] [-w handler_us]\n",argv[0]);
+			fprintf(stderr,"Scenarios:");
+			for ( unsigned sx=0; sx<nsc; ++sx )
+				fprintf(stderr," %s",scenarios[sx].name);
+			fprintf(stderr,"\n");
+			return 2;
+		}
+	}
+	if ( bitrate < 20000 || bitrate > 1000000 ) {
+		fprintf(stderr,"Bit rate %u out of range\n",(unsigned)bitrate);
+		return 2;
+	}
+
+	if ( name ) {
+		for ( unsigned sx=0; sx<nsc; ++sx )
+			if ( !strcmp(scenarios[sx].name,name) )
+				fails = run(&scenarios[sx]);
+		if ( !scenario ) {
+			fprintf(stderr,"Unknown scenario %s\n",name);
+			return 2;
+		}
+	} else	{
+		for ( unsigned sx=0; sx<nsc; ++sx ) {
+			fflush(stdout);
+			if ( (pid = fork()) == 0 ) {
+				rc = run(&scenarios[sx]);
+				_exit(rc > 255 ? 255 : rc);
+			}
+			if ( pid < 0 || waitpid(pid,&status,0) != pid || !WIFEXITED(status) )
+				++fails;
+			else	fails += WEXITSTATUS(status);
+		}
+	}
+
+	printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End canbench.c
@@ -0,0 +1,105 @@
+/* cantiming.c -- Print CAN bit timing tables
+ * Warren W. Gay VE3WWG
+ *
+ * Runs cantiming_calc() for the given bit rates (or the usual ones)
+ * and prints the prescaler, segments, sample point and bit rate error.
+ * With -t the results print as C initializers, for a table to put in
+ * the firmware. Each result is checked against the bxCAN limits, and
+ * an error over 0.5% (the oscillator tolerance budget) fails.
+ *
+ * Usage: cantiming [-c clock_hz] [-s sample_pm] [-t] [bitrate...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cantiming.h"
+
+#define MAX_ERR_PPM	5000
+
+static const uint32_t usual[] = {
+	10000, 20000, 33333, 50000, 83333, 100000, 125000, 250000, 500000, 800000, 1000000
+};
+
+/*********************************************************************
+ * Result is within the hardware limits and gives its bit rate
+ *********************************************************************/
+
+static bool
+valid(const struct s_cantiming *t,uint32_t clock) {
+	unsigned tq = 1 + t->ts1 + t->ts2;
+
+	return t->brp >= 1 && t->brp <= CANT_BRP_MAX
+		&& t->ts1 >= 1 && t->ts1 <= CANT_TS1_MAX
+		&& t->ts2 >= 1 && t->ts2 <= CANT_TS2_MAX
+		&& t->sjw >= 1 && t->sjw <= CANT_SJW_MAX && t->sjw <= t->ts2
+		&& tq >= CANT_TQ_MIN && tq <= CANT_TQ_MAX
+		&& t->bitrate == (clock + t->brp * tq / 2) / (t->brp * tq)
+		&& t->sample == (1 + t->ts1) * 1000 / tq;
+}
+
+static unsigned
+show(uint32_t clock,uint32_t bitrate,unsigned sample,bool table) {
+	struct s_cantiming t;
+	bool ok;
+
+	if ( !cantiming_calc(&t,clock,bitrate,sample) ) {
+		printf("%8u: no timing\n",(unsigned)bitrate);
+		return 1;
+	}
+	ok = valid(&t,clock) && labs(t.error_ppm) <= MAX_ERR_PPM;
+
+	if ( table )
+		printf("\t{ %7u, %4u, %2u, %u, %u },\t// %u bps, %+d ppm, %u.%u%%%s\n",
+			(unsigned)bitrate,t.brp,t.ts1,t.ts2,t.sjw,(unsigned)t.bitrate,
+			(int)t.error_ppm,t.sample/10,t.sample%10,ok ? "" : " BAD");
+	else	printf("%8u %5u %4u %4u %4u %4u %9u %+8d %5u.%u%%  %s\n",
+			(unsigned)bitrate,t.brp,1+t.ts1+t.ts2,t.ts1,t.ts2,t.sjw,(unsigned)t.bitrate,
+			(int)t.error_ppm,t.sample/10,t.sample%10,ok ? "ok" : "BAD");
+	return !ok;
+}
+
+int
+main(int argc,char **argv) {
+	uint32_t clock = 36000000;
+	unsigned sample = CANT_SAMPLE, fails = 0;
+	bool table = false;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"c:s:th")) != -1 ) {
+		switch ( optch ) {
+		case 'c':
+			clock = strtoul(optarg,0,10);
+			break;
+		case 's':
+			sample = strtoul(optarg,0,10);
+			break;
+		case 't':
+			table = true;
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-c clock_hz] [-s sample_pm] [-t] [bitrate...]\n",argv[0]);
+			return 2;
+		}
+	}
+
+	if ( table )
+		printf("// APB1 %u Hz, sample point %u.%u%%: bitrate, brp, ts1, ts2, sjw\n",
+			(unsigned)clock,sample/10,sample%10);
+	else	printf("%8s %5s %4s %4s %4s %4s %9s %8s %7s\n",
+			"Bitrate","BRP","tq","TS1","TS2","SJW","Actual","ppm","Sample");
+
+	if ( optind < argc ) {
+		for ( ; optind < argc; ++optind )
+			fails += show(clock,strtoul(argv[optind],0,10),sample,table);
+	} else	{
+		for ( unsigned ux=0; ux<sizeof usual/sizeof usual[0]; ++ux )
+			fails += show(clock,usual[ux],sample,table);
+	}
+
+	if ( !table )
+		printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End cantiming.c
@@ -0,0 +1,202 @@
+/* filtcheck.c -- Check the CAN filter bank compiler
+ * Warren W. Gay VE3WWG
+ *
+ * Compiles rule sets with canfilter.c, then offers every standard
+ * frame, and every extended frame below 2^20 (where the extended
+ * rules live), to the layout. Each wanted frame must be accepted, with
+ * an FMI that names its rule, or a merged filter. Only a merged filter
+ * may take it into the other FIFO ("stolen"). The unwanted frames
+ * accepted must match the leakage the compiler reports.
+ *
+ * Usage: filtcheck [-v]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "canfilter.h"
+
+#define EXT_SPAN	(1u << 20)
+
+static bool verbose = false;
+
+static const struct s_canfilt_rule front_rules[] = {
+	{ 100, 102, 0, CANF_DATA, 0 },		// ID_LeftEn .. ID_ParkEn
+	{ 104, 104, 0, CANF_DATA, 0 },		// ID_Flash
+};
+
+static const struct s_canfilt_rule rear_rules[] = {
+	{ 100, 104, 0, CANF_DATA, 0 },		// ID_LeftEn .. ID_Flash
+	{ 105, 105, 0, CANF_RTR, 1 },		// ID_Temp request
+	{ 0x7E0, 0x7E0, 0, CANF_DATA, 1 },	// ID_IsotpMain
+};
+
+static const struct s_canfilt_rule main_rules[] = {
+	{ 105, 105, 0, CANF_DATA, 0 },		// ID_Temp
+	{ 200, 201, 0, CANF_DATA, 1 },		// ID_HeartBeat, ID_HeartBeat2
+	{ 0x700, 0x707, 0, CANF_DATA, 1 },	// tx_bench() loopback
+	{ 0x7E8, 0x7E8, 0, CANF_DATA, 1 },	// ID_IsotpRear
+};
+
+static const struct s_canfilt_rule mixed_rules[] = {
+	{ 0x12345, 0x12345, 1, CANF_DATA, 0 },
+	{ 0x12346, 0x12346, 1, CANF_DATA, 0 },
+	{ 0x20000, 0x2FFFF, 1, CANF_ANY, 1 },
+	{ 0x01000, 0x01003, 1, CANF_DATA, 1 },
+	{ 0x7FF, 0x7FF, 0, CANF_RTR, 0 },
+	{ 0x000, 0x00F, 0, CANF_ANY, 1 },
+	{ 0x123, 0x123, 0, CANF_ANY, 0 },
+	{ 0x300, 0x37E, 0, CANF_DATA, 1 },
+};
+
+static uint32_t
+prng(uint32_t *seed) {
+	*seed = *seed * 1103515245u + 12345u;
+	return *seed >> 8;
+}
+
+/*********************************************************************
+ * Rule r asks for this frame
+ *********************************************************************/
+
+static bool
+wants(const struct s_canfilt_rule *r,uint32_t id,bool ext,bool rtr) {
+	return r->ext == ext && id >= r->first && id <= r->last && (r->frames & (rtr ? CANF_RTR : CANF_DATA));
+}
+
+static void
+show_layout(const struct s_canfilt *cf) {
+
+	for ( unsigned bx=0; bx<cf->nbanks; ++bx ) {
+		const struct s_canfilt_bank *bk = &cf->bank[bx];
+
+		printf("    bank %2u: %s %s fifo %u  %08X %08X\n",bx,
+			bk->scale32 ? "32" : "16",bk->list ? "list" : "mask",
+			bk->fifo,(unsigned)bk->fr1,(unsigned)bk->fr2);
+	}
+}
+
+/*********************************************************************
+ * Compile and check one rule set
+ *********************************************************************/
+
+static unsigned
+check(const char *name,const struct s_canfilt_rule *rules,unsigned nrules) {
+	struct s_canfilt cf;
+	uint32_t leak[2] = { 0, 0 }, span;
+	unsigned missed = 0, stolen = 0, badfmi = 0, fifo, fmi, fifos, rule, fails;
+	uint8_t urgent = 0xFF;
+	bool rtr;
+
+	if ( !canfilt_compile(&cf,rules,nrules) ) {
+		printf("%-12s compile failed\n",name);
+		return 1;
+	}
+	for ( unsigned ux=0; ux<nrules; ++ux )
+		if ( rules[ux].prio < urgent )
+			urgent = rules[ux].prio;
+
+	for ( unsigned ext=0; ext<2; ++ext ) {
+		span = ext ? EXT_SPAN : 2048;
+		for ( uint32_t id=0; id<span; ++id ) {
+			for ( unsigned t=0; t<2; ++t ) {
+				rtr = t;
+				fifos = 0;
+				for ( unsigned ux=0; ux<nrules; ++ux )
+					if ( wants(&rules[ux],id,ext,rtr) )
+						fifos |= 1 << (rules[ux].prio != urgent);
+
+				if ( !canfilt_accepts(&cf,id,ext,rtr,&fifo,&fmi) ) {
+					missed += fifos != 0;
+					continue;
+				}
+				if ( !fifos ) {
+					++leak[ext];
+					continue;
+				}
+				rule = cf.fmi_rule[fifo][fmi];
+				if ( fmi >= cf.nfmi[fifo] || (rule != CANF_MERGED && !wants(&rules[rule],id,ext,rtr)) )
+					++badfmi;
+				else if ( !(fifos & 1 << fifo) )
+					++stolen;
+			}
+		}
+	}
+
+	fails = missed + badfmi + (leak[0] != cf.leak_std) + (leak[1] != cf.leak_ext);
+	printf("%-12s %5u %5u %4u/%-4u %6u %9u %9u %6u  %s\n",
+		name,nrules,cf.nbanks,cf.nfmi[0],cf.nfmi[1],cf.merges,
+		(unsigned)cf.leak_std,(unsigned)cf.leak_ext,stolen,fails ? "BAD" : "ok");
+	if ( fails )
+		printf("  missed %u, wrong FMI %u, leakage %u/%u (counted)\n",
+			missed,badfmi,(unsigned)leak[0],(unsigned)leak[1]);
+	if ( verbose || fails )
+		show_layout(&cf);
+	return fails ? 1 : 0;
+}
+
+/*********************************************************************
+ * Pseudo random rule sets, large enough to need merging
+ *********************************************************************/
+
+static unsigned
+random_set(const char *name,unsigned nrules,bool ext,unsigned nranges,uint32_t seed) {
+	struct s_canfilt_rule *rules = calloc(nrules,sizeof *rules);
+	uint32_t span = ext ? EXT_SPAN : 2048, len;
+	unsigned fails;
+
+	for ( unsigned ux=0; ux<nrules; ++ux ) {
+		rules[ux].ext = ext;
+		rules[ux].first = prng(&seed) % span;
+		len = ux < nranges ? prng(&seed) % (ext ? 5000 : 40) : 0;
+		rules[ux].last = rules[ux].first + len < span ? rules[ux].first + len : span - 1;
+		rules[ux].frames = ux % 7 == 3 ? CANF_ANY : ux % 5 == 1 ? CANF_RTR : CANF_DATA;
+		rules[ux].prio = ux % 3 == 0 ? 0 : 2;
+	}
+	fails = check(name,rules,nrules);
+	free(rules);
+	return fails;
+}
+
+int
+main(int argc,char **argv) {
+	static const struct s_canfilt_rule bad_rules[] = {
+		{ 0x800, 0x800, 0, CANF_DATA, 0 },	// Not an 11 bit ID
+	};
+	struct s_canfilt cf;
+	unsigned fails = 0;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"vh")) != -1 ) {
+		switch ( optch ) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-v]\n",argv[0]);
+			return 2;
+		}
+	}
+
+	printf("%-12s %5s %5s %9s %6s %9s %9s %6s\n","Rules","Count","Banks","FMI 0/1","Merges","Leak std","Leak ext","Stolen");
+	fails += check("front",front_rules,sizeof front_rules/sizeof front_rules[0]);
+	fails += check("rear",rear_rules,sizeof rear_rules/sizeof rear_rules[0]);
+	fails += check("main",main_rules,sizeof main_rules/sizeof main_rules[0]);
+	fails += check("mixed",mixed_rules,sizeof mixed_rules/sizeof mixed_rules[0]);
+	fails += random_set("std 24",24,false,4,1);
+	fails += random_set("std 60",60,false,8,2);
+	fails += random_set("std 120",120,false,20,3);
+	fails += random_set("ext 20",20,true,3,4);
+	fails += random_set("ext 50",50,true,10,5);
+
+	if ( canfilt_compile(&cf,bad_rules,1) ) {
+		printf("Out of range ID accepted\n");
+		++fails;
+	}
+
+	printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End filtcheck.c
@@ -0,0 +1,44 @@
+/* hosted.h -- Host (POSIX) virtual CAN nodes
+ * Warren W. Gay VE3WWG
+ *
+ * Up to HOST_NODES simulated STM32s share one virtual CAN bus. Each
+ * node runs its FreeRTOS tasks as threads (hostrtos.c) and has its
+ * own bxCAN (vcan.c). Only one thread runs at a time, handing over
+ * at FreeRTOS calls, so time is virtual and every run repeats
+ * exactly. Code takes no time: a task spends CPU time only in
+ * taskYIELD() (1 us) and host_busy(), and each interrupt costs
+ * host_isr_ns(). Interrupts are taken between a task's FreeRTOS
+ * calls, or while it spends time outside a critical section.
+ */
+#ifndef HOSTED_H
+#define HOSTED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HOST_NODES	4
+#define HOST_NEVER	UINT64_MAX
+
+struct s_vnode_api;
+
+struct s_host_cpu {
+	uint64_t	isr_ns;		// Time in interrupts
+	uint64_t	work_ns;	// Time spent by tasks
+	uint32_t	isrs;		// Interrupts taken
+	uint32_t	runs;		// Times a task was given the CPU
+};
+
+void host_boot(unsigned node,const struct s_vnode_api *api,int (*boot)(void));
+void host_select(unsigned node);
+unsigned host_node(void);
+void host_run(uint64_t until_ns);
+uint64_t host_now_ns(void);
+void host_busy(uint64_t ns);
+void host_isr_ns(uint64_t ns);
+void host_cpu(unsigned node,struct s_host_cpu *cpu,bool reset);
+uint16_t host_gpio(unsigned node,uint32_t gpioport);
+void host_gpio_watch(void (*changed)(unsigned node,uint32_t gpioport,uint16_t levels));
+
+#endif // HOSTED_H
+
+// End hosted.h
@@ -0,0 +1,841 @@
+/* hostrtos.c -- FreeRTOS on virtual time, for the virtual CAN nodes
+ * Warren W. Gay VE3WWG
+ *
+ * Each task is a thread, but it runs only while it holds the baton,
+ * handed to it by the scheduler (host_run(), in the main thread). It
+ * hands the baton back when it blocks, yields, spends time in
+ * host_busy() or ends. On each node the highest priority ready task
+ * runs, oldest first within a priority, and a task readying a higher
+ * priority one on its node is preempted. Between task runs, the
+ * scheduler takes a node's pending (and unmasked) CAN interrupts in
+ * order of IRQ number, each costing host_isr_ns() of the node's CPU.
+ * A task spending time in a critical section masks them meanwhile.
+ * A task level call (not ...FromISR) from an interrupt stops the
+ * run, as does a blocking call in a critical section.
+ *
+ * Also here: the node's GPIO, RCC, NVIC, DWT and ADC stand-ins.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/f1/nvic.h>
+#include <libopencm3/cm3/dwt.h>
+
+#include "hosted.h"
+#include "vcan.h"
+#include "vnodeapi.h"
+
+#define NS_PER_TICK	1000000ull
+#define YIELD_NS	1000		// CPU time of a taskYIELD()
+#define STACK_SIZE	(256 * 1024)	// Host thread stack
+
+enum {
+	T_READY = 0,			// Runs when picked
+	T_WORK,				// Spending CPU time (work_ns)
+	T_BLOCKED,
+	T_DONE
+};
+
+enum {
+	W_NONE = 0,
+	W_DELAY,
+	W_TAKE,				// ulTaskNotifyTake()
+	W_NOTIFY,			// xTaskNotifyWait()
+	W_SEM				// On a semaphore
+};
+
+struct s_host_task {
+	struct s_host_task *next;	// All tasks
+	struct s_host_task *wnext;	// Semaphore waiters
+	pthread_t	thread;
+	pthread_cond_t	cv;
+	bool		go;		// Holds the baton
+	TaskFunction_t	fn;
+	void		*arg;
+	char		name[16];
+	unsigned	node;
+	UBaseType_t	prio;
+	uint64_t	seq;		// Order within a priority
+	uint8_t		state;
+	uint8_t		wait;
+	bool		timedout;
+	bool		got;		// Semaphore handed over
+	bool		notified;
+	uint32_t	value;		// Notification value
+	unsigned	crit;		// Critical section nesting
+	uint64_t	wake_ns;	// Timeout, or HOST_NEVER
+	uint64_t	work_ns;	// CPU time left (T_WORK)
+};
+
+struct s_host_sem {
+	UBaseType_t	count, max;
+	struct s_host_task *waiters;	// By priority, then FIFO
+};
+
+struct s_node {
+	const struct s_vnode_api *api;	// Null if unused
+	uint8_t		nvic;		// Enabled IRQs, 1 << VCAN_IRQ_x
+	uint64_t	isr_end;	// In an interrupt until
+	uint16_t	odr[3];		// GPIOA to GPIOC outputs
+	struct s_host_cpu cpu;
+};
+
+static pthread_mutex_t big = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;	// Baton returned
+static bool locked = false;				// Main thread has big
+static struct s_host_task *tasks = 0, **tasks_end = &tasks;
+static struct s_host_task *cur = 0;			// Holds the baton
+static unsigned cur_node = 0;
+static unsigned isr_crit = 0;				// Not in a task
+static bool in_isr = false;
+static bool preempt = false;
+static uint64_t now_ns = 0;
+static uint64_t seq = 0;
+static uint64_t isr_ns = 5000;
+static struct s_node nodes[HOST_NODES];
+static void (*gpio_changed)(unsigned node,uint32_t gpioport,uint16_t levels) = 0;
+
+uint32_t rcc_apb1_frequency = 36000000;
+uint32_t rcc_ahb_frequency = 72000000;
+volatile uint32_t host_rcc_apb1enr, host_rcc_apb2enr, host_rcc_apb2rstr;
+
+/*********************************************************************
+ * Internal: Stop on misuse of the simulation
+ *********************************************************************/
+
+static void
+fatal(const char *what) {
+	fprintf(stderr,"hostrtos: %s (node %u, task %s)\n",what,cur_node,cur ? cur->name : "none");
+	abort();
+}
+
+/*********************************************************************
+ * Internal: Stop on a task level call (not ...FromISR) from an ISR
+ *********************************************************************/
+
+static void
+task_level(const char *call) {
+	char what[64];
+
+	if ( in_isr ) {
+		snprintf(what,sizeof what,"%s called from an ISR",call);
+		fatal(what);
+	}
+}
+
+static void
+lock(void) {
+	if ( !locked ) {
+		pthread_mutex_lock(&big);
+		locked = true;
+	}
+}
+
+/*********************************************************************
+ * Virtual clock and the current node
+ *********************************************************************/
+
+uint64_t
+host_now_ns(void) {
+	return now_ns;
+}
+
+unsigned
+host_node(void) {
+	return cur_node;
+}
+
+void
+host_select(unsigned node) {
+	lock();
+	cur_node = node % HOST_NODES;
+}
+
+void
+host_isr_ns(uint64_t ns) {
+	isr_ns = ns;
+}
+
+void
+host_cpu(unsigned node,struct s_host_cpu *cpu,bool reset) {
+	*cpu = nodes[node].cpu;
+	if ( reset )
+		memset(&nodes[node].cpu,0,sizeof nodes[node].cpu);
+}
+
+/*********************************************************************
+ * Internal: Hand the baton back to the scheduler, and wait for it
+ *********************************************************************/
+
+static void
+give_baton(void) {
+	struct s_host_task *t = cur;
+
+	vcan_sync();
+	t->go = false;
+	cur = 0;
+	pthread_cond_signal(&idle);
+}
+
+static void
+switch_out(void) {
+	struct s_host_task *t = cur;
+
+	give_baton();
+	while ( !t->go )
+		pthread_cond_wait(&t->cv,&big);
+}
+
+static void *
+task_thread(void *arg) {
+	struct s_host_task *t = arg;
+
+	pthread_mutex_lock(&big);
+	while ( !t->go )
+		pthread_cond_wait(&t->cv,&big);
+	t->fn(t->arg);
+	t->state = T_DONE;
+	give_baton();
+	pthread_mutex_unlock(&big);
+	return 0;
+}
+
+/*********************************************************************
+ * Internal: Scheduler runs task t until it gives the baton back
+ *********************************************************************/
+
+static void
+run_task(struct s_host_task *t) {
+
+	cur = t;
+	cur_node = t->node;
+	preempt = false;
+	++nodes[t->node].cpu.runs;
+	t->go = true;
+	pthread_cond_signal(&t->cv);
+	while ( cur )
+		pthread_cond_wait(&idle,&big);
+}
+
+/*********************************************************************
+ * Internal: Make t ready. The running task is preempted (at the end
+ * of its FreeRTOS call) when t is of higher priority on its node.
+ *********************************************************************/
+
+static void
+ready(struct s_host_task *t) {
+
+	t->state = T_READY;
+	t->wait = W_NONE;
+	t->wake_ns = HOST_NEVER;
+	t->seq = ++seq;
+	if ( cur && cur != t && cur->node == t->node && t->prio > cur->prio && !cur->crit )
+		preempt = true;
+}
+
+static void
+preempted(void) {
+
+	if ( preempt && cur ) {
+		preempt = false;
+		switch_out();			// Stays T_READY
+	}
+}
+
+/*********************************************************************
+ * Internal: Block the running task, for ticks at most. Returns false
+ * on a timeout.
+ *********************************************************************/
+
+static bool
+block(uint8_t wait,TickType_t ticks) {
+	struct s_host_task *t = cur;
+
+	if ( !t )
+		fatal("blocking call outside a task");
+	if ( t->crit )
+		fatal("blocking call in a critical section");
+	t->state = T_BLOCKED;
+	t->wait = wait;
+	t->timedout = false;
+	t->wake_ns = ticks == portMAX_DELAY ? HOST_NEVER : (now_ns / NS_PER_TICK + ticks) * NS_PER_TICK;
+	switch_out();
+	return !t->timedout;
+}
+
+/*********************************************************************
+ * Internal: The running task spends ns of CPU time
+ *********************************************************************/
+
+static void
+spend(uint64_t ns,bool yield) {
+	struct s_host_task *t = cur;
+
+	if ( !t )
+		fatal("CPU time spent outside a task");
+	t->state = T_WORK;
+	t->work_ns = ns;
+	if ( yield )
+		t->seq = ++seq;			// After its equals
+	switch_out();
+}
+
+void
+host_busy(uint64_t ns) {
+	if ( ns > 0 )
+		spend(ns,false);
+}
+
+/*********************************************************************
+ * Tasks
+ *********************************************************************/
+
+BaseType_t
+xTaskCreate(TaskFunction_t fn,const char *name,uint16_t stack,void *arg,UBaseType_t prio,TaskHandle_t *handle) {
+	struct s_host_task *t = calloc(1,sizeof *t);
+	pthread_attr_t attr;
+
+	(void)stack;
+	task_level("xTaskCreate");
+	lock();
+	t->fn = fn;
+	t->arg = arg;
+	strncpy(t->name,name,sizeof t->name - 1);
+	t->node = cur_node;
+	t->prio = prio < configMAX_PRIORITIES ? prio : configMAX_PRIORITIES - 1;
+	pthread_cond_init(&t->cv,0);
+	ready(t);
+	*tasks_end = t;
+	tasks_end = &t->next;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr,STACK_SIZE);
+	if ( pthread_create(&t->thread,&attr,task_thread,t) != 0 )
+		fatal("pthread_create");
+	pthread_attr_destroy(&attr);
+	if ( handle )
+		*handle = t;
+	preempted();
+	return pdPASS;
+}
+
+/*********************************************************************
+ * The firmware's main() ends here: its boot task is done.
+ *********************************************************************/
+
+void
+vTaskStartScheduler(void) {
+	struct s_host_task *t = cur;
+
+	task_level("vTaskStartScheduler");
+	if ( !t )
+		fatal("vTaskStartScheduler outside a boot task");
+	t->state = T_DONE;
+	give_baton();
+	pthread_mutex_unlock(&big);
+	pthread_exit(0);
+}
+
+void
+vTaskDelay(TickType_t ticks) {
+	task_level("vTaskDelay");
+	if ( ticks == 0 )
+		taskYIELD();
+	else	block(W_DELAY,ticks);
+}
+
+void
+taskYIELD(void) {
+	task_level("taskYIELD");
+	spend(YIELD_NS,true);
+}
+
+TickType_t
+xTaskGetTickCount(void) {
+	task_level("xTaskGetTickCount");
+	return xTaskGetTickCountFromISR();
+}
+
+TickType_t
+xTaskGetTickCountFromISR(void) {
+	return (TickType_t)(now_ns / NS_PER_TICK);
+}
+
+/*********************************************************************
+ * Critical sections mask the node's interrupts (only felt while the
+ * task spends time in one).
+ *********************************************************************/
+
+void
+host_enter_critical(bool isr) {
+	if ( !isr )
+		task_level("taskENTER_CRITICAL");
+	if ( cur )
+		++cur->crit;
+	else	++isr_crit;
+}
+
+void
+host_exit_critical(bool isr) {
+	unsigned *crit = cur ? &cur->crit : &isr_crit;
+
+	if ( !isr )
+		task_level("taskEXIT_CRITICAL");
+	if ( *crit == 0 )
+		fatal("unbalanced critical section");
+	if ( --*crit == 0 )
+		preempted();
+}
+
+/*********************************************************************
+ * Task notifications
+ *********************************************************************/
+
+static void
+notify(struct s_host_task *t) {
+
+	t->notified = true;
+	if ( t->state == T_BLOCKED && (t->wait == W_TAKE || t->wait == W_NOTIFY) )
+		ready(t);
+}
+
+uint32_t
+ulTaskNotifyTake(BaseType_t clear,TickType_t ticks) {
+	struct s_host_task *t = cur;
+	uint32_t value;
+
+	task_level("ulTaskNotifyTake");
+	if ( !t )
+		fatal("ulTaskNotifyTake outside a task");
+	if ( t->value == 0 && ticks > 0 )
+		block(W_TAKE,ticks);
+	value = t->value;
+	if ( value )
+		t->value = clear ? 0 : value - 1;
+	t->notified = false;
+	return value;
+}
+
+BaseType_t
+xTaskNotifyGive(TaskHandle_t task) {
+	task_level("xTaskNotifyGive");
+	++task->value;
+	notify(task);
+	preempted();
+	return pdPASS;
+}
+
+void
+vTaskNotifyGiveFromISR(TaskHandle_t task,BaseType_t *woken) {
+	++task->value;
+	notify(task);
+	if ( woken )
+		*woken = pdTRUE;
+}
+
+BaseType_t
+xTaskNotify(TaskHandle_t task,uint32_t value,eNotifyAction action) {
+	BaseType_t rc = pdPASS;
+
+	task_level("xTaskNotify");
+	switch ( action ) {
+	case eSetBits:
+		task->value |= value;
+		break;
+	case eIncrement:
+		++task->value;
+		break;
+	case eSetValueWithOverwrite:
+		task->value = value;
+		break;
+	case eSetValueWithoutOverwrite:
+		if ( task->notified )
+			rc = pdFAIL;
+		else	task->value = value;
+		break;
+	default:
+		break;
+	}
+	notify(task);
+	preempted();
+	return rc;
+}
+
+BaseType_t
+xTaskNotifyWait(uint32_t clear_entry,uint32_t clear_exit,uint32_t *value,TickType_t ticks) {
+	struct s_host_task *t = cur;
+	BaseType_t rc = pdFALSE;
+
+	task_level("xTaskNotifyWait");
+	if ( !t )
+		fatal("xTaskNotifyWait outside a task");
+	if ( !t->notified ) {
+		t->value &= ~clear_entry;
+		if ( ticks > 0 )
+			block(W_NOTIFY,ticks);
+	}
+	if ( value )
+		*value = t->value;
+	if ( t->notified ) {
+		t->value &= ~clear_exit;
+		rc = pdTRUE;
+	}
+	t->notified = false;
+	return rc;
+}
+
+/*********************************************************************
+ * Counting semaphores: a give hands the count straight to the first
+ * waiter.
+ *********************************************************************/
+
+SemaphoreHandle_t
+xSemaphoreCreateCounting(UBaseType_t max,UBaseType_t initial) {
+	struct s_host_sem *s = calloc(1,sizeof *s);
+
+	s->max = max;
+	s->count = initial;
+	return s;
+}
+
+BaseType_t
+xSemaphoreTakeFromISR(SemaphoreHandle_t sem,BaseType_t *woken) {
+
+	(void)woken;
+	if ( sem->count == 0 )
+		return pdFALSE;
+	--sem->count;
+	return pdTRUE;
+}
+
+BaseType_t
+xSemaphoreTake(SemaphoreHandle_t sem,TickType_t ticks) {
+	struct s_host_task *t = cur, **tp;
+
+	task_level("xSemaphoreTake");
+	if ( xSemaphoreTakeFromISR(sem,0) == pdTRUE )
+		return pdTRUE;
+	if ( ticks == 0 )
+		return pdFALSE;
+
+	for ( tp = &sem->waiters; *tp && (*tp)->prio >= t->prio; tp = &(*tp)->wnext )
+		;
+	t->wnext = *tp;
+	*tp = t;
+	t->got = false;
+	if ( !block(W_SEM,ticks) ) {
+		for ( tp = &sem->waiters; *tp && *tp != t; tp = &(*tp)->wnext )
+			;
+		if ( *tp )
+			*tp = t->wnext;
+	}
+	return t->got ? pdTRUE : pdFALSE;
+}
+
+BaseType_t
+xSemaphoreGiveFromISR(SemaphoreHandle_t sem,BaseType_t *woken) {
+	struct s_host_task *t = sem->waiters;
+
+	if ( t ) {
+		sem->waiters = t->wnext;
+		t->got = true;
+		ready(t);
+		if ( woken )
+			*woken = pdTRUE;
+		return pdTRUE;
+	}
+	if ( sem->count >= sem->max )
+		return pdFALSE;
+	++sem->count;
+	return pdTRUE;
+}
+
+BaseType_t
+xSemaphoreGive(SemaphoreHandle_t sem) {
+	BaseType_t rc;
+
+	task_level("xSemaphoreGive");
+	rc = xSemaphoreGiveFromISR(sem,0);
+	preempted();
+	return rc;
+}
+
+/*********************************************************************
+ * Boot a node: boot() (the firmware's main()) runs as its first task
+ *********************************************************************/
+
+static void
+boot_task(void *arg) {
+	int (*boot)(void) = (int (*)(void))arg;
+
+	boot();
+}
+
+void
+host_boot(unsigned node,const struct s_vnode_api *api,int (*boot)(void)) {
+
+	host_select(node);
+	nodes[cur_node].api = api;
+	xTaskCreate(boot_task,"boot",0,(void *)boot,configMAX_PRIORITIES-1,0);
+}
+
+/*********************************************************************
+ * Internal: The task a node runs now (highest priority, oldest)
+ *********************************************************************/
+
+static struct s_host_task *
+pick(unsigned node) {
+	struct s_host_task *best = 0;
+
+	for ( struct s_host_task *t = tasks; t; t = t->next ) {
+		if ( t->node != node || (t->state != T_READY && t->state != T_WORK) )
+			continue;
+		if ( !best || t->prio > best->prio || (t->prio == best->prio && t->seq < best->seq) )
+			best = t;
+	}
+	return best;
+}
+
+/*********************************************************************
+ * Internal: Take a node's first pending, unmasked interrupt. Returns
+ * false if there is none.
+ *********************************************************************/
+
+static bool
+interrupt(unsigned node,const struct s_host_task *t) {
+	struct s_node *np = &nodes[node];
+	unsigned irqs;
+
+	if ( t && t->crit )
+		return false;			// Masked
+	irqs = vcan_irqs(node) & np->nvic;
+	for ( unsigned irq=0; irq<4; ++irq ) {
+		if ( !(irqs & 1 << irq) )
+			continue;
+		cur_node = node;
+		in_isr = true;
+		np->api->isr[irq]();
+		in_isr = false;
+		vcan_sync();
+		if ( isr_crit )
+			fatal("ISR left a critical section open");
+		np->isr_end = now_ns + isr_ns;
+		np->cpu.isr_ns += isr_ns;
+		++np->cpu.isrs;
+		return true;
+	}
+	return false;
+}
+
+/*********************************************************************
+ * Run the nodes until virtual time until_ns. Each pass at one
+ * instant completes bus events, takes interrupts and runs ready tasks
+ * until nothing changes. Then the bus starts its next frame, and time
+ * moves to the next event: a frame or interrupt ending, task work
+ * done, a timeout or the tick (a task still working goes behind the
+ * others of its priority, unless in a critical section).
+ *********************************************************************/
+
+void
+host_run(uint64_t until_ns) {
+	struct s_host_task *t;
+	uint64_t next, ns;
+	bool again;
+
+	lock();
+	vcan_sync();				// Last access from the main thread
+	for (;;) {
+		do	{
+			again = false;
+			for ( t = tasks; t; t = t->next ) {
+				if ( t->state == T_BLOCKED && t->wake_ns <= now_ns ) {
+					t->timedout = true;
+					ready(t);
+				}
+			}
+			vcan_step(now_ns);
+
+			for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+				if ( !nodes[nx].api || nodes[nx].isr_end > now_ns )
+					continue;
+				t = pick(nx);
+				if ( interrupt(nx,t) ) {
+					again = true;
+				} else if ( t && t->state == T_READY ) {
+					run_task(t);
+					again = true;
+				}
+			}
+		} while ( again );
+
+		vcan_start(now_ns);
+		if ( now_ns >= until_ns )
+			break;
+
+		next = until_ns;
+		if ( (ns = vcan_next()) < next )
+			next = ns;
+		for ( t = tasks; t; t = t->next )
+			if ( t->state == T_BLOCKED && t->wake_ns < next )
+				next = t->wake_ns;
+		for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+			if ( nodes[nx].isr_end > now_ns ) {
+				if ( nodes[nx].isr_end < next )
+					next = nodes[nx].isr_end;
+			} else if ( (t = pick(nx)) != 0 && t->state == T_WORK ) {
+				if ( now_ns + t->work_ns < next )
+					next = now_ns + t->work_ns;
+				if ( (ns = (now_ns / NS_PER_TICK + 1) * NS_PER_TICK) < next )
+					next = ns;	// Time slice ends
+			}
+		}
+
+		for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+			if ( nodes[nx].isr_end > now_ns || (t = pick(nx)) == 0 || t->state != T_WORK )
+				continue;
+			t->work_ns -= next - now_ns;
+			nodes[nx].cpu.work_ns += next - now_ns;
+			if ( t->work_ns == 0 )
+				t->state = T_READY;
+			else if ( next % NS_PER_TICK == 0 && !t->crit )
+				t->seq = ++seq;		// Tick: round robin within its priority
+		}
+		now_ns = next;
+	}
+}
+
+/*********************************************************************
+ * Cortex-M3 cycle counter at 72 MHz
+ *********************************************************************/
+
+bool
+dwt_enable_cycle_counter(void) {
+	return true;
+}
+
+uint32_t
+dwt_read_cycle_counter(void) {
+	return (uint32_t)(now_ns * 72 / 1000);
+}
+
+/*********************************************************************
+ * NVIC: the CAN interrupts of the node
+ *********************************************************************/
+
+static unsigned
+can_irq(uint8_t irqn) {
+	if ( irqn < NVIC_USB_HP_CAN_TX_IRQ || irqn > NVIC_CAN_SCE_IRQ )
+		return 0;
+	return 1 << (irqn - NVIC_USB_HP_CAN_TX_IRQ);
+}
+
+void
+nvic_enable_irq(uint8_t irqn) {
+	nodes[cur_node].nvic |= can_irq(irqn);
+}
+
+void
+nvic_disable_irq(uint8_t irqn) {
+	nodes[cur_node].nvic &= ~can_irq(irqn);
+}
+
+void
+nvic_set_priority(uint8_t irqn,uint8_t priority) {
+	(void)irqn;
+	(void)priority;
+}
+
+/*********************************************************************
+ * GPIO output levels of each node, for GPIOA to GPIOC. The bench
+ * may watch for changes.
+ *********************************************************************/
+
+static uint16_t *
+odr(unsigned node,uint32_t gpioport) {
+	return &nodes[node].odr[((gpioport - GPIOA) / 0x400) % 3];
+}
+
+uint16_t
+host_gpio(unsigned node,uint32_t gpioport) {
+	return *odr(node,gpioport);
+}
+
+void
+host_gpio_watch(void (*changed)(unsigned node,uint32_t gpioport,uint16_t levels)) {
+	gpio_changed = changed;
+}
+
+static void
+gpio_write(uint32_t gpioport,uint16_t levels) {
+	uint16_t *op = odr(cur_node,gpioport);
+
+	if ( *op != levels ) {
+		*op = levels;
+		if ( gpio_changed )
+			gpio_changed(cur_node,gpioport,levels);
+	}
+}
+
+void
+gpio_set(uint32_t gpioport,uint16_t gpios) {
+	gpio_write(gpioport,*odr(cur_node,gpioport) | gpios);
+}
+
+void
+gpio_clear(uint32_t gpioport,uint16_t gpios) {
+	gpio_write(gpioport,*odr(cur_node,gpioport) & ~gpios);
+}
+
+void
+gpio_toggle(uint32_t gpioport,uint16_t gpios) {
+	gpio_write(gpioport,*odr(cur_node,gpioport) ^ gpios);
+}
+
+uint16_t
+gpio_get(uint32_t gpioport,uint16_t gpios) {
+	return *odr(cur_node,gpioport) & gpios;
+}
+
+/*********************************************************************
+ * ADC: conversions are done at once
+ *********************************************************************/
+
+bool adc_eoc(uint32_t adc) { (void)adc; return true; }
+bool adc_is_calibrating(uint32_t adc) { (void)adc; return false; }
+uint32_t adc_read_regular(uint32_t adc) { (void)adc; return HOST_ADC_VALUE; }
+
+/*********************************************************************
+ * Peripheral setup calls have nothing to do on the host
+ *********************************************************************/
+
+void rcc_clock_setup_in_hse_8mhz_out_72mhz(void) { }
+void rcc_periph_clock_enable(enum rcc_periph_clken clken) { (void)clken; }
+void rcc_peripheral_enable_clock(volatile uint32_t *reg,uint32_t en) { *reg |= en; }
+void rcc_peripheral_reset(volatile uint32_t *reg,uint32_t reset) { *reg |= reset; }
+void rcc_peripheral_clear_reset(volatile uint32_t *reg,uint32_t clear_reset) { *reg &= ~clear_reset; }
+void rcc_set_adcpre(uint32_t adcpre) { (void)adcpre; }
+void gpio_set_mode(uint32_t gpioport,uint8_t mode,uint8_t cnf,uint16_t gpios) { (void)gpioport; (void)mode; (void)cnf; (void)gpios; }
+void gpio_primary_remap(uint32_t swjdisable,uint32_t maps) { (void)swjdisable; (void)maps; }
+void adc_power_off(uint32_t adc) { (void)adc; }
+void adc_power_on(uint32_t adc) { (void)adc; }
+void adc_set_dual_mode(uint32_t mode) { (void)mode; }
+void adc_disable_scan_mode(uint32_t adc) { (void)adc; }
+void adc_set_right_aligned(uint32_t adc) { (void)adc; }
+void adc_set_single_conversion_mode(uint32_t adc) { (void)adc; }
+void adc_set_sample_time(uint32_t adc,uint8_t channel,uint8_t time) { (void)adc; (void)channel; (void)time; }
+void adc_enable_temperature_sensor(void) { }
+void adc_reset_calibration(uint32_t adc) { (void)adc; }
+void adc_calibrate_async(uint32_t adc) { (void)adc; }
+void adc_set_regular_sequence(uint32_t adc,uint8_t length,uint8_t channel[]) { (void)adc; (void)length; (void)channel; }
+void adc_start_conversion_direct(uint32_t adc) { (void)adc; }
+
+// End hostrtos.c
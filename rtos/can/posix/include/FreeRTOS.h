@@ -0,0 +1,38 @@
+/* FreeRTOS.h -- Hosted (POSIX) stand-in for FreeRTOS
+ *
+ * The FreeRTOS API used by canmsgs.c, isotpcan.c and the front/rear
+ * firmware, run by hostrtos.c: each task is a thread, but only one
+ * runs at a time, on virtual time (see hosted.h).
+ */
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef struct s_host_task *TaskHandle_t;
+typedef struct s_host_sem *SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+#define pdFALSE				0
+#define pdTRUE				1
+#define pdPASS				pdTRUE
+#define pdFAIL				pdFALSE
+#define portMAX_DELAY			((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS		1
+#define pdMS_TO_TICKS(ms)		((TickType_t)(ms))
+
+#define configCPU_CLOCK_HZ		72000000ul
+#define configTICK_RATE_HZ		1000
+#define configMAX_PRIORITIES		5
+#define configMAX_SYSCALL_INTERRUPT_PRIORITY 191
+
+#define portYIELD_FROM_ISR(woken)	((void)(woken))
+
+#endif // FREERTOS_H
+
+// End FreeRTOS.h
@@ -0,0 +1,16 @@
+/* dwt.h -- Hosted (POSIX) stand-in for libopencm3 DWT
+ *
+ * The cycle counter runs from virtual time, at 72 MHz.
+ */
+#ifndef HOSTED_DWT_H
+#define HOSTED_DWT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool dwt_enable_cycle_counter(void);
+uint32_t dwt_read_cycle_counter(void);
+
+#endif // HOSTED_DWT_H
+
+// End dwt.h
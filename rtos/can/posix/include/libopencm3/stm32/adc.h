@@ -0,0 +1,37 @@
+/* adc.h -- Hosted (POSIX) stand-in for libopencm3 ADC
+ *
+ * Conversions complete at once, reading HOST_ADC_VALUE (1.43 V, the
+ * temperature sensor at 25 C).
+ */
+#ifndef HOSTED_ADC_H
+#define HOSTED_ADC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ADC1				0x40012400u
+#define ADC_CHANNEL_TEMP		16
+#define ADC_SMPR_SMP_239DOT5CYC		7
+#define ADC_CR1_DUALMOD_IND		0
+
+#define HOST_ADC_VALUE			1775		// 1430 mV of 3300
+
+void adc_power_off(uint32_t adc);
+void adc_power_on(uint32_t adc);
+void adc_set_dual_mode(uint32_t mode);
+void adc_disable_scan_mode(uint32_t adc);
+void adc_set_right_aligned(uint32_t adc);
+void adc_set_single_conversion_mode(uint32_t adc);
+void adc_set_sample_time(uint32_t adc,uint8_t channel,uint8_t time);
+void adc_enable_temperature_sensor(void);
+void adc_reset_calibration(uint32_t adc);
+void adc_calibrate_async(uint32_t adc);
+bool adc_is_calibrating(uint32_t adc);
+void adc_set_regular_sequence(uint32_t adc,uint8_t length,uint8_t channel[]);
+void adc_start_conversion_direct(uint32_t adc);
+bool adc_eoc(uint32_t adc);
+uint32_t adc_read_regular(uint32_t adc);
+
+#endif // HOSTED_ADC_H
+
+// End adc.h
@@ -0,0 +1,163 @@
+/* can.h -- Hosted (POSIX) stand-in for libopencm3 CAN
+ *
+ * Register accesses reach the current node's simulated bxCAN through
+ * host_can_reg() (vcan.c). Writes are seen at the next register
+ * access, or when the task or ISR gives up the CPU. The filter banks
+ * are only set through can_filter_init().
+ */
+#ifndef HOSTED_CAN_H
+#define HOSTED_CAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAN1				0x40006400u
+
+volatile uint32_t *host_can_reg(uint32_t addr);
+
+#define CAN_MCR(p)			(*host_can_reg((p) + 0x000))
+#define CAN_MSR(p)			(*host_can_reg((p) + 0x004))
+#define CAN_TSR(p)			(*host_can_reg((p) + 0x008))
+#define CAN_RF0R(p)			(*host_can_reg((p) + 0x00C))
+#define CAN_RF1R(p)			(*host_can_reg((p) + 0x010))
+#define CAN_IER(p)			(*host_can_reg((p) + 0x014))
+#define CAN_ESR(p)			(*host_can_reg((p) + 0x018))
+#define CAN_BTR(p)			(*host_can_reg((p) + 0x01C))
+
+#define CAN_MBOX0			0x180
+#define CAN_MBOX1			0x190
+#define CAN_MBOX2			0x1A0
+#define CAN_FIFO0			0x1B0
+#define CAN_FIFO1			0x1C0
+
+#define CAN_TIxR(p,m)			(*host_can_reg((p) + (m) + 0x0))
+#define CAN_TDTxR(p,m)			(*host_can_reg((p) + (m) + 0x4))
+#define CAN_TDLxR(p,m)			(*host_can_reg((p) + (m) + 0x8))
+#define CAN_TDHxR(p,m)			(*host_can_reg((p) + (m) + 0xC))
+#define CAN_RIxR(p,f)			(*host_can_reg((p) + (f) + 0x0))
+#define CAN_RDTxR(p,f)			(*host_can_reg((p) + (f) + 0x4))
+#define CAN_RDLxR(p,f)			(*host_can_reg((p) + (f) + 0x8))
+#define CAN_RDHxR(p,f)			(*host_can_reg((p) + (f) + 0xC))
+
+#define CAN_MCR_DBF			(1 << 16)
+#define CAN_MCR_RESET			(1 << 15)
+#define CAN_MCR_TTCM			(1 << 7)
+#define CAN_MCR_ABOM			(1 << 6)
+#define CAN_MCR_AWUM			(1 << 5)
+#define CAN_MCR_NART			(1 << 4)
+#define CAN_MCR_RFLM			(1 << 3)
+#define CAN_MCR_TXFP			(1 << 2)
+#define CAN_MCR_SLEEP			(1 << 1)
+#define CAN_MCR_INRQ			(1 << 0)
+
+#define CAN_MSR_RX			(1 << 11)
+#define CAN_MSR_SAMP			(1 << 10)
+#define CAN_MSR_RXM			(1 << 9)
+#define CAN_MSR_TXM			(1 << 8)
+#define CAN_MSR_SLAKI			(1 << 4)
+#define CAN_MSR_WKUI			(1 << 3)
+#define CAN_MSR_ERRI			(1 << 2)
+#define CAN_MSR_SLAK			(1 << 1)
+#define CAN_MSR_INAK			(1 << 0)
+
+#define CAN_TSR_LOW2			(1 << 31)
+#define CAN_TSR_LOW1			(1 << 30)
+#define CAN_TSR_LOW0			(1 << 29)
+#define CAN_TSR_TME2			(1 << 28)
+#define CAN_TSR_TME1			(1 << 27)
+#define CAN_TSR_TME0			(1 << 26)
+#define CAN_TSR_CODE_SHIFT		24
+#define CAN_TSR_CODE_MASK		(3 << 24)
+#define CAN_TSR_ABRQ2			(1 << 23)
+#define CAN_TSR_TERR2			(1 << 19)
+#define CAN_TSR_ALST2			(1 << 18)
+#define CAN_TSR_TXOK2			(1 << 17)
+#define CAN_TSR_RQCP2			(1 << 16)
+#define CAN_TSR_ABRQ1			(1 << 15)
+#define CAN_TSR_TERR1			(1 << 11)
+#define CAN_TSR_ALST1			(1 << 10)
+#define CAN_TSR_TXOK1			(1 << 9)
+#define CAN_TSR_RQCP1			(1 << 8)
+#define CAN_TSR_ABRQ0			(1 << 7)
+#define CAN_TSR_TERR0			(1 << 3)
+#define CAN_TSR_ALST0			(1 << 2)
+#define CAN_TSR_TXOK0			(1 << 1)
+#define CAN_TSR_RQCP0			(1 << 0)
+
+#define CAN_RF0R_RFOM0			(1 << 5)
+#define CAN_RF0R_FOVR0			(1 << 4)
+#define CAN_RF0R_FULL0			(1 << 3)
+#define CAN_RF0R_FMP0_MASK		(3 << 0)
+#define CAN_RF1R_RFOM1			(1 << 5)
+#define CAN_RF1R_FOVR1			(1 << 4)
+#define CAN_RF1R_FULL1			(1 << 3)
+#define CAN_RF1R_FMP1_MASK		(3 << 0)
+
+#define CAN_IER_SLKIE			(1 << 17)
+#define CAN_IER_WKUIE			(1 << 16)
+#define CAN_IER_ERRIE			(1 << 15)
+#define CAN_IER_LECIE			(1 << 11)
+#define CAN_IER_BOFIE			(1 << 10)
+#define CAN_IER_EPVIE			(1 << 9)
+#define CAN_IER_EWGIE			(1 << 8)
+#define CAN_IER_FOVIE1			(1 << 6)
+#define CAN_IER_FFIE1			(1 << 5)
+#define CAN_IER_FMPIE1			(1 << 4)
+#define CAN_IER_FOVIE0			(1 << 3)
+#define CAN_IER_FFIE0			(1 << 2)
+#define CAN_IER_FMPIE0			(1 << 1)
+#define CAN_IER_TMEIE			(1 << 0)
+
+#define CAN_ESR_REC_MASK		(0xFFu << 24)
+#define CAN_ESR_TEC_MASK		(0xFF << 16)
+#define CAN_ESR_LEC_SHIFT		4
+#define CAN_ESR_LEC_MASK		(7 << 4)
+#define CAN_ESR_LEC_NO_ERROR		(0 << 4)
+#define CAN_ESR_LEC_STUFF_ERROR		(1 << 4)
+#define CAN_ESR_LEC_FORM_ERROR		(2 << 4)
+#define CAN_ESR_LEC_ACK_ERROR		(3 << 4)
+#define CAN_ESR_LEC_REC_ERROR		(4 << 4)
+#define CAN_ESR_LEC_DOM_ERROR		(5 << 4)
+#define CAN_ESR_LEC_CRC_ERROR		(6 << 4)
+#define CAN_ESR_LEC_USER		(7 << 4)
+#define CAN_ESR_BOFF			(1 << 2)
+#define CAN_ESR_EPVF			(1 << 1)
+#define CAN_ESR_EWGF			(1 << 0)
+
+#define CAN_BTR_SILM			(1u << 31)
+#define CAN_BTR_LBKM			(1 << 30)
+#define CAN_BTR_SJW_SHIFT		24
+#define CAN_BTR_SJW_MASK		(3 << 24)
+#define CAN_BTR_TS2_SHIFT		20
+#define CAN_BTR_TS2_MASK		(7 << 20)
+#define CAN_BTR_TS1_SHIFT		16
+#define CAN_BTR_TS1_MASK		(0xF << 16)
+#define CAN_BTR_BRP_MASK		0x3FF
+
+#define CAN_TIxR_STID_SHIFT		21
+#define CAN_TIxR_EXID_SHIFT		3
+#define CAN_TIxR_IDE			(1 << 2)
+#define CAN_TIxR_RTR			(1 << 1)
+#define CAN_TIxR_TXRQ			(1 << 0)
+
+#define CAN_RIxR_STID_SHIFT		21
+#define CAN_RIxR_EXID_SHIFT		3
+#define CAN_RIxR_IDE			(1 << 2)
+#define CAN_RIxR_RTR			(1 << 1)
+
+#define CAN_RDTxR_FMI_SHIFT		8
+#define CAN_RDTxR_FMI_MASK		(0xFF << 8)
+#define CAN_RDTxR_DLC_MASK		0xF
+
+void can_reset(uint32_t canport);
+int can_init(uint32_t canport,bool ttcm,bool abom,bool awum,bool nart,bool rflm,bool txfp,
+	uint32_t sjw,uint32_t ts1,uint32_t ts2,uint32_t brp,bool loopback,bool silent);
+void can_filter_init(uint32_t nr,bool scale_32bit,bool id_list_mode,uint32_t fr1,uint32_t fr2,
+	uint32_t fifo,bool enable);
+void can_enable_irq(uint32_t canport,uint32_t irq);
+void can_disable_irq(uint32_t canport,uint32_t irq);
+int can_transmit(uint32_t canport,uint32_t id,bool ext,bool rtr,uint8_t length,uint8_t *data);
+
+#endif // HOSTED_CAN_H
+
+// End can.h
@@ -0,0 +1,26 @@
+/* nvic.h -- Hosted (POSIX) stand-in for libopencm3 NVIC (STM32F1)
+ *
+ * Only the CAN interrupts are simulated.
+ */
+#ifndef HOSTED_NVIC_H
+#define HOSTED_NVIC_H
+
+#include <stdint.h>
+
+#define NVIC_USB_HP_CAN_TX_IRQ		19
+#define NVIC_USB_LP_CAN_RX0_IRQ		20
+#define NVIC_CAN_RX1_IRQ		21
+#define NVIC_CAN_SCE_IRQ		22
+
+void nvic_enable_irq(uint8_t irqn);
+void nvic_disable_irq(uint8_t irqn);
+void nvic_set_priority(uint8_t irqn,uint8_t priority);
+
+void usb_hp_can_tx_isr(void);
+void usb_lp_can_rx0_isr(void);
+void can_rx1_isr(void);
+void can_sce_isr(void);
+
+#endif // HOSTED_NVIC_H
+
+// End nvic.h
@@ -0,0 +1,59 @@
+/* gpio.h -- Hosted (POSIX) stand-in for libopencm3 GPIO
+ *
+ * Output levels are kept for each node, so that the bench can read
+ * the lamps (see host_gpio()).
+ */
+#ifndef HOSTED_GPIO_H
+#define HOSTED_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOA				0x40010800u
+#define GPIOB				0x40010C00u
+#define GPIOC				0x40011000u
+
+#define GPIO0				(1 << 0)
+#define GPIO1				(1 << 1)
+#define GPIO2				(1 << 2)
+#define GPIO3				(1 << 3)
+#define GPIO4				(1 << 4)
+#define GPIO5				(1 << 5)
+#define GPIO6				(1 << 6)
+#define GPIO7				(1 << 7)
+#define GPIO8				(1 << 8)
+#define GPIO9				(1 << 9)
+#define GPIO10				(1 << 10)
+#define GPIO11				(1 << 11)
+#define GPIO12				(1 << 12)
+#define GPIO13				(1 << 13)
+#define GPIO14				(1 << 14)
+#define GPIO15				(1 << 15)
+
+#define GPIO_CAN_RX			GPIO11		// PA11
+#define GPIO_CAN_TX			GPIO12		// PA12
+#define GPIO_CAN_PB_RX			GPIO8		// PB8 (remapped)
+#define GPIO_CAN_PB_TX			GPIO9		// PB9 (remapped)
+#define GPIO_USART1_TX			GPIO9
+
+#define GPIO_MODE_INPUT			0
+#define GPIO_MODE_OUTPUT_2_MHZ		2
+#define GPIO_MODE_OUTPUT_50_MHZ		3
+#define GPIO_CNF_INPUT_FLOAT		1
+#define GPIO_CNF_OUTPUT_PUSHPULL	0
+#define GPIO_CNF_OUTPUT_ALTFN_PUSHPULL	2
+#define GPIO_CNF_OUTPUT_ALTFN_OPENDRAIN	3
+
+#define AFIO_MAPR_SWJ_CFG_JTAG_OFF_SW_OFF (4 << 24)
+#define AFIO_MAPR_CAN1_REMAP_PORTA	(0 << 13)
+#define AFIO_MAPR_CAN1_REMAP_PORTB	(2 << 13)
+
+void gpio_set_mode(uint32_t gpioport,uint8_t mode,uint8_t cnf,uint16_t gpios);
+void gpio_set(uint32_t gpioport,uint16_t gpios);
+void gpio_clear(uint32_t gpioport,uint16_t gpios);
+void gpio_toggle(uint32_t gpioport,uint16_t gpios);
+uint16_t gpio_get(uint32_t gpioport,uint16_t gpios);
+void gpio_primary_remap(uint32_t swjdisable,uint32_t maps);
+
+#endif // HOSTED_GPIO_H
+
+// End gpio.h
@@ -0,0 +1,36 @@
+/* rcc.h -- Hosted (POSIX) stand-in for libopencm3 RCC
+ *
+ * The clocks are always those of rcc_clock_setup_in_hse_8mhz_out_72mhz().
+ */
+#ifndef HOSTED_RCC_H
+#define HOSTED_RCC_H
+
+#include <stdint.h>
+
+enum rcc_periph_clken {
+	RCC_GPIOA, RCC_GPIOB, RCC_GPIOC, RCC_AFIO, RCC_CAN1, RCC_ADC1
+};
+
+extern uint32_t rcc_apb1_frequency;
+extern uint32_t rcc_ahb_frequency;
+
+extern volatile uint32_t host_rcc_apb1enr, host_rcc_apb2enr, host_rcc_apb2rstr;
+
+#define RCC_APB1ENR			(host_rcc_apb1enr)
+#define RCC_APB2ENR			(host_rcc_apb2enr)
+#define RCC_APB2RSTR			(host_rcc_apb2rstr)
+#define RCC_APB1ENR_CAN1EN		(1 << 25)
+#define RCC_APB2ENR_ADC1EN		(1 << 9)
+#define RCC_APB2RSTR_ADC1RST		(1 << 9)
+#define RCC_CFGR_ADCPRE_PCLK2_DIV6	2
+
+void rcc_clock_setup_in_hse_8mhz_out_72mhz(void);
+void rcc_periph_clock_enable(enum rcc_periph_clken clken);
+void rcc_peripheral_enable_clock(volatile uint32_t *reg,uint32_t en);
+void rcc_peripheral_reset(volatile uint32_t *reg,uint32_t reset);
+void rcc_peripheral_clear_reset(volatile uint32_t *reg,uint32_t clear_reset);
+void rcc_set_adcpre(uint32_t adcpre);
+
+#endif // HOSTED_RCC_H
+
+// End rcc.h
@@ -0,0 +1,9 @@
+/* timer.h -- Hosted (POSIX) stand-in: front.c and rear.c include it,
+ * but use no timers.
+ */
+#ifndef HOSTED_TIMER_H
+#define HOSTED_TIMER_H
+
+#endif // HOSTED_TIMER_H
+
+// End timer.h
@@ -0,0 +1,9 @@
+/* mcuio.h -- Hosted (POSIX) stand-in: front.c and rear.c include it,
+ * but have no console.
+ */
+#ifndef MCUIO_H
+#define MCUIO_H
+
+#endif // MCUIO_H
+
+// End mcuio.h
@@ -0,0 +1,9 @@
+/* miniprintf.h -- Hosted (POSIX) stand-in: front.c and rear.c include
+ * it, but print nothing.
+ */
+#ifndef MINIPRINTF_H
+#define MINIPRINTF_H
+
+#endif // MINIPRINTF_H
+
+// End miniprintf.h
@@ -0,0 +1,12 @@
+/* queue.h -- Hosted (POSIX) stand-in for FreeRTOS queue.h
+ *
+ * canmsgs.h includes it, but no queues are used.
+ */
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "FreeRTOS.h"
+
+#endif // QUEUE_H
+
+// End queue.h
@@ -0,0 +1,21 @@
+/* semphr.h -- Hosted (POSIX) stand-in for FreeRTOS semphr.h
+ *
+ * Counting semaphores (a mutex is one with a count of one, without
+ * priority inheritance).
+ */
+#ifndef SEMPHR_H
+#define SEMPHR_H
+
+#include "FreeRTOS.h"
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max,UBaseType_t initial);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem,TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t sem,BaseType_t *woken);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem,BaseType_t *woken);
+
+#define xSemaphoreCreateMutex()		xSemaphoreCreateCounting(1,1)
+
+#endif // SEMPHR_H
+
+// End semphr.h
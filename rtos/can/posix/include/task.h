@@ -0,0 +1,39 @@
+/* task.h -- Hosted (POSIX) stand-in for FreeRTOS task.h
+ */
+#ifndef TASK_H
+#define TASK_H
+
+#include "FreeRTOS.h"
+
+typedef enum {
+	eNoAction = 0,
+	eSetBits,
+	eIncrement,
+	eSetValueWithOverwrite,
+	eSetValueWithoutOverwrite
+} eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t fn,const char *name,uint16_t stack,void *arg,UBaseType_t prio,TaskHandle_t *handle);
+void vTaskStartScheduler(void);
+void vTaskDelay(TickType_t ticks);
+void taskYIELD(void);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear,TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task,BaseType_t *woken);
+BaseType_t xTaskNotify(TaskHandle_t task,uint32_t value,eNotifyAction action);
+BaseType_t xTaskNotifyWait(uint32_t clear_entry,uint32_t clear_exit,uint32_t *value,TickType_t ticks);
+
+void host_enter_critical(bool isr);
+void host_exit_critical(bool isr);
+
+#define taskENTER_CRITICAL()		host_enter_critical(false)
+#define taskEXIT_CRITICAL()		host_exit_critical(false)
+#define taskENTER_CRITICAL_FROM_ISR()	(host_enter_critical(true),(UBaseType_t)0)
+#define taskEXIT_CRITICAL_FROM_ISR(m)	((void)(m),host_exit_critical(true))
+
+#endif // TASK_H
+
+// End task.h
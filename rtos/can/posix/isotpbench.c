@@ -0,0 +1,428 @@
+/* isotpbench.c -- ISO-TP throughput on a virtual CAN bus
+ * Warren W. Gay VE3WWG
+ *
+ * Two isotp.c nodes share an in-process bus running on simulated
+ * time. Each node has three transmit mailboxes. Each idle bus goes to
+ * the lowest queued ID, and the frame occupies it for its worst case
+ * stuffed length. A completed frame is delivered to the other node,
+ * and the sender is polled as the TX mailbox interrupt would. Then
+ * every node is polled, as its timer task would be.
+ *
+ * Transfers of ISOTP_MAX_LEN bytes are timed against the receiver's
+ * STmin and block size. Then both directions run at once, and the
+ * overflow, lost frame, timeout and restarted message paths are
+ * checked.
+ *
+ * Usage: isotpbench [-b bitrate] [-v]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "isotp.h"
+
+#define MBOXES		3
+#define ID_A		0x7E0		// Node A sends on this
+#define ID_B		0x7E8		// Node B sends on this
+
+struct s_frame {
+	uint32_t	id;
+	uint8_t		length;
+	uint8_t		data[8];
+};
+
+struct s_node {
+	const char		*name;
+	struct s_isotp_node	tp;
+	struct s_isotp		s;
+	struct s_frame		mbox[MBOXES];
+	unsigned		nmbox;
+	uint32_t		due;		// Next poll, when timed
+	bool			timed;
+	unsigned		frames;		// Frames sent
+};
+
+struct s_result {
+	int		result;
+	unsigned	length;
+	uint32_t	at;			// Completion time (us)
+	bool		done;
+};
+
+static bool verbose = false;
+static uint32_t bitrate = 500000;
+static uint32_t now = 0;			// Simulated time (us)
+static unsigned drop_frame = 0;			// Lose this frame (1 based)
+static unsigned bus_frames = 0;
+static unsigned aborts = 0;			// ISOTP_ABORTED seen by restarted()
+static struct s_node nodes[2];
+
+/*********************************************************************
+ * Bits on the bus, worst case stuffing (as canmsgs.c frame_bits())
+ *********************************************************************/
+
+static uint32_t
+frame_bits(bool ext,bool rtr,unsigned length) {
+	unsigned n = (ext ? 54 : 34) + (rtr ? 0 : length * 8);
+
+	return n + (n - 1) / 4 + 13;
+}
+
+/*********************************************************************
+ * isotp_xmit_t: load a mailbox, if one is free
+ *********************************************************************/
+
+static bool
+xmit(void *arg,uint32_t id,bool ext __attribute((unused)),const uint8_t *data,uint8_t length) {
+	struct s_node *n = arg;
+	struct s_frame *f;
+
+	if ( n->nmbox >= MBOXES )
+		return false;
+	f = &n->mbox[n->nmbox++];
+	f->id = id;
+	f->length = length;
+	memcpy(f->data,data,length);
+	return true;
+}
+
+/*********************************************************************
+ * Poll a node, noting its next deadline
+ *********************************************************************/
+
+static void
+poll(struct s_node *n) {
+	uint32_t next = isotp_poll(&n->tp,now);
+
+	n->timed = next != ISOTP_IDLE;
+	n->due = now + next;
+}
+
+/*********************************************************************
+ * Run the bus until nothing is queued or timed. Returns false if
+ * limit_us passed first.
+ *********************************************************************/
+
+static bool
+run(uint32_t limit_us) {
+	const uint32_t start = now;
+	struct s_node *tx;
+	struct s_frame f;
+	unsigned mx, bits;
+	bool lost;
+
+	while ( now - start < limit_us ) {
+		tx = 0;
+		mx = 0;
+		for ( unsigned nx=0; nx<2; ++nx )
+			for ( unsigned bx=0; bx<nodes[nx].nmbox; ++bx )
+				if ( !tx || nodes[nx].mbox[bx].id < tx->mbox[mx].id ) {
+					tx = &nodes[nx];
+					mx = bx;
+				}
+
+		if ( !tx ) {
+			// Bus idle: skip to the next deadline
+			struct s_node *first = 0;
+
+			for ( unsigned nx=0; nx<2; ++nx )
+				if ( nodes[nx].timed && (!first || (int32_t)(nodes[nx].due - first->due) < 0) )
+					first = &nodes[nx];
+			if ( !first )
+				return true;
+			if ( (int32_t)(first->due - now) > 0 )
+				now = first->due;
+			poll(first);
+			continue;
+		}
+
+		f = tx->mbox[mx];
+		memmove(&tx->mbox[mx],&tx->mbox[mx+1],(tx->nmbox - mx - 1) * sizeof f);
+		--tx->nmbox;
+		bits = frame_bits(false,false,f.length);
+		now += (bits * 1000000u + bitrate - 1) / bitrate;
+		++tx->frames;
+		lost = ++bus_frames == drop_frame;
+
+		for ( unsigned nx=0; nx<2; ++nx )
+			if ( &nodes[nx] != tx && !lost )
+				isotp_frame(&nodes[nx].tp,f.id,false,f.data,f.length,now);
+		poll(tx);					// TX mailbox ISR
+		for ( unsigned nx=0; nx<2; ++nx )
+			if ( nodes[nx].timed && (int32_t)(now - nodes[nx].due) >= 0 )
+				poll(&nodes[nx]);		// Timer task
+	}
+	return false;
+}
+
+/*********************************************************************
+ * Completion callbacks
+ *********************************************************************/
+
+static void
+done(struct s_isotp *s,int result,unsigned length) {
+	struct s_result *r = s->user;
+
+	if ( !r )
+		return;				// Not watched
+	r->result = result;
+	r->length = length;
+	r->at = now;
+	r->done = true;
+}
+
+static void
+tx_done(struct s_isotp *s,int result,unsigned length) {
+	done(s,result,length);
+	if ( verbose )
+		printf("    %s sent %u bytes at %u us (%d)\n",
+			s->tx_id == ID_A ? "A" : "B",length,(unsigned)now,result);
+}
+
+static void
+restarted(struct s_isotp *s,int result,unsigned length) {
+
+	if ( result == ISOTP_ABORTED )
+		++aborts;			// The buffer stays armed
+	else	done(s,result,length);
+}
+
+/*********************************************************************
+ * Set up both nodes: receivers grant bs and stmin
+ *********************************************************************/
+
+static void
+setup(uint8_t bs,uint8_t stmin) {
+
+	memset(nodes,0,sizeof nodes);
+	nodes[0].name = "A";
+	nodes[1].name = "B";
+	isotp_init(&nodes[0].s,ID_A,ID_B,false,xmit,&nodes[0]);
+	isotp_init(&nodes[1].s,ID_B,ID_A,false,xmit,&nodes[1]);
+	for ( unsigned nx=0; nx<2; ++nx ) {
+		nodes[nx].s.bs = bs;
+		nodes[nx].s.stmin = stmin;
+		isotp_attach(&nodes[nx].tp,&nodes[nx].s);
+	}
+	now = 0x7FFFF000u;			// Cross the wrap early on
+	bus_frames = 0;
+	drop_frame = 0;
+}
+
+static void
+fill(uint8_t *buf,unsigned length,unsigned seed) {
+
+	for ( unsigned ux=0; ux<length; ++ux )
+		buf[ux] = ux * seed + (ux >> 8) + seed;
+}
+
+/*********************************************************************
+ * Time one transfer A => B. Returns 1 on failure.
+ *********************************************************************/
+
+static unsigned
+transfer(uint8_t bs,uint8_t stmin,unsigned length) {
+	static uint8_t out[ISOTP_MAX_LEN], in[ISOTP_MAX_LEN];
+	struct s_result txr = { -1, 0, 0, false }, rxr = { -1, 0, 0, false };
+	uint32_t t0, us;
+
+	setup(bs,stmin);
+	fill(out,length,stmin + bs + 1);
+	memset(in,0,sizeof in);
+	nodes[0].s.user = &txr;
+	nodes[1].s.user = &rxr;
+
+	t0 = now;
+	isotp_recv(&nodes[1].s,in,sizeof in,done);
+	isotp_send(&nodes[0].s,out,length,tx_done,now);
+	run(10000000u);
+	us = rxr.at - t0;
+
+	if ( !rxr.done || rxr.result != ISOTP_OK || rxr.length != length || memcmp(in,out,length) != 0 ) {
+		printf("  bs %3u stmin $%02X: FAILED (rx %s, result %d, %u bytes)\n",
+			bs,stmin,rxr.done ? "done" : "pending",rxr.result,rxr.length);
+		return 1;
+	}
+	printf("  bs %3u stmin $%02X (%5u us): %4u frames, %4u FC, %8u us, %6u B/s\n",
+		bs,stmin,(unsigned)isotp_stmin_us(stmin),nodes[0].frames,nodes[1].frames,
+		(unsigned)us,(unsigned)((uint64_t)length * 1000000u / us));
+	return 0;
+}
+
+/*********************************************************************
+ * Both directions at once
+ *********************************************************************/
+
+static unsigned
+duplex(uint8_t bs,uint8_t stmin) {
+	static uint8_t out[2][ISOTP_MAX_LEN], in[2][ISOTP_MAX_LEN];
+	struct s_result rxr[2];
+	uint32_t t0;
+	unsigned fails = 0;
+
+	setup(bs,stmin);
+	t0 = now;
+	for ( unsigned nx=0; nx<2; ++nx ) {
+		memset(&rxr[nx],0,sizeof rxr[nx]);
+		fill(out[nx],ISOTP_MAX_LEN,nx + 5);
+		nodes[nx].s.user = &rxr[nx];
+		isotp_recv(&nodes[nx].s,in[nx],ISOTP_MAX_LEN,done);
+	}
+	for ( unsigned nx=0; nx<2; ++nx )
+		isotp_send(&nodes[nx].s,out[nx],ISOTP_MAX_LEN,0,now);
+	run(10000000u);
+
+	for ( unsigned nx=0; nx<2; ++nx ) {
+		// Node nx received what the other node sent
+		bool ok = rxr[nx].done && rxr[nx].result == ISOTP_OK
+			&& memcmp(in[nx],out[nx^1],ISOTP_MAX_LEN) == 0;
+
+		printf("  duplex bs %u stmin $%02X, %s => %s: %8u us, %6u B/s %s\n",
+			bs,stmin,nodes[nx^1].name,nodes[nx].name,(unsigned)(rxr[nx].at - t0),
+			ok ? (unsigned)((uint64_t)ISOTP_MAX_LEN * 1000000u / (rxr[nx].at - t0)) : 0u,
+			ok ? "" : "FAILED");
+		fails += !ok;
+	}
+	return fails;
+}
+
+/*********************************************************************
+ * Error paths: each must end with the expected result
+ *********************************************************************/
+
+static unsigned
+expect(const char *what,int got,int want) {
+
+	printf("  %-32s %s (%d)\n",what,got == want ? "ok" : "FAILED",got);
+	return got != want;
+}
+
+static unsigned
+errors(void) {
+	static uint8_t out[ISOTP_MAX_LEN], in[ISOTP_MAX_LEN];
+	struct s_result txr, rxr;
+	unsigned fails = 0;
+
+	// Receiver buffer too small: FC overflow
+	setup(8,0);
+	memset(&txr,0,sizeof txr);
+	nodes[0].s.user = &txr;
+	isotp_recv(&nodes[1].s,in,100,done);
+	isotp_send(&nodes[0].s,out,200,tx_done,now);
+	run(10000000u);
+	fails += expect("overflow",txr.done ? txr.result : -1,ISOTP_OVERFLOW);
+
+	// A lost consecutive frame: the next is out of sequence
+	setup(8,0);
+	memset(&rxr,0,sizeof rxr);
+	nodes[1].s.user = &rxr;
+	drop_frame = 5;
+	isotp_recv(&nodes[1].s,in,sizeof in,done);
+	isotp_send(&nodes[0].s,out,500,0,now);
+	run(10000000u);
+	fails += expect("lost CF (sequence)",rxr.done ? rxr.result : -1,ISOTP_SEQUENCE);
+
+	// The last CF lost: receiver times out (N_Cr)
+	setup(0,0);
+	memset(&rxr,0,sizeof rxr);
+	nodes[1].s.user = &rxr;
+	drop_frame = 4;
+	isotp_recv(&nodes[1].s,in,sizeof in,done);
+	isotp_send(&nodes[0].s,out,20,0,now);
+	run(10000000u);
+	fails += expect("lost last CF (N_Cr)",rxr.done ? rxr.result : -1,ISOTP_TIMEOUT);
+
+	// FC lost: sender times out (N_Bs)
+	setup(8,0);
+	memset(&txr,0,sizeof txr);
+	nodes[0].s.user = &txr;
+	drop_frame = 2;
+	isotp_recv(&nodes[1].s,in,sizeof in,done);
+	isotp_send(&nodes[0].s,out,100,tx_done,now);
+	run(10000000u);
+	fails += expect("lost FC (N_Bs)",txr.done ? txr.result : -1,ISOTP_TIMEOUT);
+
+	// The sender gives up mid-message and starts over with an FF, or
+	// an SF: the old message is aborted, the new one received
+	for ( unsigned length=300; length>0; length = length > 7 ? 7 : 0 ) {
+		setup(0,0);
+		memset(&rxr,0,sizeof rxr);
+		nodes[1].s.user = &rxr;
+		aborts = 0;
+		isotp_recv(&nodes[1].s,in,sizeof in,restarted);
+		isotp_send(&nodes[0].s,out,500,0,now);
+		run(1000);				// FF, FC and some CFs
+		isotp_init(&nodes[0].s,ID_A,ID_B,false,xmit,&nodes[0]);
+		nodes[0].nmbox = 0;
+		fill(out,length,length);
+		isotp_send(&nodes[0].s,out,length,0,now);
+		if ( length > 7 ) {
+			run(1000);
+			fails += expect("re-arm after abort",isotp_recv(&nodes[1].s,in,sizeof in,restarted),ISOTP_OK);
+			fails += expect("other buffer after abort",isotp_recv(&nodes[1].s,out,sizeof out,restarted),ISOTP_BUSY);
+		}
+		run(10000000u);
+		fails += expect(length > 7 ? "FF mid-reception" : "SF mid-reception",
+			aborts == 1 && rxr.done && rxr.length == length && !memcmp(in,out,length) ? rxr.result : -1,ISOTP_OK);
+	}
+
+	// A single frame, then busy and bad lengths
+	setup(8,0);
+	memset(&rxr,0,sizeof rxr);
+	nodes[1].s.user = &rxr;
+	fill(out,7,9);
+	isotp_recv(&nodes[1].s,in,sizeof in,done);
+	isotp_send(&nodes[0].s,out,7,0,now);
+	run(10000000u);
+	fails += expect("single frame",rxr.done && rxr.length == 7 && !memcmp(in,out,7) ? rxr.result : -1,ISOTP_OK);
+	fails += expect("empty message",isotp_send(&nodes[0].s,out,0,0,now),ISOTP_BADLEN);
+	fails += expect("too long",isotp_send(&nodes[0].s,out,ISOTP_MAX_LEN+1,0,now),ISOTP_BADLEN);
+	isotp_send(&nodes[0].s,out,100,0,now);
+	fails += expect("send while sending",isotp_send(&nodes[0].s,out,100,0,now),ISOTP_BUSY);
+	return fails;
+}
+
+int
+main(int argc,char **argv) {
+	static const uint8_t stmins[] = { 0x00, 0xF5, 0x01, 0x02, 0x05, 0x0A };
+	static const uint8_t sizes[] = { 0, 8 };
+	unsigned fails = 0;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"b:vh")) != -1 ) {
+		switch ( optch ) {
+		case 'b':
+			bitrate = strtoul(optarg,0,10);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-b bitrate] [-v]\n",argv[0]);
+			return 2;
+		}
+	}
+	if ( bitrate < 10000 || bitrate > 1000000 ) {
+		fprintf(stderr,"Bit rate %u out of range\n",(unsigned)bitrate);
+		return 2;
+	}
+
+	printf("ISO-TP, %u bytes at %u bit/s, %u us per frame:\n",ISOTP_MAX_LEN,(unsigned)bitrate,
+		(unsigned)((frame_bits(false,false,8) * 1000000u + bitrate - 1) / bitrate));
+	for ( unsigned bx=0; bx<sizeof sizes; ++bx )
+		for ( unsigned sx=0; sx<sizeof stmins; ++sx )
+			fails += transfer(sizes[bx],stmins[sx],ISOTP_MAX_LEN);
+
+	printf("\nConcurrent sessions:\n");
+	fails += duplex(8,0);
+	fails += duplex(0,0xF5);
+
+	printf("\nError paths:\n");
+	fails += errors();
+
+	printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End isotpbench.c
@@ -0,0 +1,958 @@
+/* vcan.c -- Virtual bxCAN controllers on one bus
+ * Warren W. Gay VE3WWG
+ *
+ * Each node has the parts of the STM32F103 bxCAN that canmsgs.c
+ * uses: three TX mailboxes, two 3 deep RX FIFOs (locked, or the last
+ * frame overwritten on overrun), 14 filter banks, the error counters
+ * and the four interrupt lines, as in the reference manual. When the
+ * bus is idle, it goes to the lowest arbitration key among the nodes'
+ * pending mailboxes, and the frame takes its exactly stuffed length
+ * at the bus bit rate.
+ *
+ * A node more than 0.5% off the bus bit rate can't send (bit error,
+ * TEC + 8) nor receive (stuff error, REC + 1), and while it is error
+ * active its error flags destroy the other nodes' frames. A frame no
+ * other node acknowledges is an ACK error. TEC over 255 is bus-off,
+ * left 128 x 11 bit times after initialization mode is entered and
+ * left (or at once, with ABOM).
+ *
+ * Register writes through host_can_reg() are applied by vcan_sync(),
+ * by comparing the register with the value exposed: a write of that
+ * same value goes unseen.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libopencm3/stm32/can.h>
+#include <libopencm3/stm32/rcc.h>
+
+#include "hosted.h"
+#include "vcan.h"
+
+#define MBOXES		3
+#define FIFO_DEPTH	3
+#define BANKS		14
+#define REGS		(0x200 / 4)	// CAN1 registers up to the filters
+#define RATE_TOL	5		// Bit rate mismatch, per mille
+#define ERR_BITS	17		// Error flag, delimiter and IFS
+
+#define TSR_MB(mb)	(0x0Fu << (mb) * 8)	// RQCP, TXOK, ALST, TERR
+#define TSR_RQCP(mb)	(CAN_TSR_RQCP0 << (mb) * 8)
+#define TSR_TXOK(mb)	(CAN_TSR_TXOK0 << (mb) * 8)
+#define TSR_ALST(mb)	(CAN_TSR_ALST0 << (mb) * 8)
+#define TSR_TERR(mb)	(CAN_TSR_TERR0 << (mb) * 8)
+#define TSR_ABRQ(mb)	(CAN_TSR_ABRQ0 << (mb) * 8)
+#define TSR_TME(mb)	(CAN_TSR_TME0 << (mb))
+
+enum {
+	OK = 0,				// Frame sent
+	ERR_SENDER,			// Sender off the bus rate
+	ERR_FLAG,			// Destroyed by an off rate receiver
+	ERR_ACK				// Nobody acknowledged
+};
+
+struct s_frame {
+	uint32_t	ir, dtr, dlr, dhr;	// As CAN_TIxR etc.
+};
+
+struct s_bank {
+	uint32_t	fr1, fr2;
+	uint8_t		active : 1;
+	uint8_t		scale32 : 1;
+	uint8_t		list : 1;
+	uint8_t		fifo : 1;
+};
+
+struct s_vcan {
+	bool		present;		// Reset or initialized
+	bool		init;			// Initialization mode (INAK)
+	bool		boff;			// Bus-off
+	uint32_t	mcr, ier, btr;
+	uint32_t	msr;			// ERRI
+	uint32_t	tsr;			// RQCP, TXOK, ALST and TERR bits
+	uint32_t	rfr[2];			// FULL and FOVR bits
+	uint8_t		lec;
+	uint16_t	tec, rec;
+	uint8_t		flags;			// EWGF, EPVF and BOFF last noted
+	struct s_frame	mbox[MBOXES];
+	uint32_t	txseq[MBOXES];		// Request order (TXFP)
+	uint8_t		abrq;			// Aborts of the mailbox on the bus
+	int		txmb;			// Mailbox being sent, else -1
+	uint64_t	lb_end;			// End of a silent loopback frame
+	uint64_t	recover;		// End of bus-off recovery
+	struct s_frame	fifo[2][FIFO_DEPTH];
+	uint8_t		nfifo[2];
+	struct s_bank	bank[BANKS];
+	uint32_t	port[REGS];		// Register values as last exposed
+	struct s_vcan_node_stats stats;
+};
+
+static struct s_vcan vcan[HOST_NODES];
+static uint32_t txseq = 0;
+
+static struct {
+	uint32_t	bitrate;		// Nominal bus rate
+	int		sender;			// Node sending, else -1
+	uint8_t		outcome;
+	uint64_t	end;			// Bus free again
+	struct s_vcan_stats stats;
+} bus = { 500000, -1, OK, 0, { 0, 0, 0, 0 } };
+
+static struct {
+	bool		pending;		// A register was accessed
+	unsigned	node;
+	unsigned	reg;			// Register index
+	uint32_t	value;			// Value exposed
+} access;
+
+/*********************************************************************
+ * Bus bit rate, that the nodes must match
+ *********************************************************************/
+
+void
+vcan_bitrate(uint32_t bitrate) {
+	bus.bitrate = bitrate;
+}
+
+void
+vcan_stats(struct s_vcan_stats *stats) {
+	*stats = bus.stats;
+}
+
+void
+vcan_node_stats(unsigned node,struct s_vcan_node_stats *stats) {
+	*stats = vcan[node].stats;
+}
+
+/*********************************************************************
+ * Bits a frame takes on the bus: SOF to CRC with stuff bits (the CRC
+ * computed), then CRC delimiter, ACK, EOF and interframe space.
+ *********************************************************************/
+
+uint32_t
+vcan_frame_bits(uint32_t id,bool ext,bool rtr,uint8_t length,const uint8_t *data) {
+	uint8_t bits[160];
+	unsigned n = 0, run = 0, stuffed = 0, last = 2, crcnxt;
+	uint16_t crc = 0;
+
+	#define PUT(v,w) do { for ( int bx=(w)-1; bx>=0; --bx ) bits[n++] = ((v) >> bx) & 1; } while (0)
+
+	PUT(0,1);				// SOF
+	if ( ext ) {
+		PUT(id >> 18,11);
+		PUT(3,2);			// SRR, IDE
+		PUT(id & 0x3FFFF,18);
+		PUT(rtr,1);
+		PUT(0,2);			// r1, r0
+	} else	{
+		PUT(id,11);
+		PUT(rtr,1);
+		PUT(0,2);			// IDE, r0
+	}
+	PUT(length,4);
+	if ( !rtr )
+		for ( unsigned ux=0; ux<length && ux<8; ++ux )
+			PUT(data[ux],8);
+
+	for ( unsigned ux=0; ux<n; ++ux ) {
+		crcnxt = bits[ux] ^ (crc >> 14 & 1);
+		crc = crc << 1 & 0x7FFF;
+		if ( crcnxt )
+			crc ^= 0x4599;
+	}
+	PUT(crc,15);
+	#undef PUT
+
+	for ( unsigned ux=0; ux<n; ++ux ) {
+		if ( bits[ux] == last )
+			++run;
+		else	{
+			last = bits[ux];
+			run = 1;
+		}
+		if ( run == 5 ) {		// Stuff bit of opposite level
+			++stuffed;
+			last ^= 1;
+			run = 1;
+		}
+	}
+	return n + stuffed + 13;
+}
+
+/*********************************************************************
+ * Internal: Frame fields from the mailbox layout
+ *********************************************************************/
+
+static uint32_t
+frame_id(const struct s_frame *f) {
+	return f->ir & CAN_TIxR_IDE ? f->ir >> CAN_TIxR_EXID_SHIFT : f->ir >> CAN_TIxR_STID_SHIFT;
+}
+
+static uint32_t
+frame_bits(const struct s_frame *f) {
+	uint8_t data[8];
+
+	memcpy(data,&f->dlr,4);
+	memcpy(data+4,&f->dhr,4);
+	return vcan_frame_bits(frame_id(f),!!(f->ir & CAN_TIxR_IDE),!!(f->ir & CAN_TIxR_RTR),
+		f->dtr & CAN_RDTxR_DLC_MASK,data);
+}
+
+/*********************************************************************
+ * Internal: Arbitration key (lower wins): base ID, RTR or SRR, IDE,
+ * extended ID bits and RTR.
+ *********************************************************************/
+
+static uint32_t
+frame_key(const struct s_frame *f) {
+	uint32_t id = frame_id(f), rtr = !!(f->ir & CAN_TIxR_RTR);
+
+	if ( !(f->ir & CAN_TIxR_IDE) )
+		return (id & 0x7FF) << 21 | rtr << 20;
+	return (id & 0x1FFC0000) << 3 | 3 << 19 | (id & 0x3FFFF) << 1 | rtr;
+}
+
+/*********************************************************************
+ * Internal: Bit rate from CAN_BTR, and nanoseconds for bits
+ *********************************************************************/
+
+static uint32_t
+node_rate(const struct s_vcan *v) {
+	uint32_t brp = (v->btr & CAN_BTR_BRP_MASK) + 1;
+	uint32_t tq = 3 + (v->btr >> CAN_BTR_TS1_SHIFT & 0xF) + (v->btr >> CAN_BTR_TS2_SHIFT & 0x7);
+
+	return rcc_apb1_frequency / (brp * tq);
+}
+
+static uint64_t
+bit_ns(uint64_t bits,uint32_t bitrate) {
+	return (bits * 1000000000ull + bitrate / 2) / bitrate;
+}
+
+static bool
+matched(const struct s_vcan *v) {
+	uint32_t rate = node_rate(v);
+	uint32_t diff = rate > bus.bitrate ? rate - bus.bitrate : bus.bitrate - rate;
+
+	return (uint64_t)diff * 1000 <= (uint64_t)bus.bitrate * RATE_TOL;
+}
+
+/*********************************************************************
+ * Internal: Node states on the bus
+ *********************************************************************/
+
+static bool
+listening(const struct s_vcan *v) {			// Receives frames
+	return v->present && !v->init && !v->boff
+		&& (v->btr & (CAN_BTR_LBKM|CAN_BTR_SILM)) != (CAN_BTR_LBKM|CAN_BTR_SILM);
+}
+
+static bool
+driving(const struct s_vcan *v) {			// Sends, acks, flags
+	return listening(v) && !(v->btr & CAN_BTR_SILM);
+}
+
+static bool
+error_active(const struct s_vcan *v) {
+	return v->tec <= 127 && v->rec <= 127;
+}
+
+/*********************************************************************
+ * Internal: Note error counters and LEC (0 after a good frame),
+ * raising ERRI for the enabled conditions newly set
+ *********************************************************************/
+
+static void
+note(struct s_vcan *v,unsigned lec) {
+	uint8_t flags = 0, rise;
+
+	if ( v->tec >= 96 || v->rec >= 96 )
+		flags |= CAN_ESR_EWGF;
+	if ( v->tec > 127 || v->rec > 127 )
+		flags |= CAN_ESR_EPVF;
+	if ( v->boff )
+		flags |= CAN_ESR_BOFF;
+	rise = flags & ~v->flags;
+	v->flags = flags;
+	v->lec = lec;
+
+	if ( ((rise & CAN_ESR_EWGF) && (v->ier & CAN_IER_EWGIE))
+	  || ((rise & CAN_ESR_EPVF) && (v->ier & CAN_IER_EPVIE))
+	  || ((rise & CAN_ESR_BOFF) && (v->ier & CAN_IER_BOFIE))
+	  || (lec != 0 && (v->ier & CAN_IER_LECIE)) )
+		v->msr |= CAN_MSR_ERRI;
+}
+
+/*********************************************************************
+ * Internal: Initialization mode
+ *********************************************************************/
+
+static void
+enter_init(struct s_vcan *v) {
+	v->init = true;
+	v->recover = HOST_NEVER;
+}
+
+static void
+leave_init(struct s_vcan *v) {
+	v->init = false;
+	if ( v->boff && v->recover == HOST_NEVER )
+		v->recover = host_now_ns() + bit_ns(128 * 11,node_rate(v));
+}
+
+/*********************************************************************
+ * Internal: Reset values
+ *********************************************************************/
+
+static void
+reset(struct s_vcan *v) {
+	struct s_vcan_node_stats stats = v->stats;
+
+	memset(v,0,sizeof *v);
+	v->stats = stats;
+	v->present = true;
+	v->init = true;
+	v->mcr = CAN_MCR_DBF | CAN_MCR_SLEEP;
+	v->btr = 0x01230000;
+	v->txmb = -1;
+	v->recover = HOST_NEVER;
+}
+
+static struct s_vcan *
+node_can(uint32_t canport) {
+	struct s_vcan *v = &vcan[host_node()];
+
+	if ( canport != CAN1 ) {
+		fprintf(stderr,"vcan: only CAN1 is simulated\n");
+		abort();
+	}
+	vcan_sync();
+	if ( !v->present )
+		reset(v);
+	return v;
+}
+
+/*********************************************************************
+ * Internal: Mailbox completed (ok is TXOK)
+ *********************************************************************/
+
+static void
+tx_done(struct s_vcan *v,int mb,bool ok,uint32_t status) {
+
+	v->mbox[mb].ir &= ~CAN_TIxR_TXRQ;
+	v->tsr = (v->tsr & ~TSR_MB(mb)) | TSR_RQCP(mb) | (ok ? TSR_TXOK(mb) : 0) | status;
+	v->abrq &= ~(1 << mb);
+}
+
+static void
+tx_request(struct s_vcan *v,int mb) {
+
+	v->tsr &= ~TSR_MB(mb);				// TXRQ clears the status
+	v->txseq[mb] = ++txseq;
+}
+
+/*********************************************************************
+ * Internal: Mailbox to send next (priority by ID, or by request
+ * order with TXFP), else -1
+ *********************************************************************/
+
+static int
+next_mbox(const struct s_vcan *v) {
+	int best = -1;
+
+	for ( int mb=0; mb<MBOXES; ++mb ) {
+		if ( !(v->mbox[mb].ir & CAN_TIxR_TXRQ) )
+			continue;
+		if ( best < 0
+		  || ((v->mcr & CAN_MCR_TXFP) ? v->txseq[mb] < v->txseq[best]
+		    : frame_key(&v->mbox[mb]) < frame_key(&v->mbox[best])) )
+			best = mb;
+	}
+	return best;
+}
+
+/*********************************************************************
+ * Internal: Filter banks. The filter numbers (FMI) count every filter
+ * of the banks assigned to a FIFO, active or not. A 32 bit filter
+ * wins over a 16 bit one, a list over a mask, then the lowest number.
+ *********************************************************************/
+
+static bool
+filter(const struct s_vcan *v,uint32_t ir,unsigned *fifo,unsigned *fmi) {
+	uint32_t w32 = ir & ~1u, val, mask;
+	uint16_t w16 = (ir >> 21) << 5 | (ir & CAN_RIxR_RTR) << 3 | (ir & CAN_RIxR_IDE) << 1 | (ir >> 18 & 7);
+	unsigned nfmi[2] = { 0, 0 }, n, score, best = 0;
+
+	for ( unsigned bx=0; bx<BANKS; ++bx ) {
+		const struct s_bank *bk = &v->bank[bx];
+
+		n = bk->scale32 ? (bk->list ? 2 : 1) : (bk->list ? 4 : 2);
+		for ( unsigned ux=0; bk->active && ux<n; ++ux ) {
+			if ( bk->scale32 ) {
+				if ( bk->list ) {
+					val = ux ? bk->fr2 : bk->fr1;
+					mask = 0xFFFFFFFE;
+				} else	{
+					val = bk->fr1;
+					mask = bk->fr2;
+				}
+				if ( (w32 ^ val) & mask )
+					continue;
+			} else	{
+				if ( bk->list ) {
+					val = ((ux & 2) ? bk->fr2 : bk->fr1) >> (ux & 1) * 16 & 0xFFFF;
+					mask = 0xFFFF;
+				} else	{
+					val = (ux ? bk->fr2 : bk->fr1) & 0xFFFF;
+					mask = (ux ? bk->fr2 : bk->fr1) >> 16;
+				}
+				if ( (w16 ^ val) & mask )
+					continue;
+			}
+			score = 1 + bk->scale32 * 2 + bk->list;
+			if ( score > best ) {
+				best = score;
+				*fifo = bk->fifo;
+				*fmi = nfmi[bk->fifo] + ux;
+			}
+		}
+		nfmi[bk->fifo] += n;
+	}
+	return best > 0;
+}
+
+/*********************************************************************
+ * Internal: A good frame reaches node v's filters and FIFOs
+ *********************************************************************/
+
+static void
+deliver(struct s_vcan *v,const struct s_frame *f) {
+	struct s_frame rx = *f;
+	unsigned fifo, fmi;
+
+	if ( !filter(v,f->ir,&fifo,&fmi) ) {
+		++v->stats.rejected;
+		return;
+	}
+	++v->stats.accepted;
+	rx.ir &= ~CAN_TIxR_TXRQ;
+	rx.dtr = (f->dtr & CAN_RDTxR_DLC_MASK) | fmi << CAN_RDTxR_FMI_SHIFT
+		| (uint32_t)(host_now_ns() / 1000 & 0xFFFF) << 16;
+
+	if ( v->nfifo[fifo] >= FIFO_DEPTH ) {
+		++v->stats.lost[fifo];
+		if ( !(v->rfr[fifo] & CAN_RF0R_FOVR0) )
+			++v->stats.overruns[fifo];
+		v->rfr[fifo] |= CAN_RF0R_FOVR0;
+		if ( !(v->mcr & CAN_MCR_RFLM) )
+			v->fifo[fifo][FIFO_DEPTH-1] = rx;	// Last one overwritten
+		return;
+	}
+	v->fifo[fifo][v->nfifo[fifo]++] = rx;
+	if ( v->nfifo[fifo] == FIFO_DEPTH )
+		v->rfr[fifo] |= CAN_RF0R_FULL0;
+}
+
+/*********************************************************************
+ * Internal: Release the FIFO output mailbox
+ *********************************************************************/
+
+static void
+fifo_release(struct s_vcan *v,unsigned fifo) {
+
+	if ( v->nfifo[fifo] == 0 )
+		return;
+	memmove(&v->fifo[fifo][0],&v->fifo[fifo][1],sizeof v->fifo[fifo][0] * (FIFO_DEPTH - 1));
+	--v->nfifo[fifo];
+	v->rfr[fifo] &= ~CAN_RF0R_FULL0;
+}
+
+/*********************************************************************
+ * Internal: Abort request for a mailbox. One on the bus completes
+ * as its frame does (TXOK if it was sent).
+ *********************************************************************/
+
+static void
+tx_abort(struct s_vcan *v,int mb) {
+
+	if ( !(v->mbox[mb].ir & CAN_TIxR_TXRQ) )
+		return;
+	if ( v->txmb == mb )
+		v->abrq |= 1 << mb;		// Being sent
+	else	tx_done(v,mb,false,0);
+}
+
+/*********************************************************************
+ * Internal: Register value as the firmware reads it
+ *********************************************************************/
+
+static uint32_t
+reg_value(const struct s_vcan *v,unsigned off) {
+	uint32_t r;
+	int mb;
+
+	switch ( off ) {
+	case 0x000:
+		return v->mcr | (v->init ? CAN_MCR_INRQ : 0);
+	case 0x004:
+		return v->msr | CAN_MSR_RX | CAN_MSR_SAMP | (v->init ? CAN_MSR_INAK : 0);
+	case 0x008:
+		r = v->tsr;
+		for ( mb=MBOXES-1; mb>=0; --mb ) {
+			if ( v->abrq & 1 << mb )
+				r |= TSR_ABRQ(mb);
+			if ( !(v->mbox[mb].ir & CAN_TIxR_TXRQ) )
+				r = (r & ~CAN_TSR_CODE_MASK) | TSR_TME(mb) | (uint32_t)mb << CAN_TSR_CODE_SHIFT;
+		}
+		return r;
+	case 0x00C:
+	case 0x010:
+		return v->rfr[(off - 0x00C) / 4] | v->nfifo[(off - 0x00C) / 4];
+	case 0x014:
+		return v->ier;
+	case 0x018:
+		return (uint32_t)(v->rec > 255 ? 255 : v->rec) << 24 | (uint32_t)(v->tec > 255 ? 255 : v->tec) << 16
+			| (uint32_t)v->lec << CAN_ESR_LEC_SHIFT | v->flags;
+	case 0x01C:
+		return v->btr;
+	}
+
+	if ( off >= CAN_MBOX0 && off < CAN_FIFO0 ) {
+		const struct s_frame *f = &v->mbox[(off - CAN_MBOX0) / 16];
+
+		return (&f->ir)[off % 16 / 4];
+	}
+	if ( off >= CAN_FIFO0 && off < CAN_FIFO1 + 16 ) {
+		unsigned fifo = (off - CAN_FIFO0) / 16;
+
+		if ( v->nfifo[fifo] == 0 )
+			return 0;
+		return (&v->fifo[fifo][0].ir)[off % 16 / 4];
+	}
+	return 0;
+}
+
+/*********************************************************************
+ * Internal: Firmware wrote value to a register
+ *********************************************************************/
+
+static void
+reg_write(struct s_vcan *v,unsigned off,uint32_t value) {
+	int mb;
+
+	switch ( off ) {
+	case 0x000:
+		if ( value & CAN_MCR_RESET ) {
+			reset(v);
+			return;
+		}
+		v->mcr = value & ~(CAN_MCR_INRQ|CAN_MCR_RESET);
+		if ( (value & CAN_MCR_INRQ) && !v->init )
+			enter_init(v);
+		else if ( !(value & CAN_MCR_INRQ) && v->init )
+			leave_init(v);
+		return;
+	case 0x004:
+		v->msr &= ~(value & (CAN_MSR_ERRI|CAN_MSR_WKUI|CAN_MSR_SLAKI));
+		return;
+	case 0x008:
+		for ( mb=0; mb<MBOXES; ++mb ) {
+			if ( value & TSR_RQCP(mb) )
+				v->tsr &= ~TSR_MB(mb);
+			if ( value & TSR_ABRQ(mb) )
+				tx_abort(v,mb);
+		}
+		return;
+	case 0x00C:
+	case 0x010:
+		mb = (off - 0x00C) / 4;			// FIFO number
+		v->rfr[mb] &= ~(value & (CAN_RF0R_FOVR0|CAN_RF0R_FULL0));
+		if ( value & CAN_RF0R_RFOM0 )
+			fifo_release(v,mb);
+		return;
+	case 0x014:
+		v->ier = value;
+		return;
+	case 0x018:
+		v->lec = (value & CAN_ESR_LEC_MASK) >> CAN_ESR_LEC_SHIFT;
+		return;
+	case 0x01C:
+		if ( v->init )
+			v->btr = value;
+		return;
+	}
+
+	if ( off >= CAN_MBOX0 && off < CAN_FIFO0 ) {
+		struct s_frame *f = &v->mbox[mb = (off - CAN_MBOX0) / 16];
+
+		if ( f->ir & CAN_TIxR_TXRQ )
+			return;				// Pending: write protected
+		(&f->ir)[off % 16 / 4] = value;
+		if ( off % 16 == 0 && (value & CAN_TIxR_TXRQ) )
+			tx_request(v,mb);
+	}
+}
+
+/*********************************************************************
+ * A CAN register of the current node. A write through the pointer is
+ * applied at the next access, or vcan_sync().
+ *********************************************************************/
+
+volatile uint32_t *
+host_can_reg(uint32_t addr) {
+	unsigned off = addr - CAN1;
+	struct s_vcan *v;
+
+	if ( off >= REGS * 4 || (off & 3) ) {
+		fprintf(stderr,"vcan: register $%08X not simulated\n",(unsigned)addr);
+		abort();
+	}
+	v = node_can(CAN1);			// Syncs the last access
+	access.pending = true;
+	access.node = host_node();
+	access.reg = off / 4;
+	access.value = v->port[off / 4] = reg_value(v,off);
+	return &v->port[off / 4];
+}
+
+/*********************************************************************
+ * Apply a write to the register last accessed
+ *********************************************************************/
+
+void
+vcan_sync(void) {
+	struct s_vcan *v;
+
+	if ( !access.pending )
+		return;
+	access.pending = false;
+	v = &vcan[access.node];
+	if ( v->port[access.reg] != access.value )
+		reg_write(v,access.reg * 4,v->port[access.reg]);
+}
+
+/*********************************************************************
+ * Interrupt lines of a node (1 << VCAN_IRQ_x)
+ *********************************************************************/
+
+unsigned
+vcan_irqs(unsigned node) {
+	const struct s_vcan *v = &vcan[node];
+	unsigned irqs = 0;
+
+	vcan_sync();
+	if ( !v->present )
+		return 0;
+	if ( (v->ier & CAN_IER_TMEIE) && (v->tsr & (TSR_RQCP(0)|TSR_RQCP(1)|TSR_RQCP(2))) )
+		irqs |= 1 << VCAN_IRQ_TX;
+	for ( unsigned fifo=0; fifo<2; ++fifo ) {
+		uint32_t ier = v->ier >> fifo * 3;
+
+		if ( ((ier & CAN_IER_FMPIE0) && v->nfifo[fifo])
+		  || ((ier & CAN_IER_FFIE0) && (v->rfr[fifo] & CAN_RF0R_FULL0))
+		  || ((ier & CAN_IER_FOVIE0) && (v->rfr[fifo] & CAN_RF0R_FOVR0)) )
+			irqs |= 1 << (VCAN_IRQ_RX0 + fifo);
+	}
+	if ( (v->ier & CAN_IER_ERRIE) && (v->msr & CAN_MSR_ERRI) )
+		irqs |= 1 << VCAN_IRQ_SCE;
+	return irqs;
+}
+
+/*********************************************************************
+ * Internal: Error counting for a failed frame
+ *********************************************************************/
+
+static void
+tx_error(struct s_vcan *v,unsigned lec,bool count) {
+
+	if ( count )
+		v->tec += 8;
+	if ( v->tec > 255 && !v->boff ) {
+		v->boff = true;
+		v->tec = 255;
+		++v->stats.busoffs;
+		if ( v->mcr & CAN_MCR_ABOM )
+			v->recover = host_now_ns() + bit_ns(128 * 11,node_rate(v));
+	}
+	note(v,lec);
+}
+
+static void
+rx_error(struct s_vcan *v) {
+
+	if ( v->rec < 255 )
+		++v->rec;
+	note(v,CAN_ESR_LEC_STUFF_ERROR >> CAN_ESR_LEC_SHIFT);
+}
+
+/*********************************************************************
+ * Internal: The frame on the bus ends
+ *********************************************************************/
+
+static void
+complete(void) {
+	struct s_vcan *s = &vcan[bus.sender], *v;
+	int mb = s->txmb;
+	struct s_frame f = s->mbox[mb];
+
+	s->txmb = -1;
+	bus.sender = -1;
+
+	if ( bus.outcome == OK ) {
+		++bus.stats.frames;
+		++s->stats.sent;
+		if ( s->tec > 0 )
+			--s->tec;
+		tx_done(s,mb,true,0);
+		note(s,0);
+		for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+			v = &vcan[nx];
+			if ( v == s || !listening(v) )
+				continue;
+			if ( !matched(v) ) {
+				rx_error(v);
+				continue;
+			}
+			if ( v->rec > 127 )
+				v->rec = 120;
+			else if ( v->rec > 0 )
+				--v->rec;
+			note(v,0);
+			deliver(v,&f);
+		}
+		if ( s->btr & CAN_BTR_LBKM )
+			deliver(s,&f);
+		return;
+	}
+
+	++bus.stats.errors;
+	if ( bus.outcome == ERR_ACK ) {
+		++bus.stats.acks;
+		tx_error(s,CAN_ESR_LEC_ACK_ERROR >> CAN_ESR_LEC_SHIFT,error_active(s));
+	} else	{
+		tx_error(s,(bus.outcome == ERR_SENDER ? CAN_ESR_LEC_DOM_ERROR : CAN_ESR_LEC_REC_ERROR)
+			>> CAN_ESR_LEC_SHIFT,true);
+		for ( unsigned nx=0; nx<HOST_NODES; ++nx )
+			if ( &vcan[nx] != s && listening(&vcan[nx]) )
+				rx_error(&vcan[nx]);
+	}
+	if ( s->mcr & CAN_MCR_NART )
+		tx_done(s,mb,false,TSR_TERR(mb));
+	else if ( s->abrq & 1 << mb )
+		tx_done(s,mb,false,0);
+}
+
+/*********************************************************************
+ * Complete what is due at now: bus-off recoveries, silent loopback
+ * frames and the frame on the bus
+ *********************************************************************/
+
+void
+vcan_step(uint64_t now) {
+	struct s_vcan *v;
+
+	vcan_sync();
+	for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+		v = &vcan[nx];
+		if ( !v->present )
+			continue;
+		if ( v->recover <= now ) {
+			v->recover = HOST_NEVER;
+			v->boff = false;
+			v->tec = v->rec = 0;
+			note(v,0);
+		}
+		if ( !v->init && v->txmb >= 0 && v->lb_end <= now
+		  && (v->btr & (CAN_BTR_LBKM|CAN_BTR_SILM)) == (CAN_BTR_LBKM|CAN_BTR_SILM) ) {
+			struct s_frame f = v->mbox[v->txmb];
+
+			++v->stats.sent;
+			tx_done(v,v->txmb,true,0);
+			v->txmb = -1;
+			deliver(v,&f);
+		}
+	}
+
+	if ( bus.sender >= 0 && bus.end <= now )
+		complete();
+}
+
+/*********************************************************************
+ * Start frames at now: silent loopback nodes each on their own, and
+ * the bus (when idle) by arbitration among the other nodes
+ *********************************************************************/
+
+void
+vcan_start(uint64_t now) {
+	struct s_vcan *v, *s;
+	uint32_t key, bestkey = 0, bits;
+	int best = -1, mb;
+	bool acked = false, flagged = false;
+
+	vcan_sync();
+	for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+		v = &vcan[nx];
+		if ( !v->present || v->init || v->txmb >= 0
+		  || (v->btr & (CAN_BTR_LBKM|CAN_BTR_SILM)) != (CAN_BTR_LBKM|CAN_BTR_SILM) )
+			continue;
+		if ( (mb = next_mbox(v)) >= 0 ) {
+			v->txmb = mb;
+			++v->stats.attempts;
+			v->lb_end = now + bit_ns(frame_bits(&v->mbox[mb]),node_rate(v));
+		}
+	}
+
+	if ( bus.sender >= 0 || bus.end > now )
+		return;
+
+	for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+		v = &vcan[nx];
+		if ( !driving(v) || (mb = next_mbox(v)) < 0 )
+			continue;
+		key = frame_key(&v->mbox[mb]);
+		if ( best < 0 || key < bestkey ) {
+			best = nx;
+			bestkey = key;
+		}
+	}
+	if ( best < 0 )
+		return;
+
+	// Losers without automatic retransmission give up
+	for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+		v = &vcan[nx];
+		if ( (int)nx != best && driving(v) && (v->mcr & CAN_MCR_NART) && (mb = next_mbox(v)) >= 0 )
+			tx_done(v,mb,false,TSR_ALST(mb));
+	}
+
+	s = &vcan[best];
+	s->txmb = next_mbox(s);
+	++s->stats.attempts;
+	bits = frame_bits(&s->mbox[s->txmb]);
+
+	for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+		v = &vcan[nx];
+		if ( (int)nx == best || !driving(v) )
+			continue;
+		if ( matched(v) )
+			acked = true;
+		else if ( error_active(v) )
+			flagged = true;
+	}
+
+	if ( !matched(s) ) {
+		bus.outcome = ERR_SENDER;
+		bits = bits / 2 + ERR_BITS;
+	} else if ( flagged ) {
+		bus.outcome = ERR_FLAG;
+		bits = bits / 2 + ERR_BITS;
+	} else if ( !acked && !(s->btr & CAN_BTR_LBKM) ) {
+		bus.outcome = ERR_ACK;
+		bits += ERR_BITS - 12;		// Error flag after the ACK slot
+	} else	bus.outcome = OK;
+
+	bus.sender = best;
+	bus.end = now + bit_ns(bits,bus.bitrate);
+	bus.stats.busy_ns += bus.end - now;
+}
+
+/*********************************************************************
+ * Time of the next bus event, or HOST_NEVER
+ *********************************************************************/
+
+uint64_t
+vcan_next(void) {
+	uint64_t next = HOST_NEVER;
+
+	if ( bus.sender >= 0 )
+		next = bus.end;
+	for ( unsigned nx=0; nx<HOST_NODES; ++nx ) {
+		const struct s_vcan *v = &vcan[nx];
+
+		if ( !v->present )
+			continue;
+		if ( v->recover < next )
+			next = v->recover;
+		if ( v->txmb >= 0 && v->lb_end < next
+		  && (v->btr & (CAN_BTR_LBKM|CAN_BTR_SILM)) == (CAN_BTR_LBKM|CAN_BTR_SILM) )
+			next = v->lb_end;
+	}
+	return next;
+}
+
+/*********************************************************************
+ * libopencm3 CAN calls
+ *********************************************************************/
+
+void
+can_reset(uint32_t canport) {
+	struct s_vcan *v = node_can(canport);
+
+	if ( bus.sender == (int)host_node() )
+		bus.sender = -1;		// Frame cut off
+	reset(v);
+}
+
+int
+can_init(uint32_t canport,bool ttcm,bool abom,bool awum,bool nart,bool rflm,bool txfp,
+  uint32_t sjw,uint32_t ts1,uint32_t ts2,uint32_t brp,bool loopback,bool silent) {
+	struct s_vcan *v = node_can(canport);
+
+	enter_init(v);
+	v->mcr = (ttcm ? CAN_MCR_TTCM : 0) | (abom ? CAN_MCR_ABOM : 0) | (awum ? CAN_MCR_AWUM : 0)
+		| (nart ? CAN_MCR_NART : 0) | (rflm ? CAN_MCR_RFLM : 0) | (txfp ? CAN_MCR_TXFP : 0);
+	v->btr = sjw | ts1 | ts2 | ((brp - 1) & CAN_BTR_BRP_MASK)
+		| (loopback ? CAN_BTR_LBKM : 0) | (silent ? CAN_BTR_SILM : 0);
+	leave_init(v);
+	return 0;
+}
+
+void
+can_filter_init(uint32_t nr,bool scale_32bit,bool id_list_mode,uint32_t fr1,uint32_t fr2,
+  uint32_t fifo,bool enable) {
+	struct s_vcan *v = node_can(CAN1);
+	struct s_bank *bk = &v->bank[nr % BANKS];
+
+	bk->fr1 = fr1;
+	bk->fr2 = fr2;
+	bk->scale32 = scale_32bit;
+	bk->list = id_list_mode;
+	bk->fifo = fifo & 1;
+	bk->active = enable;
+}
+
+void
+can_enable_irq(uint32_t canport,uint32_t irq) {
+	node_can(canport)->ier |= irq;
+}
+
+void
+can_disable_irq(uint32_t canport,uint32_t irq) {
+	node_can(canport)->ier &= ~irq;
+}
+
+int
+can_transmit(uint32_t canport,uint32_t id,bool ext,bool rtr,uint8_t length,uint8_t *data) {
+	struct s_vcan *v = node_can(canport);
+	struct s_frame *f;
+	uint8_t buf[8];
+
+	for ( int mb=0; mb<MBOXES; ++mb ) {
+		f = &v->mbox[mb];
+		if ( f->ir & CAN_TIxR_TXRQ )
+			continue;
+		memset(buf,0,sizeof buf);
+		memcpy(buf,data,length > 8 ? 8 : length);
+		f->ir = (ext ? id << CAN_TIxR_EXID_SHIFT | CAN_TIxR_IDE : id << CAN_TIxR_STID_SHIFT)
+			| (rtr ? CAN_TIxR_RTR : 0) | CAN_TIxR_TXRQ;
+		f->dtr = length & CAN_RDTxR_DLC_MASK;
+		memcpy(&f->dlr,buf,4);
+		memcpy(&f->dhr,buf+4,4);
+		tx_request(v,mb);
+		return mb;
+	}
+	return -1;
+}
+
+// End vcan.c
@@ -0,0 +1,46 @@
+/* vcan.h -- Virtual bxCAN controllers on one bus
+ * Warren W. Gay VE3WWG
+ */
+#ifndef VCAN_H
+#define VCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VCAN_IRQ_TX	0		// USB_HP_CAN_TX
+#define VCAN_IRQ_RX0	1		// USB_LP_CAN_RX0
+#define VCAN_IRQ_RX1	2		// CAN_RX1
+#define VCAN_IRQ_SCE	3		// CAN_SCE
+
+struct s_vcan_stats {
+	uint32_t	frames;		// Frames sent without error
+	uint32_t	errors;		// Frames ended by an error
+	uint32_t	acks;		// ..of which no one acknowledged
+	uint64_t	busy_ns;	// Bus time used (frames and errors)
+};
+
+struct s_vcan_node_stats {
+	uint32_t	sent;		// Frames sent (TXOK)
+	uint32_t	attempts;	// Frames started on the bus
+	uint32_t	accepted;	// Frames passed by the filters
+	uint32_t	rejected;	// Frames stopped by the filters
+	uint32_t	lost[2];	// Frames lost to FIFO overrun
+	uint32_t	overruns[2];	// FOVR settings (overrun events)
+	uint32_t	busoffs;	// Entries into bus-off
+};
+
+void vcan_bitrate(uint32_t bitrate);
+void vcan_stats(struct s_vcan_stats *stats);
+void vcan_node_stats(unsigned node,struct s_vcan_node_stats *stats);
+uint32_t vcan_frame_bits(uint32_t id,bool ext,bool rtr,uint8_t length,const uint8_t *data);
+
+// For hostrtos.c:
+void vcan_step(uint64_t now);
+void vcan_start(uint64_t now);
+uint64_t vcan_next(void);
+unsigned vcan_irqs(unsigned node);
+void vcan_sync(void);
+
+#endif // VCAN_H
+
+// End vcan.h
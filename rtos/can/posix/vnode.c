@@ -0,0 +1,28 @@
+/* vnode.c -- A virtual node's entry points, for the bench
+ * Warren W. Gay VE3WWG
+ *
+ * Compiled once per node (see vnode.h).
+ */
+#include <libopencm3/stm32/f1/nvic.h>
+
+#include "vnodeapi.h"
+
+const struct s_vnode_api VN_NAME(api) = {
+	initialize_can,
+	can_filter_layout,
+	can_rx_stats,
+	can_xmit,
+	can_xmit_wait,
+	can_tx_stats,
+	can_set_bitrate,
+	can_bus_policy,
+	can_bus_stats,
+	isotp_can_init,
+	isotp_can_session,
+	isotp_can_rx,
+	isotp_can_send,
+	isotp_can_recv,
+	{ usb_hp_can_tx_isr, usb_lp_can_rx0_isr, can_rx1_isr, can_sce_isr }
+};
+
+// End vnode.c
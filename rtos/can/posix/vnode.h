@@ -0,0 +1,45 @@
+/* vnode.h -- Per node names for the virtual CAN bench
+ * Warren W. Gay VE3WWG
+ *
+ * canmsgs.c, isotpcan.c, vnode.c and the firmware (front.c, rear.c)
+ * are compiled once per node, with -DVNODE=n -include vnode.h, so
+ * that each node has its own static state. Their external names get
+ * the prefix vn<n>_ here. The bench reaches a node's copy through
+ * vn<n>_api (vnodeapi.h), and runs firmware from vn<n>_main().
+ */
+#ifndef VNODE_H
+#define VNODE_H
+
+#define VN_PASTE(n,name)	vn ## n ## _ ## name
+#define VN_NAME2(n,name)	VN_PASTE(n,name)
+#define VN_NAME(name)		VN_NAME2(VNODE,name)
+
+#define initialize_can		VN_NAME(initialize_can)
+#define can_filter_layout	VN_NAME(can_filter_layout)
+#define can_rx_stats		VN_NAME(can_rx_stats)
+#define can_xmit		VN_NAME(can_xmit)
+#define can_xmit_wait		VN_NAME(can_xmit_wait)
+#define can_xmit_isr		VN_NAME(can_xmit_isr)
+#define can_tx_hook		VN_NAME(can_tx_hook)
+#define can_tx_stats		VN_NAME(can_tx_stats)
+#define can_configure		VN_NAME(can_configure)
+#define can_set_bitrate		VN_NAME(can_set_bitrate)
+#define can_bus_policy		VN_NAME(can_bus_policy)
+#define can_bus_stats		VN_NAME(can_bus_stats)
+#define usb_hp_can_tx_isr	VN_NAME(usb_hp_can_tx_isr)
+#define usb_lp_can_rx0_isr	VN_NAME(usb_lp_can_rx0_isr)
+#define can_rx1_isr		VN_NAME(can_rx1_isr)
+#define can_sce_isr		VN_NAME(can_sce_isr)
+
+#define isotp_can_init		VN_NAME(isotp_can_init)
+#define isotp_can_session	VN_NAME(isotp_can_session)
+#define isotp_can_rx		VN_NAME(isotp_can_rx)
+#define isotp_can_send		VN_NAME(isotp_can_send)
+#define isotp_can_recv		VN_NAME(isotp_can_recv)
+#define isotp_can_now		VN_NAME(isotp_can_now)
+
+#define main			VN_NAME(main)
+
+#endif // VNODE_H
+
+// End vnode.h
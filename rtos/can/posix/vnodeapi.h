@@ -0,0 +1,36 @@
+/* vnodeapi.h -- A virtual node's copy of canmsgs.c and isotpcan.c
+ * Warren W. Gay VE3WWG
+ */
+#ifndef VNODEAPI_H
+#define VNODEAPI_H
+
+#include "canmsgs.h"
+#include "isotpcan.h"
+
+struct s_vnode_api {
+	void (*init)(bool nart,bool locked,bool altcfg,uint32_t bitrate,
+		const struct s_canfilt_rule *rules,const can_handler_t *handlers,unsigned nrules);
+	const struct s_canfilt *(*filters)(void);
+	void (*rx_stats)(struct s_canrx_stats *stats,bool reset);
+	void (*xmit)(uint32_t id,bool ext,bool rtr,uint8_t length,void *data);
+	bool (*xmit_wait)(uint32_t id,bool ext,bool rtr,uint8_t length,const void *data,TickType_t ticks);
+	void (*tx_stats)(struct s_cantx_stats *stats,bool reset);
+	bool (*set_bitrate)(uint32_t bitrate,bool loopback,struct s_cantiming *timing);
+	void (*bus_policy)(const struct s_canbus_policy *policy);
+	void (*bus_stats)(struct s_canbus_stats *stats,bool reset);
+	void (*tp_init)(void);
+	bool (*tp_session)(struct s_isotp *s,uint32_t tx_id,uint32_t rx_id,bool ext);
+	void (*tp_rx)(struct s_canmsg *msg);
+	int (*tp_send)(struct s_isotp *s,const void *data,unsigned length,isotp_done_t done);
+	int (*tp_recv)(struct s_isotp *s,void *buf,unsigned size,isotp_done_t done);
+	void (*isr[4])(void);		// TX, RX0, RX1, SCE (VCAN_IRQ_x)
+};
+
+extern const struct s_vnode_api vn0_api, vn1_api, vn2_api, vn3_api;
+
+int vn1_main(void);			// front.c
+int vn2_main(void);			// rear.c
+
+#endif // VNODEAPI_H
+
+// End vnodeapi.h
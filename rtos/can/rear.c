@@ -24,6 +24,7 @@
 #include "mcuio.h"
 #include "miniprintf.h"
 #include "canmsgs.h"
+#include "isotpcan.h"
 
 #define GPIO_PORT_LED		GPIOC		// Builtin LED port
 #define GPIO_LED		GPIO13		// Builtin LED
@@ -34,6 +35,9 @@
 #define LAMP_PARK		GPIO12		// Parking lights
 
 static volatile struct s_lamp_status lamp_status = { 0, 0, 0, 0, 0, 0 };
+static struct s_isotp tp;			// ISO-TP echo session
+static uint8_t tpbuf[1024];
+static TaskHandle_t echo_handle;
 
 /*********************************************************************
  * Turn the given lamp(s) on/off
@@ -114,40 +118,57 @@ degrees_C100(void) {
 }
 
 /*********************************************************************
- * CAN Receive Callback
+ * CAN Receive Handlers
  *********************************************************************/
-void
-can_recv(struct s_canmsg *msg) {
+static void
+lamp_rx(struct s_canmsg *msg) {
 	union u_msg {
 		struct s_lamp_en	lamp;
 	} *msgp = (union u_msg *)msg->data;
+
+	gpio_toggle(GPIO_PORT_LED,GPIO_LED);
+	lamp_enable((enum MsgID)msg->msgid,msgp->lamp.enable);
+}
+
+static void
+temp_request(struct s_canmsg *msg __attribute((unused))) {
 	struct s_temp100 temp_msg;
 
 	gpio_toggle(GPIO_PORT_LED,GPIO_LED);
+	temp_msg.celciusx100 = degrees_C100();
+	can_xmit(ID_Temp,false,false,sizeof temp_msg,&temp_msg);
+}
 
-	if ( !msg->rtrf ) {
-		// Received commands:
-		switch ( msg->msgid ) {
-		case ID_LeftEn:
-		case ID_RightEn:
-		case ID_ParkEn:
-		case ID_BrakeEn:
-		case ID_Flash:
-			lamp_enable((enum MsgID)msg->msgid,msgp->lamp.enable);
-			break;
-		default:
-			break;
-		}
-	} else	{
-		// Requests:
-		switch ( msg->msgid ) {
-		case ID_Temp:
-			temp_msg.celciusx100 = degrees_C100();
-			can_xmit(ID_Temp,false,false,sizeof temp_msg,&temp_msg);
-			break;
-		default:
-			break;
-		}
+static const struct s_canfilt_rule can_rules[] = {
+	{ ID_LeftEn, ID_Flash, 0, CANF_DATA, 0 },	// Lamp commands
+	{ ID_Temp, ID_Temp, 0, CANF_RTR, 1 },		// Temperature requests
+	{ ID_IsotpMain, ID_IsotpMain, 0, CANF_DATA, 1 }, // ISO-TP from main
+};
+
+static const can_handler_t can_handlers[] = {
+	lamp_rx,
+	temp_request,
+	isotp_can_rx,
+};
+
+/*********************************************************************
+ * ISO-TP echo: send each message received back to main
+ *********************************************************************/
+static void
+tp_done(struct s_isotp *s __attribute((unused)),int result,unsigned length) {
+
+	xTaskNotify(echo_handle,result == ISOTP_OK ? length : 0,eSetValueWithOverwrite);
+}
+
+static void
+echo_task(void *arg __attribute((unused))) {
+	uint32_t length;
+
+	for (;;) {
+		isotp_can_recv(&tp,tpbuf,sizeof tpbuf,tp_done);
+		xTaskNotifyWait(0,0,&length,portMAX_DELAY);
+		if ( length > 0 && isotp_can_send(&tp,tpbuf,length,tp_done) == ISOTP_OK )
+			xTaskNotifyWait(0,0,&length,portMAX_DELAY);
 	}
 }
 
@@ -188,10 +209,15 @@ main(void) {
 	gpio_clear(GPIO_PORT_LED,GPIO_LED);
 
 	// Initialize CAN
-	initialize_can(false,true,false);		// !nart, locked, altcfg=false PA11/PA12
+	initialize_can(false,true,false,CAN_BITRATE,	// !nart, locked, altcfg=false PA11/PA12
+		can_rules,can_handlers,sizeof can_rules/sizeof can_rules[0]);
 
 	xTaskCreate(controller_task,"rear",300,NULL,configMAX_PRIORITIES-1,NULL);
 
+	isotp_can_session(&tp,ID_IsotpRear,ID_IsotpMain,false);
+	isotp_can_init();
+	xTaskCreate(echo_task,"echo",200,NULL,configMAX_PRIORITIES-1,&echo_handle);
+
 	// Initialize ADC:
 	rcc_peripheral_enable_clock(&RCC_APB2ENR,RCC_APB2ENR_ADC1EN);
 	adc_power_off(ADC1);
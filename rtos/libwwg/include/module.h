@@ -0,0 +1,91 @@
+/* module.h -- Loadable modules from W25Qxx flash
+ * Warren W. Gay VE3WWG
+ */
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * A module is linked separately, at address 0, by module.ld and then
+ * converted by posix/mkmod. In SPI flash it is stored as:
+ *
+ *	struct s_modhdr
+ *	Import names	nimports NUL terminated strings
+ *	Image		size bytes of code and data, padded to 4
+ *	Relocations	nrelocs uint16_t word indexes into the image:
+ *			the load address is added to each word
+ *	Import relocs	nimprelocs pairs of uint16_t (word index,
+ *			import #): the import's address is added
+ *
+ * followed by bss bytes of zeroed RAM. The image is at most 256K, so
+ * that a word index fits 16 bits.
+ *********************************************************************/
+
+#define MODULE_MAGIC	0x444F4D57	// "WMOD"
+#define MODULE_MAXNAME	48		// Longest import name + 1
+
+struct s_modhdr {
+	uint32_t	magic;		// MODULE_MAGIC
+	uint32_t	size;		// Image bytes
+	uint32_t	bss;		// Zeroed bytes following the image
+	uint32_t	entry;		// Entry point offset (Thumb bit set)
+	uint16_t	nrelocs;	// Local relocations
+	uint16_t	nimprelocs;	// Relocations against imports
+	uint16_t	nimports;	// Import names
+	uint16_t	namebytes;	// Bytes of import names
+	uint32_t	crc;		// ovlz_crc32() of the image as stored
+};
+
+/*********************************************************************
+ * The exported symbol table, supplied by the application:
+ *
+ *	static const struct s_modexport exports[] = {
+ *		MODULE_EXPORT(std_printf),
+ *		MODULE_EXPORT(w25_read_data),
+ *		...
+ *	};
+ *********************************************************************/
+
+struct s_modexport {
+	const char	*name;
+	const void	*addr;
+};
+
+#define MODULE_EXPORT(sym)	{ #sym, (const void *)&(sym) }
+
+/*********************************************************************
+ * A loaded module (the caller provides the storage)
+ *********************************************************************/
+
+struct s_module {
+	struct s_module	*next;		// Next loaded module, by address
+	char		*base;		// Load address in the arena
+	uint32_t	size;		// Arena bytes used (image + bss)
+	uint32_t	addr;		// SPI flash address loaded from
+	void		*entry;		// Entry point
+	char		missing[MODULE_MAXNAME];	// Unresolved import (MODERR_IMPORT)
+};
+
+#define MODERR_FORMAT	(-1)		// Not a module, or a bad table
+#define MODERR_NOMEM	(-2)		// Does not fit in the arena
+#define MODERR_IMPORT	(-3)		// Import not exported (see missing)
+#define MODERR_CRC	(-4)		// Image fails its CRC
+
+void module_init(uint32_t spi,void *arena,uint32_t size,const struct s_modexport *exports,unsigned nexports);
+int module_load(uint32_t addr,struct s_module *mod);
+void module_unload(struct s_module *mod);
+const struct s_modexport *module_export(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODULE_H
+
+// End module.h
@@ -0,0 +1,139 @@
+/* overlay.h -- Overlay manager for code loaded from W25Qxx flash
+ * Warren W. Gay VE3WWG
+ */
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * An overlay region is an area of RAM that overlays are loaded into.
+ *********************************************************************/
+
+struct s_overlay;
+
+struct s_ovregion {
+	char		*vma;		// Region's RAM address
+	uint32_t	size;		// Region size in bytes
+	struct s_overlay *cur;		// Resident overlay, else null
+	uint32_t	loads;		// Times this region was (re)loaded
+	uint32_t	restores;	// Overlay kept from before a reset
+	uint32_t	corrupt;	// Stray writes found by overlay_verify()
+};
+
+/*********************************************************************
+ * Overlay table entry. "regions" is a bit mask of the regions the
+ * overlay may be loaded into. Code linked for a fixed address must
+ * name only the region it was linked for; position independent code
+ * may name several, and the least recently used one is evicted.
+ *********************************************************************/
+
+struct s_overlay {
+	char		*start;		// Load start address (in SPI flash)
+	char		*stop;		// Load stop address
+	char		*vma;		// Linked (mapped) address
+	void		*func;		// Function's linked address
+	uint32_t	regions;	// Bit mask of permitted regions
+	uint32_t	size;		// Size in bytes
+	void		*entry;		// Function address when resident, else null
+	struct s_ovregion *region;	// Region occupied, else null
+	uint32_t	lru;		// Last use stamp
+	uint16_t	pins;		// > 0 when not to be evicted
+	uint32_t	loads;		// Times read from SPI flash
+	uint32_t	hits;		// Calls that found it resident
+	uint32_t	prefetches;	// Loads started by overlay_prefetch()
+	uint32_t	stall;		// CPU cycles spent waiting in overlay_load()
+};
+
+#define OVERLAY_REGION(vma,size)	{ (char*)&(vma), (size), 0, 0, 0, 0 }
+#define OVERLAY_LOADREF(sym)		__load_start_ ## sym, __load_stop_ ## sym
+#define OVERLAY(regions,vma,sym) \
+	{ &__load_start_ ## sym, &__load_stop_ ## sym, (char*)&(vma), (void*)(sym), \
+	  (regions), 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+
+/*********************************************************************
+ * Residency record, one per region, kept in .noinit RAM so that a
+ * region's contents can be trusted again after a warm reset. The
+ * linker script must place .noinit in RAM outside of .bss.
+ *********************************************************************/
+
+#define OVERLAY_MAXREGIONS	8
+#define OVERLAY_RESMAGIC	0x4F564C59	// "OVLY"
+
+struct s_ovresid {
+	uint32_t	magic;		// OVERLAY_RESMAGIC when valid
+	uint32_t	build;		// Build hash given to overlay_init()
+	uint32_t	index;		// Overlay table index
+	uint32_t	size;		// Bytes loaded
+	uint32_t	crc;		// ovlz_crc32() of the loaded bytes
+};
+
+extern uint32_t overlay_clock;		// LRU clock
+
+bool overlay_init(uint32_t spi,struct s_ovregion *regions,unsigned nregions,struct s_overlay *overlays,unsigned novls,uint32_t build);
+unsigned overlay_verify(void);
+struct s_overlay *overlay_find(const void *start);
+void *overlay_load(struct s_overlay *ov);
+bool overlay_prefetch(const void *start);
+void overlay_prefetch_wait(void);
+void overlay_pin(struct s_overlay *ov);
+void overlay_unpin(struct s_overlay *ov);
+void overlay_fault(struct s_overlay *ov);
+
+/*********************************************************************
+ * Stub fast path: one compare when the overlay is already resident.
+ * The overlay stays pinned until overlay_leave(), so that overlays
+ * it calls cannot evict it while it is on the call stack.
+ *********************************************************************/
+
+static inline void *
+overlay_enter(struct s_overlay *ov) {
+	void *entry = ov->entry;
+
+	if ( !entry )
+		entry = overlay_load(ov);
+	else	++ov->hits;
+	++ov->pins;
+	ov->lru = ++overlay_clock;
+	return entry;
+}
+
+static inline void
+overlay_leave(struct s_overlay *ov) {
+	--ov->pins;
+}
+
+/*********************************************************************
+ * Define name_stub() to call overlay function name() through ov:
+ *
+ *	OVERLAY_STUB(int,fee,&overlays[0],(int arg),(arg))
+ *	OVERLAY_VSTUB(show,&overlays[1],(const char *msg),(msg))
+ *********************************************************************/
+
+#define OVERLAY_STUB(type,name,ov,params,args) \
+	type name ## _stub params { \
+		type (*fp)params = (type (*)params)overlay_enter(ov); \
+		type r = fp args; \
+		overlay_leave(ov); \
+		return r; \
+	}
+
+#define OVERLAY_VSTUB(name,ov,params,args) \
+	void name ## _stub params { \
+		void (*fp)params = (void (*)params)overlay_enter(ov); \
+		fp args; \
+		overlay_leave(ov); \
+	}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OVERLAY_H
+
+// End overlay.h
@@ -0,0 +1,56 @@
+/* ovlz.h -- Compressed overlay images in SPI flash
+ * Warren W. Gay VE3WWG
+ */
+#ifndef OVLZ_H
+#define OVLZ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+ * A compressed image starts with this header, followed by LZSS data:
+ *
+ *	A flag byte precedes each group of 8 items, LSB first. A 1 bit
+ *	is a literal byte. A 0 bit is a 2 byte match, copied from the
+ *	output already produced:
+ *
+ *		byte 0:	distance-1, bits 7..0
+ *		byte 1:	distance-1, bits 11..8 << 4 | (length-3)
+ *
+ *	Distance is 1..4096 and length is 3..18.
+ *
+ * Since matches refer to the output, the decoder needs no window
+ * buffer: it decompresses straight into the overlay region.
+ *
+ * An image that does not start with OVLZ_MAGIC is stored raw. The
+ * magic is two permanently undefined Thumb instructions (udf #254),
+ * so it cannot begin real code.
+ *********************************************************************/
+
+#define OVLZ_MAGIC	0xDEFEDEFE
+#define OVLZ_MINMATCH	3
+#define OVLZ_MAXMATCH	(OVLZ_MINMATCH + 15)
+#define OVLZ_WINDOW	4096
+
+struct s_ovlzhdr {
+	uint32_t	magic;		// OVLZ_MAGIC
+	uint32_t	size;		// Uncompressed bytes
+	uint32_t	csize;		// Compressed bytes following header
+	uint32_t	crc;		// ovlz_crc32() of uncompressed bytes
+};
+
+uint32_t ovlz_crc32(const void *data,uint32_t bytes);
+int32_t ovlz_load(uint32_t spi,uint32_t addr,void *dest,uint32_t rawsize,uint32_t maxsize,uint32_t *crc);
+int32_t ovlz_unpack(const struct s_ovlzhdr *hdr,const void *src,void *dest,uint32_t maxsize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OVLZ_H
+
+// End ovlz.h
@@ -0,0 +1,56 @@
+/* w25cache.h -- RAM page cache for Winbond W25Qxx reads
+ * Warren W. Gay VE3WWG
+ */
+#ifndef W25CACHE_H
+#define W25CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define W25_CACHE_LINESZ	256	// One W25 page per line
+#define W25_LINE_PREFETCH	0x01	// Line read ahead, not yet used
+
+/*********************************************************************
+ * Cache line: storage is supplied by the caller to w25_cache_init()
+ * so that the application decides how much RAM is spent. Each line
+ * costs W25_CACHE_LINESZ + 8 bytes.
+ *********************************************************************/
+
+struct s_w25line {
+	uint32_t	addr;		// Page address held (tag) | W25_LINE_* flags
+	uint32_t	lru;		// Last use stamp (0 == line is empty)
+	uint8_t		data[W25_CACHE_LINESZ];
+};
+
+/*********************************************************************
+ * Cache counters
+ *********************************************************************/
+
+struct s_w25stats {
+	uint32_t	hits;		// Pages satisfied from RAM
+	uint32_t	misses;		// Pages read from flash on demand
+	uint32_t	prefetches;	// Readahead pages streamed after a miss
+	uint32_t	prefetch_hits;	// Streamed pages later used
+	uint32_t	bypass;		// Reads sent straight to flash
+	uint32_t	invalidates;	// Lines dropped by erase
+	uint32_t	transactions;	// Flash read commands issued
+};
+
+void w25_cache_init(uint32_t spi,struct s_w25line *lines,unsigned nlines,unsigned readahead);
+void w25_cache_disable(void);
+uint32_t w25_cache_read(uint32_t spi,uint32_t addr,void *data,uint32_t bytes);
+void w25_cache_update(uint32_t spi,uint32_t addr,const void *data,uint32_t bytes);
+void w25_cache_invalidate(uint32_t spi,uint32_t addr,uint32_t bytes);
+void w25_cache_stats(struct s_w25stats *stats,bool reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // W25CACHE_H
+
+// End w25cache.h
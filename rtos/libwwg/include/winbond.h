@@ -23,12 +23,48 @@
 #define W25_CMD_ERA_SECTOR	0x20
 #define W25_CMD_ERA_32K		0x52
 #define W25_CMD_ERA_64K		0xD8
+#define W25_CMD_READ_SFDP	0x5A
+#define W25_CMD_ENTER_4B	0xB7
 
 #define DUMMY			0x00
 
 #define W25_SR1_BUSY		0x01
 #define W25_SR1_WEL		0x02
 
+#define W25_N_ERASE		4	// Max erase types (SFDP)
+
+typedef void (*w25_progress_t)(uint32_t done,uint32_t total,void *arg);
+typedef void (*w25_busy_t)(void);
+
+/*********************************************************************
+ * Per device descriptor, used by all w25_*() calls. Filled in from
+ * SFDP by w25_init(), else defaults to a 3-byte address W25Q part.
+ *********************************************************************/
+
+struct s_w25erase {
+	uint32_t	size;		// Bytes erased (0 == unused entry)
+	uint8_t		cmd;		// Erase opcode
+	uint16_t	typ_ms;		// Typical erase time (0 == unknown)
+};
+
+struct s_w25dev {
+	uint32_t	spi;		// SPI1 or SPI2
+	uint32_t	jedec_id;	// Manuf., type and capacity
+	uint32_t	capacity;	// Bytes (0 == unknown)
+	uint16_t	page_size;	// Program page size
+	uint8_t		addr_bytes;	// 3 or 4
+	bool		sfdp;		// True when configured from SFDP
+	uint16_t	page_us;	// Typical page program time (us)
+	uint32_t	chip_ms;	// Typical chip erase time (ms)
+	struct s_w25erase erase[W25_N_ERASE];
+	uint8_t		enter_4b;	// SFDP 4-byte entry methods
+};
+
+bool w25_init(uint32_t spi);
+const struct s_w25dev *w25_device(uint32_t spi);
+void w25_read_sfdp(uint32_t spi,uint32_t addr,void *data,uint32_t bytes);
+void w25_busy_hook(uint32_t spi,w25_busy_t hook);
+
 uint8_t w25_read_sr1(uint32_t spi);
 uint8_t w25_read_sr2(uint32_t spi);
 void w25_wait(uint32_t spi);
@@ -42,10 +78,14 @@ void w25_read_uid(uint32_t spi,void *buf,uint16_t bytes);
 void w25_power(uint32_t spi,bool on);
 
 uint32_t w25_read_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes);
+void w25_read_start(uint32_t spi,uint32_t addr);
+void w25_read_stream(uint32_t spi,void *data,uint32_t bytes);
+void w25_read_stop(uint32_t spi);
 unsigned w25_write_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes);
 
 bool w25_chip_erase(uint32_t spi);
 bool w25_erase_block(uint32_t spi,uint32_t addr,uint8_t cmd);
+bool w25_erase_range(uint32_t spi,uint32_t start,uint32_t len,w25_progress_t progress,void *arg);
 
 void w25_spi_setup(
   uint32_t spi,		// SPI1 or SPI2
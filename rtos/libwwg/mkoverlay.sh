@@ -0,0 +1,425 @@
+#!/bin/sh
+######################################################################
+#  mkoverlay.sh -- Generate overlay table, stubs and linker fragment
+#  Warren W. Gay VE3WWG
+#
+#  Overlays are declared once, in the C source, with a one line
+#  prototype naming a section .ov_<name>:
+#
+#	int fee(int arg) __attribute__((noinline,section(".ov_fee")));
+#
+#  Static data for an overlay may be placed in .ov_<name>_data.
+#
+#  Usage:
+#	mkoverlay.sh -H out.h sources.c...
+#		Emit the stub header (prototypes of <name>_stub(),
+#		OVL_<name> indexes and the table externs).
+#	mkoverlay.sh -N sources.c...
+#		List the overlay names (for objcopy).
+#	mkoverlay.sh [-n regions] [-m max_bytes] -C out.c -L out.ld \
+#		sources.c... objects.o...
+#		Read section sizes and relocations from the objects,
+#		pack the overlays into regions and emit the overlay
+#		table, stubs and linker script fragment. A report is
+#		written to standard output. ovl_build is a checksum
+#		of the objects, for overlay_init(). It can't change
+#		with a relink, so overlay_init() also checks resident
+#		overlays against their images in SPI flash.
+#
+#  Packing: overlays that call each other must be in different
+#  regions (the caller is pinned while the callee runs). Overlays
+#  called one after another from the same function are kept apart
+#  where possible, so that they can stay resident together. Other
+#  overlays share regions to save RAM. The region size estimate adds
+#  8 bytes per long branch veneer the linker will need.
+#
+#  The fragment is INCLUDEd in the SECTIONS of the linker script,
+#  which must define the MEMORY regions ovl (RAM) and xflash (load).
+#
+#  The environment variable OBJDUMP names the objdump to use.
+######################################################################
+
+OBJDUMP="${OBJDUMP:-arm-none-eabi-objdump}"
+NREGIONS=1
+MAXBYTES=0
+HDR=""
+TBL=""
+LDF=""
+NAMES=0
+
+usage() {
+	echo "Usage: $0 -H out.h | -N | [-n regions] [-m max] -C out.c -L out.ld  files..." >&2
+	exit 2
+}
+
+while getopts "H:NC:L:n:m:" opt ; do
+	case "$opt" in
+	H)	HDR="$OPTARG" ;;
+	N)	NAMES=1 ;;
+	C)	TBL="$OPTARG" ;;
+	L)	LDF="$OPTARG" ;;
+	n)	NREGIONS="$OPTARG" ;;
+	m)	MAXBYTES="$OPTARG" ;;
+	*)	usage ;;
+	esac
+done
+shift $(($OPTIND - 1))
+
+[ $# -gt 0 ] || usage
+if [ -z "$HDR" -a $NAMES -eq 0 ] ; then
+	[ -n "$TBL" -a -n "$LDF" ] || usage
+fi
+
+SRCS=""
+OBJS=""
+for f in "$@" ; do
+	case "$f" in
+	*.o)	OBJS="$OBJS $f" ;;
+	*)	SRCS="$SRCS $f" ;;
+	esac
+done
+
+# Build hash, so that overlays resident in RAM from a different
+# build are not trusted after a reset. It doesn't cover the link
+# (addresses called), so overlay_init() also compares each resident
+# overlay with its image in SPI flash.
+BUILD=0
+if [ -n "$OBJS" ] ; then
+	BUILD=`cat $OBJS | cksum | cut -d' ' -f1` || exit 1
+fi
+
+######################################################################
+#  Feed sources, then objdump output, to awk with @ markers
+######################################################################
+
+(
+	for f in $SRCS ; do
+		echo "@SRC $f"
+		cat "$f" || exit 1
+	done
+	for f in $OBJS ; do
+		echo "@HDR $f"
+		"$OBJDUMP" -h "$f" || exit 1
+		echo "@REL $f"
+		"$OBJDUMP" -r "$f" || exit 1
+	done
+) | awk -v hdr="$HDR" -v tbl="$TBL" -v ldf="$LDF" -v names="$NAMES" \
+	-v nregions="$NREGIONS" -v maxbytes="$MAXBYTES" -v srcs="$SRCS" -v objs="$OBJS" \
+	-v build="$BUILD" '
+
+function hex(s,   n, ux) {
+	n = 0
+	s = tolower(s)
+	for ( ux=1; ux<=length(s); ++ux )
+		n = n * 16 + index("0123456789abcdef",substr(s,ux,1)) - 1
+	return n
+}
+
+function trim(s) {
+	sub(/^[ \t]+/,"",s)
+	sub(/[ \t]+$/,"",s)
+	return s
+}
+
+# Parse "type name(params) __attribute__((...section(".ov_name")...));"
+function prototype(line,   ax, decl, sec, px, head, name, type, params, n, parts, ux, p, args) {
+	sec = line
+	sub(/.*section\([ \t]*"\.ov_/,"",sec)
+	sub(/".*/,"",sec)
+	ax = index(line,"__attribute__")
+	decl = trim(substr(line,1,ax-1))
+	px = index(decl,"(")
+	if ( px == 0 || substr(decl,length(decl)) != ")" )
+		return
+	head = trim(substr(decl,1,px-1))
+	params = trim(substr(decl,px+1,length(decl)-px-1))
+	name = head
+	sub(/.*[^A-Za-z0-9_]/,"",name)
+	if ( name != sec || name in ovx )
+		return
+	type = trim(substr(head,1,length(head)-length(name)))
+	sub(/^(extern|static)[ \t]+/,"",type)
+
+	args = ""
+	if ( params != "" && params != "void" ) {
+		n = split(params,parts,",")
+		for ( ux=1; ux<=n; ++ux ) {
+			p = trim(parts[ux])
+			sub(/[ \t]*\[[^]]*\]$/,"",p)
+			sub(/.*[^A-Za-z0-9_]/,"",p)
+			args = args (ux > 1 ? "," : "") p
+		}
+	} else	params = "void"
+
+	ovx[name] = nov
+	ovname[nov] = name
+	ovtype[nov] = type
+	ovparams[nov] = params
+	ovargs[nov] = args
+	ovsize[nov] = 0
+	nov++
+}
+
+# Overlay index owning section sec, else -1
+function owner(sec,   name) {
+	if ( substr(sec,1,4) != ".ov_" )
+		return -1
+	name = substr(sec,5)
+	if ( name in ovx )
+		return ovx[name]
+	sub(/_data$/,"",name)
+	if ( name in ovx )
+		return ovx[name]
+	return -1
+}
+
+function weight(a,b,w) {
+	if ( a == b )
+		return
+	wt[a "," b] += w
+	wt[b "," a] += w
+}
+
+BEGIN {
+	nov = 0
+	state = ""
+}
+
+/^@SRC / { state = "src"; next }
+/^@HDR / { state = "hdr"; next }
+/^@REL / { state = "rel"; next }
+
+state == "src" && /section\([ \t]*"\.ov_/ && /\(/ {
+	prototype($0)
+	next
+}
+
+state == "hdr" && $2 ~ /^\.ov_/ && $3 ~ /^[0-9a-fA-F]+$/ {
+	ox = owner($2)
+	if ( ox >= 0 )
+		ovsize[ox] += int((hex($3) + 3) / 4) * 4
+	next
+}
+
+state == "rel" && /^RELOCATION RECORDS FOR/ {
+	sec = $4
+	gsub(/[\[\]:]/,"",sec)
+	cur = owner(sec)
+	last = -1
+	next
+}
+
+state == "rel" && NF >= 3 && $2 ~ /CALL|JUMP24|PLT32/ {
+	sym = $3
+	sub(/[-+].*/,"",sym)
+	callee = -1
+	if ( sym ~ /_stub$/ ) {
+		callee = substr(sym,1,length(sym)-5)
+		callee = (callee in ovx) ? ovx[callee] : -1
+	}
+	if ( cur >= 0 ) {
+		if ( callee >= 0 )
+			weight(cur,callee,1000000)	# Must not share
+		else if ( !((cur "," sym) in veneer) && !(sym in ovx) ) {
+			veneer[cur "," sym] = 1
+			ovven[cur] += 8			# Long branch to flash
+		}
+	} else if ( callee >= 0 ) {
+		if ( last >= 0 && last != callee )
+			weight(last,callee,1)		# Called in sequence
+		last = callee
+	}
+	next
+}
+
+END {
+	if ( nov == 0 ) {
+		print "mkoverlay.sh: no overlay prototypes found in" srcs > "/dev/stderr"
+		exit 1
+	}
+
+	if ( names ) {
+		for ( ux=0; ux<nov; ++ux )
+			printf("%s%s",(ux ? " " : ""),ovname[ux])
+		printf("\n")
+		exit 0
+	}
+
+	if ( hdr != "" ) {
+		emit_header()
+		exit 0
+	}
+
+	pack()
+	emit_table()
+	emit_ld()
+	report()
+}
+
+######################################################################
+#  Greedy packing, largest overlay first
+######################################################################
+
+function pack(   ux, vx, rx, best, cost, bestcost, conflict, grow, used, t) {
+	for ( ux=0; ux<nov; ++ux ) {
+		est[ux] = ovsize[ux] + ovven[ux]
+		est[ux] = int((est[ux] + 7) / 8) * 8
+		order[ux] = ux
+	}
+	for ( ux=0; ux<nov; ++ux )
+		for ( vx=ux+1; vx<nov; ++vx )
+			if ( est[order[vx]] > est[order[ux]] ) {
+				t = order[ux]; order[ux] = order[vx]; order[vx] = t
+			}
+
+	for ( rx=0; rx<nregions; ++rx ) {
+		rsize[rx] = 0
+		rcount[rx] = 0
+	}
+
+	for ( ux=0; ux<nov; ++ux ) {
+		ox = order[ux]
+		best = -1
+		used = 0
+		for ( rx=0; rx<nregions; ++rx )
+			used += rsize[rx]
+		for ( rx=0; rx<nregions; ++rx ) {
+			conflict = 0
+			for ( vx=0; vx<nov; ++vx )
+				if ( (vx in region) && region[vx] == rx && ((ox "," vx) in wt) )
+					conflict += wt[ox "," vx]
+			grow = est[ox] > rsize[rx] ? est[ox] - rsize[rx] : 0
+			if ( maxbytes > 0 && used + grow > maxbytes )
+				conflict += 1000000000	# Over budget
+			cost = conflict * 65536 + grow * 16 + rcount[rx]
+			if ( best < 0 || cost < bestcost ) {
+				best = rx
+				bestcost = cost
+			}
+		}
+		region[ox] = best
+		rconf[best] += int(bestcost / 65536)
+		if ( est[ox] > rsize[best] )
+			rsize[best] = est[ox]
+		rcount[best]++
+	}
+
+	offset = 0
+	for ( rx=0; rx<nregions; ++rx ) {
+		roff[rx] = offset
+		offset += rsize[rx]
+	}
+	total = offset
+}
+
+######################################################################
+#  Emit stub header
+######################################################################
+
+function emit_header(   ux) {
+	printf("/* %s -- Generated by mkoverlay.sh from%s: do not edit\n */\n",hdr,srcs) > hdr
+	printf("#ifndef GENERATED_OVERLAY_H\n#define GENERATED_OVERLAY_H\n\n") > hdr
+	printf("#include \"overlay.h\"\n\n") > hdr
+	printf("#define OVL_COUNT\t%d\n\n",nov) > hdr
+	for ( ux=0; ux<nov; ++ux )
+		printf("#define OVL_%s\t%d\n",ovname[ux],ux) > hdr
+	printf("\nextern struct s_overlay ovl_table[OVL_COUNT];\n") > hdr
+	printf("extern struct s_ovregion ovl_regions[];\n") > hdr
+	printf("extern const unsigned ovl_nregions;\n") > hdr
+	printf("extern const uint32_t ovl_build;\n\n") > hdr
+	for ( ux=0; ux<nov; ++ux )
+		printf("%s %s_stub(%s);\n",ovtype[ux],ovname[ux],ovparams[ux]) > hdr
+	printf("\n#endif // GENERATED_OVERLAY_H\n") > hdr
+}
+
+######################################################################
+#  Emit overlay table and stubs
+######################################################################
+
+function emit_table(   ux, rx) {
+	printf("/* %s -- Generated by mkoverlay.sh from%s%s: do not edit\n */\n",tbl,srcs,objs) > tbl
+	printf("#include \"overlay.h\"\n\n") > tbl
+	for ( rx=0; rx<nregions; ++rx )
+		printf("extern char __ovl_region%d;\n",rx) > tbl
+	printf("\n") > tbl
+	for ( ux=0; ux<nov; ++ux ) {
+		printf("extern char OVERLAY_LOADREF(%s);\n",ovname[ux]) > tbl
+		printf("%s %s(%s);\n",ovtype[ux],ovname[ux],ovparams[ux]) > tbl
+		printf("%s %s_stub(%s);\n",ovtype[ux],ovname[ux],ovparams[ux]) > tbl
+	}
+
+	printf("\nconst unsigned ovl_nregions = %d;\n",nregions) > tbl
+	printf("const uint32_t ovl_build = %su;\n\n",build) > tbl
+	printf("struct s_ovregion ovl_regions[%d] = {\n",nregions) > tbl
+	for ( rx=0; rx<nregions; ++rx )
+		printf("\tOVERLAY_REGION(__ovl_region%d,%d)%s\n",rx,rsize[rx],(rx+1 < nregions ? "," : "")) > tbl
+	printf("};\n\n") > tbl
+
+	printf("struct s_overlay ovl_table[%d] = {\n",nov) > tbl
+	for ( ux=0; ux<nov; ++ux )
+		printf("\tOVERLAY(0x%02X,__ovl_region%d,%s)%s\n",2^region[ux],region[ux],ovname[ux],(ux+1 < nov ? "," : "")) > tbl
+	printf("};\n\n") > tbl
+
+	for ( ux=0; ux<nov; ++ux ) {
+		if ( ovtype[ux] == "void" )
+			printf("OVERLAY_VSTUB(%s,&ovl_table[%d],(%s),(%s))\n",ovname[ux],ux,ovparams[ux],ovargs[ux]) > tbl
+		else	printf("OVERLAY_STUB(%s,%s,&ovl_table[%d],(%s),(%s))\n",ovtype[ux],ovname[ux],ux,ovparams[ux],ovargs[ux]) > tbl
+	}
+}
+
+######################################################################
+#  Emit linker script fragment
+######################################################################
+
+function emit_ld(   ux, rx, first) {
+	printf("/* %s -- Generated by mkoverlay.sh: do not edit */\n\n",ldf) > ldf
+	for ( rx=0; rx<nregions; ++rx ) {
+		printf("/* Region %d: %d bytes */\n",rx,rsize[rx]) > ldf
+		printf("__ovl_region%d = ORIGIN(ovl) + %d;\n",rx,roff[rx]) > ldf
+		first = 1
+		for ( ux=0; ux<nov; ++ux ) {
+			if ( region[ux] != rx )
+				continue
+			if ( first )
+				printf("OVERLAY __ovl_region%d : NOCROSSREFS {\n",rx) > ldf
+			first = 0
+			printf("\t.%s { *(.ov_%s) *(.ov_%s_data) }\n",ovname[ux],ovname[ux],ovname[ux]) > ldf
+		}
+		if ( !first )
+			printf("} AT >xflash\n") > ldf
+		for ( ux=0; ux<nov; ++ux )
+			if ( region[ux] == rx )
+				printf("ASSERT(SIZEOF(.%s) <= %d, \"overlay %s exceeds region %d\");\n",
+					ovname[ux],rsize[rx],ovname[ux],rx) > ldf
+		printf("\n") > ldf
+	}
+	printf("ASSERT(%d <= LENGTH(ovl), \"overlay regions exceed ovl\");\n",total) > ldf
+}
+
+######################################################################
+#  Report sizes and packing
+######################################################################
+
+function report(   ux, rx, vx, n) {
+	printf("Overlay              Bytes  Veneers  Region\n")
+	for ( ux=0; ux<nov; ++ux )
+		printf("%-20s %5d  %7d  %6d\n",ovname[ux],ovsize[ux],ovven[ux]/8,region[ux])
+	printf("\nRegion  Offset  Bytes  Overlays  Conflicts\n")
+	for ( rx=0; rx<nregions; ++rx )
+		printf("%6d  %6d  %5d  %8d  %9d\n",rx,roff[rx],rsize[rx],rcount[rx],rconf[rx])
+	printf("Total %d bytes", total)
+	if ( maxbytes > 0 )
+		printf(" of %d",maxbytes)
+	printf("\n")
+	n = 0
+	for ( ux=0; ux<nov; ++ux )
+		for ( vx=ux+1; vx<nov; ++vx )
+			if ( region[ux] == region[vx] && ((ux "," vx) in wt) && wt[ux "," vx] >= 1000000 ) {
+				printf("ERROR: %s and %s call each other but share region %d\n",
+					ovname[ux],ovname[vx],region[ux]) > "/dev/stderr"
+				n++
+			}
+	if ( n > 0 )
+		exit 1
+}
+'
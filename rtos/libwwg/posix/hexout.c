@@ -0,0 +1,51 @@
+/* hexout.c -- Write Intel hex for the host tools
+ * Warren W. Gay VE3WWG
+ */
+#include "hexout.h"
+
+/*********************************************************************
+ * Write one Intel hex record
+ *********************************************************************/
+
+static void
+hexrec(FILE *f,unsigned type,unsigned addr,const uint8_t *data,unsigned n) {
+	unsigned sum = n + (addr >> 8 & 0xFF) + (addr & 0xFF) + type;
+
+	fprintf(f,":%02X%04X%02X",n,addr & 0xFFFF,type);
+	for ( unsigned ux=0; ux<n; ++ux ) {
+		fprintf(f,"%02X",data[ux]);
+		sum += data[ux];
+	}
+	fprintf(f,"%02X\n",(-sum) & 0xFF);
+}
+
+/*********************************************************************
+ * Write data as Intel hex at addr
+ *********************************************************************/
+
+void
+write_hex(FILE *f,uint32_t addr,const uint8_t *data,uint32_t n) {
+	uint32_t upper = 0xFFFFFFFF, chunk;
+	uint8_t ext[2];
+
+	while ( n > 0 ) {
+		if ( (addr >> 16) != upper ) {
+			upper = addr >> 16;
+			ext[0] = upper >> 8;
+			ext[1] = upper;
+			hexrec(f,0x04,0,ext,2);
+		}
+		chunk = 16 - (addr & 15);
+		if ( chunk > n )
+			chunk = n;
+		if ( (addr & 0xFFFF) + chunk > 0x10000 )
+			chunk = 0x10000 - (addr & 0xFFFF);
+		hexrec(f,0x00,addr,data,chunk);
+		addr += chunk;
+		data += chunk;
+		n -= chunk;
+	}
+	hexrec(f,0x01,0,0,0);
+}
+
+// End hexout.c
@@ -0,0 +1,14 @@
+/* hexout.h -- Write Intel hex for the host tools
+ * Warren W. Gay VE3WWG
+ */
+#ifndef HEXOUT_H
+#define HEXOUT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+void write_hex(FILE *f,uint32_t addr,const uint8_t *data,uint32_t n);
+
+#endif // HEXOUT_H
+
+// End hexout.h
@@ -0,0 +1,145 @@
+/* hosted.c -- Virtual time and no-op peripheral setup for POSIX
+ * Warren W. Gay VE3WWG
+ */
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/cm3/dwt.h>
+
+#include "hosted.h"
+
+static uint64_t now_ns = 0;
+static uint64_t wake_ns = 0;		// Next simulated event, else 0
+
+/*********************************************************************
+ * Virtual clock
+ *********************************************************************/
+
+uint64_t
+host_now_ns(void) {
+	return now_ns;
+}
+
+void
+host_advance_ns(uint64_t ns) {
+	now_ns += ns;
+}
+
+/*********************************************************************
+ * Simulated hardware (the DMA) has something happen at time ns
+ *********************************************************************/
+
+void
+host_wake_at(uint64_t ns) {
+	if ( ns > now_ns && (wake_ns <= now_ns || ns < wake_ns) )
+		wake_ns = ns;
+}
+
+/*********************************************************************
+ * Cortex-M3 cycle counter at 72 MHz
+ *********************************************************************/
+
+bool
+dwt_enable_cycle_counter(void) {
+	return true;
+}
+
+uint32_t
+dwt_read_cycle_counter(void) {
+	return (uint32_t)(now_ns * 72 / 1000);
+}
+
+/*********************************************************************
+ * FreeRTOS stand-ins: There is only one "task", so a yield passes
+ * the time until the next simulated event (if any), and a delay
+ * simply advances the clock.
+ *********************************************************************/
+
+void
+host_yield(void) {
+	if ( wake_ns > now_ns )
+		now_ns = wake_ns;
+	wake_ns = 0;
+}
+
+void
+host_delay(TickType_t ticks) {
+	now_ns += (uint64_t)ticks * 1000000ull;
+}
+
+TickType_t
+host_ticks(void) {
+	return (TickType_t)(now_ns / 1000000ull);
+}
+
+/*********************************************************************
+ * GPIO output levels, for GPIOA to GPIOC. A simulated device may
+ * watch for changes (one watcher).
+ *********************************************************************/
+
+static uint16_t gpio_odr[3];
+static void (*gpio_changed)(uint32_t gpioport,uint16_t levels) = 0;
+
+static uint16_t *
+odr(uint32_t gpioport) {
+	return &gpio_odr[((gpioport - GPIOA) / 0x400) % 3];
+}
+
+void
+host_gpio_watch(void (*changed)(uint32_t gpioport,uint16_t levels)) {
+	gpio_changed = changed;
+}
+
+static void
+gpio_write(uint32_t gpioport,uint16_t levels) {
+	uint16_t *op = odr(gpioport);
+
+	if ( *op != levels ) {
+		*op = levels;
+		if ( gpio_changed )
+			gpio_changed(gpioport,levels);
+	}
+}
+
+void
+gpio_set(uint32_t gpioport,uint16_t gpios) {
+	gpio_write(gpioport,*odr(gpioport) | gpios);
+}
+
+void
+gpio_clear(uint32_t gpioport,uint16_t gpios) {
+	gpio_write(gpioport,*odr(gpioport) & ~gpios);
+}
+
+void
+gpio_toggle(uint32_t gpioport,uint16_t gpios) {
+	gpio_write(gpioport,*odr(gpioport) ^ gpios);
+}
+
+uint16_t
+gpio_get(uint32_t gpioport,uint16_t gpios) {
+	return *odr(gpioport) & gpios;
+}
+
+/*********************************************************************
+ * Peripheral setup calls have nothing to do on the host
+ *********************************************************************/
+
+void rcc_periph_clock_enable(enum rcc_periph_clken clken) { (void)clken; }
+void gpio_set_mode(uint32_t gpioport,uint8_t mode,uint8_t cnf,uint16_t gpios) { (void)gpioport; (void)mode; (void)cnf; (void)gpios; }
+void spi_reset(uint32_t spi) { (void)spi; }
+void spi_disable_software_slave_management(uint32_t spi) { (void)spi; }
+void spi_enable_ss_output(uint32_t spi) { (void)spi; }
+
+int
+spi_init_master(uint32_t spi,uint32_t br,uint32_t cpol,uint32_t cpha,uint32_t dff,uint32_t lsbfirst) {
+	(void)spi; (void)br; (void)cpol; (void)cpha; (void)dff; (void)lsbfirst;
+	return 0;
+}
+
+// End hosted.c
@@ -0,0 +1,20 @@
+/* hosted.h -- Host (POSIX) support for running libwwg modules
+ * Warren W. Gay VE3WWG
+ *
+ * Time is virtual and advances only when the simulated hardware
+ * (or taskYIELD()/vTaskDelay()) says so. This makes benchmark
+ * figures repeatable and independent of the host machine.
+ */
+#ifndef HOSTED_H
+#define HOSTED_H
+
+#include <stdint.h>
+
+uint64_t host_now_ns(void);
+void host_advance_ns(uint64_t ns);
+void host_wake_at(uint64_t ns);
+void host_gpio_watch(void (*changed)(uint32_t gpioport,uint16_t levels));
+
+#endif // HOSTED_H
+
+// End hosted.h
@@ -0,0 +1,143 @@
+/* hosteddma.c -- DMA1 stand-in for SPI transfers on POSIX
+ * Warren W. Gay VE3WWG
+ *
+ * A transfer starts when the SPI's transmit DMA request is enabled,
+ * with its receive channel (if enabled) collecting the bytes. The
+ * data moves at once, through w25sim_dma(), but the transfer is only
+ * complete (TCIF) after the bytes' time on the bus has passed. That
+ * is the time a taskYIELD() in a polling loop skips ahead to.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+
+#include "hosted.h"
+#include "w25sim.h"
+
+volatile uint32_t host_spi_dr;
+
+static struct s_chan {
+	uint8_t		*maddr;		// Memory address
+	uint16_t	count;		// Number of data
+	bool		from_mem;	// Memory to peripheral
+	bool		minc;		// Memory increment
+	bool		enabled;
+	uint64_t	done_ns;	// Completion time, else 0
+} chans[8];
+
+/*********************************************************************
+ * Internal: SPI to (receive, transmit) channel mapping for DMA1
+ *********************************************************************/
+
+static void
+spi_chans(uint32_t spi,struct s_chan **rx,struct s_chan **tx) {
+	unsigned ch = spi == SPI2 ? DMA_CHANNEL4 : DMA_CHANNEL2;
+
+	*rx = &chans[ch];
+	*tx = &chans[ch+1];
+}
+
+void
+dma_channel_reset(uint32_t dma,uint8_t channel) {
+	(void)dma;
+	memset(&chans[channel],0,sizeof chans[channel]);
+}
+
+void
+dma_set_peripheral_address(uint32_t dma,uint8_t channel,uint32_t address) {
+	(void)dma; (void)channel; (void)address;	// Always the SPI DR
+}
+
+void
+dma_set_memory_address(uint32_t dma,uint8_t channel,uint32_t address) {
+	(void)dma;
+	chans[channel].maddr = (uint8_t*)(uintptr_t)address;
+}
+
+void
+dma_set_number_of_data(uint32_t dma,uint8_t channel,uint16_t number) {
+	(void)dma;
+	chans[channel].count = number;
+}
+
+void
+dma_set_read_from_peripheral(uint32_t dma,uint8_t channel) {
+	(void)dma;
+	chans[channel].from_mem = false;
+}
+
+void
+dma_set_read_from_memory(uint32_t dma,uint8_t channel) {
+	(void)dma;
+	chans[channel].from_mem = true;
+}
+
+void
+dma_enable_memory_increment_mode(uint32_t dma,uint8_t channel) {
+	(void)dma;
+	chans[channel].minc = true;
+}
+
+void dma_set_peripheral_size(uint32_t dma,uint8_t channel,uint32_t size) { (void)dma; (void)channel; (void)size; }
+void dma_set_memory_size(uint32_t dma,uint8_t channel,uint32_t size) { (void)dma; (void)channel; (void)size; }
+void dma_set_priority(uint32_t dma,uint8_t channel,uint32_t prio) { (void)dma; (void)channel; (void)prio; }
+
+void
+dma_enable_channel(uint32_t dma,uint8_t channel) {
+	(void)dma;
+	chans[channel].enabled = true;
+}
+
+void
+dma_disable_channel(uint32_t dma,uint8_t channel) {
+	(void)dma;
+	chans[channel].enabled = false;
+}
+
+bool
+dma_get_interrupt_flag(uint32_t dma,uint8_t channel,uint32_t interrupts) {
+	struct s_chan *ch = &chans[channel];
+
+	(void)dma;
+	return (interrupts & DMA_TCIF) && ch->done_ns && host_now_ns() >= ch->done_ns;
+}
+
+void
+dma_clear_interrupt_flags(uint32_t dma,uint8_t channel,uint32_t interrupts) {
+	(void)dma;
+	if ( interrupts & DMA_TCIF )
+		chans[channel].done_ns = 0;
+}
+
+/*********************************************************************
+ * SPI DMA requests
+ *********************************************************************/
+
+void spi_enable_rx_dma(uint32_t spi) { (void)spi; }
+void spi_disable_rx_dma(uint32_t spi) { (void)spi; }
+void spi_disable_tx_dma(uint32_t spi) { (void)spi; }
+
+void
+spi_enable_tx_dma(uint32_t spi) {
+	struct s_chan *rx, *tx;
+	uint8_t sink;
+	uint64_t ns;
+
+	spi_chans(spi,&rx,&tx);
+	if ( !tx->enabled || !tx->from_mem )
+		return;
+
+	if ( rx->enabled && rx->count >= tx->count )
+		ns = w25sim_dma(tx->maddr,tx->minc,rx->maddr,rx->minc,tx->count);
+	else	ns = w25sim_dma(tx->maddr,tx->minc,&sink,false,tx->count);
+
+	tx->done_ns = host_now_ns() + ns;
+	if ( rx->enabled )
+		rx->done_ns = tx->done_ns;
+	host_wake_at(tx->done_ns);
+}
+
+// End hosteddma.c
@@ -0,0 +1,30 @@
+/* FreeRTOS.h -- Hosted (POSIX) stand-in for FreeRTOS
+ *
+ * Just enough of the FreeRTOS API for libwwg modules to compile and
+ * run on the host. Time is virtual: it is advanced by the simulated
+ * SPI devices, and by taskYIELD() and vTaskDelay().
+ */
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdFALSE			0
+#define pdTRUE			1
+#define pdPASS			pdTRUE
+#define portMAX_DELAY		((TickType_t)0xFFFFFFFF)
+#define configTICK_RATE_HZ	1000
+#define pdMS_TO_TICKS(ms)	((TickType_t)(ms))
+
+void host_yield(void);
+void host_delay(TickType_t ticks);
+TickType_t host_ticks(void);
+
+#endif // FREERTOS_H
+
+// End FreeRTOS.h
@@ -0,0 +1,47 @@
+/* gpio.h -- Hosted (POSIX) stand-in for libopencm3 GPIO
+ *
+ * Output levels are kept, so that simulated devices can read pins
+ * such as a D/C line (see host_gpio_watch()).
+ */
+#ifndef HOSTED_GPIO_H
+#define HOSTED_GPIO_H
+
+#include <stdint.h>
+
+#define GPIOA				0x40010800u
+#define GPIOB				0x40010C00u
+#define GPIOC				0x40011000u
+
+#define GPIO0				(1 << 0)
+#define GPIO1				(1 << 1)
+#define GPIO2				(1 << 2)
+#define GPIO3				(1 << 3)
+#define GPIO4				(1 << 4)
+#define GPIO5				(1 << 5)
+#define GPIO6				(1 << 6)
+#define GPIO7				(1 << 7)
+#define GPIO8				(1 << 8)
+#define GPIO9				(1 << 9)
+#define GPIO10				(1 << 10)
+#define GPIO11				(1 << 11)
+#define GPIO12				(1 << 12)
+#define GPIO13				(1 << 13)
+#define GPIO14				(1 << 14)
+#define GPIO15				(1 << 15)
+
+#define GPIO_MODE_INPUT			0
+#define GPIO_MODE_OUTPUT_2_MHZ		2
+#define GPIO_MODE_OUTPUT_50_MHZ		3
+#define GPIO_CNF_INPUT_FLOAT		1
+#define GPIO_CNF_OUTPUT_PUSHPULL	0
+#define GPIO_CNF_OUTPUT_ALTFN_PUSHPULL	2
+
+void gpio_set_mode(uint32_t gpioport,uint8_t mode,uint8_t cnf,uint16_t gpios);
+void gpio_set(uint32_t gpioport,uint16_t gpios);
+void gpio_clear(uint32_t gpioport,uint16_t gpios);
+void gpio_toggle(uint32_t gpioport,uint16_t gpios);
+uint16_t gpio_get(uint32_t gpioport,uint16_t gpios);
+
+#endif // HOSTED_GPIO_H
+
+// End gpio.h
@@ -0,0 +1,14 @@
+/* rcc.h -- Hosted (POSIX) stand-in for libopencm3 RCC
+ */
+#ifndef HOSTED_RCC_H
+#define HOSTED_RCC_H
+
+enum rcc_periph_clken {
+	RCC_GPIOA, RCC_GPIOB, RCC_GPIOC, RCC_SPI1, RCC_SPI2, RCC_DMA1
+};
+
+void rcc_periph_clock_enable(enum rcc_periph_clken clken);
+
+#endif // HOSTED_RCC_H
+
+// End rcc.h
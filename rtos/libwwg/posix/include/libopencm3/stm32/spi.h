@@ -0,0 +1,49 @@
+/* spi.h -- Hosted (POSIX) stand-in for libopencm3 SPI
+ *
+ * spi_enable()/spi_disable() frame a command (chip select), and
+ * spi_xfer() is routed to the simulated device on that SPI.
+ */
+#ifndef HOSTED_SPI_H
+#define HOSTED_SPI_H
+
+#include <stdint.h>
+
+#define SPI1				0x40013000u
+#define SPI2				0x40003800u
+
+extern volatile uint32_t host_spi_dr;	// Stands in for the data register
+#define SPI_DR(spi)			(host_spi_dr)
+
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_2	0x00
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_4	0x01
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_8	0x02
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_16	0x03
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_32	0x04
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_64	0x05
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_128	0x06
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_256	0x07
+#define SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE	0
+#define SPI_CR1_CPOL_CLK_TO_1_WHEN_IDLE	1
+#define SPI_CR1_CPHA_CLK_TRANSITION_1	0
+#define SPI_CR1_CPHA_CLK_TRANSITION_2	1
+#define SPI_CR1_DFF_8BIT		0
+#define SPI_CR1_DFF_16BIT		1
+#define SPI_CR1_MSBFIRST		0
+#define SPI_CR1_LSBFIRST		1
+
+void spi_enable(uint32_t spi);
+void spi_disable(uint32_t spi);
+uint16_t spi_xfer(uint32_t spi,uint16_t data);
+
+void spi_reset(uint32_t spi);
+int spi_init_master(uint32_t spi,uint32_t br,uint32_t cpol,uint32_t cpha,uint32_t dff,uint32_t lsbfirst);
+void spi_disable_software_slave_management(uint32_t spi);
+void spi_enable_ss_output(uint32_t spi);
+void spi_enable_rx_dma(uint32_t spi);
+void spi_disable_rx_dma(uint32_t spi);
+void spi_enable_tx_dma(uint32_t spi);
+void spi_disable_tx_dma(uint32_t spi);
+
+#endif // HOSTED_SPI_H
+
+// End spi.h
@@ -0,0 +1,16 @@
+/* task.h -- Hosted (POSIX) stand-in for FreeRTOS task.h
+ */
+#ifndef TASK_H
+#define TASK_H
+
+#include "FreeRTOS.h"
+
+#define taskYIELD()		host_yield()
+#define vTaskDelay(t)		host_delay(t)
+#define xTaskGetTickCount()	host_ticks()
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+#endif // TASK_H
+
+// End task.h
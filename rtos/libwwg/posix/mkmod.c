@@ -0,0 +1,241 @@
+/* mkmod.c -- Convert a linked module into an Intel hex image for xflash
+ * Warren W. Gay VE3WWG
+ *
+ * Usage: mkmod -a load_addr [-o out.hex] module.elf
+ *
+ *	-a	Address of the module in SPI flash
+ *	-o	Output file (default stdout)
+ *
+ * The module is linked at 0 by ../module.ld, keeping its relocations
+ * (ld -q) and leaving imports undefined:
+ *
+ *	arm-none-eabi-gcc -mthumb -mcpu=cortex-m3 -mlong-calls -Os \
+ *		-nostartfiles -Wl,-q -Wl,--unresolved-symbols=ignore-all \
+ *		-T ../libwwg/module.ld mod.o -lgcc -o mod.elf
+ *
+ * Only R_ARM_ABS32 relocations are kept: against the module's own
+ * sections they become local relocations, against undefined symbols
+ * imports. PC relative relocations within the module need nothing at
+ * load time. A call to an import must be a long call (-mlong-calls),
+ * so that its address is loaded from a literal pool word.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <elf.h>
+
+#include "module.h"
+#include "modenc.h"
+#include "hexout.h"
+
+static uint8_t *elf;
+static long elfsize;
+
+/*********************************************************************
+ * Internal: Section header x, or exit if the file is truncated
+ *********************************************************************/
+
+static Elf32_Shdr *
+shdr(unsigned x) {
+	Elf32_Ehdr *eh = (Elf32_Ehdr *)elf;
+	uint32_t off = eh->e_shoff + x * eh->e_shentsize;
+
+	if ( x >= eh->e_shnum || off + sizeof(Elf32_Shdr) > (uint32_t)elfsize ) {
+		fprintf(stderr,"Truncated ELF file\n");
+		exit(1);
+	}
+	return (Elf32_Shdr *)(elf + off);
+}
+
+/*********************************************************************
+ * Internal: Read the whole file
+ *********************************************************************/
+
+static void
+read_elf(const char *path) {
+	Elf32_Ehdr *eh;
+	FILE *f = fopen(path,"rb");
+
+	if ( !f ) {
+		perror(path);
+		exit(1);
+	}
+	fseek(f,0,SEEK_END);
+	elfsize = ftell(f);
+	rewind(f);
+	elf = malloc(elfsize > 0 ? elfsize : 1);
+	if ( elfsize < (long)sizeof *eh || fread(elf,1,elfsize,f) != (size_t)elfsize ) {
+		fprintf(stderr,"%s: Not an ELF file\n",path);
+		exit(1);
+	}
+	fclose(f);
+
+	eh = (Elf32_Ehdr *)elf;
+	if ( memcmp(eh->e_ident,ELFMAG,SELFMAG) || eh->e_ident[EI_CLASS] != ELFCLASS32
+	  || eh->e_ident[EI_DATA] != ELFDATA2LSB || eh->e_machine != EM_ARM ) {
+		fprintf(stderr,"%s: Not a 32 bit little endian ARM ELF file\n",path);
+		exit(1);
+	}
+	if ( eh->e_type != ET_EXEC ) {
+		fprintf(stderr,"%s: Not linked (link with -T module.ld -Wl,-q)\n",path);
+		exit(1);
+	}
+}
+
+/*********************************************************************
+ * Internal: Collect the relocations of one SHT_REL section
+ *********************************************************************/
+
+static unsigned
+relocs(struct s_modenc *m,Elf32_Shdr *rsh,const char *path) {
+	Elf32_Shdr *symsh = shdr(rsh->sh_link), *strsh = shdr(symsh->sh_link);
+	Elf32_Sym *syms = (Elf32_Sym *)(elf + symsh->sh_offset), *sym;
+	Elf32_Rel *rel = (Elf32_Rel *)(elf + rsh->sh_offset);
+	unsigned nrel = rsh->sh_size / sizeof *rel, errs = 0;
+	const char *name;
+
+	for ( unsigned ux=0; ux<nrel; ++ux, ++rel ) {
+		sym = &syms[ELF32_R_SYM(rel->r_info)];
+		name = (const char *)elf + strsh->sh_offset + sym->st_name;
+
+		switch ( ELF32_R_TYPE(rel->r_info) ) {
+		case R_ARM_NONE:
+		case R_ARM_V4BX:
+			break;
+		case R_ARM_ABS32:
+		case R_ARM_TARGET1:
+			if ( sym->st_shndx == SHN_ABS )
+				break;
+			if ( sym->st_shndx != SHN_UNDEF || ELF32_R_SYM(rel->r_info) == 0 ) {
+				if ( !modenc_reloc(m,rel->r_offset) ) {
+					fprintf(stderr,"%s: Unaligned pointer at 0x%X\n",path,(unsigned)rel->r_offset);
+					++errs;
+				}
+			} else if ( ELF32_ST_BIND(sym->st_info) == STB_WEAK ) {
+				break;				// Left null
+			} else if ( !modenc_import(m,rel->r_offset,name) ) {
+				fprintf(stderr,"%s: Bad import %s at 0x%X\n",path,name,(unsigned)rel->r_offset);
+				++errs;
+			}
+			break;
+		case R_ARM_REL32:
+		case R_ARM_THM_PC22:
+		case R_ARM_THM_JUMP24:
+		case R_ARM_THM_JUMP19:
+		case R_ARM_THM_PC11:
+		case R_ARM_THM_PC9:
+		case R_ARM_THM_PC8:
+		case R_ARM_THM_PC12:
+		case R_ARM_THM_ALU_PREL_11_0:
+		case R_ARM_CALL:
+		case R_ARM_JUMP24:
+		case R_ARM_PREL31:
+			if ( sym->st_shndx == SHN_UNDEF && ELF32_R_SYM(rel->r_info) != 0 ) {
+				fprintf(stderr,"%s: PC relative reference to %s at 0x%X (use -mlong-calls)\n",
+					path,name,(unsigned)rel->r_offset);
+				++errs;
+			}
+			break;
+		default:
+			fprintf(stderr,"%s: Unsupported relocation type %u at 0x%X\n",
+				path,(unsigned)ELF32_R_TYPE(rel->r_info),(unsigned)rel->r_offset);
+			++errs;
+		}
+	}
+	return errs;
+}
+
+int
+main(int argc,char **argv) {
+	const char *outpath = 0, *path;
+	Elf32_Ehdr *eh;
+	Elf32_Shdr *sh;
+	struct s_modenc m;
+	uint32_t addr = 0, size = 0, end = 0, bytes;
+	uint8_t *image, *out;
+	bool got_addr = false;
+	unsigned errs = 0;
+	FILE *f;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"a:o:h")) != -1 ) {
+		switch ( optch ) {
+		case 'a':
+			addr = strtoul(optarg,0,0);
+			got_addr = true;
+			break;
+		case 'o':
+			outpath = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if ( optind + 1 != argc || !got_addr ) {
+usage:		fprintf(stderr,"Usage: %s -a load_addr [-o out.hex] module.elf\n",argv[0]);
+		return 2;
+	}
+	path = argv[optind];
+	read_elf(path);
+	eh = (Elf32_Ehdr *)elf;
+
+	// Image: loaded sections, then the bss sections
+	for ( unsigned ux=1; ux<eh->e_shnum; ++ux ) {
+		sh = shdr(ux);
+		if ( !(sh->sh_flags & SHF_ALLOC) || !sh->sh_size )
+			continue;
+		if ( sh->sh_type != SHT_NOBITS ) {
+			if ( sh->sh_addr + sh->sh_size > size )
+				size = sh->sh_addr + sh->sh_size;
+		} else if ( sh->sh_addr + sh->sh_size > end )
+			end = sh->sh_addr + sh->sh_size;
+	}
+	image = calloc(size ? size : 1,1);
+	for ( unsigned ux=1; ux<eh->e_shnum; ++ux ) {
+		sh = shdr(ux);
+		if ( (sh->sh_flags & SHF_ALLOC) && sh->sh_type != SHT_NOBITS && sh->sh_size )
+			memcpy(image + sh->sh_addr,elf + sh->sh_offset,sh->sh_size);
+	}
+
+	if ( !modenc_init(&m,image,size,end > size ? end - ((size + 3) & ~3u) : 0,eh->e_entry) ) {
+		fprintf(stderr,"%s: Image too large (%u bytes), or no entry point\n",path,(unsigned)size);
+		return 1;
+	}
+
+	for ( unsigned ux=1; ux<eh->e_shnum; ++ux ) {
+		sh = shdr(ux);
+		if ( sh->sh_type == SHT_RELA ) {
+			fprintf(stderr,"%s: RELA relocations are not supported\n",path);
+			return 1;
+		}
+		if ( sh->sh_type == SHT_REL && (shdr(sh->sh_info)->sh_flags & SHF_ALLOC) )
+			errs += relocs(&m,sh,path);
+	}
+	if ( errs )
+		return 1;
+	if ( !(out = modenc_output(&m,&bytes)) ) {
+		fprintf(stderr,"%s: Too many imports\n",path);
+		return 1;
+	}
+
+	fprintf(stderr,"%s: %u bytes + %u bss at 0x%06X, %u relocs, %u imports (%u relocs), image %u bytes\n",
+		path,(unsigned)m.size,(unsigned)m.bss,(unsigned)addr,m.nrelocs,m.nimports,m.nimprelocs,(unsigned)bytes);
+
+	if ( outpath && !(f = fopen(outpath,"w")) ) {
+		perror(outpath);
+		return 1;
+	}
+	write_hex(outpath ? f : stdout,addr,out,bytes);
+	if ( outpath )
+		fclose(f);
+
+	modenc_free(&m);
+	free(out);
+	free(image);
+	free(elf);
+	return 0;
+}
+
+// End mkmod.c
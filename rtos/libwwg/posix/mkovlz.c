@@ -0,0 +1,94 @@
+/* mkovlz.c -- Compress an overlay into an Intel hex image for xflash
+ * Warren W. Gay VE3WWG
+ *
+ * Usage: mkovlz [-r] -a load_addr [-o out.hex] overlay.bin
+ *
+ *	-a	Load address (LMA) of the overlay in SPI flash
+ *	-o	Output file (default stdout)
+ *	-r	Store raw (no compression)
+ *
+ * The overlay section is extracted with objcopy -O binary. The image
+ * written is never larger than the input, so it occupies the space
+ * that the linker allotted at the overlay's load address.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ovlz.h"
+#include "ovlzenc.h"
+#include "hexout.h"
+
+int
+main(int argc,char **argv) {
+	const char *outpath = 0;
+	uint32_t addr = 0, size, isize;
+	bool raw = false, got_addr = false;
+	uint8_t *in, *img;
+	FILE *f;
+	long n;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"a:o:rh")) != -1 ) {
+		switch ( optch ) {
+		case 'a':
+			addr = strtoul(optarg,0,0);
+			got_addr = true;
+			break;
+		case 'o':
+			outpath = optarg;
+			break;
+		case 'r':
+			raw = true;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if ( optind + 1 != argc || !got_addr ) {
+usage:		fprintf(stderr,"Usage: %s [-r] -a load_addr [-o out.hex] overlay.bin\n",argv[0]);
+		return 2;
+	}
+
+	if ( !(f = fopen(argv[optind],"rb")) ) {
+		perror(argv[optind]);
+		return 1;
+	}
+	fseek(f,0,SEEK_END);
+	n = ftell(f);
+	rewind(f);
+	size = n > 0 ? n : 0;
+	in = malloc(size + 1);
+	img = malloc(OVLZ_BOUND(size));
+	if ( fread(in,1,size,f) != size ) {
+		perror(argv[optind]);
+		return 1;
+	}
+	fclose(f);
+
+	if ( raw ) {
+		memcpy(img,in,size);
+		isize = size;
+	} else	isize = ovlz_image(in,size,img,false);
+
+	fprintf(stderr,"%s: %u bytes at 0x%06X, image %u bytes (%s, %u%%)\n",
+		argv[optind],(unsigned)size,(unsigned)addr,(unsigned)isize,
+		isize < size ? "compressed" : "raw",
+		size ? (unsigned)(isize * 100 / size) : 100);
+
+	if ( outpath && !(f = fopen(outpath,"w")) ) {
+		perror(outpath);
+		return 1;
+	}
+	write_hex(outpath ? f : stdout,addr,img,isize);
+	if ( outpath )
+		fclose(f);
+
+	free(in);
+	free(img);
+	return 0;
+}
+
+// End mkovlz.c
@@ -0,0 +1,325 @@
+/* modbench.c -- Exercise the module loader against the W25 simulator
+ * Warren W. Gay VE3WWG
+ *
+ * Builds synthetic modules with modenc (pseudo random code, a local
+ * relocation every rstep bytes and a few imports), loads them with
+ * module.c and checks every patched word. Then checks the arena
+ * (reuse of a hole, out of memory) and the refusal of a missing
+ * import, a corrupt image and a bad relocation. Reports virtual
+ * load time and the bytes read over SPI.
+ *
+ * Usage: modbench [-k spi_khz]
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libopencm3/stm32/spi.h>
+
+#include "winbond.h"
+#include "module.h"
+#include "modenc.h"
+#include "hosted.h"
+#include "w25sim.h"
+
+#define ARENA_SIZE	16384
+
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(8)));
+
+static const struct s_modexport exports[] = {
+	MODULE_EXPORT(w25_read_data),
+	MODULE_EXPORT(w25_read_sr1),
+	MODULE_EXPORT(module_load),
+	MODULE_EXPORT(module_unload),
+	MODULE_EXPORT(host_now_ns),
+};
+
+static const char *imports[] = {
+	"w25_read_data", "host_now_ns", "module_load",
+};
+
+/*********************************************************************
+ * A synthetic module, stored at addr. The expected contents after
+ * loading at base are recomputed by check().
+ *********************************************************************/
+
+struct s_synth {
+	uint32_t	addr;		// SPI flash address
+	uint32_t	size, bss;
+	uint32_t	rstep;		// Bytes between local relocations
+	uint32_t	istep;		// Bytes between import relocations
+	uint8_t		*image;		// As linked
+	uint32_t	bytes;		// Stored size
+};
+
+static uint32_t
+prng(uint32_t *seed) {
+	*seed = *seed * 1103515245u + 12345u;
+	return *seed >> 8;
+}
+
+static uint32_t
+synth(struct s_synth *s,uint32_t addr,uint32_t size,uint32_t bss,uint32_t rstep,uint32_t istep) {
+	struct s_modenc m;
+	uint32_t seed = addr ^ size, *words;
+	uint8_t *out;
+
+	s->addr = addr;
+	s->size = size;
+	s->bss = bss;
+	s->rstep = rstep;
+	s->istep = istep;
+	s->image = calloc(size,1);
+	words = (uint32_t *)s->image;
+	for ( uint32_t ux=0; ux<size/4; ++ux )
+		words[ux] = prng(&seed);
+
+	for ( uint32_t off=0; off<size; off += 4 ) {
+		if ( rstep && off % rstep == 0 )
+			words[off/4] = prng(&seed) % size;		// Pointer into module
+		else if ( istep && off % istep == 4 )
+			words[off/4] = off & 0xFF;			// Addend
+	}
+
+	modenc_init(&m,s->image,size,bss,1);
+	for ( uint32_t off=0; off<size; off += 4 ) {
+		if ( rstep && off % rstep == 0 )
+			modenc_reloc(&m,off);
+		else if ( istep && off % istep == 4 )
+			modenc_import(&m,off,imports[(off / istep) % 3]);
+	}
+	out = modenc_output(&m,&s->bytes);
+	memcpy(w25sim_mem() + addr,out,s->bytes);
+	free(out);
+	modenc_free(&m);
+	return s->bytes;
+}
+
+/*********************************************************************
+ * Check a loaded module word by word
+ *********************************************************************/
+
+static unsigned
+check(const struct s_synth *s,const struct s_module *mod) {
+	const uint32_t *img = (const uint32_t *)s->image, *ram = (const uint32_t *)mod->base;
+	uint32_t want;
+	unsigned bad = 0;
+
+	for ( uint32_t off=0; off<s->size; off += 4 ) {
+		want = img[off/4];
+		if ( s->rstep && off % s->rstep == 0 )
+			want += (uint32_t)(uintptr_t)mod->base;
+		else if ( s->istep && off % s->istep == 4 )
+			want += (uint32_t)(uintptr_t)module_export(imports[(off / s->istep) % 3])->addr;
+		if ( ram[off/4] != want )
+			++bad;
+	}
+	for ( uint32_t off=s->size; off<s->size+s->bss; ++off )
+		if ( mod->base[off] )
+			++bad;
+	if ( mod->entry != mod->base + 1 )
+		++bad;
+	return bad;
+}
+
+/*********************************************************************
+ * Load, check and report timing for one module
+ *********************************************************************/
+
+static unsigned
+timed(const char *what,struct s_synth *s,struct s_module *mod) {
+	struct s_w25sim_stats st;
+	uint64_t t0;
+	unsigned bad;
+	int rc;
+
+	memset(arena,0xA5,sizeof arena);
+	w25sim_stats(&st,true);
+	t0 = host_now_ns();
+	rc = module_load(s->addr,mod);
+	w25sim_stats(&st,false);
+	if ( rc ) {
+		printf("%-24s load failed (%d)\n",what,rc);
+		return 1;
+	}
+	bad = check(s,mod);
+	printf("%-24s %6u %6u %6u %10.3f %9.1f%%%s\n",
+		what,(unsigned)s->size,(unsigned)s->bytes,(unsigned)st.bytes,
+		(host_now_ns() - t0) / 1e6,
+		(s->bytes - s->size) * 100.0 / s->size,
+		bad ? "  BAD" : "");
+	module_unload(mod);
+	return bad ? 1 : 0;
+}
+
+/*********************************************************************
+ * Arena allocation and error checks
+ *********************************************************************/
+
+static unsigned
+arena_checks(void) {
+	struct s_synth a, b, c, big, bad;
+	struct s_module ma, mb, mc, md, me;
+	unsigned fails = 0;
+	char *hole;
+	int rc;
+
+	synth(&a,0x200000,4096,0,16,64);
+	synth(&b,0x210000,2048,512,32,0);
+	synth(&c,0x220000,4096,0,0,32);
+	synth(&big,0x230000,ARENA_SIZE-4096,0,64,0);
+
+	if ( module_load(a.addr,&ma) || module_load(b.addr,&mb) || module_load(c.addr,&mc) ) {
+		printf("  arena: loading 3 modules failed\n");
+		return 1;
+	}
+	if ( check(&a,&ma) || check(&b,&mb) || check(&c,&mc) )
+		++fails;
+
+	// A module that fits the hole left by b goes there:
+	hole = mb.base;
+	module_unload(&mb);
+	if ( module_load(b.addr,&md) || check(&b,&md) )
+		++fails;
+	if ( md.base != hole ) {
+		printf("  arena: hole not reused\n");
+		++fails;
+	}
+
+	// Too large for what is left:
+	if ( (rc = module_load(big.addr,&me)) != MODERR_NOMEM ) {
+		printf("  arena: expected MODERR_NOMEM, got %d\n",rc);
+		++fails;
+	}
+	module_unload(&ma);
+	module_unload(&mc);
+	module_unload(&md);
+	if ( module_load(big.addr,&me) || check(&big,&me) ) {
+		printf("  arena: big module failed after unloading\n");
+		++fails;
+	}
+	module_unload(&me);
+
+	// Missing import:
+	module_init(SPI1,arena,sizeof arena,exports,2);
+	if ( (rc = module_load(a.addr,&ma)) != MODERR_IMPORT || strcmp(ma.missing,"host_now_ns") ) {
+		printf("  missing import not reported (%d, \"%s\")\n",rc,ma.missing);
+		++fails;
+	}
+	module_init(SPI1,arena,sizeof arena,exports,sizeof exports/sizeof exports[0]);
+
+	// Corrupt image:
+	synth(&bad,0x240000,1024,0,16,0);
+	w25sim_mem()[bad.addr + sizeof(struct s_modhdr) + 100] ^= 0x04;
+	if ( (rc = module_load(bad.addr,&ma)) != MODERR_CRC ) {
+		printf("  corrupt image not detected (%d)\n",rc);
+		++fails;
+	}
+	free(bad.image);
+
+	// A bss size that would wrap the arena size:
+	synth(&bad,0x270000,1024,0,16,0);
+	memcpy(w25sim_mem() + bad.addr + offsetof(struct s_modhdr,bss),&(uint32_t){0xFFFFFFFD},4);
+	if ( (rc = module_load(bad.addr,&ma)) != MODERR_FORMAT ) {
+		printf("  huge bss accepted (%d)\n",rc);
+		++fails;
+	}
+	free(bad.image);
+
+	// Relocation outside the image:
+	synth(&bad,0x250000,1024,0,16,0);
+	w25sim_mem()[bad.addr + bad.bytes - 1] = 0x7F;
+	if ( (rc = module_load(bad.addr,&ma)) != MODERR_FORMAT ) {
+		printf("  bad relocation not detected (%d)\n",rc);
+		++fails;
+	}
+
+	// Not a module:
+	if ( (rc = module_load(0x260000,&ma)) != MODERR_FORMAT ) {
+		printf("  erased flash accepted (%d)\n",rc);
+		++fails;
+	}
+
+	if ( fails )
+		printf("  arena/error checks: %u failures\n",fails);
+	free(a.image);
+	free(b.image);
+	free(c.image);
+	free(big.image);
+	free(bad.image);
+	return fails;
+}
+
+/*********************************************************************
+ * Run at one SPI clock
+ *********************************************************************/
+
+static unsigned
+run(uint32_t spi_hz) {
+	static const struct {
+		const char	*name;
+		uint32_t	size, bss, rstep, istep;
+	} mods[] = {
+		{ "1K, no relocations",	1024, 0, 0, 0 },
+		{ "1K, reloc/32 bytes",	1024, 64, 32, 128 },
+		{ "4K, reloc/32 bytes",	4096, 256, 32, 128 },
+		{ "4K, reloc/8 bytes",	4096, 256, 8, 64 },
+		{ "12K, reloc/32 bytes",12288, 1024, 32, 256 },
+	};
+	struct s_w25sim_cfg cfg;
+	struct s_synth s;
+	struct s_module mod;
+	unsigned fails = 0;
+
+	w25sim_defaults(&cfg);
+	cfg.spi_hz = spi_hz;
+	if ( w25sim_open(&cfg) )
+		exit(1);
+	w25_init(SPI1);
+	module_init(SPI1,arena,sizeof arena,exports,sizeof exports/sizeof exports[0]);
+
+	printf("\nSPI clock %u kHz\n",(unsigned)(spi_hz / 1000));
+	printf("%-24s %6s %6s %6s %10s %10s\n","Module","Bytes","Stored","Read","Load ms","Overhead");
+
+	for ( unsigned ux=0; ux<sizeof mods/sizeof mods[0]; ++ux ) {
+		synth(&s,0x100000 + ux * 0x10000,mods[ux].size,mods[ux].bss,mods[ux].rstep,mods[ux].istep);
+		fails += timed(mods[ux].name,&s,&mod);
+		free(s.image);
+	}
+	fails += arena_checks();
+
+	w25sim_close();
+	return fails;
+}
+
+int
+main(int argc,char **argv) {
+	uint32_t khz = 0;
+	unsigned fails = 0;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"k:h")) != -1 ) {
+		switch ( optch ) {
+		case 'k':
+			khz = strtoul(optarg,0,10);
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-k spi_khz]\n",argv[0]);
+			return 2;
+		}
+	}
+
+	if ( khz )
+		fails += run(khz * 1000);
+	else	{
+		fails += run(72000000 / 256);	// SPI_CR1_BAUDRATE_FPCLK_DIV_256
+		fails += run(72000000 / 4);	// SPI_CR1_BAUDRATE_FPCLK_DIV_4
+	}
+
+	printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End modbench.c
@@ -0,0 +1,157 @@
+/* modenc.c -- Host side loadable module image builder
+ * Warren W. Gay VE3WWG
+ *
+ * Collects a module's image, relocations and imports, and lays them
+ * out as ../src/module.c reads them (see module.h). Relocations are
+ * sorted, so that the loader patches the image in address order.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "ovlz.h"
+#include "module.h"
+#include "modenc.h"
+
+/*********************************************************************
+ * Start a module from image (size bytes, padded here to a multiple
+ * of 4). Returns false if the image is too large for 16 bit word
+ * indexes, or entry is outside of it.
+ *********************************************************************/
+
+bool
+modenc_init(struct s_modenc *m,const void *image,uint32_t size,uint32_t bss,uint32_t entry) {
+
+	memset(m,0,sizeof *m);
+	m->size = (size + 3) & ~3u;
+	if ( m->size > 0x40000 || (entry & ~1u) >= m->size )
+		return false;
+	m->image = calloc(m->size ? m->size : 1,1);
+	memcpy(m->image,image,size);
+	m->bss = bss;
+	m->entry = entry;
+	return true;
+}
+
+/*********************************************************************
+ * Internal: Word index for offset, -1 if unaligned or outside image
+ *********************************************************************/
+
+static int
+word_index(const struct s_modenc *m,uint32_t offset) {
+
+	if ( (offset & 3) || offset + 4 > m->size )
+		return -1;
+	return offset / 4;
+}
+
+/*********************************************************************
+ * The word at offset holds an image offset: add the load address
+ *********************************************************************/
+
+bool
+modenc_reloc(struct s_modenc *m,uint32_t offset) {
+	int wx = word_index(m,offset);
+
+	if ( wx < 0 || m->nrelocs >= 0xFFFF )
+		return false;
+	m->relocs = realloc(m->relocs,(m->nrelocs + 1) * sizeof *m->relocs);
+	m->relocs[m->nrelocs++] = wx;
+	return true;
+}
+
+/*********************************************************************
+ * The word at offset holds an addend: add the address of name
+ *********************************************************************/
+
+bool
+modenc_import(struct s_modenc *m,uint32_t offset,const char *name) {
+	int wx = word_index(m,offset);
+	unsigned ix;
+
+	if ( wx < 0 || strlen(name) >= MODULE_MAXNAME || m->nimprelocs >= 0xFFFF )
+		return false;
+
+	for ( ix=0; ix<m->nimports && strcmp(m->imports[ix],name); ++ix )
+		;
+	if ( ix >= m->nimports ) {
+		m->imports = realloc(m->imports,(m->nimports + 1) * sizeof *m->imports);
+		m->imports[m->nimports++] = strdup(name);
+	}
+
+	m->imprelocs = realloc(m->imprelocs,(m->nimprelocs + 1) * 2 * sizeof *m->imprelocs);
+	m->imprelocs[m->nimprelocs * 2] = wx;
+	m->imprelocs[m->nimprelocs * 2 + 1] = ix;
+	++m->nimprelocs;
+	return true;
+}
+
+/*********************************************************************
+ * Internal: Order relocations by (leading) word index
+ *********************************************************************/
+
+static int
+cmp_word(const void *a,const void *b) {
+	return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+/*********************************************************************
+ * Lay out the module as stored in SPI flash. Returns a malloc'd
+ * buffer of *bytes bytes, or null if there are too many names.
+ *********************************************************************/
+
+uint8_t *
+modenc_output(struct s_modenc *m,uint32_t *bytes) {
+	struct s_modhdr hdr;
+	uint32_t namebytes = 0, off;
+	uint8_t *out;
+
+	for ( unsigned ux=0; ux<m->nimports; ++ux )
+		namebytes += strlen(m->imports[ux]) + 1;
+	if ( namebytes > 0xFFFF || m->nimports > 0xFFFF )
+		return 0;
+
+	if ( m->nrelocs )
+		qsort(m->relocs,m->nrelocs,sizeof *m->relocs,cmp_word);
+	if ( m->nimprelocs )
+		qsort(m->imprelocs,m->nimprelocs,2 * sizeof *m->imprelocs,cmp_word);
+
+	hdr.magic = MODULE_MAGIC;
+	hdr.size = m->size;
+	hdr.bss = m->bss;
+	hdr.entry = m->entry;
+	hdr.nrelocs = m->nrelocs;
+	hdr.nimprelocs = m->nimprelocs;
+	hdr.nimports = m->nimports;
+	hdr.namebytes = namebytes;
+	hdr.crc = ovlz_crc32(m->image,m->size);
+
+	*bytes = sizeof hdr + namebytes + m->size + m->nrelocs * 2 + m->nimprelocs * 4;
+	out = malloc(*bytes);
+
+	memcpy(out,&hdr,sizeof hdr);
+	off = sizeof hdr;
+	for ( unsigned ux=0; ux<m->nimports; ++ux ) {
+		strcpy((char *)out + off,m->imports[ux]);
+		off += strlen(m->imports[ux]) + 1;
+	}
+	memcpy(out + off,m->image,m->size);
+	off += m->size;
+	memcpy(out + off,m->relocs,m->nrelocs * 2);
+	off += m->nrelocs * 2;
+	memcpy(out + off,m->imprelocs,m->nimprelocs * 4);
+	return out;
+}
+
+void
+modenc_free(struct s_modenc *m) {
+
+	for ( unsigned ux=0; ux<m->nimports; ++ux )
+		free(m->imports[ux]);
+	free(m->imports);
+	free(m->relocs);
+	free(m->imprelocs);
+	free(m->image);
+	memset(m,0,sizeof *m);
+}
+
+// End modenc.c
@@ -0,0 +1,31 @@
+/* modenc.h -- Host side loadable module image builder
+ * Warren W. Gay VE3WWG
+ */
+#ifndef MODENC_H
+#define MODENC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct s_modenc {
+	uint8_t		*image;		// Code and data, linked at 0
+	uint32_t	size;		// Image bytes (multiple of 4)
+	uint32_t	bss;		// Zeroed bytes after image
+	uint32_t	entry;		// Entry offset (Thumb bit set)
+	uint16_t	*relocs;	// Word indexes
+	unsigned	nrelocs;
+	uint16_t	*imprelocs;	// (word index, import #) pairs
+	unsigned	nimprelocs;
+	char		**imports;	// Import names
+	unsigned	nimports;
+};
+
+bool modenc_init(struct s_modenc *m,const void *image,uint32_t size,uint32_t bss,uint32_t entry);
+bool modenc_reloc(struct s_modenc *m,uint32_t offset);
+bool modenc_import(struct s_modenc *m,uint32_t offset,const char *name);
+uint8_t *modenc_output(struct s_modenc *m,uint32_t *bytes);
+void modenc_free(struct s_modenc *m);
+
+#endif // MODENC_H
+
+// End modenc.h
@@ -0,0 +1,475 @@
+/* ovlbench.c -- Compare raw and compressed overlay loading
+ * Warren W. Gay VE3WWG
+ *
+ * Loads each sample through overlay.c from the W25 simulator, once
+ * stored raw and once as mkovlz would store it (compressed, unless
+ * that does not pay), checks the region contents and reports bytes
+ * read over SPI and virtual load time. Residency records are checked
+ * across simulated warm resets. Finally, calls through overlay_enter()
+ * are timed with and without overlay_prefetch() of the next overlay,
+ * reporting stall cycles (72 MHz) per call.
+ *
+ * Usage: ovlbench [-k spi_khz] [overlay.bin...]
+ *
+ * Give the overlay binaries of a real build (objcopy -O binary -j.fee
+ * main.elf fee.bin) for Thumb code figures. Without arguments, pieces
+ * of this program's own .text are used (host code, not Thumb). The
+ * virtual time counts SPI transfers only; decompression CPU time on
+ * the target is not modelled. Work done between overlay calls is
+ * modelled by advancing the clock.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <elf.h>
+
+#include <libopencm3/stm32/spi.h>
+
+#include "winbond.h"
+#include "overlay.h"
+#include "ovlz.h"
+#include "ovlzenc.h"
+#include "hosted.h"
+#include "w25sim.h"
+
+#define MAX_SAMPLES	16
+#define REGION_SIZE	16384
+#define PF_OVERLAYS	4		// Overlays in prefetch runs
+#define PF_ROUNDS	100
+
+struct s_sample {
+	char		name[32];
+	uint8_t		*data;
+	uint32_t	size;
+};
+
+static struct s_sample samples[MAX_SAMPLES];
+static unsigned nsamples = 0;
+static unsigned faults = 0;
+static char region[REGION_SIZE];
+
+void
+overlay_fault(struct s_overlay *ov) {
+	(void)ov;
+	++faults;
+}
+
+/*********************************************************************
+ * Load a sample from a file
+ *********************************************************************/
+
+static void
+load_file(const char *path) {
+	struct s_sample *s = &samples[nsamples];
+	FILE *f = fopen(path,"rb");
+	long n;
+
+	if ( !f ) {
+		perror(path);
+		exit(1);
+	}
+	fseek(f,0,SEEK_END);
+	n = ftell(f);
+	rewind(f);
+	if ( n <= 0 || n > REGION_SIZE ) {
+		fprintf(stderr,"%s: bad size %ld\n",path,n);
+		exit(1);
+	}
+	s->size = n;
+	s->data = malloc(n);
+	if ( fread(s->data,1,n,f) != (size_t)n ) {
+		perror(path);
+		exit(1);
+	}
+	fclose(f);
+	snprintf(s->name,sizeof s->name,"%s",path);
+	++nsamples;
+}
+
+/*********************************************************************
+ * Take samples of increasing size from our own .text section
+ *********************************************************************/
+
+static void
+self_samples(void) {
+	static const uint32_t sizes[] = { 256, 512, 1024, 2048, 4096 };
+	Elf64_Ehdr eh;
+	Elf64_Shdr sh, strsh;
+	char name[16];
+	FILE *f = fopen("/proc/self/exe","rb");
+	uint32_t off = 0, text = 0, textsz = 0;
+
+	if ( !f || fread(&eh,sizeof eh,1,f) != 1 )
+		goto fail;
+	fseek(f,eh.e_shoff + eh.e_shstrndx * sizeof sh,SEEK_SET);
+	if ( fread(&strsh,sizeof strsh,1,f) != 1 )
+		goto fail;
+	for ( unsigned ux=0; ux<eh.e_shnum; ++ux ) {
+		fseek(f,eh.e_shoff + ux * sizeof sh,SEEK_SET);
+		if ( fread(&sh,sizeof sh,1,f) != 1 )
+			goto fail;
+		fseek(f,strsh.sh_offset + sh.sh_name,SEEK_SET);
+		if ( !fgets(name,sizeof name,f) )
+			goto fail;
+		if ( !strcmp(name,".text") ) {
+			text = sh.sh_offset;
+			textsz = sh.sh_size;
+			break;
+		}
+	}
+
+	for ( unsigned ux=0; ux<sizeof sizes/sizeof sizes[0]; ++ux ) {
+		struct s_sample *s = &samples[nsamples];
+
+		if ( off + sizes[ux] > textsz )
+			break;
+		s->size = sizes[ux];
+		s->data = malloc(s->size);
+		fseek(f,text + off,SEEK_SET);
+		if ( fread(s->data,1,s->size,f) != s->size )
+			goto fail;
+		snprintf(s->name,sizeof s->name,".text+%u",(unsigned)off);
+		off += sizes[ux];
+		++nsamples;
+	}
+	fclose(f);
+	return;
+
+fail:	fprintf(stderr,"Unable to read /proc/self/exe\n");
+	exit(1);
+}
+
+/*********************************************************************
+ * Load overlay ov into the (only) region, returning ns and SPI bytes
+ *********************************************************************/
+
+static uint64_t
+timed_load(struct s_ovregion *rgn,struct s_overlay *ov,uint64_t *bytes) {
+	struct s_w25sim_stats st;
+	uint64_t t0;
+
+	memset(region,0,sizeof region);	// Nothing to restore
+	overlay_init(SPI1,rgn,1,ov,1,0);
+	w25sim_stats(&st,true);
+	t0 = host_now_ns();
+	overlay_load(ov);
+	w25sim_stats(&st,false);
+	*bytes = st.bytes;
+	return host_now_ns() - t0;
+}
+
+/*********************************************************************
+ * Warm reset: a resident overlay is kept if its region is intact and
+ * still matches its image in flash
+ *********************************************************************/
+
+static unsigned
+warm_reset(struct s_ovregion *rgn,struct s_overlay *ov) {
+	uint8_t *flash = w25sim_mem() + (uintptr_t)ov->start;
+	const struct s_ovlzhdr *hdr = (const struct s_ovlzhdr *)flash;
+	bool lz = hdr->magic == OVLZ_MAGIC;
+	unsigned at = lz ? offsetof(struct s_ovlzhdr,crc) : ov->size / 2;
+	uint64_t most = 8 + sizeof *hdr;	// Header read (8 for the command)
+	struct s_w25sim_stats st;
+	unsigned fails = 0;
+
+	if ( !lz )
+		most += ov->size + 8 * ((ov->size + 63) / 64);	// Compared raw
+
+	overlay_init(SPI1,rgn,1,ov,1,0x1234);
+	overlay_load(ov);
+
+	// Same build, intact region: only the image is checked
+	w25sim_stats(&st,true);
+	overlay_init(SPI1,rgn,1,ov,1,0x1234);
+	overlay_load(ov);
+	w25sim_stats(&st,false);
+	if ( rgn->restores != 1 || st.bytes > most || overlay_verify() != 0 )
+		++fails;
+
+	// Relinked and reflashed, same build hash: the image differs
+	flash[at] ^= 0x01;
+	overlay_init(SPI1,rgn,1,ov,1,0x1234);
+	if ( rgn->restores != 0 || ov->entry )
+		++fails;
+	flash[at] ^= 0x01;
+	overlay_load(ov);
+
+	// Stray write into the region is caught:
+	region[ov->size / 2] ^= 0x01;
+	if ( overlay_verify() != 1 || ov->entry || rgn->corrupt != 1 )
+		++fails;
+	overlay_load(ov);
+
+	// A stray write before the reset forces a reload:
+	region[1] ^= 0x80;
+	overlay_init(SPI1,rgn,1,ov,1,0x1234);
+	if ( rgn->restores != 0 || ov->entry )
+		++fails;
+	overlay_load(ov);
+
+	// So does a different build:
+	overlay_init(SPI1,rgn,1,ov,1,0x4321);
+	if ( rgn->restores != 0 || ov->entry )
+		++fails;
+
+	if ( fails )
+		printf("  warm reset check failed\n");
+	return fails;
+}
+
+/*********************************************************************
+ * Call overlays in the order given by seq, doing work_ns of other
+ * work between calls, optionally prefetching the next overlay first.
+ * Returns failures; the stall and time per call are returned.
+ *********************************************************************/
+
+static unsigned
+pf_run(struct s_ovregion *rgns,unsigned nrgns,struct s_overlay *ovs,const struct s_sample *parts,
+  const unsigned *seq,unsigned nseq,bool prefetch,uint64_t work_ns,double *stall,double *call_ns) {
+	unsigned n = nseq * PF_ROUNDS, fails = 0, x;
+	uint64_t t0, stalls = 0;
+	void *entry;
+
+	memset(region,0,sizeof region);
+	overlay_init(SPI1,rgns,nrgns,ovs,PF_OVERLAYS,0);
+
+	t0 = host_now_ns();
+	for ( unsigned ux=0; ux<n; ++ux ) {
+		x = seq[ux % nseq];
+		entry = overlay_enter(&ovs[x]);
+		if ( !entry || memcmp(entry,parts[x].data,parts[x].size) )
+			++fails;
+		overlay_leave(&ovs[x]);
+
+		if ( prefetch )
+			overlay_prefetch(ovs[seq[(ux + 1) % nseq]].start);
+		host_advance_ns(work_ns);
+	}
+	overlay_prefetch_wait();
+
+	for ( unsigned ux=0; ux<PF_OVERLAYS; ++ux )
+		stalls += ovs[ux].stall;
+	*stall = (double)stalls / n;
+	*call_ns = (double)(host_now_ns() - t0) / n;
+	return fails;
+}
+
+/*********************************************************************
+ * Prefetch: the largest sample, split into PF_OVERLAYS overlays
+ *********************************************************************/
+
+static unsigned
+prefetch_bench(void) {
+	static const unsigned alt[] = { 0, 1 }, cycle[] = { 0, 1, 2, 3 };
+	static const struct {
+		const char	*name;
+		const unsigned	*seq;
+		unsigned	nseq, nrgns, work;	// work in % of a load
+		bool		prefetch;
+	} runs[] = {
+		{ "alternate, 1 region",	alt, 2, 1, 125, false },
+		{ "  prefetching",		alt, 2, 1, 125, true },
+		{ "cycle of 4, 2 regions",	cycle, 4, 2, 125, false },
+		{ "  prefetching",		cycle, 4, 2, 125, true },
+		{ "  short work",		cycle, 4, 2, 25, true },
+	};
+	struct s_sample parts[PF_OVERLAYS], *big = &samples[0];
+	struct s_ovregion rgns[2];
+	struct s_overlay ovs[PF_OVERLAYS];
+	uint8_t *img = malloc(OVLZ_BOUND(REGION_SIZE));
+	uint32_t at, isize, psize, rsize;
+	uint64_t load_ns = 0;
+	double stall, call_ns;
+	unsigned fails = 0, loads;
+	bool pf_ok = false;
+
+	for ( unsigned ux=1; ux<nsamples; ++ux )
+		if ( samples[ux].size > big->size )
+			big = &samples[ux];
+	psize = big->size / PF_OVERLAYS;
+	rsize = REGION_SIZE / 2;
+
+	rgns[0] = (struct s_ovregion){ region, rsize, 0, 0, 0, 0 };
+	rgns[1] = (struct s_ovregion){ region + rsize, rsize, 0, 0, 0, 0 };
+
+	for ( unsigned ux=0; ux<PF_OVERLAYS; ++ux ) {
+		parts[ux].data = big->data + ux * psize;
+		parts[ux].size = psize;
+		at = 0x100000 + ux * 0x10000;
+		isize = ovlz_image(parts[ux].data,psize,img,false);
+		memcpy(w25sim_mem()+at,img,isize);
+
+		memset(&ovs[ux],0,sizeof ovs[ux]);
+		ovs[ux].start = (char *)(uintptr_t)at;
+		ovs[ux].stop = ovs[ux].start + psize;
+		ovs[ux].vma = ovs[ux].func = region;
+	}
+
+	// Time of one load, to scale the work between calls:
+	for ( unsigned ux=0; ux<PF_OVERLAYS; ++ux ) {
+		ovs[ux].regions = 1;
+		load_ns += timed_load(&rgns[0],&ovs[ux],&(uint64_t){0});
+	}
+	load_ns /= PF_OVERLAYS;
+
+	printf("\nPrefetch: %u overlays of %u bytes from %s, load %.1f us\n",
+		PF_OVERLAYS,(unsigned)psize,big->name,load_ns / 1e3);
+	printf("%-24s %8s %6s %12s %10s\n","Scenario","Work us","Loads","Stall cyc","Call us");
+
+	for ( unsigned rx=0; rx<sizeof runs/sizeof runs[0]; ++rx ) {
+		uint64_t work_ns = load_ns * runs[rx].work / 100;
+
+		for ( unsigned ux=0; ux<PF_OVERLAYS; ++ux )
+			ovs[ux].regions = (1u << runs[rx].nrgns) - 1;
+		fails += pf_run(rgns,runs[rx].nrgns,ovs,parts,runs[rx].seq,runs[rx].nseq,
+			runs[rx].prefetch,work_ns,&stall,&call_ns);
+		loads = 0;
+		for ( unsigned ux=0; ux<PF_OVERLAYS; ++ux )
+			loads += ovs[ux].loads;
+		printf("%-24s %8.1f %6u %12.0f %10.1f\n",
+			runs[rx].name,work_ns / 1e3,loads,stall,call_ns / 1e3);
+	}
+	if ( fails )
+		printf("  %u prefetched calls found bad contents\n",fails);
+
+	// Reading the flash during a prefetch completes the prefetch first
+	// (a new build, so that nothing is restored):
+	overlay_init(SPI1,rgns,2,ovs,PF_OVERLAYS,1);
+	if ( overlay_prefetch(ovs[0].start) ) {
+		uint8_t buf[64];
+
+		at = (uint32_t)(uintptr_t)ovs[1].start;
+		w25_read_data(SPI1,at,buf,sizeof buf);
+		pf_ok = ovs[0].entry && !memcmp(ovs[0].entry,parts[0].data,psize)
+			&& !memcmp(buf,w25sim_mem()+at,sizeof buf);
+	}
+	if ( !pf_ok ) {
+		printf("  flash read during a prefetch failed\n");
+		++fails;
+	}
+
+	free(img);
+	return fails;
+}
+
+/*********************************************************************
+ * Run all samples at one SPI clock
+ *********************************************************************/
+
+static unsigned
+run(uint32_t spi_hz) {
+	struct s_w25sim_cfg cfg;
+	struct s_ovregion rgn = { region, REGION_SIZE, 0, 0, 0, 0 };
+	struct s_overlay ov;
+	uint8_t *img = malloc(OVLZ_BOUND(REGION_SIZE));
+	uint64_t raw_ns, lz_ns, raw_bytes, lz_bytes, tot_raw = 0, tot_lz = 0;
+	uint32_t raw_at, lz_at, isize;
+	unsigned fails = 0;
+
+	w25sim_defaults(&cfg);
+	cfg.spi_hz = spi_hz;
+	if ( w25sim_open(&cfg) )
+		exit(1);
+	w25_init(SPI1);
+
+	printf("\nSPI clock %u kHz\n",(unsigned)(spi_hz / 1000));
+	printf("%-16s %6s %6s %10s %7s %10s %7s %6s\n",
+		"Overlay","Bytes","Image","Raw ms","Read","LZ ms","Read","Gain");
+
+	for ( unsigned ux=0; ux<nsamples; ++ux ) {
+		struct s_sample *s = &samples[ux];
+
+		raw_at = ux * 0x10000;
+		lz_at = raw_at + 0x8000;
+		memcpy(w25sim_mem()+raw_at,s->data,s->size);
+		isize = ovlz_image(s->data,s->size,img,false);
+		memcpy(w25sim_mem()+lz_at,img,isize);
+
+		memset(&ov,0,sizeof ov);
+		ov.vma = ov.func = region;
+		ov.regions = 1;
+
+		ov.start = (char *)(uintptr_t)raw_at;
+		ov.stop = ov.start + s->size;
+		raw_ns = timed_load(&rgn,&ov,&raw_bytes);
+		if ( memcmp(region,s->data,s->size) )
+			++fails;
+		fails += warm_reset(&rgn,&ov);
+
+		ov.start = (char *)(uintptr_t)lz_at;
+		ov.stop = ov.start + s->size;
+		lz_ns = timed_load(&rgn,&ov,&lz_bytes);
+		if ( memcmp(region,s->data,s->size) )
+			++fails;
+		fails += warm_reset(&rgn,&ov);
+
+		tot_raw += raw_ns;
+		tot_lz += lz_ns;
+		printf("%-16s %6u %5u%% %10.3f %7llu %10.3f %7llu %5.2fx\n",
+			s->name,
+			(unsigned)s->size,
+			(unsigned)(isize * 100 / s->size),
+			raw_ns / 1e6,(unsigned long long)raw_bytes,
+			lz_ns / 1e6,(unsigned long long)lz_bytes,
+			(double)raw_ns / lz_ns);
+
+		if ( isize >= s->size )
+			continue;		// Stored raw: no CRC
+
+		// A corrupted image must be refused:
+		w25sim_mem()[lz_at + isize / 2] ^= 0x10;
+		faults = 0;
+		ov.start = (char *)(uintptr_t)lz_at;
+		timed_load(&rgn,&ov,&lz_bytes);
+		if ( faults != 1 || ov.entry ) {
+			printf("  corrupt image not detected\n");
+			++fails;
+		}
+	}
+	printf("%-16s %6s %6s %10.3f %7s %10.3f %7s %5.2fx\n",
+		"Total","","",tot_raw / 1e6,"",tot_lz / 1e6,"",(double)tot_raw / tot_lz);
+
+	fails += prefetch_bench();
+
+	w25sim_close();
+	free(img);
+	return fails;
+}
+
+int
+main(int argc,char **argv) {
+	uint32_t khz = 0;
+	unsigned fails = 0;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"k:h")) != -1 ) {
+		switch ( optch ) {
+		case 'k':
+			khz = strtoul(optarg,0,10);
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-k spi_khz] [overlay.bin...]\n",argv[0]);
+			return 2;
+		}
+	}
+
+	for ( ; optind < argc && nsamples < MAX_SAMPLES; ++optind )
+		load_file(argv[optind]);
+	if ( !nsamples )
+		self_samples();
+
+	if ( khz )
+		fails += run(khz * 1000);
+	else	{
+		fails += run(72000000 / 256);	// SPI_CR1_BAUDRATE_FPCLK_DIV_256
+		fails += run(72000000 / 4);	// SPI_CR1_BAUDRATE_FPCLK_DIV_4
+	}
+
+	printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End ovlbench.c
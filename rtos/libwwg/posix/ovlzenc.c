@@ -0,0 +1,106 @@
+/* ovlzenc.c -- Host side overlay image compressor
+ * Warren W. Gay VE3WWG
+ *
+ * Produces the LZSS format decoded by ../src/ovlz.c. Matching is
+ * greedy with one step of lazy evaluation, searching the whole 4K
+ * window: overlays are small, so speed does not matter here.
+ */
+#include <string.h>
+
+#include "ovlz.h"
+#include "ovlzenc.h"
+
+/*********************************************************************
+ * Internal: Longest match for in[pos..], returns length (0 if none)
+ *********************************************************************/
+
+static uint32_t
+longest(const uint8_t *in,uint32_t size,uint32_t pos,uint32_t *dist) {
+	uint32_t best = 0, lim = size - pos, n;
+
+	if ( lim > OVLZ_MAXMATCH )
+		lim = OVLZ_MAXMATCH;
+	if ( lim < OVLZ_MINMATCH )
+		return 0;
+
+	for ( uint32_t d=1; d<=OVLZ_WINDOW && d<=pos; ++d ) {
+		const uint8_t *m = in + pos - d;
+
+		for ( n=0; n<lim && m[n] == in[pos+n]; ++n )
+			;
+		if ( n > best ) {
+			best = n;
+			*dist = d;
+			if ( n == lim )
+				break;
+		}
+	}
+	return best >= OVLZ_MINMATCH ? best : 0;
+}
+
+/*********************************************************************
+ * Compress size bytes from in to out (LZSS stream only, no header).
+ * out must hold OVLZ_BOUND(size) bytes. Returns compressed size.
+ *********************************************************************/
+
+uint32_t
+ovlz_encode(const uint8_t *in,uint32_t size,uint8_t *out) {
+	uint8_t *op = out, *flags = 0;
+	uint32_t pos = 0, len, dist = 0, len2, dist2;
+	unsigned bit = 8;
+
+	while ( pos < size ) {
+		if ( bit == 8 ) {
+			flags = op++;
+			*flags = 0;
+			bit = 0;
+		}
+
+		len = longest(in,size,pos,&dist);
+		if ( len > 0 && len < OVLZ_MAXMATCH ) {
+			// Lazy: prefer a literal if the next match is longer
+			len2 = longest(in,size,pos+1,&dist2);
+			if ( len2 > len + 1 )
+				len = 0;
+		}
+
+		if ( len == 0 ) {
+			*flags |= 1 << bit;
+			*op++ = in[pos++];
+		} else	{
+			*op++ = (dist - 1) & 0xFF;
+			*op++ = ((dist - 1) >> 4 & 0xF0) | (len - OVLZ_MINMATCH);
+			pos += len;
+		}
+		++bit;
+	}
+	return op - out;
+}
+
+/*********************************************************************
+ * Build the flash image for an overlay: header + compressed data, or
+ * the raw bytes when compression does not pay (unless force). The
+ * image never exceeds size bytes unless force is true, so it fits in
+ * the space the linker allotted. Returns the image size.
+ *********************************************************************/
+
+uint32_t
+ovlz_image(const uint8_t *in,uint32_t size,uint8_t *out,bool force) {
+	struct s_ovlzhdr hdr;
+	uint32_t csize;
+
+	csize = ovlz_encode(in,size,out+sizeof hdr);
+	if ( !force && sizeof hdr + csize >= size ) {
+		memcpy(out,in,size);
+		return size;
+	}
+
+	hdr.magic = OVLZ_MAGIC;
+	hdr.size = size;
+	hdr.csize = csize;
+	hdr.crc = ovlz_crc32(in,size);
+	memcpy(out,&hdr,sizeof hdr);
+	return sizeof hdr + csize;
+}
+
+// End ovlzenc.c
@@ -0,0 +1,17 @@
+/* ovlzenc.h -- Host side overlay image compressor
+ * Warren W. Gay VE3WWG
+ */
+#ifndef OVLZENC_H
+#define OVLZENC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+uint32_t ovlz_encode(const uint8_t *in,uint32_t size,uint8_t *out);
+uint32_t ovlz_image(const uint8_t *in,uint32_t size,uint8_t *out,bool force);
+
+#define OVLZ_BOUND(size)	(sizeof(struct s_ovlzhdr) + (size) + ((size) + 7) / 8)
+
+#endif // OVLZENC_H
+
+// End ovlzenc.h
@@ -0,0 +1,397 @@
+/* ssd1306sim.c -- SSD1306 128x64 OLED controller simulator (POSIX)
+ * Warren W. Gay VE3WWG
+ *
+ * Decodes the command and data stream of a 4-wire SPI SSD1306 into
+ * its display RAM: page, horizontal and vertical addressing, with
+ * the column and page windows, start line, display offset, segment
+ * and COM remapping, inverse and display on/off. As on the part,
+ * page mode address commands (0x00-0x1F, 0xB0-0xB7) are ignored in
+ * horizontal/vertical mode, and the window commands (0x21, 0x22) in
+ * page mode. Scrolling is accepted but not animated.
+ *
+ * Bytes arrive either through the hosted spi_enable()/spi_xfer()/
+ * spi_disable() calls, with D/C read from its GPIO pin, or from
+ * ssd1306sim_write() (the DMA stand-in). Commands may be split
+ * across chip selects, as the part allows.
+ *
+ * The panel is taken to be mounted as on the common modules: SEG0 at
+ * the right and COM0 at the bottom. With 0xA1 and 0xC0 (oled_init())
+ * the pixmap's bottom up rows then give an upright image.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/gpio.h>
+
+#include "hosted.h"
+#include "ssd1306sim.h"
+
+#define PAGES		(SSD1306SIM_HEIGHT / 8)
+
+static struct {
+	struct s_ssd1306sim_cfg	cfg;
+	uint64_t	byte_ns;	// Time to clock one byte
+	bool		cs;		// Chip selected
+
+	uint8_t		ram[PAGES][SSD1306SIM_WIDTH];
+	uint8_t		mode;		// 0 horizontal, 1 vertical, 2 page
+	uint8_t		col, page;	// RAM pointer
+	uint8_t		col_lo, col_hi;	// Window (0x21)
+	uint8_t		page_lo, page_hi; // Window (0x22)
+	uint8_t		start_line;	// 0x40-0x7F
+	uint8_t		offset;		// 0xD3
+	uint8_t		mux;		// 0xA8
+	uint8_t		contrast;	// 0x81
+	bool		seg_remap;	// 0xA1
+	bool		com_remap;	// 0xC8
+	bool		inverse;	// 0xA7
+	bool		entire_on;	// 0xA5
+	bool		display_on;	// 0xAF
+	bool		scrolling;	// 0x2F
+
+	uint8_t		cmd[8];		// Command being collected
+	unsigned	nbytes;		// Bytes of it so far
+
+	struct s_ssd1306sim_stats stats;
+} sim;
+
+/*********************************************************************
+ * Default configuration: SPI1 at 72 MHz / 256, D/C on PB10 and /RES
+ * on PB11, as wired for the oled projects
+ *********************************************************************/
+
+void
+ssd1306sim_defaults(struct s_ssd1306sim_cfg *cfg) {
+
+	cfg->spi_hz = 72000000 / 256;
+	cfg->dc_port = GPIOB;
+	cfg->dc_pin = GPIO10;
+	cfg->res_port = GPIOB;
+	cfg->res_pin = GPIO11;
+}
+
+/*********************************************************************
+ * Internal: Reset state (the RAM is not cleared, as on the part)
+ *********************************************************************/
+
+static void
+reset(void) {
+
+	sim.mode = 2;
+	sim.col = sim.page = 0;
+	sim.col_lo = 0;
+	sim.col_hi = SSD1306SIM_WIDTH - 1;
+	sim.page_lo = 0;
+	sim.page_hi = PAGES - 1;
+	sim.start_line = 0;
+	sim.offset = 0;
+	sim.mux = SSD1306SIM_HEIGHT - 1;
+	sim.contrast = 0x7F;
+	sim.seg_remap = sim.com_remap = false;
+	sim.inverse = sim.entire_on = false;
+	sim.display_on = false;
+	sim.scrolling = false;
+	sim.nbytes = 0;
+}
+
+static void
+gpio_changed(uint32_t gpioport,uint16_t levels) {
+
+	if ( gpioport == sim.cfg.res_port && !(levels & sim.cfg.res_pin) )
+		reset();
+}
+
+void
+ssd1306sim_open(const struct s_ssd1306sim_cfg *cfg) {
+
+	memset(&sim,0,sizeof sim);
+	sim.cfg = *cfg;
+	sim.byte_ns = 8000000000ull / cfg->spi_hz;
+	reset();
+	host_gpio_watch(gpio_changed);
+}
+
+/*********************************************************************
+ * Internal: Argument bytes following command byte c
+ *********************************************************************/
+
+static unsigned
+nargs(uint8_t c) {
+
+	switch ( c ) {
+	case 0x20: case 0x81: case 0x8D: case 0xA8:
+	case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+		return 1;
+	case 0x21: case 0x22: case 0xA3:
+		return 2;
+	case 0x29: case 0x2A:
+		return 5;
+	case 0x26: case 0x27:
+		return 6;
+	default:
+		return 0;
+	}
+}
+
+/*********************************************************************
+ * Internal: Execute the command collected in sim.cmd[]
+ *********************************************************************/
+
+static void
+execute(void) {
+	uint8_t c = sim.cmd[0];
+
+	++sim.stats.commands;
+
+	if ( c <= 0x0F ) {
+		if ( sim.mode == 2 )
+			sim.col = (sim.col & 0x70) | c;
+	} else if ( c <= 0x1F ) {
+		if ( sim.mode == 2 )
+			sim.col = (sim.col & 0x0F) | (c & 0x07) << 4;
+	} else if ( c >= 0x40 && c <= 0x7F ) {
+		sim.start_line = c & 0x3F;
+	} else if ( c >= 0xB0 && c <= 0xB7 ) {
+		if ( sim.mode == 2 )
+			sim.page = c & 0x07;
+	} else	{
+		switch ( c ) {
+		case 0x20:
+			if ( (sim.cmd[1] & 3) != 3 )
+				sim.mode = sim.cmd[1] & 3;
+			break;
+		case 0x21:
+			if ( sim.mode != 2 ) {
+				sim.col_lo = sim.cmd[1] & 0x7F;
+				sim.col_hi = sim.cmd[2] & 0x7F;
+				sim.col = sim.col_lo;
+			}
+			break;
+		case 0x22:
+			if ( sim.mode != 2 ) {
+				sim.page_lo = sim.cmd[1] & 0x07;
+				sim.page_hi = sim.cmd[2] & 0x07;
+				sim.page = sim.page_lo;
+			}
+			break;
+		case 0x26: case 0x27: case 0x29: case 0x2A: case 0xA3:
+			break;			// Scroll setup
+		case 0x2E:
+			sim.scrolling = false;
+			break;
+		case 0x2F:
+			sim.scrolling = true;
+			break;
+		case 0x81:
+			sim.contrast = sim.cmd[1];
+			break;
+		case 0xA0: case 0xA1:
+			sim.seg_remap = c & 1;
+			break;
+		case 0xA4: case 0xA5:
+			sim.entire_on = c & 1;
+			break;
+		case 0xA6: case 0xA7:
+			sim.inverse = c & 1;
+			break;
+		case 0xA8:
+			if ( (sim.cmd[1] & 0x3F) >= 15 )
+				sim.mux = sim.cmd[1] & 0x3F;
+			break;
+		case 0xAE: case 0xAF:
+			sim.display_on = c & 1;
+			break;
+		case 0xC0: case 0xC8:
+			sim.com_remap = c & 8;
+			break;
+		case 0xD3:
+			sim.offset = sim.cmd[1] & 0x3F;
+			break;
+		case 0x8D: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+		case 0xE3:
+			break;			// Analog settings, NOP
+		default:
+			++sim.stats.unknown;
+		}
+	}
+}
+
+/*********************************************************************
+ * Internal: Write display RAM and advance the pointer
+ *********************************************************************/
+
+static void
+data(uint8_t b) {
+
+	sim.ram[sim.page][sim.col] = b;
+
+	switch ( sim.mode ) {
+	case 0:					// Horizontal
+		if ( sim.col >= sim.col_hi ) {
+			sim.col = sim.col_lo;
+			sim.page = sim.page >= sim.page_hi ? sim.page_lo : sim.page + 1;
+		} else	++sim.col;
+		break;
+	case 1:					// Vertical
+		if ( sim.page >= sim.page_hi ) {
+			sim.page = sim.page_lo;
+			sim.col = sim.col >= sim.col_hi ? sim.col_lo : sim.col + 1;
+		} else	++sim.page;
+		break;
+	default:				// Page
+		sim.col = (sim.col + 1) % SSD1306SIM_WIDTH;
+	}
+}
+
+/*********************************************************************
+ * Internal: One byte from the bus
+ *********************************************************************/
+
+static void
+byte(bool isdata,uint8_t b) {
+
+	++sim.stats.bytes;
+	sim.stats.wire_ns += sim.byte_ns;
+
+	if ( isdata ) {
+		++sim.stats.data_bytes;
+		data(b);
+		return;
+	}
+
+	++sim.stats.cmd_bytes;
+	sim.cmd[sim.nbytes++] = b;
+	if ( sim.nbytes > nargs(sim.cmd[0]) ) {
+		execute();
+		sim.nbytes = 0;
+	}
+}
+
+/*********************************************************************
+ * Hosted SPI: the controller is the only device
+ *********************************************************************/
+
+void
+spi_enable(uint32_t spi) {
+
+	(void)spi;
+	if ( !sim.cs ) {
+		sim.cs = true;
+		++sim.stats.selects;
+	}
+}
+
+void
+spi_disable(uint32_t spi) {
+
+	(void)spi;
+	sim.cs = false;
+}
+
+uint16_t
+spi_xfer(uint32_t spi,uint16_t data) {
+
+	(void)spi;
+	host_advance_ns(sim.byte_ns);
+	byte(gpio_get(sim.cfg.dc_port,sim.cfg.dc_pin) != 0,data);
+	return 0;
+}
+
+/*********************************************************************
+ * A DMA transfer of n bytes, as commands or data. The caller's clock
+ * is not advanced (see stats.wire_ns).
+ *********************************************************************/
+
+void
+ssd1306sim_write(bool isdata,const uint8_t *buf,uint32_t n) {
+
+	++sim.stats.selects;
+	while ( n-- > 0 )
+		byte(isdata,*buf++);
+}
+
+void
+ssd1306sim_stats(struct s_ssd1306sim_stats *stats,bool reset) {
+
+	*stats = sim.stats;
+	if ( reset )
+		memset(&sim.stats,0,sizeof sim.stats);
+}
+
+const uint8_t *
+ssd1306sim_ram(void) {
+	return &sim.ram[0][0];
+}
+
+/*********************************************************************
+ * The image on the panel: 0 (dark) or 255 (lit) per pixel, top row
+ * first
+ *********************************************************************/
+
+void
+ssd1306sim_screen(uint8_t screen[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH]) {
+	unsigned com, row, col;
+	bool lit;
+
+	for ( unsigned y=0; y<SSD1306SIM_HEIGHT; ++y ) {
+		com = sim.com_remap ? y : SSD1306SIM_HEIGHT - 1 - y;
+		row = (com + sim.start_line + sim.offset) % SSD1306SIM_HEIGHT;
+		for ( unsigned x=0; x<SSD1306SIM_WIDTH; ++x ) {
+			col = sim.seg_remap ? x : SSD1306SIM_WIDTH - 1 - x;
+			lit = (sim.ram[row / 8][col] >> row % 8) & 1;
+			if ( sim.entire_on )
+				lit = true;
+			if ( sim.inverse )
+				lit = !lit;
+			if ( !sim.display_on || com > sim.mux )
+				lit = false;
+			screen[y][x] = lit ? 255 : 0;
+		}
+	}
+}
+
+/*********************************************************************
+ * Write the panel image as a binary PGM, each pixel scale x scale
+ *********************************************************************/
+
+int
+ssd1306sim_write_pgm(const char *path,unsigned scale) {
+	static uint8_t screen[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH];
+	FILE *f = fopen(path,"wb");
+
+	if ( !f ) {
+		perror(path);
+		return -1;
+	}
+	if ( !scale )
+		scale = 1;
+	ssd1306sim_screen(screen);
+	fprintf(f,"P5\n%u %u\n255\n",SSD1306SIM_WIDTH * scale,SSD1306SIM_HEIGHT * scale);
+	for ( unsigned y=0; y<SSD1306SIM_HEIGHT * scale; ++y )
+		for ( unsigned x=0; x<SSD1306SIM_WIDTH * scale; ++x )
+			fputc(screen[y / scale][x / scale],f);
+	return fclose(f) ? -1 : 0;
+}
+
+/*********************************************************************
+ * Read a PGM written by ssd1306sim_write_pgm() with scale 1
+ *********************************************************************/
+
+int
+ssd1306sim_read_pgm(const char *path,uint8_t screen[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH]) {
+	FILE *f = fopen(path,"rb");
+	unsigned w, h, maxval;
+	int rc = -1;
+
+	if ( !f )
+		return -1;
+	if ( fscanf(f,"P5 %u %u %u",&w,&h,&maxval) == 3 && fgetc(f) != EOF
+	  && w == SSD1306SIM_WIDTH && h == SSD1306SIM_HEIGHT && maxval == 255
+	  && fread(screen,SSD1306SIM_WIDTH,SSD1306SIM_HEIGHT,f) == SSD1306SIM_HEIGHT )
+		rc = 0;
+	fclose(f);
+	return rc;
+}
+
+// End ssd1306sim.c
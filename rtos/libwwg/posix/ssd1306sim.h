@@ -0,0 +1,55 @@
+/* ssd1306sim.h -- SSD1306 128x64 OLED controller simulator (POSIX)
+ * Warren W. Gay VE3WWG
+ */
+#ifndef SSD1306SIM_H
+#define SSD1306SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SSD1306SIM_WIDTH	128
+#define SSD1306SIM_HEIGHT	64
+
+/*********************************************************************
+ * Simulated panel, 4-wire SPI. D/C is read from a GPIO pin when the
+ * hosted spi_xfer() is used (low: command, high: data), and /RES
+ * low resets the controller.
+ *********************************************************************/
+
+struct s_ssd1306sim_cfg {
+	uint32_t	spi_hz;		// SCK frequency
+	uint32_t	dc_port;	// D/C GPIO (GPIOB)
+	uint16_t	dc_pin;		// (GPIO10)
+	uint32_t	res_port;	// /RES GPIO (GPIOB)
+	uint16_t	res_pin;	// (GPIO11)
+};
+
+/*********************************************************************
+ * Bus counters. A "frame" is whatever was sent between calls to
+ * ssd1306sim_stats() with reset set.
+ *********************************************************************/
+
+struct s_ssd1306sim_stats {
+	uint64_t	bytes;		// Bytes clocked over SPI
+	uint64_t	wire_ns;	// Time those took at spi_hz
+	uint32_t	cmd_bytes;	// Bytes sent with D/C low
+	uint32_t	data_bytes;	// Bytes sent with D/C high
+	uint32_t	commands;	// Commands decoded (with arguments)
+	uint32_t	selects;	// Chip select cycles / DMA transfers
+	uint32_t	unknown;	// Commands not understood
+};
+
+void ssd1306sim_defaults(struct s_ssd1306sim_cfg *cfg);
+void ssd1306sim_open(const struct s_ssd1306sim_cfg *cfg);
+
+void ssd1306sim_write(bool data,const uint8_t *buf,uint32_t n);
+void ssd1306sim_stats(struct s_ssd1306sim_stats *stats,bool reset);
+
+const uint8_t *ssd1306sim_ram(void);
+void ssd1306sim_screen(uint8_t screen[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH]);
+int ssd1306sim_write_pgm(const char *path,unsigned scale);
+int ssd1306sim_read_pgm(const char *path,uint8_t screen[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH]);
+
+#endif // SSD1306SIM_H
+
+// End ssd1306sim.h
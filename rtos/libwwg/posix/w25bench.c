@@ -0,0 +1,307 @@
+/* w25bench.c -- Exercise and benchmark winbond.c on the W25 simulator
+ * Warren W. Gay VE3WWG
+ *
+ * Runs the unmodified libwwg W25 driver against w25sim, checks the
+ * results against the simulated array, and reports virtual time and
+ * SPI traffic for typical access patterns.
+ *
+ * Usage: w25bench [-f image_file] [-k spi_khz]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libopencm3/stm32/spi.h>
+
+#include "winbond.h"
+#include "w25cache.h"
+#include "hosted.h"
+#include "w25sim.h"
+
+static unsigned failures = 0;
+
+#define CHECK(cond) \
+	do { if ( !(cond) ) { ++failures; printf("FAILED: %s (line %d)\n",#cond,__LINE__); } } while (0)
+
+/*********************************************************************
+ * Timing and traffic for one benchmark
+ *********************************************************************/
+
+struct s_mark {
+	uint64_t		t0;
+	struct s_w25sim_stats	stats;
+};
+
+static void
+mark(struct s_mark *m) {
+	m->t0 = host_now_ns();
+	w25sim_stats(&m->stats,true);
+}
+
+static uint64_t		// Returns elapsed ns
+report(const char *what,struct s_mark *m) {
+	struct s_w25sim_stats s;
+	uint64_t ns = host_now_ns() - m->t0;
+
+	w25sim_stats(&s,false);
+	printf("  %-34s %9.3f ms %8llu bytes %6u cmds\n",
+		what,
+		ns / 1e6,
+		(unsigned long long)s.bytes,
+		(unsigned)s.commands);
+	return ns;
+}
+
+/*********************************************************************
+ * Identify the part
+ *********************************************************************/
+
+static void
+identify(void) {
+	const struct s_w25dev *dev;
+	bool sfdp = w25_init(SPI1);
+
+	dev = w25_device(SPI1);
+	printf("JEDEC $%06X, %s, %u KB, page %u, %u-byte addresses\n",
+		(unsigned)dev->jedec_id,
+		sfdp ? "SFDP" : "no SFDP",
+		(unsigned)(dev->capacity / 1024),
+		dev->page_size,
+		dev->addr_bytes);
+	for ( unsigned ux=0; ux<W25_N_ERASE; ++ux )
+		if ( dev->erase[ux].size )
+			printf("  erase %2uK cmd $%02X typ %u ms\n",
+				(unsigned)(dev->erase[ux].size / 1024),
+				dev->erase[ux].cmd,
+				dev->erase[ux].typ_ms);
+}
+
+/*********************************************************************
+ * Program across page boundaries and check NOR semantics
+ *********************************************************************/
+
+static void
+program_test(uint32_t base) {
+	uint8_t buf[600], rbuf[600];
+	uint8_t *mem = w25sim_mem();
+	struct s_mark m;
+
+	for ( unsigned ux=0; ux<sizeof buf; ++ux )
+		buf[ux] = ux * 7 + 3;
+
+	CHECK(w25_erase_range(SPI1,base,8192,0,0));
+	mark(&m);
+	CHECK(w25_write_data(SPI1,base+0x1F0,buf,sizeof buf) == base+0x1F0+sizeof buf);
+	report("program 600 bytes (3 pages)",&m);
+	CHECK(!memcmp(mem+base+0x1F0,buf,sizeof buf));
+
+	w25_read_data(SPI1,base+0x1F0,rbuf,sizeof rbuf);
+	CHECK(!memcmp(rbuf,buf,sizeof buf));
+
+	// Programming 1 bits over 0 bits must not change anything:
+	memset(buf,0xFF,sizeof buf);
+	w25_write_data(SPI1,base+0x1F0,buf,16);
+	CHECK(mem[base+0x1F0] == 3);
+	buf[0] = 0x00;
+	w25_write_data(SPI1,base+0x1F0,buf,1);
+	CHECK(mem[base+0x1F0] == 0x00);
+
+	// Without write enable, nothing may change:
+	w25_write_en(SPI1,false);
+	CHECK(w25_is_wprotect(SPI1));
+	CHECK(!w25_erase_block(SPI1,base,W25_CMD_ERA_SECTOR));
+	CHECK(mem[base+0x1F0] == 0x00);
+}
+
+/*********************************************************************
+ * Erase range planner
+ *********************************************************************/
+
+static unsigned erase_ops;
+
+static void
+progress(uint32_t done,uint32_t total,void *arg) {
+	(void)done; (void)total; (void)arg;
+	++erase_ops;
+}
+
+static void
+erase_test(void) {
+	const uint32_t start = 0x1800, len = 0x4F000;
+	uint8_t *mem = w25sim_mem();
+	struct s_mark m;
+	uint32_t end = (start + len + 4095) & ~4095u;
+	bool ok = true;
+
+	memset(mem,0x00,0x60000);		// Pretend it was all programmed
+
+	erase_ops = 0;
+	mark(&m);
+	CHECK(w25_erase_range(SPI1,start,len,progress,0));
+	report("erase_range 316K (planned)",&m);
+	printf("    %u erase operations\n",erase_ops);
+
+	for ( uint32_t a=0; a<0x60000; ++a ) {
+		uint8_t want = (a >= (start & ~4095u) && a < end) ? 0xFF : 0x00;
+
+		if ( mem[a] != want ) {
+			ok = false;
+			break;
+		}
+	}
+	CHECK(ok);
+
+	mark(&m);
+	for ( uint32_t a=start & ~4095u; a<end; a += 4096 ) {
+		w25_write_en(SPI1,true);
+		w25_erase_block(SPI1,a,W25_CMD_ERA_SECTOR);
+	}
+	report("same range in 4K sectors",&m);
+}
+
+/*********************************************************************
+ * Random small reads (font/bitmap/KV lookups) with and without cache.
+ * The cache must not be slower than going straight to flash.
+ *********************************************************************/
+
+static void
+read_bench(void) {
+	static struct s_w25line lines[8];
+	struct s_w25stats cs;
+	struct s_mark m;
+	uint8_t buf[256];
+	uint8_t *mem = w25sim_mem();
+	uint32_t seed, a, n;
+	uint64_t ns[2][3];			// [cached][case]
+
+	for ( a=0; a<0x20000; ++a )
+		mem[a] = a ^ (a >> 8);
+
+	for ( int cached=0; cached<2; ++cached ) {
+		if ( cached )
+			w25_cache_init(SPI1,lines,8,2);
+		mark(&m);
+		seed = 1;
+		for ( unsigned ux=0; ux<4000; ++ux ) {
+			seed = seed * 1103515245 + 12345;
+			a = (seed >> 8) % 0x600;		// 1.5K font
+			n = 8 + (seed >> 4) % 24;
+			w25_cache_read(SPI1,a,buf,n);
+			if ( memcmp(buf,mem+a,n) )
+				++failures;
+		}
+		ns[cached][0] = report(cached ? "4000 glyphs in 1.5K, cached" : "4000 glyphs in 1.5K, uncached",&m);
+
+		mark(&m);
+		for ( unsigned ux=0; ux<4000; ++ux ) {
+			seed = seed * 1103515245 + 12345;
+			a = (seed >> 8) % 0x10000;		// 64K of records
+			n = 8 + (seed >> 4) % 24;
+			w25_cache_read(SPI1,a,buf,n);
+			if ( memcmp(buf,mem+a,n) )
+				++failures;
+		}
+		ns[cached][1] = report(cached ? "4000 lookups in 64K, cached" : "4000 lookups in 64K, uncached",&m);
+
+		mark(&m);
+		for ( a=0x10000; a<0x20000; a += 64 ) {
+			w25_cache_read(SPI1,a,buf,64);
+			if ( memcmp(buf,mem+a,64) )
+				++failures;
+		}
+		ns[cached][2] = report(cached ? "64K stream by 64, cached" : "64K stream by 64, uncached",&m);
+
+		if ( cached ) {
+			w25_cache_stats(&cs,true);
+			printf("    hits %u misses %u bypassed %u prefetched %u (used %u) transactions %u\n",
+				(unsigned)cs.hits,(unsigned)cs.misses,(unsigned)cs.bypass,
+				(unsigned)cs.prefetches,(unsigned)cs.prefetch_hits,
+				(unsigned)cs.transactions);
+			w25_cache_disable();
+		}
+	}
+
+	for ( unsigned ux=0; ux<3; ++ux )
+		CHECK(ns[1][ux] <= ns[0][ux]);
+}
+
+/*********************************************************************
+ * 4-byte addressing on a 32 MB part, or on a smaller part that only
+ * accepts 4-byte addresses
+ *********************************************************************/
+
+static void
+big_part_test(uint32_t spi_hz,bool addr4_only) {
+	struct s_w25sim_cfg cfg;
+	uint8_t buf[16], rbuf[16];
+	const uint32_t addr = addr4_only ? 0x234500 : 0x1234500;
+
+	w25sim_defaults(&cfg);
+	cfg.size = addr4_only ? 4*1024*1024 : 32*1024*1024;
+	cfg.addr4_only = addr4_only;
+	cfg.spi_hz = spi_hz;
+	if ( w25sim_open(&cfg) ) {
+		++failures;
+		return;
+	}
+
+	printf("\n");
+	identify();
+	CHECK(w25_device(SPI1)->addr_bytes == 4);
+
+	memcpy(buf,"4-byte address!",16);
+	CHECK(w25_erase_range(SPI1,addr,16,0,0));
+	w25_write_data(SPI1,addr,buf,sizeof buf);
+	CHECK(!memcmp(w25sim_mem()+addr,buf,sizeof buf));
+	w25_read_data(SPI1,addr,rbuf,sizeof rbuf);
+	CHECK(!memcmp(rbuf,buf,sizeof buf));
+	if ( !addr4_only )
+		CHECK(w25sim_mem()[addr & 0xFFFFFF] == 0xFF);	// No aliasing
+
+	w25sim_close();
+}
+
+/*********************************************************************
+ * Main program
+ *********************************************************************/
+
+int
+main(int argc,char **argv) {
+	struct s_w25sim_cfg cfg;
+	int optch;
+
+	w25sim_defaults(&cfg);
+
+	while ( (optch = getopt(argc,argv,"f:k:h")) != -1 ) {
+		switch ( optch ) {
+		case 'f':
+			cfg.path = optarg;
+			break;
+		case 'k':
+			cfg.spi_hz = strtoul(optarg,0,10) * 1000;
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-f image_file] [-k spi_khz]\n",argv[0]);
+			return 2;
+		}
+	}
+
+	if ( w25sim_open(&cfg) )
+		return 1;
+
+	printf("SPI clock %u kHz\n",(unsigned)(cfg.spi_hz / 1000));
+	identify();
+	program_test(0x300000);
+	erase_test();
+	read_bench();
+	w25sim_close();
+
+	big_part_test(cfg.spi_hz,false);
+	big_part_test(cfg.spi_hz,true);
+
+	printf("\n%s (%u failures)\n",failures ? "FAILED" : "PASSED",failures);
+	return failures ? 1 : 0;
+}
+
+// End w25bench.c
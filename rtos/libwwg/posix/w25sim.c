@@ -0,0 +1,512 @@
+/* w25sim.c -- File backed W25Qxx SPI flash simulator (POSIX)
+ * Warren W. Gay VE3WWG
+ *
+ * Implements the W25 command set used by winbond.c, behind the
+ * spi_enable()/spi_xfer()/spi_disable() calls of the hosted SPI
+ * layer. The array is an mmap'd file, so contents persist between
+ * runs. NOR rules are enforced: programming can only clear bits,
+ * and only an erase sets them again. Program/erase operations need
+ * WEL set, and leave BUSY set for their configured (virtual) time.
+ * Commands other than status reads are rejected while busy.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libopencm3/stm32/spi.h>
+
+#include "hosted.h"
+#include "w25sim.h"
+
+#define SR1_BUSY	0x01
+#define SR1_WEL		0x02
+
+static struct {
+	struct s_w25sim_cfg	cfg;
+	uint8_t		*mem;		// Flash array
+	int		fd;		// Backing file or -1
+	uint8_t		capcode;	// log2(size)
+	uint64_t	byte_ns;	// Time to clock one byte
+
+	bool		cs;		// Chip selected
+	bool		rejected;	// Current command rejected
+	unsigned	n;		// Byte # within command
+	uint8_t		cmd;		// Current command
+	uint32_t	addr;		// Address being collected/used
+	unsigned	alen;		// Address bytes for cmd
+
+	bool		wel;		// Write enable latch
+	bool		addr4;		// 4-byte address mode
+	bool		powerdown;	// Deep power down
+	uint64_t	busy_until;	// ns
+
+	uint8_t		page[256];	// Page program buffer
+	uint8_t		pmask[256];	// Bytes present in buffer
+	uint8_t		sfdp[256];	// SFDP space
+	uint8_t		uid[8];		// Unique ID
+
+	struct s_w25sim_stats stats;
+} sim = { .fd = -1 };
+
+/*********************************************************************
+ * Default configuration: W25Q32 on SPI1 at 72 MHz / 256
+ *********************************************************************/
+
+void
+w25sim_defaults(struct s_w25sim_cfg *cfg) {
+
+	memset(cfg,0,sizeof *cfg);
+	cfg->size = 4*1024*1024;
+	cfg->manuf = 0xEF;
+	cfg->type = 0x40;
+	cfg->sfdp = true;
+	cfg->spi_hz = 72000000 / 256;
+	cfg->page_us = 700;
+	cfg->erase4k_ms = 45;
+	cfg->erase32k_ms = 120;
+	cfg->erase64k_ms = 150;
+	cfg->chip_ms = 10000;
+}
+
+/*********************************************************************
+ * Internal: SFDP time encodings (count-1, unit)
+ *********************************************************************/
+
+static uint32_t
+enc_time(uint32_t t,const uint32_t *units,unsigned nunits,unsigned countbits) {
+	uint32_t maxcount = 1u << countbits, count;
+
+	for ( unsigned ux=0; ux<nunits; ++ux ) {
+		count = (t + units[ux] - 1) / units[ux];
+		if ( count < 1 )
+			count = 1;
+		if ( count <= maxcount || ux+1 == nunits )
+			return ((count > maxcount ? maxcount : count) - 1) | ux << countbits;
+	}
+	return 0;
+}
+
+static void
+put32(uint8_t *p,uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/*********************************************************************
+ * Internal: Build SFDP header + JEDEC basic flash parameter table
+ *********************************************************************/
+
+static void
+build_sfdp(void) {
+	static const uint32_t erase_units[4] = { 1, 16, 128, 1000 };
+	static const uint32_t pp_units[2] = { 8, 64 };
+	static const uint32_t chip_units[4] = { 16, 256, 4000, 64000 };
+	const struct s_w25sim_cfg *cfg = &sim.cfg;
+	uint8_t *tab = &sim.sfdp[0x30];
+	uint64_t bits = (uint64_t)cfg->size * 8;
+
+	memset(sim.sfdp,0xFF,sizeof sim.sfdp);
+	if ( !cfg->sfdp )
+		return;
+
+	memcpy(sim.sfdp,"SFDP",4);
+	sim.sfdp[4] = 0x06;			// Minor rev
+	sim.sfdp[5] = 0x01;			// Major rev
+	sim.sfdp[6] = 0x00;			// 1 parameter header
+	sim.sfdp[7] = 0xFF;
+
+	sim.sfdp[8] = 0x00;			// Basic table ID LSB
+	sim.sfdp[9] = 0x06;
+	sim.sfdp[10] = 0x01;
+	sim.sfdp[11] = 16;			// Length in dwords
+	sim.sfdp[12] = 0x30;			// Table pointer
+	sim.sfdp[13] = 0x00;
+	sim.sfdp[14] = 0x00;
+	sim.sfdp[15] = 0xFF;			// Basic table ID MSB
+
+	memset(tab,0,16*4);
+	put32(tab+0,0x01 | 0x04 | (0x20 << 8)
+		| (cfg->addr4_only ? 2u << 17 : cfg->size > 16u*1024*1024 ? 1u << 17 : 0));
+	if ( bits <= 0x80000000ull )
+		put32(tab+4,(uint32_t)(bits - 1));
+	else	put32(tab+4,0x80000000u | (sim.capcode + 3));
+	put32(tab+28,0x0C | (0x20 << 8) | (0x0F << 16) | (0x52u << 24));
+	put32(tab+32,0x10 | (0xD8 << 8));
+	put32(tab+36,0x02
+		| enc_time(cfg->erase4k_ms,erase_units,4,5) << 4
+		| enc_time(cfg->erase32k_ms,erase_units,4,5) << 11
+		| enc_time(cfg->erase64k_ms,erase_units,4,5) << 18);
+	put32(tab+40,0x02 | (8 << 4)
+		| enc_time(cfg->page_us,pp_units,2,5) << 8
+		| enc_time(cfg->chip_ms,chip_units,4,5) << 24);
+	put32(tab+60,0x01u << 24);		// Enter 4-byte: B7h
+}
+
+/*********************************************************************
+ * Open the simulated device
+ *********************************************************************/
+
+int
+w25sim_open(const struct s_w25sim_cfg *cfg) {
+	struct stat st;
+	bool fresh = true;
+
+	if ( !cfg->size || (cfg->size & (cfg->size - 1)) ) {
+		fprintf(stderr,"w25sim: size %u is not a power of 2\n",(unsigned)cfg->size);
+		return -1;
+	}
+
+	w25sim_close();
+	memset(&sim,0,sizeof sim);
+	sim.cfg = *cfg;
+	sim.fd = -1;
+
+	while ( (1u << sim.capcode) < cfg->size )
+		++sim.capcode;
+	sim.byte_ns = 8000000000ull / cfg->spi_hz;
+
+	if ( cfg->path ) {
+		sim.fd = open(cfg->path,O_RDWR|O_CREAT,0644);
+		if ( sim.fd < 0 ) {
+			perror(cfg->path);
+			return -1;
+		}
+		if ( fstat(sim.fd,&st) == 0 && st.st_size == (off_t)cfg->size )
+			fresh = false;
+		else if ( ftruncate(sim.fd,cfg->size) < 0 ) {
+			perror(cfg->path);
+			close(sim.fd);
+			sim.fd = -1;
+			return -1;
+		}
+		sim.mem = mmap(0,cfg->size,PROT_READ|PROT_WRITE,MAP_SHARED,sim.fd,0);
+	} else	{
+		sim.mem = mmap(0,cfg->size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	}
+
+	if ( sim.mem == MAP_FAILED ) {
+		perror("w25sim: mmap");
+		sim.mem = 0;
+		if ( sim.fd >= 0 )
+			close(sim.fd);
+		sim.fd = -1;
+		return -1;
+	}
+
+	if ( fresh )
+		memset(sim.mem,0xFF,cfg->size);	// Erased state
+
+	for ( unsigned ux=0; ux<sizeof sim.uid; ++ux )
+		sim.uid[ux] = 0xD0 + ux;
+	sim.addr4 = cfg->addr4_only;
+	build_sfdp();
+	return 0;
+}
+
+/*********************************************************************
+ * Close the simulated device (contents are flushed to the file)
+ *********************************************************************/
+
+void
+w25sim_close(void) {
+
+	if ( sim.mem ) {
+		munmap(sim.mem,sim.cfg.size);
+		sim.mem = 0;
+	}
+	if ( sim.fd >= 0 ) {
+		close(sim.fd);
+		sim.fd = -1;
+	}
+}
+
+/*********************************************************************
+ * Direct access to the array (for checking results)
+ *********************************************************************/
+
+uint8_t *
+w25sim_mem(void) {
+	return sim.mem;
+}
+
+void
+w25sim_stats(struct s_w25sim_stats *stats,bool reset) {
+
+	*stats = sim.stats;
+	if ( reset )
+		memset(&sim.stats,0,sizeof sim.stats);
+}
+
+/*********************************************************************
+ * Internal: Device state
+ *********************************************************************/
+
+static bool
+is_busy(void) {
+	return host_now_ns() < sim.busy_until;
+}
+
+static uint8_t
+sr1(void) {
+
+	if ( is_busy() )
+		return SR1_BUSY | SR1_WEL;	// WEL clears on completion
+	return sim.wel ? SR1_WEL : 0;
+}
+
+static void
+start_op(uint64_t ns) {
+	sim.wel = false;
+	sim.busy_until = host_now_ns() + ns;
+}
+
+/*********************************************************************
+ * Internal: Address length for command
+ *********************************************************************/
+
+static unsigned
+addr_len(uint8_t cmd) {
+
+	switch ( cmd ) {
+	case 0x03: case 0x0B: case 0x02:
+	case 0x20: case 0x52: case 0xD8:
+		return sim.addr4 ? 4 : 3;
+	case 0x5A: case 0x90:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+/*********************************************************************
+ * Internal: Erase
+ *********************************************************************/
+
+static void
+erase(uint32_t size,uint32_t ms) {
+	uint32_t addr = sim.addr & (sim.cfg.size - 1) & ~(size - 1);
+
+	memset(sim.mem+addr,0xFF,size);
+	++sim.stats.erases;
+	start_op((uint64_t)ms * 1000000ull);
+}
+
+/*********************************************************************
+ * Chip select asserted
+ *********************************************************************/
+
+void
+spi_enable(uint32_t spi) {
+
+	(void)spi;
+	sim.cs = true;
+	sim.n = 0;
+	sim.rejected = false;
+}
+
+/*********************************************************************
+ * Internal: Exchange one byte with the device (untimed)
+ *********************************************************************/
+
+static uint8_t
+exchange(uint8_t data) {
+	unsigned n = sim.n++, dx;
+	uint32_t a;
+
+	++sim.stats.bytes;
+
+	if ( !sim.cs || !sim.mem )
+		return 0xFF;
+
+	if ( n == 0 ) {
+		sim.cmd = data;
+		sim.addr = 0;
+		sim.alen = addr_len(sim.cmd);
+		++sim.stats.commands;
+
+		if ( (sim.powerdown && sim.cmd != 0xAB)
+		  || (is_busy() && sim.cmd != 0x05 && sim.cmd != 0x35) ) {
+			sim.rejected = true;
+			++sim.stats.errors;
+		}
+		switch ( sim.cmd ) {
+		case 0x05:
+		case 0x35:
+			++sim.stats.status_polls;
+			break;
+		case 0x03:
+		case 0x0B:
+			++sim.stats.reads;
+			break;
+		case 0x02:
+			memset(sim.pmask,0,sizeof sim.pmask);
+			break;
+		}
+		return 0xFF;
+	}
+
+	if ( sim.rejected )
+		return 0xFF;
+
+	if ( n <= sim.alen ) {
+		sim.addr = (sim.addr << 8) | (data & 0xFF);
+		return 0xFF;
+	}
+	dx = n - sim.alen - 1;			// Index past address
+
+	switch ( sim.cmd ) {
+	case 0x05:				// Read SR1
+		return sr1();
+	case 0x35:				// Read SR2
+		return 0x00;
+	case 0x9F:				// JEDEC ID
+		switch ( (n - 1) % 3 ) {
+		case 0:
+			return sim.cfg.manuf;
+		case 1:
+			return sim.cfg.type;
+		default:
+			return sim.capcode;
+		}
+	case 0x90:				// Manufacturer/device
+		return ((dx ^ (sim.addr & 1)) & 1) ? sim.capcode - 1 : sim.cfg.manuf;
+	case 0xAB:				// Release power down/ID
+		return n >= 4 ? sim.capcode - 1 : 0xFF;
+	case 0x4B:				// Unique ID
+		return n >= 5 ? sim.uid[(n - 5) % sizeof sim.uid] : 0xFF;
+	case 0x03:				// Read data
+		a = sim.addr + dx;
+		return sim.mem[a & (sim.cfg.size - 1)];
+	case 0x0B:				// Fast read (1 dummy)
+		if ( dx == 0 )
+			return 0xFF;
+		a = sim.addr + dx - 1;
+		return sim.mem[a & (sim.cfg.size - 1)];
+	case 0x5A:				// SFDP (1 dummy)
+		if ( dx == 0 )
+			return 0xFF;
+		return sim.sfdp[(sim.addr + dx - 1) & 0xFF];
+	case 0x02:				// Page program data
+		a = (sim.addr + dx) & 0xFF;	// Wraps within page
+		sim.page[a] = data;
+		sim.pmask[a] = 1;
+		return 0xFF;
+	default:
+		return 0xFF;
+	}
+}
+
+/*********************************************************************
+ * Exchange one byte
+ *********************************************************************/
+
+uint16_t
+spi_xfer(uint32_t spi,uint16_t data) {
+
+	(void)spi;
+	host_advance_ns(sim.byte_ns);
+	return exchange(data);
+}
+
+/*********************************************************************
+ * Exchange n bytes for the DMA stand-in. The bytes to send come from
+ * tx (the same byte when !txinc), and those received go to rx. The
+ * caller's clock is not advanced: the time the transfer takes on
+ * the bus is returned (ns).
+ *********************************************************************/
+
+uint64_t
+w25sim_dma(const uint8_t *tx,bool txinc,uint8_t *rx,bool rxinc,uint32_t n) {
+
+	for ( uint32_t ux=0; ux<n; ++ux ) {
+		*rx = exchange(*tx);
+		tx += txinc;
+		rx += rxinc;
+	}
+	return n * sim.byte_ns;
+}
+
+/*********************************************************************
+ * Chip select released: Execute the command
+ *********************************************************************/
+
+void
+spi_disable(uint32_t spi) {
+	const struct s_w25sim_cfg *cfg = &sim.cfg;
+	bool have_addr = sim.n > sim.alen;
+	uint32_t base;
+
+	(void)spi;
+	if ( !sim.cs )
+		return;
+	sim.cs = false;
+
+	if ( sim.rejected || sim.n == 0 )
+		return;
+
+	switch ( sim.cmd ) {
+	case 0x06:
+		sim.wel = true;
+		break;
+	case 0x04:
+		sim.wel = false;
+		break;
+	case 0xB7:
+		sim.addr4 = true;
+		break;
+	case 0xE9:
+		sim.addr4 = sim.cfg.addr4_only;
+		break;
+	case 0xB9:
+		sim.powerdown = true;
+		break;
+	case 0xAB:
+		sim.powerdown = false;
+		break;
+	case 0x02:
+		if ( !sim.wel || !have_addr ) {
+			++sim.stats.errors;
+			break;
+		}
+		base = sim.addr & (cfg->size - 1) & ~0xFFu;
+		for ( unsigned ux=0; ux<256; ++ux )
+			if ( sim.pmask[ux] )
+				sim.mem[base + ux] &= sim.page[ux]; // NOR: clear bits only
+		++sim.stats.programs;
+		start_op((uint64_t)cfg->page_us * 1000ull);
+		break;
+	case 0x20:
+	case 0x52:
+	case 0xD8:
+		if ( !sim.wel || !have_addr ) {
+			++sim.stats.errors;
+			break;
+		}
+		if ( sim.cmd == 0x20 )
+			erase(4*1024,cfg->erase4k_ms);
+		else if ( sim.cmd == 0x52 )
+			erase(32*1024,cfg->erase32k_ms);
+		else	erase(64*1024,cfg->erase64k_ms);
+		break;
+	case 0xC7:
+	case 0x60:
+		if ( !sim.wel ) {
+			++sim.stats.errors;
+			break;
+		}
+		memset(sim.mem,0xFF,cfg->size);
+		++sim.stats.erases;
+		start_op((uint64_t)cfg->chip_ms * 1000000ull);
+		break;
+	default:
+		break;
+	}
+}
+
+// End w25sim.c
@@ -0,0 +1,54 @@
+/* w25sim.h -- File backed W25Qxx SPI flash simulator (POSIX)
+ * Warren W. Gay VE3WWG
+ */
+#ifndef W25SIM_H
+#define W25SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*********************************************************************
+ * Simulated part. Times are the typical values; the device reports
+ * BUSY in SR1 until the (virtual) time has elapsed.
+ *********************************************************************/
+
+struct s_w25sim_cfg {
+	const char	*path;		// Backing file (null for anonymous)
+	uint32_t	size;		// Bytes (power of 2)
+	uint8_t		manuf;		// Manufacturer ID (0xEF Winbond)
+	uint8_t		type;		// Memory type (0x40)
+	bool		sfdp;		// Provide an SFDP table
+	bool		addr4_only;	// Accepts 4-byte addresses only
+	uint32_t	spi_hz;		// SCK frequency
+	uint32_t	page_us;	// Page program time
+	uint32_t	erase4k_ms;	// Sector erase time
+	uint32_t	erase32k_ms;	// 32K block erase time
+	uint32_t	erase64k_ms;	// 64K block erase time
+	uint32_t	chip_ms;	// Chip erase time
+};
+
+/*********************************************************************
+ * Bus and device counters
+ *********************************************************************/
+
+struct s_w25sim_stats {
+	uint64_t	bytes;		// Bytes clocked over SPI
+	uint32_t	commands;	// Chip select cycles
+	uint32_t	reads;		// 0x03/0x0B commands
+	uint32_t	programs;	// Page programs executed
+	uint32_t	erases;		// Sector/block/chip erases executed
+	uint32_t	status_polls;	// SR1/SR2 reads
+	uint32_t	errors;		// Rejected commands (busy, !WEL, etc.)
+};
+
+void w25sim_defaults(struct s_w25sim_cfg *cfg);
+int w25sim_open(const struct s_w25sim_cfg *cfg);
+void w25sim_close(void);
+
+uint8_t *w25sim_mem(void);
+void w25sim_stats(struct s_w25sim_stats *stats,bool reset);
+uint64_t w25sim_dma(const uint8_t *tx,bool txinc,uint8_t *rx,bool rxinc,uint32_t n);
+
+#endif // W25SIM_H
+
+// End w25sim.h
@@ -0,0 +1,211 @@
+/* Loadable Module Loader
+ * Warren W. Gay VE3WWG
+ *
+ * Loads modules (see module.h), built apart from the firmware, from
+ * SPI flash into a RAM arena given to module_init(). Import names are
+ * resolved against the application's export table first, then the
+ * image is read and its CRC checked, and finally the relocations are
+ * streamed in and applied, in one FAST_READ transaction.
+ *
+ * The arena is allocated first fit, in address order, so that a
+ * module unloaded leaves a hole that a later module may reuse.
+ *
+ * Like winbond.c, no locking is done: load and unload modules from
+ * one task only.
+ */
+#include <string.h>
+
+#include "winbond.h"
+#include "ovlz.h"
+#include "module.h"
+
+#define CHUNK		16		// Relocations read at a time
+#define MAXIMAGE	0x40000		// Word indexes are 16 bits
+
+static struct {
+	uint32_t		spi;		// SPI flash device
+	char			*arena;		// Module RAM
+	uint32_t		size;		// Arena bytes
+	const struct s_modexport *exports;
+	unsigned		nexports;
+	struct s_module		*mods;		// Loaded, in address order
+} mdm;
+
+/*********************************************************************
+ * Initialize the loader: modules are loaded into arena, and may
+ * import the symbols listed in exports.
+ *********************************************************************/
+
+void
+module_init(uint32_t spi,void *arena,uint32_t size,const struct s_modexport *exports,unsigned nexports) {
+
+	mdm.spi = spi;
+	mdm.arena = (char *)arena;
+	mdm.size = size;
+	mdm.exports = exports;
+	mdm.nexports = nexports;
+	mdm.mods = 0;
+}
+
+/*********************************************************************
+ * Look up an exported symbol by name (null if not exported)
+ *********************************************************************/
+
+const struct s_modexport *
+module_export(const char *name) {
+
+	for ( unsigned ux=0; ux<mdm.nexports; ++ux )
+		if ( !strcmp(mdm.exports[ux].name,name) )
+			return &mdm.exports[ux];
+	return 0;
+}
+
+/*********************************************************************
+ * Internal: Find the first gap in the arena of bytes (8 byte aligned).
+ * *link receives where the module must be linked into mdm.mods.
+ *********************************************************************/
+
+static char *
+alloc(uint32_t bytes,struct s_module ***link) {
+	struct s_module **mpp = &mdm.mods;
+	char *at = mdm.arena, *limit;
+
+	for (;;) {
+		at = (char *)(((uintptr_t)at + 7) & ~(uintptr_t)7);
+		limit = *mpp ? (*mpp)->base : mdm.arena + mdm.size;
+		if ( at <= limit && (uint32_t)(limit - at) >= bytes ) {
+			*link = mpp;
+			return at;
+		}
+		if ( !*mpp )
+			return 0;
+		at = (*mpp)->base + (*mpp)->size;
+		mpp = &(*mpp)->next;
+	}
+}
+
+/*********************************************************************
+ * Load the module stored at addr in SPI flash. Returns 0, or one of
+ * the MODERR_* codes. mod must not already be loaded.
+ *********************************************************************/
+
+int
+module_load(uint32_t addr,struct s_module *mod) {
+	struct s_modhdr hdr;
+	struct s_module **link;
+	char *base, name[MODULE_MAXNAME];
+	uint32_t *words, *imports, bytes, bss, left, n;
+	uint16_t rel[CHUNK*2];
+	const struct s_modexport *exp;
+	unsigned nx;
+	int err = 0;
+
+	mod->missing[0] = 0;
+	w25_read_data(mdm.spi,addr,&hdr,sizeof hdr);
+
+	if ( hdr.magic != MODULE_MAGIC || (hdr.size & 3) || hdr.size > MAXIMAGE || hdr.entry >= hdr.size )
+		return MODERR_FORMAT;
+	if ( hdr.bss > MAXIMAGE || hdr.nimports * 2u > hdr.namebytes )
+		return MODERR_FORMAT;		// The arena size must not wrap
+
+	// Resolved imports are kept past the bss until relocated:
+	bss = (hdr.bss + 3) & ~3u;
+	bytes = hdr.size + bss;
+	if ( !(base = alloc(bytes + hdr.nimports * sizeof *imports,&link)) )
+		return MODERR_NOMEM;
+	words = (uint32_t *)base;
+	imports = (uint32_t *)(base + bytes);
+
+	w25_read_start(mdm.spi,addr + sizeof hdr);
+
+	left = hdr.namebytes;
+	for ( unsigned ix=0; ix<hdr.nimports; ++ix ) {
+		for ( nx=0; ; ++nx ) {
+			if ( !left || nx >= MODULE_MAXNAME ) {
+				err = MODERR_FORMAT;
+				goto xit;
+			}
+			w25_read_stream(mdm.spi,&name[nx],1);
+			--left;
+			if ( !name[nx] )
+				break;
+		}
+		if ( !(exp = module_export(name)) ) {
+			strcpy(mod->missing,name);
+			err = MODERR_IMPORT;
+			goto xit;
+		}
+		imports[ix] = (uint32_t)(uintptr_t)exp->addr;
+	}
+	if ( left ) {
+		err = MODERR_FORMAT;
+		goto xit;
+	}
+
+	w25_read_stream(mdm.spi,base,hdr.size);
+	if ( ovlz_crc32(base,hdr.size) != hdr.crc ) {
+		err = MODERR_CRC;
+		goto xit;
+	}
+
+	for ( left = hdr.nrelocs; left > 0; left -= n ) {
+		n = left < CHUNK * 2 ? left : CHUNK * 2;
+		w25_read_stream(mdm.spi,rel,n * sizeof rel[0]);
+		for ( unsigned ux=0; ux<n; ++ux ) {
+			if ( rel[ux] >= hdr.size / 4 ) {
+				err = MODERR_FORMAT;
+				goto xit;
+			}
+			words[rel[ux]] += (uint32_t)(uintptr_t)base;
+		}
+	}
+
+	for ( left = hdr.nimprelocs; left > 0; left -= n ) {
+		n = left < CHUNK ? left : CHUNK;
+		w25_read_stream(mdm.spi,rel,n * 2 * sizeof rel[0]);
+		for ( unsigned ux=0; ux<n; ++ux ) {
+			if ( rel[ux*2] >= hdr.size / 4 || rel[ux*2+1] >= hdr.nimports ) {
+				err = MODERR_FORMAT;
+				goto xit;
+			}
+			words[rel[ux*2]] += imports[rel[ux*2+1]];
+		}
+	}
+
+xit:	w25_read_stop(mdm.spi);
+	if ( err )
+		return err;
+
+	memset(base + hdr.size,0,bss);
+#ifdef __arm__
+	__asm__ volatile ( "dsb\n\tisb" ::: "memory" );	// Before running new code
+#endif
+
+	mod->base = base;
+	mod->size = bytes;
+	mod->addr = addr;
+	mod->entry = base + hdr.entry;
+	mod->next = *link;
+	*link = mod;
+	return 0;
+}
+
+/*********************************************************************
+ * Unload a module, returning its space to the arena
+ *********************************************************************/
+
+void
+module_unload(struct s_module *mod) {
+
+	for ( struct s_module **mpp = &mdm.mods; *mpp; mpp = &(*mpp)->next ) {
+		if ( *mpp == mod ) {
+			*mpp = mod->next;
+			mod->next = 0;
+			mod->base = 0;
+			mod->entry = 0;
+			return;
+		}
+	}
+}
+
+// End module.c
@@ -0,0 +1,512 @@
+/* Overlay Manager
+ * Warren W. Gay VE3WWG
+ *
+ * Loads overlay code from SPI flash into one of several RAM regions.
+ * Overlays are found by load address through a small open addressed
+ * hash table. When an overlay must be loaded, the region chosen is an
+ * empty one if possible, else the least recently used region whose
+ * resident overlay is not pinned. Images may be stored compressed
+ * (see ovlz.h), and are decompressed straight into the region.
+ *
+ * Each region has a residency record in .noinit RAM. After a warm
+ * reset, overlay_init() keeps a region's overlay when the record is
+ * for the same build, the region's CRC still matches, and the region
+ * still matches the image in SPI flash (the CRC in a compressed
+ * image's header, else the raw bytes). The build hash alone can't
+ * tell a relink or a reflash.
+ *
+ * overlay_prefetch() starts loading an overlay into a free (or least
+ * recently used) region with the SPI's DMA channels, while the caller
+ * goes on running. The DMA is polled, not interrupt driven: the load
+ * is completed (and a compressed image decompressed in place) by the
+ * next overlay_load(), which then waits only for what is left. Until
+ * then the flash stays selected: overlay_init() registers
+ * overlay_prefetch_wait() with w25_busy_hook(), so that any other
+ * w25_*() call (or w25cache read) first completes the prefetch.
+ * Cycles spent in overlay_load() are counted in the overlay's stall
+ * field.
+ *
+ * Like winbond.c, no locking is done: overlays should be called from
+ * one task only.
+ */
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/dwt.h>
+
+#include "winbond.h"
+#include "overlay.h"
+#include "ovlz.h"
+
+#ifndef OVERLAY_HASHBITS
+#define OVERLAY_HASHBITS	6	// 64 slots: up to 32 overlays
+#endif
+#define OVERLAY_HASHSZ		(1u << OVERLAY_HASHBITS)
+
+uint32_t overlay_clock = 0;		// LRU clock
+
+static struct s_ovresid resid[OVERLAY_MAXREGIONS] __attribute__((section(".noinit")));
+
+static struct {
+	uint32_t		spi;		// SPI flash device
+	uint32_t		build;		// Build hash
+	struct s_ovregion	*regions;
+	unsigned		nregions;
+	struct s_overlay	*overlays;
+	unsigned		novls;
+	uint8_t			hash[OVERLAY_HASHSZ];	// Overlay index + 1 (0 == empty)
+	uint8_t			rxch, txch;	// SPI DMA channels (0 == none)
+	struct s_overlay	*pending;	// Prefetch in progress
+	struct s_ovregion	*prgn;		// Region being prefetched into
+	uint8_t			*src;		// Compressed data in prgn, else null
+	struct s_ovlzhdr	hdr;		// Header of pending image
+} ovm;
+
+/*********************************************************************
+ * Internal: Hash a load address to a slot
+ *********************************************************************/
+
+static unsigned
+hash_slot(const void *start) {
+	return ((uint32_t)(uintptr_t)start * 2654435761u) >> (32 - OVERLAY_HASHBITS);
+}
+
+/*********************************************************************
+ * Internal: Make overlay ov resident in region rgn
+ *********************************************************************/
+
+static void
+attach(struct s_ovregion *rgn,struct s_overlay *ov) {
+	rgn->cur = ov;
+	ov->region = rgn;
+	ov->entry = rgn->vma + ((char *)ov->func - ov->vma);
+}
+
+/*********************************************************************
+ * Internal: Does the region of rec hold ov's image in SPI flash?
+ *********************************************************************/
+
+static bool
+same_image(const struct s_ovregion *rgn,const struct s_ovresid *rec,const struct s_overlay *ov) {
+	struct s_ovlzhdr hdr;
+	uint8_t buf[64];
+	uint32_t addr = (uint32_t)(uintptr_t)ov->start, n;
+
+	if ( ov->size >= sizeof hdr ) {
+		w25_read_data(ovm.spi,addr,&hdr,sizeof hdr);
+		if ( hdr.magic == OVLZ_MAGIC )
+			return hdr.size == rec->size && hdr.crc == rec->crc;
+	}
+
+	if ( rec->size != ov->size )
+		return false;
+	for ( uint32_t off=0; off<rec->size; off += n ) {
+		n = rec->size - off < sizeof buf ? rec->size - off : sizeof buf;
+		w25_read_data(ovm.spi,addr+off,buf,n);
+		if ( memcmp(rgn->vma+off,buf,n) != 0 )
+			return false;
+	}
+	return true;
+}
+
+/*********************************************************************
+ * Internal: Trust a region's contents from before a reset?
+ *********************************************************************/
+
+static bool
+restore(unsigned regionx) {
+	struct s_ovregion *rgn = &ovm.regions[regionx];
+	struct s_ovresid *rec = &resid[regionx];
+	struct s_overlay *ov;
+
+	if ( rec->magic != OVERLAY_RESMAGIC || rec->build != ovm.build || rec->index >= ovm.novls )
+		return false;
+	ov = &ovm.overlays[rec->index];
+	if ( !(ov->regions & (1u << regionx)) || ov->region || rec->size > rgn->size )
+		return false;
+	if ( ovlz_crc32(rgn->vma,rec->size) != rec->crc || !same_image(rgn,rec,ov) )
+		return false;
+
+	attach(rgn,ov);
+	++rgn->restores;
+	return true;
+}
+
+/*********************************************************************
+ * Internal: Choose a region for ov: an empty one, else the least
+ * recently used one that is not pinned. The region's overlay is
+ * evicted. Returns null if none can be had.
+ *********************************************************************/
+
+static struct s_ovregion *
+choose(struct s_overlay *ov) {
+	struct s_ovregion *rgn, *victim = 0;
+	uint32_t oldest = 0;
+
+	for ( unsigned ux=0; ux<ovm.nregions; ++ux ) {
+		if ( !(ov->regions & (1u << ux)) )
+			continue;
+		rgn = &ovm.regions[ux];
+		if ( !rgn->cur ) {
+			victim = rgn;
+			break;
+		}
+		if ( rgn->cur->pins )
+			continue;
+		if ( !victim || rgn->cur->lru - oldest > 0x7FFFFFFF ) {
+			victim = rgn;
+			oldest = rgn->cur->lru;
+		}
+	}
+
+	if ( victim ) {
+		if ( victim->cur ) {
+			victim->cur->entry = 0;
+			victim->cur->region = 0;
+			victim->cur = 0;
+		}
+		resid[victim - ovm.regions].magic = 0;	// Not valid while loading
+	}
+	return victim;
+}
+
+/*********************************************************************
+ * Internal: Record a completed load of ov into rgn
+ *********************************************************************/
+
+static void
+loaded(struct s_ovregion *rgn,struct s_overlay *ov,uint32_t size) {
+	struct s_ovresid *rec = &resid[rgn - ovm.regions];
+
+	++rgn->loads;
+	++ov->loads;
+
+	rec->build = ovm.build;
+	rec->index = ov - ovm.overlays;
+	rec->size = size;
+	rec->magic = OVERLAY_RESMAGIC;
+
+	attach(rgn,ov);
+}
+
+/*********************************************************************
+ * Internal: Start a DMA read of bytes from the selected flash
+ *********************************************************************/
+
+static void
+dma_start(void *dest,uint32_t bytes) {
+	static const uint8_t dummy = 0x00;
+
+	dma_channel_reset(DMA1,ovm.rxch);
+	dma_set_peripheral_address(DMA1,ovm.rxch,(uint32_t)(uintptr_t)&SPI_DR(ovm.spi));
+	dma_set_memory_address(DMA1,ovm.rxch,(uint32_t)(uintptr_t)dest);
+	dma_set_number_of_data(DMA1,ovm.rxch,bytes);
+	dma_set_read_from_peripheral(DMA1,ovm.rxch);
+	dma_enable_memory_increment_mode(DMA1,ovm.rxch);
+	dma_set_peripheral_size(DMA1,ovm.rxch,DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1,ovm.rxch,DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1,ovm.rxch,DMA_CCR_PL_HIGH);
+
+	// Transmit clocks the bytes in: the same dummy byte each time
+	dma_channel_reset(DMA1,ovm.txch);
+	dma_set_peripheral_address(DMA1,ovm.txch,(uint32_t)(uintptr_t)&SPI_DR(ovm.spi));
+	dma_set_memory_address(DMA1,ovm.txch,(uint32_t)(uintptr_t)&dummy);
+	dma_set_number_of_data(DMA1,ovm.txch,bytes);
+	dma_set_read_from_memory(DMA1,ovm.txch);
+	dma_set_peripheral_size(DMA1,ovm.txch,DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1,ovm.txch,DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1,ovm.txch,DMA_CCR_PL_LOW);
+
+	dma_enable_channel(DMA1,ovm.rxch);
+	dma_enable_channel(DMA1,ovm.txch);
+	spi_enable_rx_dma(ovm.spi);
+	spi_enable_tx_dma(ovm.spi);
+}
+
+/*********************************************************************
+ * Internal: Shut down the DMA and deselect the flash
+ *********************************************************************/
+
+static void
+dma_stop(void) {
+
+	spi_disable_tx_dma(ovm.spi);
+	spi_disable_rx_dma(ovm.spi);
+	dma_disable_channel(DMA1,ovm.txch);
+	dma_disable_channel(DMA1,ovm.rxch);
+	dma_clear_interrupt_flags(DMA1,ovm.txch,DMA_TCIF);
+	dma_clear_interrupt_flags(DMA1,ovm.rxch,DMA_TCIF);
+	w25_read_stop(ovm.spi);
+	ovm.pending = 0;
+}
+
+/*********************************************************************
+ * Initialize the overlay manager. build identifies the overlay build
+ * (mkoverlay.sh generates ovl_build), so that a region loaded by a
+ * different firmware is never trusted. Returns false if the table is
+ * too large, or an overlay does not fit a region it names.
+ *********************************************************************/
+
+bool
+overlay_init(uint32_t spi,struct s_ovregion *regions,unsigned nregions,struct s_overlay *overlays,unsigned novls,uint32_t build) {
+	struct s_overlay *ov;
+	unsigned slot;
+
+	if ( novls > OVERLAY_HASHSZ / 2 || nregions > OVERLAY_MAXREGIONS )
+		return false;
+
+	if ( ovm.pending )
+		dma_stop();
+	memset(&ovm,0,sizeof ovm);
+	ovm.spi = spi;
+	ovm.build = build;
+	ovm.regions = regions;
+	ovm.nregions = nregions;
+	ovm.overlays = overlays;
+	ovm.novls = novls;
+
+	if ( spi == SPI1 ) {
+		ovm.rxch = DMA_CHANNEL2;
+		ovm.txch = DMA_CHANNEL3;
+	} else if ( spi == SPI2 ) {
+		ovm.rxch = DMA_CHANNEL4;
+		ovm.txch = DMA_CHANNEL5;
+	}
+	if ( ovm.rxch ) {
+		rcc_periph_clock_enable(RCC_DMA1);
+		w25_busy_hook(spi,overlay_prefetch_wait);	// Other flash users wait
+	}
+	dwt_enable_cycle_counter();
+
+	for ( unsigned ux=0; ux<nregions; ++ux ) {
+		regions[ux].cur = 0;
+		regions[ux].loads = 0;
+		regions[ux].restores = 0;
+		regions[ux].corrupt = 0;
+	}
+
+	for ( unsigned ux=0; ux<novls; ++ux ) {
+		ov = &overlays[ux];
+		ov->size = ov->stop - ov->start;
+		ov->entry = 0;
+		ov->region = 0;
+		ov->lru = 0;
+		ov->pins = 0;
+		ov->loads = ov->hits = 0;
+		ov->prefetches = ov->stall = 0;
+
+		if ( !ov->regions || ov->regions >> nregions )
+			return false;
+		for ( unsigned rx=0; rx<nregions; ++rx )
+			if ( (ov->regions & (1u << rx)) && ov->size > regions[rx].size )
+				return false;
+
+		for ( slot = hash_slot(ov->start); ovm.hash[slot]; slot = (slot + 1) & (OVERLAY_HASHSZ - 1) )
+			;
+		ovm.hash[slot] = ux + 1;
+	}
+
+	for ( unsigned rx=0; rx<nregions; ++rx )
+		if ( !restore(rx) )
+			resid[rx].magic = 0;
+	return true;
+}
+
+/*********************************************************************
+ * Check the CRC of every resident overlay against its residency
+ * record. A damaged overlay is dropped, so that its next call reloads
+ * it; if it is pinned (running), overlay_fault() is called. Returns
+ * the number of damaged regions.
+ *********************************************************************/
+
+unsigned
+overlay_verify(void) {
+	struct s_ovregion *rgn;
+	struct s_ovresid *rec;
+	struct s_overlay *ov;
+	unsigned bad = 0;
+
+	for ( unsigned rx=0; rx<ovm.nregions; ++rx ) {
+		rgn = &ovm.regions[rx];
+		rec = &resid[rx];
+		if ( !(ov = rgn->cur) )
+			continue;
+		if ( rec->magic == OVERLAY_RESMAGIC && ovlz_crc32(rgn->vma,rec->size) == rec->crc )
+			continue;
+
+		++bad;
+		++rgn->corrupt;
+		rec->magic = 0;
+		rgn->cur = 0;
+		ov->entry = 0;
+		ov->region = 0;
+		if ( ov->pins )
+			overlay_fault(ov);
+	}
+	return bad;
+}
+
+/*********************************************************************
+ * Find an overlay by its load address (null if unknown)
+ *********************************************************************/
+
+struct s_overlay *
+overlay_find(const void *start) {
+	struct s_overlay *ov;
+	unsigned slot;
+
+	for ( slot = hash_slot(start); ovm.hash[slot]; slot = (slot + 1) & (OVERLAY_HASHSZ - 1) ) {
+		ov = &ovm.overlays[ovm.hash[slot] - 1];
+		if ( ov->start == start )
+			return ov;
+	}
+	return 0;
+}
+
+/*********************************************************************
+ * Called when no permitted region can be evicted, or the image read
+ * from flash is corrupt. Override this to report the failure; the
+ * default halts.
+ *********************************************************************/
+
+void __attribute__((weak))
+overlay_fault(struct s_overlay *ov) {
+	(void)ov;
+	for (;;);
+}
+
+/*********************************************************************
+ * Start loading the overlay with load address start in the background.
+ * Returns false if it is unknown, already resident or being loaded,
+ * if no region can be had, or if the SPI has no DMA channels.
+ * A prefetch already in progress is completed first.
+ *********************************************************************/
+
+bool
+overlay_prefetch(const void *start) {
+	struct s_overlay *ov = overlay_find(start);
+	struct s_ovregion *rgn;
+	struct s_ovlzhdr *hdr = &ovm.hdr;
+
+	if ( !ov || ov->entry || ov == ovm.pending || !ovm.rxch || ov->size <= sizeof *hdr )
+		return false;
+	overlay_prefetch_wait();
+
+	if ( !(rgn = choose(ov)) )
+		return false;
+	ov->lru = ++overlay_clock;	// Keep it from eviction until used
+
+	w25_read_start(ovm.spi,(uint32_t)(uintptr_t)ov->start);
+	w25_read_stream(ovm.spi,hdr,sizeof *hdr);
+
+	if ( hdr->magic == OVLZ_MAGIC && hdr->size <= rgn->size && hdr->csize <= rgn->size ) {
+		// Read to the top of the region, to decompress in place
+		ovm.src = (uint8_t*)rgn->vma + rgn->size - hdr->csize;
+		dma_start(ovm.src,hdr->csize);
+	} else	{
+		ovm.src = 0;
+		memcpy(rgn->vma,hdr,sizeof *hdr);
+		dma_start(rgn->vma + sizeof *hdr,ov->size - sizeof *hdr);
+	}
+
+	ovm.pending = ov;
+	ovm.prgn = rgn;
+	++ov->prefetches;
+	return true;
+}
+
+/*********************************************************************
+ * Wait for a prefetch in progress (if any) to complete, making its
+ * overlay resident. Falls back to an ordinary load if the image
+ * cannot be decompressed in place.
+ *********************************************************************/
+
+void
+overlay_prefetch_wait(void) {
+	struct s_overlay *ov = ovm.pending;
+	struct s_ovregion *rgn = ovm.prgn;
+	struct s_ovresid *rec;
+	int32_t size;
+
+	if ( !ov )
+		return;
+	rec = &resid[rgn - ovm.regions];
+
+	while ( !dma_get_interrupt_flag(DMA1,ovm.rxch,DMA_TCIF) )
+		taskYIELD();
+	dma_stop();
+
+	if ( !ovm.src ) {
+		size = ov->size;
+		rec->crc = ovlz_crc32(rgn->vma,size);
+	} else if ( (size = ovlz_unpack(&ovm.hdr,ovm.src,rgn->vma,rgn->size)) >= 0 ) {
+		rec->crc = ovm.hdr.crc;
+	} else	{
+		size = ovlz_load(ovm.spi,(uint32_t)(uintptr_t)ov->start,rgn->vma,ov->size,rgn->size,&rec->crc);
+		if ( size < 0 ) {
+			overlay_fault(ov);	// Corrupt image
+			return;
+		}
+	}
+	loaded(rgn,ov,size);
+}
+
+/*********************************************************************
+ * Load overlay (if not resident) and return its entry point
+ *********************************************************************/
+
+void *
+overlay_load(struct s_overlay *ov) {
+	struct s_ovregion *victim;
+	struct s_ovresid *rec;
+	uint32_t t0;
+	int32_t size;
+
+	if ( ov->entry )
+		return ov->entry;
+
+	t0 = dwt_read_cycle_counter();
+	overlay_prefetch_wait();
+
+	if ( !ov->entry ) {
+		if ( !(victim = choose(ov)) ) {
+			overlay_fault(ov);
+			return 0;
+		}
+
+		rec = &resid[victim - ovm.regions];
+		size = ovlz_load(ovm.spi,(uint32_t)(uintptr_t)ov->start,victim->vma,ov->size,victim->size,&rec->crc);
+		if ( size < 0 ) {
+			overlay_fault(ov);		// Corrupt image
+			return 0;
+		}
+		loaded(victim,ov,size);
+	}
+
+	ov->stall += dwt_read_cycle_counter() - t0;
+	return ov->entry;
+}
+
+/*********************************************************************
+ * Pin an overlay, loading it if necessary, so that it cannot be
+ * evicted. Useful for overlays holding data, or called from an ISR.
+ *********************************************************************/
+
+void
+overlay_pin(struct s_overlay *ov) {
+	overlay_load(ov);
+	++ov->pins;
+}
+
+void
+overlay_unpin(struct s_overlay *ov) {
+	if ( ov->pins > 0 )
+		--ov->pins;
+}
+
+// End overlay.c
@@ -0,0 +1,216 @@
+/* Compressed Overlay Loader
+ * Warren W. Gay VE3WWG
+ *
+ * Streams an overlay image from SPI flash into RAM, decompressing
+ * it on the fly when it was stored compressed (see ovlz.h). Input
+ * is read through a small stack buffer within one FAST_READ
+ * transaction; the output is both the destination and the window.
+ * An image already in RAM (read by DMA) can be decompressed in place
+ * with ovlz_unpack().
+ */
+#include <string.h>
+
+#ifdef STM32F1
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/crc.h>
+#endif
+
+#include "winbond.h"
+#include "ovlz.h"
+
+#define CHUNK	16		// SPI read chunk
+
+/*********************************************************************
+ * CRC-32 as computed by the STM32 CRC unit: polynomial 0x04C11DB7,
+ * initial value 0xFFFFFFFF, MSB first, fed 32 bit little endian
+ * words. A partial last word is padded with zero bytes. The CRC unit
+ * is used for word aligned data on the target.
+ *********************************************************************/
+
+uint32_t
+ovlz_crc32(const void *data,uint32_t bytes) {
+	const uint8_t *p = (const uint8_t*)data;
+	uint32_t crc = 0xFFFFFFFF, word;
+
+#ifdef STM32F1
+	static bool crc_clock = false;
+
+	if ( !((uintptr_t)p & 3) ) {
+		if ( !crc_clock ) {
+			rcc_periph_clock_enable(RCC_CRC);
+			crc_clock = true;
+		}
+		crc_reset();
+		if ( bytes >= 4 )
+			crc = crc_calculate_block((uint32_t*)p,bytes / 4);
+		p += bytes & ~3u;
+		bytes &= 3;
+		if ( !bytes )
+			return crc;
+		word = 0;
+		for ( unsigned ux=0; ux<bytes; ++ux )
+			word |= (uint32_t)p[ux] << (ux * 8);
+		return crc_calculate(word);
+	}
+#endif
+
+	while ( bytes > 0 ) {
+		word = 0;
+		for ( unsigned ux=0; ux<4; ++ux )
+			if ( bytes > ux )
+				word |= (uint32_t)p[ux] << (ux * 8);
+		p += 4;
+		bytes = bytes > 4 ? bytes - 4 : 0;
+
+		crc ^= word;
+		for ( unsigned bx=0; bx<32; ++bx )
+			crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+	}
+	return crc;
+}
+
+/*********************************************************************
+ * Internal: Input stream from SPI flash, or from memory (left == 0)
+ *********************************************************************/
+
+struct s_input {
+	uint32_t	spi;
+	uint32_t	left;		// Compressed bytes not yet read
+	const uint8_t	*next, *end;
+	bool		inplace;	// Input shares the output buffer
+	uint8_t		buf[CHUNK];
+};
+
+static int
+next_byte(struct s_input *in) {
+	uint32_t n;
+
+	if ( in->next >= in->end ) {
+		if ( !in->left )
+			return -1;
+		n = in->left < CHUNK ? in->left : CHUNK;
+		w25_read_stream(in->spi,in->buf,n);
+		in->left -= n;
+		in->next = in->buf;
+		in->end = in->buf + n;
+	}
+	return *in->next++;
+}
+
+/*********************************************************************
+ * Internal: Decompress from in until out holds size bytes. In place,
+ * output must never overtake the input not yet read.
+ *********************************************************************/
+
+static bool
+decode(struct s_input *in,uint8_t *out,uint32_t size) {
+	uint8_t *op = out, *end = out + size, *mp;
+	int flags = 0, b0, b1;
+	uint32_t dist, len;
+
+	for ( unsigned bit=8; op < end; ++bit ) {
+		if ( bit == 8 ) {
+			if ( (flags = next_byte(in)) < 0 )
+				return false;
+			bit = 0;
+		}
+		if ( flags & (1 << bit) ) {
+			if ( (b0 = next_byte(in)) < 0 )
+				return false;
+			if ( in->inplace && op >= in->next )
+				return false;
+			*op++ = b0;
+		} else	{
+			if ( (b0 = next_byte(in)) < 0 || (b1 = next_byte(in)) < 0 )
+				return false;
+			dist = ((uint32_t)(b1 & 0xF0) << 4 | b0) + 1;
+			len = (b1 & 0x0F) + OVLZ_MINMATCH;
+			if ( dist > (uint32_t)(op - out) || len > (uint32_t)(end - op) )
+				return false;
+			if ( in->inplace && op + len > in->next )
+				return false;
+			for ( mp = op - dist; len > 0; --len )
+				*op++ = *mp++;
+		}
+	}
+	return true;
+}
+
+/*********************************************************************
+ * Load an overlay image at addr into dest. An image without a header
+ * is read raw, as rawsize bytes. Returns the number of bytes loaded,
+ * or -1 if the image is corrupt, fails its CRC or exceeds maxsize.
+ * When crc is not null, it receives ovlz_crc32() of the loaded bytes.
+ *********************************************************************/
+
+int32_t
+ovlz_load(uint32_t spi,uint32_t addr,void *dest,uint32_t rawsize,uint32_t maxsize,uint32_t *crc) {
+	struct s_ovlzhdr hdr;
+	struct s_input in;
+	uint8_t *out = (uint8_t*)dest;
+	bool ok;
+
+	w25_read_data(spi,addr,&hdr,sizeof hdr);
+
+	if ( hdr.magic != OVLZ_MAGIC ) {
+		// Stored raw: keep what was read as header
+		if ( rawsize > maxsize )
+			return -1;
+		if ( rawsize <= sizeof hdr ) {
+			memcpy(dest,&hdr,rawsize);
+		} else	{
+			memcpy(dest,&hdr,sizeof hdr);
+			w25_read_data(spi,addr+sizeof hdr,out+sizeof hdr,rawsize-sizeof hdr);
+		}
+		if ( crc )
+			*crc = ovlz_crc32(dest,rawsize);
+		return rawsize;
+	}
+
+	if ( hdr.size > maxsize )
+		return -1;
+
+	in.spi = spi;
+	in.left = hdr.csize;
+	in.next = in.end = in.buf;
+	in.inplace = false;
+
+	w25_read_start(spi,addr+sizeof hdr);
+	ok = decode(&in,out,hdr.size);
+	w25_read_stop(spi);
+
+	if ( !ok || ovlz_crc32(out,hdr.size) != hdr.crc )
+		return -1;
+	if ( crc )
+		*crc = hdr.crc;
+	return hdr.size;
+}
+
+/*********************************************************************
+ * Decompress the hdr->csize bytes at src into dest. src may lie
+ * within dest's buffer, at or past dest + hdr->size - hdr->csize:
+ * typically the compressed data is read into the top of the region.
+ * Fails (-1) if output would overwrite input not yet consumed, or
+ * for the same reasons as ovlz_load().
+ *********************************************************************/
+
+int32_t
+ovlz_unpack(const struct s_ovlzhdr *hdr,const void *src,void *dest,uint32_t maxsize) {
+	struct s_input in;
+	uint8_t *out = (uint8_t*)dest;
+
+	if ( hdr->magic != OVLZ_MAGIC || hdr->size > maxsize )
+		return -1;
+
+	in.spi = 0;
+	in.left = 0;
+	in.next = (const uint8_t*)src;
+	in.end = in.next + hdr->csize;
+	in.inplace = in.next < out + hdr->size && in.end > out;
+
+	if ( !decode(&in,out,hdr->size) || ovlz_crc32(out,hdr->size) != hdr->crc )
+		return -1;
+	return hdr->size;
+}
+
+// End ovlz.c
@@ -0,0 +1,330 @@
+/* W25Qxx Read Cache
+ * Warren W. Gay VE3WWG
+ *
+ * A small LRU cache of 256 byte flash pages, sitting in front of
+ * w25_read_data(). A miss streams the missing page, plus any further
+ * pages needed by the request, in a single FAST_READ transaction.
+ * When misses arrive in ascending page order, up to "readahead"
+ * extra pages are streamed in the same transaction.
+ *
+ * Filling a whole line for a small random read only pays when the
+ * line is used again. A running estimate of page reuse is kept, and
+ * while it says a line would cost more flash traffic than it saves,
+ * small out of order misses read just the bytes asked for. Pages
+ * missed that way are remembered (tag only), so that reuse is still
+ * noticed and filling resumes when it returns.
+ *
+ * w25_write_data() and the erase routines in winbond.c call back
+ * into w25_cache_update() and w25_cache_invalidate(), so that the
+ * cache never holds stale data. Like winbond.c, no locking is done:
+ * the caller must serialize access to the SPI flash.
+ */
+#include <string.h>
+
+#include "winbond.h"
+#include "w25cache.h"
+
+#define LINE_PAGE(line)	((line)->addr & ~(W25_CACHE_LINESZ-1))
+#define READ_COST	8	// Bytes clocked to start a read (incl. busy check)
+#define REUSE_ONE	256	// cache.reuse when every page is reused
+#define N_GHOSTS	16	// Max remembered pages not cached
+
+static struct {
+	uint32_t		spi;		// SPI device being cached
+	struct s_w25line	*lines;		// Caller supplied lines
+	unsigned		nlines;		// # of lines (0 == disabled)
+	unsigned		readahead;	// Max pages to read ahead
+	uint32_t		stamp;		// LRU clock
+	uint32_t		next_seq;	// Next page if access is sequential
+	uint32_t		next_addr;	// Follows the last uncached read
+	unsigned		reuse;		// Reuse estimate, 0 to REUSE_ONE
+	uint32_t		ghosts[N_GHOSTS]; // Pages read without caching
+	unsigned		nghosts;	// # of ghosts in use (<= nlines)
+	unsigned		ghostx;		// Next ghost to replace
+	struct s_w25stats	stats;
+} cache;
+
+/*********************************************************************
+ * Initialize the cache with caller supplied line storage
+ *********************************************************************/
+
+void
+w25_cache_init(uint32_t spi,struct s_w25line *lines,unsigned nlines,unsigned readahead) {
+
+	memset(&cache,0,sizeof cache);
+	memset(lines,0,nlines * sizeof *lines);
+
+	cache.spi = spi;
+	cache.lines = lines;
+	cache.readahead = readahead < nlines ? readahead : nlines - 1;
+	cache.next_seq = cache.next_addr = 0xFFFFFFFF;
+	cache.reuse = REUSE_ONE;
+	cache.nghosts = nlines < N_GHOSTS ? nlines : N_GHOSTS;
+	for ( unsigned ux=0; ux<N_GHOSTS; ++ux )
+		cache.ghosts[ux] = 0xFFFFFFFF;
+	cache.nlines = nlines;
+}
+
+/*********************************************************************
+ * Disable caching (line storage may then be reused)
+ *********************************************************************/
+
+void
+w25_cache_disable(void) {
+	cache.nlines = 0;
+}
+
+/*********************************************************************
+ * Internal: Return true if the page overlaps addr..addr+bytes-1
+ *********************************************************************/
+
+static bool
+overlaps(uint32_t page,uint32_t addr,uint32_t bytes) {
+
+	if ( page >= addr )
+		return page - addr < bytes;
+	return addr - page < W25_CACHE_LINESZ;
+}
+
+/*********************************************************************
+ * Internal: Locate the line holding page, else null
+ *********************************************************************/
+
+static struct s_w25line *
+lookup(uint32_t page) {
+	struct s_w25line *line = cache.lines;
+
+	for ( unsigned ux=0; ux<cache.nlines; ++ux, ++line )
+		if ( line->lru && LINE_PAGE(line) == page )
+			return line;
+	return 0;
+}
+
+/*********************************************************************
+ * Internal: Return the least recently used line (empty lines first)
+ *********************************************************************/
+
+static struct s_w25line *
+victim(void) {
+	struct s_w25line *line = cache.lines, *lru = line;
+
+	for ( unsigned ux=0; ux<cache.nlines; ++ux, ++line ) {
+		if ( !line->lru )
+			return line;
+		if ( line->lru < lru->lru )
+			lru = line;
+	}
+	return lru;
+}
+
+/*********************************************************************
+ * Internal: Stream the demand pages starting at page into the cache,
+ * followed by up to ahead pages of readahead, with one flash
+ * transaction. Stops early at a page that is already cached. Returns
+ * the line holding page; *fresh is the number of demand pages after
+ * it that were streamed (and counted as misses).
+ *********************************************************************/
+
+static struct s_w25line *
+fill(uint32_t page,unsigned demand,unsigned ahead,unsigned *fresh) {
+	struct s_w25line *first = 0, *line;
+
+	if ( demand > cache.nlines )
+		demand = cache.nlines;
+	if ( ahead > cache.nlines - demand )
+		ahead = cache.nlines - demand;
+
+	w25_read_start(cache.spi,page);
+	++cache.stats.transactions;
+	*fresh = 0;
+
+	for ( unsigned ux=0; ux<demand+ahead; ++ux, page += W25_CACHE_LINESZ ) {
+		if ( ux > 0 && lookup(page) )
+			break;
+		line = victim();
+		line->addr = page;
+		line->lru = ++cache.stamp;	// Protect from victim()
+		w25_read_stream(cache.spi,line->data,W25_CACHE_LINESZ);
+		if ( !first )
+			first = line;
+		if ( ux < demand ) {
+			++cache.stats.misses;
+			if ( ux > 0 )
+				++*fresh;
+		} else	{
+			line->addr |= W25_LINE_PREFETCH;
+			++cache.stats.prefetches;
+		}
+	}
+
+	w25_read_stop(cache.spi);
+	cache.next_seq = page;
+	return first;
+}
+
+/*********************************************************************
+ * Internal: Update the reuse estimate for one demand page. Reuse is
+ * a hit, or a miss on a page recently read without caching.
+ *********************************************************************/
+
+static void
+reused(bool yes) {
+
+	cache.reuse -= cache.reuse >> 4;
+	if ( yes )
+		cache.reuse += REUSE_ONE >> 4;
+}
+
+/*********************************************************************
+ * Internal: Return true if page was recently read without caching,
+ * else remember it.
+ *********************************************************************/
+
+static bool
+ghost(uint32_t page) {
+
+	for ( unsigned ux=0; ux<cache.nghosts; ++ux )
+		if ( cache.ghosts[ux] == page )
+			return true;
+	cache.ghosts[cache.ghostx] = page;
+	if ( ++cache.ghostx >= cache.nghosts )
+		cache.ghostx = 0;
+	return false;
+}
+
+/*********************************************************************
+ * Internal: Return true if a miss reading n bytes is cheaper without
+ * filling a line: the line is expected to be missed again before it
+ * is reused often enough to pay for itself.
+ *********************************************************************/
+
+static bool
+uncached(uint32_t n) {
+
+	return (REUSE_ONE - cache.reuse) * (READ_COST + W25_CACHE_LINESZ)
+		> REUSE_ONE * (READ_COST + n);
+}
+
+/*********************************************************************
+ * Read data through the cache
+ *********************************************************************/
+
+uint32_t		// New address is returned
+w25_cache_read(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
+	uint8_t *udata = (uint8_t*)data;
+	struct s_w25line *line;
+	uint32_t page, offset, n;
+	unsigned demand, ahead, fresh = 0;
+
+	if ( !cache.nlines || spi != cache.spi )
+		return w25_read_data(spi,addr,data,bytes);
+
+	if ( bytes > cache.nlines * W25_CACHE_LINESZ / 2 ) {
+		// Don't flush the whole cache for a bulk read:
+		++cache.stats.bypass;
+		++cache.stats.transactions;
+		return w25_read_data(spi,addr,data,bytes);
+	}
+
+	while ( bytes > 0 ) {
+		page = addr & ~(W25_CACHE_LINESZ-1);
+		offset = addr - page;
+		n = W25_CACHE_LINESZ - offset;
+		if ( n > bytes )
+			n = bytes;
+
+		line = lookup(page);
+		if ( line && fresh > 0 ) {
+			--fresh;			// Streamed by this miss
+			reused(false);
+		} else if ( line ) {
+			++cache.stats.hits;
+			if ( line->addr & W25_LINE_PREFETCH ) {
+				line->addr &= ~W25_LINE_PREFETCH;
+				++cache.stats.prefetch_hits;
+			}
+			reused(true);
+		} else if ( page != cache.next_seq && addr != cache.next_addr
+		  && bytes < W25_CACHE_LINESZ && uncached(bytes) ) {
+			// Read only what is left of the request:
+			demand = (offset + bytes + W25_CACHE_LINESZ - 1) / W25_CACHE_LINESZ;
+			cache.stats.misses += demand;
+			++cache.stats.bypass;
+			++cache.stats.transactions;
+			reused(ghost(page));
+			return cache.next_addr = w25_read_data(spi,addr,udata,bytes);
+		} else	{
+			demand = (offset + bytes + W25_CACHE_LINESZ - 1) / W25_CACHE_LINESZ;
+			ahead = page == cache.next_seq || addr == cache.next_addr ? cache.readahead : 0;
+			line = fill(page,demand,ahead,&fresh);
+			reused(false);
+		}
+		line->lru = ++cache.stamp;
+
+		memcpy(udata,line->data+offset,n);
+		udata += n;
+		addr += n;
+		bytes -= n;
+	}
+	return addr;
+}
+
+/*********************************************************************
+ * Write through: Apply programmed data to cached lines. Programming
+ * can only clear bits, so the cached byte becomes old & new.
+ *********************************************************************/
+
+void
+w25_cache_update(uint32_t spi,uint32_t addr,const void *data,uint32_t bytes) {
+	const uint8_t *udata = (const uint8_t*)data;
+	struct s_w25line *line = cache.lines;
+	uint32_t page, a;
+
+	if ( !cache.nlines || spi != cache.spi || !bytes )
+		return;
+
+	for ( unsigned ux=0; ux<cache.nlines; ++ux, ++line ) {
+		page = LINE_PAGE(line);
+		if ( !line->lru || !overlaps(page,addr,bytes) )
+			continue;
+		for ( unsigned bx=0; bx<W25_CACHE_LINESZ; ++bx ) {
+			a = page + bx;
+			if ( a - addr < bytes )
+				line->data[bx] &= udata[a - addr];
+		}
+	}
+}
+
+/*********************************************************************
+ * Invalidate cached lines overlapping an erased range
+ *********************************************************************/
+
+void
+w25_cache_invalidate(uint32_t spi,uint32_t addr,uint32_t bytes) {
+	struct s_w25line *line = cache.lines;
+
+	if ( !cache.nlines || spi != cache.spi || !bytes )
+		return;
+
+	for ( unsigned ux=0; ux<cache.nlines; ++ux, ++line ) {
+		if ( line->lru && overlaps(LINE_PAGE(line),addr,bytes) ) {
+			line->lru = 0;
+			++cache.stats.invalidates;
+		}
+	}
+	cache.next_seq = cache.next_addr = 0xFFFFFFFF;
+}
+
+/*********************************************************************
+ * Return cache counters, optionally resetting them
+ *********************************************************************/
+
+void
+w25_cache_stats(struct s_w25stats *stats,bool reset) {
+
+	*stats = cache.stats;
+	if ( reset )
+		memset(&cache.stats,0,sizeof cache.stats);
+}
+
+// End w25cache.c
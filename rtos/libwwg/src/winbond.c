@@ -12,6 +12,75 @@
 #include <libopencm3/stm32/spi.h>
 
 #include "winbond.h"
+#include "w25cache.h"
+
+/*********************************************************************
+ * Device descriptors for SPI1 and SPI2. Until w25_init() is called,
+ * these describe a classic W25Q part: 3-byte addresses, 256 byte
+ * pages and 4K/32K/64K erase.
+ *********************************************************************/
+
+#define W25_DEFAULT_DEV { \
+	0, 0, 0, 256, 3, false, 0, 0, { \
+		{ 4*1024, W25_CMD_ERA_SECTOR, 0 }, \
+		{ 32*1024, W25_CMD_ERA_32K, 0 }, \
+		{ 64*1024, W25_CMD_ERA_64K, 0 }, \
+		{ 0, 0, 0 } }, 0 }
+
+static struct s_w25dev devs[2] = { W25_DEFAULT_DEV, W25_DEFAULT_DEV };
+static w25_busy_t busy[2] = { 0, 0 };
+
+static inline struct s_w25dev *
+w25_dev(uint32_t spi) {
+	return &devs[spi == SPI1 ? 0 : 1];
+}
+
+/*********************************************************************
+ * Register a hook, called before each command is sent to the device
+ * on spi. It must finish whatever else holds the device selected
+ * (overlay.c's background prefetch). Null removes the hook.
+ *********************************************************************/
+
+void
+w25_busy_hook(uint32_t spi,w25_busy_t hook) {
+	busy[spi == SPI1 ? 0 : 1] = hook;
+}
+
+/*********************************************************************
+ * Internal: Select the device to start a command
+ *********************************************************************/
+
+static void
+w25_select(uint32_t spi) {
+	w25_busy_t hook = busy[spi == SPI1 ? 0 : 1];
+
+	if ( hook )
+		hook();
+	spi_enable(spi);
+}
+
+/*********************************************************************
+ * Return the descriptor in use for the device on spi
+ *********************************************************************/
+
+const struct s_w25dev *
+w25_device(uint32_t spi) {
+	return w25_dev(spi);
+}
+
+/*********************************************************************
+ * Internal: Send a 3 or 4 byte address, as the device requires
+ *********************************************************************/
+
+static void
+w25_send_addr(uint32_t spi,uint32_t addr) {
+
+	if ( w25_dev(spi)->addr_bytes > 3 )
+		spi_xfer(spi,addr >> 24);
+	spi_xfer(spi,(addr >> 16) & 0xFF);
+	spi_xfer(spi,(addr >> 8) & 0xFF);
+	spi_xfer(spi,addr & 0xFF);
+}
 
 /*********************************************************************
  * Read status register 1
@@ -21,7 +90,7 @@ uint8_t
 w25_read_sr1(uint32_t spi) {
 	uint8_t sr1;
 
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,W25_CMD_READ_SR1);
 	sr1 = spi_xfer(spi,DUMMY);
 	spi_disable(spi);
@@ -36,7 +105,7 @@ uint8_t
 w25_read_sr2(uint32_t spi) {
 	uint8_t sr1;
 
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,W25_CMD_READ_SR2);
 	sr1 = spi_xfer(spi,0x00);
 	spi_disable(spi);
@@ -74,7 +143,7 @@ w25_write_en(uint32_t spi,bool en) {
 
 	w25_wait(spi);
 
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,en ? W25_CMD_WRITE_EN : W25_CMD_WRITE_DI);
 	spi_disable(spi);
 }
@@ -88,7 +157,7 @@ w25_manuf_device(uint32_t spi) {
 	uint16_t info;
 
 	w25_wait(spi);
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,W25_CMD_MANUF_DEVICE);	// Byte 1
 	spi_xfer(spi,DUMMY);			// Dummy1 (2)
 	spi_xfer(spi,DUMMY);			// Dummy2 (3)
@@ -108,7 +177,7 @@ w25_JEDEC_ID(uint32_t spi) {
 	uint32_t info;
 
 	w25_wait(spi);
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,W25_CMD_JEDEC_ID);
 	info = spi_xfer(spi,DUMMY);		 // Manuf.
 	info = (info << 8) | spi_xfer(spi,DUMMY);// Memory Type
@@ -132,7 +201,7 @@ w25_read_uid(uint32_t spi,void *buf,uint16_t bytes) {
 		return;
 
 	w25_wait(spi);
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,W25_CMD_READ_UID);
 	for ( uint8_t ux=0; ux<4; ++ux )
 		spi_xfer(spi,DUMMY);
@@ -150,7 +219,7 @@ w25_power(uint32_t spi,bool on) {
 
 	if ( !on )
 		w25_wait(spi);
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,on ? W25_CMD_PWR_ON : W25_CMD_PWR_OFF);
 	spi_disable(spi);
 }
@@ -165,35 +234,64 @@ w25_chip_erase(uint32_t spi) {
 	if ( w25_is_wprotect(spi) )
 		return false;
 
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,W25_CMD_CHIP_ERASE);
 	spi_disable(spi);
 
+	if ( w25_dev(spi)->chip_ms > 1 )
+		vTaskDelay(pdMS_TO_TICKS(w25_dev(spi)->chip_ms));
+
+	w25_cache_invalidate(spi,0,0xFFFFFFFF);
 	return w25_is_wprotect(spi);	// True if successful 
 }
 
 /*********************************************************************
- * Read Data
+ * Start a streamed read: CS remains asserted until w25_read_stop()
  *********************************************************************/
 
-uint32_t		// New address is returned
-w25_read_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
-	uint8_t *udata = (uint8_t*)data;
+void
+w25_read_start(uint32_t spi,uint32_t addr) {
 
 	w25_wait(spi);
 
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,W25_CMD_FAST_READ);
-	spi_xfer(spi,addr >> 16);
-	spi_xfer(spi,(addr >> 8) & 0xFF);
-	spi_xfer(spi,addr & 0xFF);
+	w25_send_addr(spi,addr);
 	spi_xfer(spi,DUMMY);
+}
+
+/*********************************************************************
+ * Continue a streamed read, from where the last one left off
+ *********************************************************************/
+
+void
+w25_read_stream(uint32_t spi,void *data,uint32_t bytes) {
+	uint8_t *udata = (uint8_t*)data;
 
-	for ( ; bytes-- > 0; ++addr )
+	while ( bytes-- > 0 )
 		*udata++ = spi_xfer(spi,0x00);
+}
 
+/*********************************************************************
+ * End a streamed read
+ *********************************************************************/
+
+void
+w25_read_stop(uint32_t spi) {
 	spi_disable(spi);
-	return addr;	
+}
+
+/*********************************************************************
+ * Read Data
+ *********************************************************************/
+
+uint32_t		// New address is returned
+w25_read_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
+
+	w25_read_start(spi,addr);
+	w25_read_stream(spi,data,bytes);
+	w25_read_stop(spi);
+	return addr + bytes;
 }
 
 /*********************************************************************
@@ -203,6 +301,8 @@ w25_read_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
 unsigned		// New address is returned
 w25_write_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
 	uint8_t *udata = (uint8_t*)data;
+	uint32_t saddr = addr, sbytes = bytes;
+	uint32_t pgmask = w25_dev(spi)->page_size - 1;
 
 	w25_write_en(spi,true);
 	w25_wait(spi);
@@ -211,15 +311,13 @@ w25_write_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
 		return 0xFFFFFFFF;	// Indicate error
 
 	while ( bytes > 0 ) {
-		spi_enable(spi);
+		w25_select(spi);
 		spi_xfer(spi,W25_CMD_WRITE_DATA);
-		spi_xfer(spi,addr >> 16);
-		spi_xfer(spi,(addr >> 8) & 0xFF);
-		spi_xfer(spi,addr & 0xFF);
+		w25_send_addr(spi,addr);
 		while ( bytes > 0 ) {
 			spi_xfer(spi,*udata++);
 			--bytes;
-			if ( (++addr & 0xFF) == 0x00 )
+			if ( (++addr & pgmask) == 0x00 )
 				break;
 		}
 		spi_disable(spi);
@@ -228,41 +326,281 @@ w25_write_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
 			w25_write_en(spi,true); // More to write
 	}
 
+	w25_cache_update(spi,saddr,data,sbytes);
 	return addr;	
 }
 
 /*********************************************************************
- * Erase 4K/32K/64K block
+ * Erase a block, using one of the device's erase commands (for
+ * example W25_CMD_ERA_SECTOR, W25_CMD_ERA_32K or W25_CMD_ERA_64K).
  *********************************************************************/
 
 bool
 w25_erase_block(uint32_t spi,uint32_t addr,uint8_t cmd) {
+	const struct s_w25erase *erase = 0;
+	struct s_w25dev *dev = w25_dev(spi);
 	
 	if ( w25_is_wprotect(spi) )
 		return false;
 
-	switch ( cmd ) {
-	case W25_CMD_ERA_SECTOR:
-		addr &= ~(4*1024-1);
-		break;
-	case W25_CMD_ERA_32K:
-		addr &= ~(32*1024-1);
-		break;
-	case W25_CMD_ERA_64K:
-		addr &= ~(64*1024-1);
-		break;
-	default:
-		return false;
+	for ( unsigned ux=0; ux<W25_N_ERASE; ++ux ) {
+		if ( dev->erase[ux].size && dev->erase[ux].cmd == cmd ) {
+			erase = &dev->erase[ux];
+			break;
+		}
 	}
+	if ( !erase )
+		return false;		// Not supported by device
+	addr &= ~(erase->size-1);
 
-	spi_enable(spi);
+	w25_select(spi);
 	spi_xfer(spi,cmd);
-	spi_xfer(spi,addr >> 16);
+	w25_send_addr(spi,addr);
+	spi_disable(spi);
+
+	if ( erase->typ_ms > 1 )
+		vTaskDelay(pdMS_TO_TICKS(erase->typ_ms)); // Don't poll needlessly
+
+	w25_cache_invalidate(spi,addr,erase->size);
+	return w25_is_wprotect(spi); // True if successful
+}
+
+/*********************************************************************
+ * Erase a range, using the fewest and fastest erase operations:
+ *
+ *	1. The range is widened to the smallest erase size.
+ *	2. A range covering the whole device uses chip erase.
+ *	3. Otherwise the largest aligned erase size that fits is
+ *	   used at each step, falling back to smaller sizes at the
+ *	   ragged edges.
+ *
+ * The SPI bus is released between operations (and while polling for
+ * completion) so other tasks may use it. If progress is not null, it
+ * is called after each operation with bytes erased so far.
+ *********************************************************************/
+
+bool
+w25_erase_range(
+  uint32_t spi,
+  uint32_t start,		// Starting address
+  uint32_t len,			// Bytes to erase
+  w25_progress_t progress,	// Progress callback or null
+  void *arg			// Argument for progress
+) {
+	const struct s_w25dev *dev = w25_dev(spi);
+	const struct s_w25erase *erase, *small = 0;
+	uint32_t addr, end, total, capacity;
+
+	if ( !len )
+		return true;
+
+	for ( unsigned ux=0; ux<W25_N_ERASE; ++ux )
+		if ( dev->erase[ux].size && (!small || dev->erase[ux].size < small->size) )
+			small = &dev->erase[ux];
+	if ( !small )
+		return false;
+
+	addr = start & ~(small->size-1);
+	end = (start + len + small->size-1) & ~(small->size-1);
+	if ( end < addr )
+		end = 0 - small->size;	// Overflow
+
+	capacity = dev->capacity;
+	if ( !capacity ) {
+		capacity = w25_JEDEC_ID(spi) & 0xFF;
+		capacity = capacity >= 16 && capacity <= 31 ? 1ul << capacity : 0;
+	}
+
+	if ( capacity ) {
+		if ( end > capacity )
+			end = capacity;
+		if ( addr >= end )
+			return false;		// Beyond end of device
+		if ( addr == 0 && end == capacity ) {
+			w25_write_en(spi,true);
+			if ( !w25_chip_erase(spi) )
+				return false;
+			if ( progress )
+				progress(capacity,capacity,arg);
+			return true;
+		}
+	}
+	total = end - addr;
+
+	while ( addr < end ) {
+		erase = small;
+		for ( unsigned ux=0; ux<W25_N_ERASE; ++ux ) {
+			const struct s_w25erase *e = &dev->erase[ux];
+
+			if ( e->size > erase->size && !(addr & (e->size-1)) && end - addr >= e->size )
+				erase = e;
+		}
+
+		w25_write_en(spi,true);
+		if ( !w25_erase_block(spi,addr,erase->cmd) )
+			return false;
+		addr += erase->size;
+
+		if ( progress )
+			progress(total - (end - addr),total,arg);
+		taskYIELD();		// Let other SPI users in
+	}
+	return true;
+}
+
+/*********************************************************************
+ * Read SFDP (Serial Flash Discoverable Parameters) data
+ *********************************************************************/
+
+void
+w25_read_sfdp(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
+	uint8_t *udata = (uint8_t*)data;
+
+	w25_wait(spi);
+
+	w25_select(spi);
+	spi_xfer(spi,W25_CMD_READ_SFDP);
+	spi_xfer(spi,(addr >> 16) & 0xFF);	// Always 3 byte address
 	spi_xfer(spi,(addr >> 8) & 0xFF);
 	spi_xfer(spi,addr & 0xFF);
+	spi_xfer(spi,DUMMY);
+	while ( bytes-- > 0 )
+		*udata++ = spi_xfer(spi,DUMMY);
 	spi_disable(spi);
+}
 
-	return w25_is_wprotect(spi); // True if successful
+/*********************************************************************
+ * Internal: Fetch little endian SFDP dword
+ *********************************************************************/
+
+static uint32_t
+sfdp_dword(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*********************************************************************
+ * Internal: Decode SFDP typical time: count in bits 4..0 and the
+ * unit code in the following 2 (or 1) bits.
+ *********************************************************************/
+
+static uint32_t
+sfdp_time(uint32_t count,uint32_t unitx,const uint32_t *units) {
+	return (count + 1) * units[unitx];
+}
+
+/*********************************************************************
+ * Internal: Parse the JEDEC Basic Flash Parameter table
+ *********************************************************************/
+
+static void
+sfdp_basic(struct s_w25dev *dev,const uint8_t *tab,unsigned dwords) {
+	static const uint32_t erase_units[4] = { 1, 16, 128, 1000 };	// ms
+	static const uint32_t chip_units[4] = { 16, 256, 4000, 64000 }; // ms
+	uint32_t dw, density, amode;
+	unsigned ex = 0;
+
+	dw = sfdp_dword(&tab[0]);			// DWORD 1
+	amode = (dw >> 17) & 3;				// 00: 3, 01: 3 or 4, 10: 4 only
+	dev->addr_bytes = amode == 0 ? 3 : 4;
+
+	density = sfdp_dword(&tab[4]);			// DWORD 2
+	if ( density & 0x80000000 ) {
+		density &= 0x7FFFFFFF;
+		dev->capacity = density >= 35 ? 0x80000000 : 1ul << (density - 3);
+	} else	dev->capacity = (density + 1) / 8;
+	if ( amode < 2 && dev->capacity <= 16ul*1024*1024 )
+		dev->addr_bytes = 3;		// 3 bytes reaches it all
+
+	memset(dev->erase,0,sizeof dev->erase);
+	for ( unsigned ux=0; ux<W25_N_ERASE && dwords >= 9; ++ux ) {
+		const uint8_t *et = &tab[28 + ux*2];	// DWORDS 8 and 9
+
+		if ( et[0] == 0 || et[0] > 31 )
+			continue;			// Unused erase type
+		dev->erase[ex].size = 1ul << et[0];
+		dev->erase[ex].cmd = et[1];
+		if ( dwords >= 10 ) {
+			dw = sfdp_dword(&tab[36]) >> (4 + ux*7); // DWORD 10
+			dev->erase[ex].typ_ms = sfdp_time(dw & 0x1F,(dw >> 5) & 3,erase_units);
+		}
+		++ex;
+	}
+
+	if ( dwords >= 11 ) {
+		dw = sfdp_dword(&tab[40]);		// DWORD 11
+		dev->page_size = 1u << ((dw >> 4) & 0x0F);
+		dev->page_us = (((dw >> 8) & 0x1F) + 1) * (dw & (1 << 13) ? 64 : 8);
+		dev->chip_ms = sfdp_time((dw >> 24) & 0x1F,(dw >> 29) & 3,chip_units);
+	}
+
+	dev->enter_4b = 0x01;				// Assume B7h
+	if ( dwords >= 16 ) {
+		dw = sfdp_dword(&tab[60]) >> 24;	// DWORD 16
+		if ( dw & 0x03 )
+			dev->enter_4b = dw & 0x03;
+	}
+}
+
+/*********************************************************************
+ * Initialize the device descriptor for the flash on spi. When the
+ * device provides SFDP, it supplies capacity, page size, erase types
+ * and typical timings. Otherwise the JEDEC ID capacity is used with
+ * the classic W25Q commands. Devices larger than 16 MB are switched
+ * to 4-byte addressing.
+ *
+ * Returns true if SFDP was used.
+ *********************************************************************/
+
+bool
+w25_init(uint32_t spi) {
+	static const struct s_w25dev defdev = W25_DEFAULT_DEV;
+	struct s_w25dev *dev = w25_dev(spi);
+	uint8_t hdr[8], phdr[8], tab[16*4];
+	uint32_t ptp;
+	unsigned nph, dwords;
+
+	*dev = defdev;
+	dev->spi = spi;
+	dev->jedec_id = w25_JEDEC_ID(spi);
+
+	w25_read_sfdp(spi,0,hdr,sizeof hdr);
+	if ( !memcmp(hdr,"SFDP",4) ) {
+		nph = hdr[6] + 1u;
+		for ( unsigned ux=0; ux<nph; ++ux ) {
+			w25_read_sfdp(spi,8+ux*8,phdr,sizeof phdr);
+			if ( phdr[0] != 0x00 || phdr[7] != 0xFF )
+				continue;		// Not the basic table
+			dwords = phdr[3];
+			if ( dwords < 2 )
+				break;
+			if ( dwords > sizeof tab / 4 )
+				dwords = sizeof tab / 4;
+			ptp = phdr[4] | (phdr[5] << 8) | ((uint32_t)phdr[6] << 16);
+			w25_read_sfdp(spi,ptp,tab,dwords*4);
+			sfdp_basic(dev,tab,dwords);
+			dev->sfdp = true;
+			break;
+		}
+	}
+
+	if ( !dev->sfdp ) {
+		uint8_t cap = dev->jedec_id & 0xFF;
+
+		if ( cap >= 16 && cap <= 31 )
+			dev->capacity = 1ul << cap;
+		dev->addr_bytes = dev->capacity > 16ul*1024*1024 ? 4 : 3;
+		dev->enter_4b = 0x01;
+	}
+
+	if ( dev->addr_bytes > 3 ) {
+		if ( dev->enter_4b & 0x02 )
+			w25_write_en(spi,true);	// WREN required first
+		w25_wait(spi);
+		w25_select(spi);
+		spi_xfer(spi,W25_CMD_ENTER_4B);
+		spi_disable(spi);
+	}
+	return dev->sfdp;
 }
 
 /*********************************************************************
@@ -34,52 +34,6 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/spi.h>
 	
-void
-oled_command(uint8_t byte) {
-	gpio_clear(GPIOB,GPIO10);
-	spi_enable(SPI1);
-	spi_xfer(SPI1,byte);
-	spi_disable(SPI1);
-}
-
-void
-oled_command2(uint8_t byte,uint8_t byte2) {
-	gpio_clear(GPIOB,GPIO10);
-	spi_enable(SPI1);
-	spi_xfer(SPI1,byte);
-	spi_xfer(SPI1,byte2);
-	spi_disable(SPI1);
-}
-
-void
-oled_data(uint8_t byte) {
-	gpio_set(GPIOB,GPIO10);
-	spi_enable(SPI1);
-	spi_xfer(SPI1,byte);
-	spi_disable(SPI1);
-}
-
-static void
-oled_reset(void) {
-	gpio_clear(GPIOB,GPIO11);
-	vTaskDelay(1);
-	gpio_set(GPIOB,GPIO11);
-}
-
-static void
-oled_init(void) {
-	static uint8_t cmds[] = {
-		0xAE, 0x00, 0x10, 0x40, 0x81, 0xCF, 0xA1, 0xA6, 
-		0xA8, 0x3F, 0xD3, 0x00, 0xD5, 0x80, 0xD9, 0xF1, 
-		0xDA, 0x12, 0xDB, 0x40, 0x8D, 0x14, 0xAF, 0xFF };
-
-	gpio_clear(GPIOC,GPIO13);
-	oled_reset();
-	for ( unsigned ux=0; cmds[ux] != 0xFF; ++ux )
-		oled_command(cmds[ux]);
-	gpio_set(GPIOC,GPIO13);
-}
-
 /*
  * Monitor task:
  */
@@ -6,9 +6,12 @@
 #ifndef OLED_H
 #define OLED_H
 
+#include <stdint.h>
+
 void oled_command(uint8_t byte);
 void oled_command2(uint8_t byte,uint8_t byte2);
 void oled_data(uint8_t byte);
+void oled_init(void);
 
 #endif // OLED_H
 
@@ -0,0 +1,147 @@
+/* oledbench.c -- The OLED meter against a simulated SSD1306
+ * Warren W. Gay VE3WWG
+ *
+ * Runs oled_init(), meter_init() and meter_update() unchanged, over
+ * the hosted SPI into libwwg/posix/ssd1306sim.c. Each frame's panel
+ * image is compared with golden/meter-NNN.pgm (NNN: centivolts), and
+ * the SPI bytes, commands and chip selects per frame are reported,
+ * with the wire time at the target's SPI clock and the host time
+ * taken by the drawing code.
+ *
+ * Usage: oledbench [-g] [-w] [-s scale]
+ *
+ *	-g	Rewrite the golden images
+ *	-w	Also write each frame to ./meter-NNN.pgm (scaled)
+ *	-s	Scale for -w (default 4)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <libopencm3/stm32/gpio.h>
+
+#include "oled.h"
+#include "meter.h"
+#include "hosted.h"
+#include "ssd1306sim.h"
+
+static uint8_t screen[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH];
+static uint8_t golden[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH];
+
+static double
+elapsed_us(void) {
+	static struct timespec t0;
+	struct timespec t1;
+	double us;
+
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+	us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+	t0 = t1;
+	return us;
+}
+
+/*********************************************************************
+ * Compare the panel with a golden image: returns differing pixels
+ *********************************************************************/
+
+static unsigned
+compare(const char *path) {
+	unsigned diffs = 0;
+
+	if ( ssd1306sim_read_pgm(path,golden) ) {
+		printf("  %s: missing or unreadable (make golden)\n",path);
+		return 1;
+	}
+	ssd1306sim_screen(screen);
+	for ( unsigned y=0; y<SSD1306SIM_HEIGHT; ++y )
+		for ( unsigned x=0; x<SSD1306SIM_WIDTH; ++x )
+			if ( screen[y][x] != golden[y][x] )
+				++diffs;
+	return diffs;
+}
+
+int
+main(int argc,char **argv) {
+	static const int values[] = { 0, 130, 200, 275, 350 };
+	struct s_ssd1306sim_cfg cfg;
+	struct s_ssd1306sim_stats st;
+	struct Meter m;
+	bool opt_g = false, opt_w = false;
+	unsigned scale = 4, fails = 0, diffs;
+	char path[64];
+	double us;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"gws:h")) != -1 ) {
+		switch ( optch ) {
+		case 'g':
+			opt_g = true;
+			break;
+		case 'w':
+			opt_w = true;
+			break;
+		case 's':
+			scale = strtoul(optarg,0,10);
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-g] [-w] [-s scale]\n",argv[0]);
+			return 2;
+		}
+	}
+
+	ssd1306sim_defaults(&cfg);
+	ssd1306sim_open(&cfg);
+	gpio_set(GPIOB,GPIO11);			// /RES idle high
+
+	oled_init();
+	ssd1306sim_stats(&st,true);
+	printf("oled_init: %u bytes, %u commands, %u unknown\n",
+		(unsigned)st.bytes,(unsigned)st.commands,(unsigned)st.unknown);
+	if ( st.unknown )
+		++fails;
+
+	meter_init(&m,3.5);
+
+	printf("\nSPI clock %u kHz\n",(unsigned)(cfg.spi_hz / 1000));
+	printf("%-6s %6s %6s %6s %6s %7s %10s %10s  %s\n",
+		"Volts","Bytes","Cmd","Data","Cmds","Selects","Wire ms","Draw us","Image");
+
+	for ( unsigned ux=0; ux<sizeof values/sizeof values[0]; ++ux ) {
+		elapsed_us();
+		meter_set_value(&m,values[ux] / 100.0);
+		us = elapsed_us();
+		ssd1306sim_stats(&st,true);
+		meter_update();
+		ssd1306sim_stats(&st,false);
+
+		snprintf(path,sizeof path,"golden/meter-%03d.pgm",values[ux]);
+		if ( opt_g ) {
+			if ( ssd1306sim_write_pgm(path,1) )
+				return 1;
+			diffs = 0;
+		} else	diffs = compare(path);
+		if ( opt_w ) {
+			snprintf(path,sizeof path,"meter-%03d.pgm",values[ux]);
+			ssd1306sim_write_pgm(path,scale);
+		}
+
+		printf("%-6.2f %6u %6u %6u %6u %7u %10.3f %10.1f  %s\n",
+			values[ux] / 100.0,(unsigned)st.bytes,(unsigned)st.cmd_bytes,
+			(unsigned)st.data_bytes,(unsigned)st.commands,(unsigned)st.selects,
+			st.wire_ns / 1e6,us,
+			opt_g ? "written" : diffs ? "DIFFERS" : "ok");
+		if ( diffs ) {
+			printf("  %u pixels differ\n",diffs);
+			++fails;
+		}
+		if ( st.unknown )
+			++fails;
+	}
+
+	printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End oledbench.c
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////
+// console.c -- Scrolling text console on the SSD1306
+// Warren W. Gay VE3WWG
+//
+// Text is drawn with uGUI's console functions (FONT_4X6), one line
+// per pixmap page. Each line is begun with a newline to uGUI, which
+// then steps down exactly one page (6 rows plus 2 of spacing). Once
+// the display is full, a new line is drawn into the page holding the
+// top line, and the display start line (0x40|line) is moved down 8
+// rows, so that page appears at the bottom. Each line scrolled in
+// then costs one page of data plus the page commands, instead of a
+// full frame.
+//
+// uGUI must be initialized first (meter_init()).
+///////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "ugui.h"
+#include "console.h"
+
+static struct {
+	uint8_t		page;		// Pixmap page of the current line
+	uint8_t		lines;		// Lines in use
+	uint8_t		line;		// Display start line
+	uint8_t		col;		// Characters on the current line
+	bool		nl;		// Newline pending
+} con;
+
+/*********************************************************************
+ * Clear the display and start at the top line
+ *********************************************************************/
+
+void
+console_init(void) {
+
+	oled_frame_begin();
+	memset(pixmap,0,OLED_PAGES*OLED_COLS);
+	oled_dirty_all();
+
+	con.page = 0;
+	con.lines = 0;
+	con.line = 0;
+	con.col = 0;
+	con.nl = true;
+	oled_set_start_line(0);
+	oled_frame_submit();
+}
+
+/*********************************************************************
+ * Internal: Start a new line, scrolling once the display is full.
+ * Pixmap page p holds rows 56-8p to 63-8p (meter.c's coordinates).
+ *********************************************************************/
+
+static void
+new_line(void) {
+	short y;
+
+	if ( con.lines < CONSOLE_LINES )
+		++con.lines;
+	else	{
+		con.line = (con.line - 8) & 0x3F;
+		oled_set_start_line(con.line);
+	}
+	con.page = (con.page + OLED_PAGES - 1) % OLED_PAGES;
+	con.col = 0;
+	con.nl = false;
+
+	memset(pixmap + con.page * OLED_COLS,0,OLED_COLS);
+	oled_mark_dirty(con.page,0);
+	oled_mark_dirty(con.page,OLED_COLS-1);
+
+	y = 56 - 8 * con.page;
+	UG_ConsoleSetArea(0,y,OLED_COLS-1,y+7);
+}
+
+/*********************************************************************
+ * Write text, wrapping long lines, and submit the frame. A trailing
+ * newline scrolls when the next character arrives.
+ *********************************************************************/
+
+void
+console_puts(const char *str) {
+	char buf[CONSOLE_COLS+2];
+	unsigned n;
+
+	oled_frame_begin();
+	UG_FontSelect(&FONT_4X6);
+	UG_FontSetHSpace(0);
+	UG_FontSetVSpace(2);
+	UG_ConsoleSetForecolor(C_WHITE);
+	UG_ConsoleSetBackcolor(C_BLACK);
+
+	while ( *str ) {
+		if ( *str == '\r' ) {
+			++str;
+			continue;
+		}
+		if ( *str == '\n' ) {
+			if ( con.nl ) {
+				// Empty line: uGUI must still step down
+				new_line();
+				UG_ConsolePutString("\n ");
+			}
+			con.nl = true;
+			++str;
+			continue;
+		}
+		if ( con.nl || con.col >= CONSOLE_COLS )
+			new_line();
+
+		// The rest of this line, led by a newline for uGUI to
+		// return to the start of the console area:
+		n = 0;
+		if ( !con.col )
+			buf[n++] = '\n';
+		while ( *str && *str != '\n' && *str != '\r' && con.col < CONSOLE_COLS ) {
+			buf[n++] = *str++;
+			++con.col;
+		}
+		buf[n] = 0;
+		UG_ConsolePutString(buf);
+	}
+	oled_frame_submit();
+}
+
+// End console.c
@@ -0,0 +1,19 @@
+///////////////////////////////////////////////////////////////////////
+// console.h -- Scrolling text console on the SSD1306
+// Warren W. Gay VE3WWG
+///////////////////////////////////////////////////////////////////////
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "oled.h"
+
+#define CONSOLE_LINES	OLED_PAGES	// One page per line (FONT_4X6)
+#define CONSOLE_COLS	31		// As uGUI's console wraps
+
+void console_init(void);
+void console_puts(const char *str);
+
+#endif // CONSOLE_H
+
+// End console.h
@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////
+// glyph.c -- Page aligned text for the SSD1306 pixmap
+// Warren W. Gay VE3WWG
+//
+// Writes whole glyph columns into the page ordered pixmap, instead
+// of a pixel at a time through uGUI. A column covering display rows
+// r..r+height-1 touches the bytes of pages r/8 onward: when r is a
+// multiple of 8 the column bytes are stored as they are, otherwise
+// they are shifted across the page boundary. Bytes that are fully
+// covered are stored, others are merged under a mask.
+//
+// Strings uGUI would wrap or clip, characters not transposed and the
+// XOR pen (C_RED) are left to UG_PutString(). Character spacing is
+// taken to be 0 (UG_FontSetHSpace).
+///////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "oled.h"
+#include "glyph.h"
+
+/*********************************************************************
+ * Internal: Store b at row[x] under mask, noting changed columns
+ *********************************************************************/
+
+static inline void
+put_byte(uint8_t *row,unsigned x,uint8_t mask,uint8_t b,unsigned *lo,unsigned *hi) {
+
+	b = (row[x] & ~mask) | (b & mask);
+	if ( b != row[x] ) {
+		row[x] = b;
+		if ( x < *lo )
+			*lo = x;
+		if ( x > *hi )
+			*hi = x;
+	}
+}
+
+/*********************************************************************
+ * Internal: Fallback to uGUI
+ *********************************************************************/
+
+static void
+ug_puts(const struct s_glyphfont *font,UG_S16 x,UG_S16 y,const char *str,UG_COLOR fc,UG_COLOR bc) {
+
+	UG_FontSelect(font->ug);
+	UG_FontSetHSpace(0);
+	UG_SetForecolor(fc);
+	UG_SetBackcolor(bc);
+	UG_PutString(x,y,(char *)str);
+}
+
+/*********************************************************************
+ * Draw str with its top left corner at x,y, in colours fc on bc
+ *********************************************************************/
+
+void
+glyph_puts(const struct s_glyphfont *font,UG_S16 x,UG_S16 y,const char *str,UG_COLOR fc,UG_COLOR bc) {
+	unsigned w = font->width, h = font->height, nb = (h + 7) / 8;
+	unsigned len = strlen(str), r, shift, pg, npg, lo[OLED_PAGES], hi[OLED_PAGES];
+	uint32_t cell = (1ul << h) - 1, fg, bg, bits, mask;
+	const uint8_t *cp;
+	uint8_t *row;
+
+	if ( fc == C_RED || bc == C_RED
+	  || x < 0 || x + len * w > OLED_COLS - 1	// uGUI would wrap
+	  || y < 0 || y + h > 64 ) {
+		ug_puts(font,x,y,str,fc,bc);
+		return;
+	}
+	for ( unsigned ux=0; ux<len; ++ux ) {
+		if ( (uint8_t)str[ux] < font->first || (uint8_t)str[ux] > font->last ) {
+			ug_puts(font,x,y,str,fc,bc);
+			return;
+		}
+	}
+
+	fg = fc == C_BLACK ? 0 : cell;		// Pixels on for glyph bits
+	bg = bc == C_BLACK ? 0 : cell;		// Pixels on for other bits
+	r = 64 - y - h;				// Bottom display row
+	shift = r % 8;
+	pg = r / 8;
+	npg = (r + h + 7) / 8 - pg;		// Pages touched
+	row = &pixmap[pg * OLED_COLS];
+	for ( unsigned px=0; px<npg; ++px ) {
+		lo[px] = OLED_COLS;
+		hi[px] = 0;
+	}
+
+	for ( ; *str; ++str ) {
+		cp = &font->cols[((uint8_t)*str - font->first) * w * nb];
+		for ( unsigned cx=0; cx<w; ++cx, ++x, cp += nb ) {
+			bits = cp[0];
+			if ( nb > 1 )
+				bits |= cp[1] << 8;
+			bits = (bits & fg) | (~bits & bg);
+
+			if ( !shift ) {
+				// Page aligned: whole bytes stored as they are
+				for ( unsigned px=0; px<npg; ++px, bits >>= 8 )
+					put_byte(row + px * OLED_COLS,x,px * 8 + 8 <= h ? 0xFF : cell >> px * 8,bits,&lo[px],&hi[px]);
+			} else	{
+				bits <<= shift;
+				mask = cell << shift;
+				for ( unsigned px=0; px<npg; ++px, bits >>= 8, mask >>= 8 )
+					put_byte(row + px * OLED_COLS,x,mask,bits,&lo[px],&hi[px]);
+			}
+		}
+	}
+
+	for ( unsigned px=0; px<npg; ++px ) {
+		if ( lo[px] < OLED_COLS ) {
+			oled_mark_dirty(pg + px,lo[px]);
+			oled_mark_dirty(pg + px,hi[px]);
+		}
+	}
+}
+
+// End glyph.c
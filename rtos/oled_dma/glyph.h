@@ -0,0 +1,32 @@
+///////////////////////////////////////////////////////////////////////
+// glyph.h -- Page aligned text for the SSD1306 pixmap
+// Warren W. Gay VE3WWG
+///////////////////////////////////////////////////////////////////////
+
+#ifndef GLYPH_H
+#define GLYPH_H
+
+#include <stdint.h>
+
+#include "ugui.h"
+
+// A uGUI font, transposed to columns by posix/mkglyphs (glyphs.c)
+struct s_glyphfont {
+	uint8_t		width;		// Cell width in pixels
+	uint8_t		height;		// Cell height in pixels
+	uint8_t		first, last;	// Characters transposed
+	const UG_FONT	*ug;		// uGUI font, for the fallback
+	const uint8_t	*cols;		// (height+7)/8 bytes per column
+};
+
+// Column bytes are LSB first. Bit height-1-j is glyph row j, as the
+// pixmap's rows run bottom up (see meter.c).
+
+extern const struct s_glyphfont GLYPH_4X6;
+extern const struct s_glyphfont GLYPH_8X12;
+
+void glyph_puts(const struct s_glyphfont *font,UG_S16 x,UG_S16 y,const char *str,UG_COLOR fc,UG_COLOR bc);
+
+#endif // GLYPH_H
+
+// End glyph.h
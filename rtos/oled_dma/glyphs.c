@@ -0,0 +1,207 @@
+///////////////////////////////////////////////////////////////////////
+// glyphs.c -- Generated by posix/mkglyphs from ugui.c: do not edit
+///////////////////////////////////////////////////////////////////////
+
+#include "glyph.h"
+
+static const uint8_t GLYPH_4X6_cols[] = {
+	0x00, 0x00, 0x00, 0x00, // ' '
+	0x00, 0x00, 0x3A, 0x00, // '!'
+	0x00, 0x30, 0x00, 0x30, // '"'
+	0x00, 0x3E, 0x14, 0x3E, // '#'
+	0x00, 0x0A, 0x3F, 0x14, // '$'
+	0x00, 0x24, 0x08, 0x12, // '%'
+	0x00, 0x16, 0x2A, 0x1E, // '&'
+	0x00, 0x30, 0x20, 0x00, // '''
+	0x00, 0x1C, 0x22, 0x00, // '('
+	0x00, 0x22, 0x1C, 0x00, // ')'
+	0x00, 0x2A, 0x1C, 0x2A, // '*'
+	0x00, 0x08, 0x1C, 0x08, // '+'
+	0x00, 0x03, 0x02, 0x00, // ','
+	0x00, 0x08, 0x08, 0x08, // '-'
+	0x00, 0x00, 0x02, 0x00, // '.'
+	0x00, 0x06, 0x08, 0x30, // '/'
+	0x00, 0x1E, 0x22, 0x3C, // '0'
+	0x00, 0x12, 0x3E, 0x02, // '1'
+	0x00, 0x26, 0x2A, 0x12, // '2'
+	0x00, 0x22, 0x2A, 0x14, // '3'
+	0x00, 0x18, 0x08, 0x3E, // '4'
+	0x00, 0x3A, 0x2A, 0x24, // '5'
+	0x00, 0x1C, 0x2A, 0x04, // '6'
+	0x00, 0x20, 0x2E, 0x38, // '7'
+	0x00, 0x14, 0x2A, 0x14, // '8'
+	0x00, 0x10, 0x2A, 0x1C, // '9'
+	0x00, 0x00, 0x0A, 0x00, // ':'
+	0x00, 0x03, 0x0A, 0x00, // ';'
+	0x00, 0x08, 0x14, 0x22, // '<'
+	0x00, 0x0A, 0x0A, 0x0A, // '='
+	0x00, 0x22, 0x14, 0x08, // '>'
+	0x00, 0x20, 0x2A, 0x10, // '?'
+	0x00, 0x3E, 0x22, 0x3A, // '@'
+	0x00, 0x1E, 0x28, 0x1E, // 'A'
+	0x00, 0x3E, 0x2A, 0x14, // 'B'
+	0x00, 0x1C, 0x22, 0x22, // 'C'
+	0x00, 0x3E, 0x22, 0x1C, // 'D'
+	0x00, 0x3E, 0x2A, 0x22, // 'E'
+	0x00, 0x3E, 0x28, 0x20, // 'F'
+	0x00, 0x1C, 0x22, 0x2E, // 'G'
+	0x00, 0x3E, 0x08, 0x3E, // 'H'
+	0x00, 0x22, 0x3E, 0x22, // 'I'
+	0x00, 0x04, 0x02, 0x3C, // 'J'
+	0x00, 0x3E, 0x08, 0x36, // 'K'
+	0x00, 0x3E, 0x02, 0x02, // 'L'
+	0x00, 0x3E, 0x18, 0x3E, // 'M'
+	0x00, 0x3E, 0x10, 0x3E, // 'N'
+	0x00, 0x1C, 0x22, 0x1C, // 'O'
+	0x00, 0x3E, 0x28, 0x10, // 'P'
+	0x00, 0x1C, 0x26, 0x1E, // 'Q'
+	0x00, 0x3E, 0x28, 0x16, // 'R'
+	0x00, 0x1A, 0x2A, 0x2C, // 'S'
+	0x00, 0x20, 0x3E, 0x20, // 'T'
+	0x00, 0x3E, 0x02, 0x3E, // 'U'
+	0x00, 0x3C, 0x02, 0x3C, // 'V'
+	0x00, 0x3E, 0x0C, 0x3E, // 'W'
+	0x00, 0x36, 0x08, 0x36, // 'X'
+	0x00, 0x30, 0x0E, 0x30, // 'Y'
+	0x00, 0x26, 0x2A, 0x32, // 'Z'
+	0x00, 0x3E, 0x22, 0x00, // '['
+	0x00, 0x30, 0x08, 0x06, // '\'
+	0x00, 0x22, 0x3E, 0x00, // ']'
+	0x00, 0x10, 0x20, 0x10, // '^'
+	0x01, 0x01, 0x01, 0x01, // '_'
+	0x00, 0x20, 0x30, 0x00, // '`'
+	0x00, 0x06, 0x0A, 0x0E, // 'a'
+	0x00, 0x3E, 0x0A, 0x04, // 'b'
+	0x00, 0x04, 0x0A, 0x0A, // 'c'
+	0x00, 0x04, 0x0A, 0x3E, // 'd'
+	0x00, 0x0C, 0x0E, 0x0A, // 'e'
+	0x00, 0x08, 0x1E, 0x28, // 'f'
+	0x00, 0x0D, 0x09, 0x0F, // 'g'
+	0x00, 0x3E, 0x08, 0x06, // 'h'
+	0x00, 0x00, 0x2E, 0x00, // 'i'
+	0x00, 0x01, 0x2F, 0x00, // 'j'
+	0x00, 0x3E, 0x04, 0x0A, // 'k'
+	0x00, 0x00, 0x3E, 0x00, // 'l'
+	0x00, 0x0E, 0x0C, 0x0E, // 'm'
+	0x00, 0x0E, 0x08, 0x06, // 'n'
+	0x00, 0x04, 0x0A, 0x04, // 'o'
+	0x00, 0x0F, 0x0A, 0x04, // 'p'
+	0x00, 0x04, 0x0A, 0x0F, // 'q'
+	0x00, 0x0E, 0x08, 0x00, // 'r'
+	0x00, 0x02, 0x0E, 0x08, // 's'
+	0x00, 0x08, 0x1E, 0x0A, // 't'
+	0x00, 0x0E, 0x02, 0x0E, // 'u'
+	0x00, 0x0C, 0x02, 0x0C, // 'v'
+	0x00, 0x0E, 0x06, 0x0E, // 'w'
+	0x00, 0x0A, 0x04, 0x0A, // 'x'
+	0x00, 0x0D, 0x02, 0x0C, // 'y'
+	0x00, 0x08, 0x0E, 0x02, // 'z'
+	0x00, 0x08, 0x3E, 0x22, // '{'
+	0x00, 0x00, 0x3E, 0x00, // '|'
+	0x00, 0x22, 0x3E, 0x08, // '}'
+	0x10, 0x20, 0x10, 0x20, // '~'
+};
+
+const struct s_glyphfont GLYPH_4X6 = { 4, 6, 0x20, 0x7E, &FONT_4X6, GLYPH_4X6_cols };
+
+static const uint8_t GLYPH_8X12_cols[] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ' '
+	0x00, 0x00, 0x80, 0x03, 0xEC, 0x07, 0xEC, 0x07, 0x80, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // '!'
+	0x00, 0x00, 0x00, 0x07, 0x80, 0x07, 0x00, 0x00, 0x00, 0x00, 0x80, 0x07, 0x00, 0x07, 0x00, 0x00, // '"'
+	0x10, 0x01, 0xFC, 0x07, 0xFC, 0x07, 0x10, 0x01, 0xFC, 0x07, 0xFC, 0x07, 0x10, 0x01, 0x00, 0x00, // '#'
+	0x88, 0x01, 0xC8, 0x03, 0x4E, 0x0E, 0x4E, 0x0E, 0x78, 0x02, 0x30, 0x02, 0x00, 0x00, 0x00, 0x00, // '$'
+	0x8C, 0x01, 0x98, 0x01, 0x30, 0x00, 0x60, 0x00, 0xCC, 0x00, 0x8C, 0x01, 0x00, 0x00, 0x00, 0x00, // '%'
+	0x78, 0x03, 0xFC, 0x07, 0xC4, 0x04, 0xEC, 0x07, 0x78, 0x03, 0x3C, 0x00, 0x64, 0x00, 0x00, 0x00, // '&'
+	0x00, 0x00, 0x80, 0x00, 0x80, 0x07, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // '''
+	0x00, 0x00, 0xE0, 0x00, 0xF0, 0x01, 0x18, 0x03, 0x0C, 0x06, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, // '('
+	0x00, 0x00, 0x04, 0x04, 0x0C, 0x06, 0x18, 0x03, 0xF0, 0x01, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00, // ')'
+	0x40, 0x00, 0x50, 0x01, 0xF0, 0x01, 0xE0, 0x00, 0xE0, 0x00, 0xF0, 0x01, 0x50, 0x01, 0x40, 0x00, // '*'
+	0x00, 0x00, 0x40, 0x00, 0x40, 0x00, 0xF0, 0x01, 0xF0, 0x01, 0x40, 0x00, 0x40, 0x00, 0x00, 0x00, // '+'
+	0x00, 0x00, 0x02, 0x00, 0x0E, 0x00, 0x0C, 0x00, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ','
+	0x40, 0x00, 0x40, 0x00, 0x40, 0x00, 0x40, 0x00, 0x40, 0x00, 0x40, 0x00, 0x40, 0x00, 0x00, 0x00, // '-'
+	0x00, 0x00, 0x00, 0x00, 0x0C, 0x00, 0x0C, 0x00, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // '.'
+	0x0C, 0x00, 0x18, 0x00, 0x30, 0x00, 0x60, 0x00, 0xC0, 0x00, 0x80, 0x01, 0x00, 0x03, 0x00, 0x00, // '/'
+	0xF8, 0x03, 0xFC, 0x07, 0x34, 0x04, 0xE4, 0x04, 0x84, 0x05, 0xFC, 0x07, 0xF8, 0x03, 0x00, 0x00, // '0'
+	0x04, 0x01, 0x04, 0x01, 0xFC, 0x03, 0xFC, 0x07, 0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, // '1'
+	0x0C, 0x03, 0x1C, 0x07, 0x34, 0x04, 0x64, 0x04, 0xCC, 0x07, 0x8C, 0x03, 0x00, 0x00, 0x00, 0x00, // '2'
+	0x08, 0x02, 0x0C, 0x06, 0x44, 0x04, 0x44, 0x04, 0xFC, 0x07, 0xB8, 0x03, 0x00, 0x00, 0x00, 0x00, // '3'
+	0x60, 0x00, 0xE0, 0x00, 0xA0, 0x01, 0x24, 0x03, 0xFC, 0x07, 0xFC, 0x07, 0x24, 0x00, 0x00, 0x00, // '4'
+	0xC8, 0x07, 0xCC, 0x07, 0x44, 0x04, 0x44, 0x04, 0x7C, 0x04, 0x38, 0x04, 0x00, 0x00, 0x00, 0x00, // '5'
+	0xF8, 0x01, 0xFC, 0x03, 0x44, 0x06, 0x44, 0x04, 0x7C, 0x04, 0x38, 0x00, 0x00, 0x00, 0x00, 0x00, // '6'
+	0x00, 0x07, 0x00, 0x07, 0x1C, 0x04, 0x3C, 0x04, 0x60, 0x04, 0xC0, 0x07, 0x80, 0x07, 0x00, 0x00, // '7'
+	0xB8, 0x03, 0xFC, 0x07, 0x44, 0x04, 0x44, 0x04, 0xFC, 0x07, 0xB8, 0x03, 0x00, 0x00, 0x00, 0x00, // '8'
+	0x80, 0x03, 0xC4, 0x07, 0x4C, 0x04, 0x7C, 0x04, 0xF0, 0x07, 0xC0, 0x03, 0x00, 0x00, 0x00, 0x00, // '9'
+	0x00, 0x00, 0x00, 0x00, 0x98, 0x01, 0x98, 0x01, 0x98, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ':'
+	0x00, 0x00, 0x00, 0x00, 0x9A, 0x01, 0x9E, 0x01, 0x9C, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // ';'
+	0x40, 0x00, 0xE0, 0x00, 0xB0, 0x01, 0x18, 0x03, 0x0C, 0x06, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, // '<'
+	0x00, 0x00, 0xA0, 0x00, 0xA0, 0x00, 0xA0, 0x00, 0xA0, 0x00, 0xA0, 0x00, 0xA0, 0x00, 0x00, 0x00, // '='
+	0x00, 0x00, 0x04, 0x04, 0x0C, 0x06, 0x18, 0x03, 0xB0, 0x01, 0xE0, 0x00, 0x40, 0x00, 0x00, 0x00, // '>'
+	0x00, 0x02, 0x00, 0x06, 0x6C, 0x04, 0xEC, 0x04, 0x80, 0x07, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, // '?'
+	0xF8, 0x03, 0xFC, 0x07, 0x04, 0x04, 0xE4, 0x04, 0xE4, 0x04, 0xE4, 0x07, 0xE0, 0x03, 0x00, 0x00, // '@'
+	0xFC, 0x01, 0xFC, 0x03, 0x20, 0x06, 0x20, 0x06, 0xFC, 0x03, 0xFC, 0x01, 0x00, 0x00, 0x00, 0x00, // 'A'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x44, 0x04, 0x44, 0x04, 0xFC, 0x07, 0xB8, 0x03, 0x00, 0x00, // 'B'
+	0xF0, 0x01, 0xF8, 0x03, 0x0C, 0x06, 0x04, 0x04, 0x04, 0x04, 0x1C, 0x07, 0x18, 0x03, 0x00, 0x00, // 'C'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x04, 0x04, 0x0C, 0x06, 0xF8, 0x03, 0xF0, 0x01, 0x00, 0x00, // 'D'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x44, 0x04, 0x44, 0x04, 0xE4, 0x04, 0x0C, 0x06, 0x00, 0x00, // 'E'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x44, 0x04, 0x40, 0x04, 0xE0, 0x06, 0x00, 0x07, 0x00, 0x00, // 'F'
+	0xF0, 0x01, 0xF8, 0x03, 0x0C, 0x06, 0x04, 0x04, 0x24, 0x04, 0x3C, 0x07, 0x3C, 0x03, 0x00, 0x00, // 'G'
+	0xFC, 0x07, 0xFC, 0x07, 0x40, 0x00, 0x40, 0x00, 0xFC, 0x07, 0xFC, 0x07, 0x00, 0x00, 0x00, 0x00, // 'H'
+	0x00, 0x00, 0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 'I'
+	0x38, 0x00, 0x3C, 0x00, 0x04, 0x00, 0x04, 0x04, 0xFC, 0x07, 0xF8, 0x07, 0x00, 0x04, 0x00, 0x00, // 'J'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x40, 0x00, 0xF0, 0x01, 0xBC, 0x07, 0x0C, 0x06, 0x00, 0x00, // 'K'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x04, 0x04, 0x04, 0x00, 0x1C, 0x00, 0x3C, 0x00, 0x00, 0x00, // 'L'
+	0xFC, 0x07, 0xFC, 0x07, 0x80, 0x03, 0xC0, 0x01, 0x80, 0x03, 0xFC, 0x07, 0xFC, 0x07, 0x00, 0x00, // 'M'
+	0xFC, 0x07, 0xFC, 0x07, 0xC0, 0x01, 0xE0, 0x00, 0x70, 0x00, 0xFC, 0x07, 0xFC, 0x07, 0x00, 0x00, // 'N'
+	0xF0, 0x01, 0xF8, 0x03, 0x0C, 0x06, 0x04, 0x04, 0x0C, 0x06, 0xF8, 0x03, 0xF0, 0x01, 0x00, 0x00, // 'O'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x44, 0x04, 0x40, 0x04, 0xC0, 0x07, 0x80, 0x03, 0x00, 0x00, // 'P'
+	0xF0, 0x01, 0xF8, 0x03, 0x08, 0x06, 0x1A, 0x04, 0x3E, 0x06, 0xFE, 0x03, 0xF2, 0x01, 0x00, 0x00, // 'Q'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x40, 0x04, 0x60, 0x04, 0xFC, 0x07, 0x9C, 0x03, 0x00, 0x00, // 'R'
+	0x98, 0x03, 0xDC, 0x07, 0x44, 0x04, 0x64, 0x04, 0x3C, 0x07, 0x18, 0x03, 0x00, 0x00, 0x00, 0x00, // 'S'
+	0x00, 0x06, 0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x04, 0x04, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, // 'T'
+	0xF8, 0x07, 0xFC, 0x07, 0x04, 0x00, 0x04, 0x00, 0xFC, 0x07, 0xF8, 0x07, 0x00, 0x00, 0x00, 0x00, // 'U'
+	0xF0, 0x07, 0xF8, 0x07, 0x0C, 0x00, 0x0C, 0x00, 0xF8, 0x07, 0xF0, 0x07, 0x00, 0x00, 0x00, 0x00, // 'V'
+	0xE0, 0x07, 0xFC, 0x07, 0x1C, 0x00, 0x60, 0x00, 0x1C, 0x00, 0xFC, 0x07, 0xE0, 0x07, 0x00, 0x00, // 'W'
+	0x1C, 0x07, 0xBC, 0x07, 0xE0, 0x00, 0xE0, 0x00, 0xBC, 0x07, 0x1C, 0x07, 0x00, 0x00, 0x00, 0x00, // 'X'
+	0x80, 0x07, 0xC4, 0x07, 0x7C, 0x00, 0x7C, 0x00, 0xC4, 0x07, 0x80, 0x07, 0x00, 0x00, 0x00, 0x00, // 'Y'
+	0x0C, 0x07, 0x3C, 0x06, 0x74, 0x04, 0xC4, 0x05, 0x84, 0x07, 0x0C, 0x06, 0x1C, 0x06, 0x00, 0x00, // 'Z'
+	0x00, 0x00, 0x00, 0x00, 0xFC, 0x07, 0xFC, 0x07, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, // '['
+	0x00, 0x03, 0x80, 0x01, 0xC0, 0x00, 0x60, 0x00, 0x30, 0x00, 0x18, 0x00, 0x0C, 0x00, 0x00, 0x00, // '\'
+	0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x00, 0x00, 0x00, 0x00, // ']'
+	0x00, 0x01, 0x00, 0x03, 0x00, 0x06, 0x00, 0x0C, 0x00, 0x06, 0x00, 0x03, 0x00, 0x01, 0x00, 0x00, // '^'
+	0x02, 0x00, 0x02, 0x00, 0x02, 0x00, 0x02, 0x00, 0x02, 0x00, 0x02, 0x00, 0x02, 0x00, 0x02, 0x00, // '_'
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x00, 0x0E, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // '`'
+	0x18, 0x00, 0xBC, 0x00, 0xA4, 0x00, 0xA4, 0x00, 0xF8, 0x00, 0x7C, 0x00, 0x04, 0x00, 0x00, 0x00, // 'a'
+	0x04, 0x04, 0xFC, 0x07, 0xF8, 0x07, 0x84, 0x00, 0x84, 0x00, 0xFC, 0x00, 0x78, 0x00, 0x00, 0x00, // 'b'
+	0x78, 0x00, 0xFC, 0x00, 0x84, 0x00, 0x84, 0x00, 0xCC, 0x00, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00, // 'c'
+	0x78, 0x00, 0xFC, 0x00, 0x84, 0x00, 0x84, 0x04, 0xF8, 0x07, 0xFC, 0x07, 0x04, 0x00, 0x00, 0x00, // 'd'
+	0x78, 0x00, 0xFC, 0x00, 0xA4, 0x00, 0xA4, 0x00, 0xEC, 0x00, 0x68, 0x00, 0x00, 0x00, 0x00, 0x00, // 'e'
+	0x44, 0x00, 0xFC, 0x03, 0xFC, 0x07, 0x44, 0x04, 0x40, 0x06, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, // 'f'
+	0x72, 0x00, 0xFB, 0x00, 0x89, 0x00, 0x89, 0x00, 0x7F, 0x00, 0xFE, 0x00, 0x80, 0x00, 0x00, 0x00, // 'g'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x40, 0x00, 0x80, 0x00, 0xFC, 0x00, 0x7C, 0x00, 0x00, 0x00, // 'h'
+	0x00, 0x00, 0x84, 0x00, 0x84, 0x00, 0xFC, 0x06, 0xFC, 0x06, 0x04, 0x00, 0x04, 0x00, 0x00, 0x00, // 'i'
+	0x06, 0x00, 0x07, 0x00, 0x81, 0x00, 0x81, 0x00, 0xFF, 0x06, 0xFE, 0x06, 0x00, 0x00, 0x00, 0x00, // 'j'
+	0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x20, 0x00, 0x70, 0x00, 0xDC, 0x00, 0x8C, 0x00, 0x00, 0x00, // 'k'
+	0x00, 0x00, 0x04, 0x04, 0x04, 0x04, 0xFC, 0x07, 0xFC, 0x07, 0x04, 0x00, 0x04, 0x00, 0x00, 0x00, // 'l'
+	0xFC, 0x00, 0xFC, 0x00, 0x80, 0x00, 0xF8, 0x00, 0x80, 0x00, 0xFC, 0x00, 0x7C, 0x00, 0x00, 0x00, // 'm'
+	0xFC, 0x00, 0xFC, 0x00, 0x80, 0x00, 0x80, 0x00, 0xFC, 0x00, 0x7C, 0x00, 0x00, 0x00, 0x00, 0x00, // 'n'
+	0x78, 0x00, 0xFC, 0x00, 0x84, 0x00, 0x84, 0x00, 0xFC, 0x00, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00, // 'o'
+	0x81, 0x00, 0xFF, 0x00, 0x7F, 0x00, 0x85, 0x00, 0x84, 0x00, 0xFC, 0x00, 0x78, 0x00, 0x00, 0x00, // 'p'
+	0x78, 0x00, 0xFC, 0x00, 0x84, 0x00, 0x85, 0x00, 0x7F, 0x00, 0xFF, 0x00, 0x81, 0x00, 0x00, 0x00, // 'q'
+	0x84, 0x00, 0xFC, 0x00, 0xFC, 0x00, 0x24, 0x00, 0xC0, 0x00, 0xE0, 0x00, 0x60, 0x00, 0x00, 0x00, // 'r'
+	0x48, 0x00, 0xEC, 0x00, 0xA4, 0x00, 0x94, 0x00, 0xDC, 0x00, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00, // 's'
+	0x80, 0x00, 0xF8, 0x01, 0xFC, 0x03, 0x84, 0x00, 0x8C, 0x00, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, // 't'
+	0xF8, 0x00, 0xFC, 0x00, 0x04, 0x00, 0x04, 0x00, 0xF8, 0x00, 0xFC, 0x00, 0x04, 0x00, 0x00, 0x00, // 'u'
+	0xF0, 0x00, 0xF8, 0x00, 0x0C, 0x00, 0x0C, 0x00, 0xF8, 0x00, 0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, // 'v'
+	0xF0, 0x00, 0xFC, 0x00, 0x0C, 0x00, 0x30, 0x00, 0x0C, 0x00, 0xFC, 0x00, 0xF0, 0x00, 0x00, 0x00, // 'w'
+	0x84, 0x00, 0xCC, 0x00, 0x78, 0x00, 0x30, 0x00, 0x78, 0x00, 0xCC, 0x00, 0x84, 0x00, 0x00, 0x00, // 'x'
+	0x01, 0x00, 0xF1, 0x00, 0xF9, 0x00, 0x0B, 0x00, 0x0E, 0x00, 0xFC, 0x00, 0xF0, 0x00, 0x00, 0x00, // 'y'
+	0xCC, 0x00, 0x9C, 0x00, 0x94, 0x00, 0xA4, 0x00, 0xE4, 0x00, 0xCC, 0x00, 0x00, 0x00, 0x00, 0x00, // 'z'
+	0x40, 0x00, 0xE0, 0x00, 0xB8, 0x03, 0x1C, 0x07, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, // '{'
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xBC, 0x07, 0xBC, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // '|'
+	0x04, 0x04, 0x04, 0x04, 0x1C, 0x07, 0xB8, 0x03, 0xE0, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, // '}'
+	0x00, 0x03, 0x00, 0x07, 0x00, 0x04, 0x00, 0x06, 0x00, 0x03, 0x00, 0x01, 0x00, 0x07, 0x00, 0x04, // '~'
+};
+
+const struct s_glyphfont GLYPH_8X12 = { 8, 12, 0x20, 0x7E, &FONT_8X12, GLYPH_8X12_cols };
+
+// End glyphs.c
@@ -30,24 +30,102 @@
 #include "queue.h"
 #include "meter.h"
 #include "oled.h"
+#include "console.h"
 
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/spi.h>
 #include <libopencm3/stm32/dma.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/dwt.h>
 	
+static void dma_init(void);
+
 static TaskHandle_t h_spidma = NULL;
 static volatile bool dma_busy = false;
 static volatile bool dma_idle = true;
-static volatile bool dma_more = false;
-static volatile uint8_t *pixmapp = NULL;
 static volatile uint8_t pageno = 0;
+static volatile bool circular = false;	// DMA refreshing continuously
+static volatile enum OledMode oled_mode = OLED_PAGED;
+
+/*********************************************************************
+ * Double buffered frames: the drawing task draws into pixmap while
+ * spidma_task sends from front. oled_frame_submit() marks pixmap
+ * pending; spidma_task swaps the two when the frame on the wire
+ * completes. A pending frame not yet taken is reclaimed by the next
+ * oled_frame_begin() and so coalesced with the one drawn after it.
+ *********************************************************************/
+
+static uint8_t fbuf[2][OLED_PAGES*OLED_COLS];
+uint8_t *pixmap = fbuf[0];		// Drawn into
+static uint8_t *front = fbuf[1];	// Being sent
+static volatile bool pending = false;	// pixmap submitted, not yet taken
+
+static struct s_dirty sendq;		// Windows waiting to be sent
+static struct s_dirty frame;		// Windows of the frame being sent
+static struct s_dirty catchup;		// Windows pixmap lags front by
+
+static volatile uint8_t start_line = 0;	// For frames submitted from now
+static uint8_t sendq_line = 0;		// Start line of the pending frame
+static volatile uint8_t frame_line = 0;	// Start line of the frame being sent
+
+static uint32_t t_submit;		// Cycle count of last submit
+static uint32_t t_frame;		// Submit time of frame being sent
+static volatile bool sending = false;	// t_frame is valid
+
+static struct s_oled_stats oled_stats;
+
+/*********************************************************************
+ * Swap in the submitted frame, if any. Called with the DMA ISR
+ * masked, or from it.
+ *********************************************************************/
 
-static void start_dma(void);
+static bool
+take_frame(void) {
+	uint8_t *bp;
+
+	if ( !pending )
+		return false;
+	bp = front;
+	front = pixmap;
+	pixmap = bp;
+	frame = catchup = sendq;
+	sendq.pages = 0;
+	frame_line = sendq_line;
+	t_frame = t_submit;
+	pending = false;
+	sending = true;
+	++oled_stats.frames;
+	return true;
+}
+
+/*********************************************************************
+ * The frame being sent is now on the display
+ *********************************************************************/
+
+static void
+frame_sent(void) {
+	uint32_t lat;
+
+	if ( !sending )
+		return;
+	lat = (dwt_read_cycle_counter() - t_frame) / (configCPU_CLOCK_HZ / 1000000);
+	oled_stats.lat_us = lat;
+	oled_stats.lat_sum_us += lat;
+	if ( lat > oled_stats.lat_max_us )
+		oled_stats.lat_max_us = lat;
+	sending = false;
+}
 
 /*********************************************************************
  * DMA ISR Routine
+ *
+ * In OLED_CIRCULAR mode the channel runs continuously, and this is
+ * called once per pass (frame). A submitted frame is swapped in here,
+ * but only if the DMA has not yet fetched the first byte of the next
+ * pass. Otherwise it waits a pass, so that the SSD1306 RAM pointer
+ * and the buffer stay in step. A frame with a new start line needs
+ * commands, so is left to spidma_task.
  *********************************************************************/
 
 void
@@ -57,6 +135,25 @@ dma1_channel3_isr(void) {
 	if ( dma_get_interrupt_flag(DMA1,DMA_CHANNEL3,DMA_TCIF) )
 		dma_clear_interrupt_flags(DMA1,DMA_CHANNEL3,DMA_TCIF);
 
+	if ( circular ) {
+		frame_sent();
+		if ( oled_mode == OLED_CIRCULAR && !(pending && sendq_line != frame_line) ) {
+			if ( pending && DMA_CNDTR(DMA1,DMA_CHANNEL3) == OLED_PAGES*OLED_COLS ) {
+				dma_disable_channel(DMA1,DMA_CHANNEL3);
+				take_frame();
+				dma_set_memory_address(DMA1,DMA_CHANNEL3,(uint32_t)front);
+				dma_set_number_of_data(DMA1,DMA_CHANNEL3,OLED_PAGES*OLED_COLS);
+				dma_enable_channel(DMA1,DMA_CHANNEL3);
+			}
+			++oled_stats.bursts;
+			oled_stats.bytes += OLED_PAGES*OLED_COLS;
+			return;
+		}
+		// Mode or start line changed: stop, and let spidma_task take over
+		dma_disable_channel(DMA1,DMA_CHANNEL3);
+		circular = false;
+	}
+
         spi_disable_tx_dma(SPI1);
 
 	// Notify spidma_task to start another:
@@ -72,6 +169,8 @@ spi_dma_transmit(volatile uint8_t *tx_buf,int tx_len) {
 
 	dma_idle = false;
 	dma_busy = true;
+	++oled_stats.bursts;
+	oled_stats.bytes += tx_len;
 
 	dma_disable_channel(DMA1,DMA_CHANNEL3);
         dma_set_memory_address(DMA1,DMA_CHANNEL3,(uint32_t)tx_buf);
@@ -81,8 +180,45 @@ spi_dma_transmit(volatile uint8_t *tx_buf,int tx_len) {
 	spi_enable(SPI1);
 }
 
+/*********************************************************************
+ * Add the dirty windows of src to dst
+ *********************************************************************/
+
+static void
+dirty_merge(struct s_dirty *dst,const struct s_dirty *src) {
+	uint8_t bit;
+
+	for ( unsigned px=0; px<OLED_PAGES; ++px ) {
+		bit = 1 << px;
+		if ( !(src->pages & bit) )
+			continue;
+		if ( !(dst->pages & bit) ) {
+			dst->lo[px] = src->lo[px];
+			dst->hi[px] = src->hi[px];
+			dst->pages |= bit;
+		} else	{
+			if ( src->lo[px] < dst->lo[px] )
+				dst->lo[px] = src->lo[px];
+			if ( src->hi[px] > dst->hi[px] )
+				dst->hi[px] = src->hi[px];
+		}
+	}
+}
+
 /*********************************************************************
  * Task to manage SPI1 & DMA1
+ *
+ * OLED_PAGED:	Sends the dirty column range of each dirty page,
+ *		preceded by its page and column address commands.
+ * OLED_FULL:	Sets horizontal addressing and the full window once,
+ *		then sends each frame as one 1K DMA transfer.
+ * OLED_CIRCULAR: As OLED_FULL, but the DMA runs in circular mode,
+ *		refreshing the display continuously. Frames are then
+ *		swapped in by the DMA ISR, without waking this task.
+ *
+ * The display start line of each frame goes with its commands: in
+ * page mode with the first page, otherwise by sending the setup
+ * commands again when it changes.
  *********************************************************************/
 
 static void
@@ -95,6 +231,17 @@ spidma_task(void *arg __attribute((unused))) {
 		0x00,		// 6: Lo col
 		0x10		// 7: Hi Col
 	};
+	static uint8_t hcmds[] = {
+		0x20, 0x00,		// Horizontal mode
+		0x40,			// Display start line
+		0xD3, 0x00,		// Display offset
+		0x21, 0x00, 0x7F,	// Columns 0 to 127
+		0x22, 0x00, 0x07	// Pages 0 to 7
+	};
+	enum OledMode mode = OLED_PAGED;	// As set up in the SSD1306
+	uint8_t line = 0;			// Start line, likewise
+	bool first = false, setup = false, swapped;
+	unsigned lo;
 
 	for (;;) {
 		// Block until ISR notifies
@@ -102,72 +249,167 @@ spidma_task(void *arg __attribute((unused))) {
 		if ( dma_busy ) {
 			spi_clean_disable(SPI1);
 			dma_busy = false;
-			if ( gpio_get(GPIOB,GPIO10) ) {
-				// Advance data
-				pixmapp += 128;
-				++pageno;
+			if ( mode == OLED_PAGED ) {
+				if ( gpio_get(GPIOB,GPIO10) )
+					frame.pages &= ~(1 << pageno);	// Page data sent
+				// Toggle between Command/Data
+				gpio_toggle(GPIOB,GPIO10);
+			} else	{
+				if ( gpio_get(GPIOB,GPIO10) )
+					frame.pages = 0;		// Frame sent
+				gpio_set(GPIOB,GPIO10);			// Data from now on
 			}
-			// Toggle between Command/Data
-			gpio_toggle(GPIOB,GPIO10);
 		}
 
-		if ( pageno >= 8 ) {
-			// All OLED pages sent:
-			dma_idle = true;
-			if ( dma_more ) {
-				// Restart update
-				dma_more = false;
-				start_dma();
+		if ( !frame.pages ) {
+			frame_sent();
+
+			// Swap in the submitted frame, if any
+			taskENTER_CRITICAL();
+			if ( !(swapped = take_frame()) )
+				dma_idle = true;
+			taskEXIT_CRITICAL();
+			if ( !swapped )
+				continue;
+
+			if ( oled_mode != mode || frame_line != line ) {
+				if ( mode == OLED_CIRCULAR )
+					dma_init();		// Back to one shot
+				mode = oled_mode;
+				line = frame_line;
+				cmds[2] = hcmds[2] = 0x40 | line;
+				setup = mode != OLED_PAGED;
 			}
-		} else	{
-			// Another page to send:
-			cmds[5] = 0xB0 | pageno;
+			if ( mode == OLED_PAGED ) {
+				gpio_clear(GPIOB,GPIO10); // Cmd mode
+				first = true;
+			}
+		}
+
+		if ( mode == OLED_PAGED ) {
+			// Next dirty page:
+			pageno = __builtin_ctz(frame.pages);
+			lo = frame.lo[pageno];
 			if ( !gpio_get(GPIOB,GPIO10) ) {
 				// Send commands:
-				if ( !pageno )
+				cmds[5] = 0xB0 | pageno;
+				cmds[6] = lo & 0x0F;
+				cmds[7] = 0x10 | lo >> 4;
+				if ( first )
 					spi_dma_transmit(&cmds[0],8);
 				else	spi_dma_transmit(&cmds[5],3);
+				first = false;
 			} else	{
 				// Send page data:
-				spi_dma_transmit(pixmapp,128);
+				spi_dma_transmit(&front[pageno * OLED_COLS + lo],frame.hi[pageno] - lo + 1);
 			}
+		} else if ( setup ) {
+			// Horizontal mode, full window:
+			gpio_clear(GPIOB,GPIO10);
+			spi_dma_transmit(hcmds,sizeof hcmds);
+			setup = false;
+		} else if ( mode == OLED_FULL ) {
+			spi_dma_transmit(front,OLED_PAGES*OLED_COLS);
+		} else	{
+			// The DMA ISR takes over until the mode changes:
+			dma_disable_channel(DMA1,DMA_CHANNEL3);
+			dma_enable_circular_mode(DMA1,DMA_CHANNEL3);
+			circular = true;
+			spi_dma_transmit(front,OLED_PAGES*OLED_COLS);
 		}
 	}
 }
 
 /*********************************************************************
- * Start DMA transfer from OLED Page 0
+ * Begin drawing a frame into pixmap. If the last submitted frame has
+ * not been taken by spidma_task, it is reclaimed, to be replaced by
+ * this one. Otherwise pixmap is the buffer last sent, and is first
+ * brought up to date from front. Calling it again is harmless.
  *********************************************************************/
 
-static void
-start_dma(void) {
-	extern uint8_t pixmap[128*64/8];
+void
+oled_frame_begin(void) {
+	unsigned off;
+
+	taskENTER_CRITICAL();
+	pending = false;
+	taskEXIT_CRITICAL();
 
-	pageno = 0;
-	pixmapp = &pixmap[0];
-	gpio_clear(GPIOB,GPIO10); // Cmd mode
-	xTaskNotifyGive(h_spidma);
+	// front is only read by the DMA, so may be copied from:
+	for ( unsigned px=0; px<OLED_PAGES; ++px ) {
+		if ( catchup.pages & (1 << px) ) {
+			off = px * OLED_COLS + catchup.lo[px];
+			memcpy(pixmap + off,front + off,catchup.hi[px] - catchup.lo[px] + 1);
+		}
+	}
+	catchup.pages = 0;
 }
 
 /*********************************************************************
- * Initiate a DMA OLED update or Queue repeat update
+ * Submit the frame drawn into pixmap for sending. A frame still
+ * waiting is replaced (coalesced): only its dirty windows are kept.
+ * Starts the DMA task if it is idle.
  *********************************************************************/
 
 void
-spi_dma_xmit_pixmap(void) {
+oled_frame_submit(void) {
 	bool prime = false;
 
 	taskENTER_CRITICAL();
-	if ( !dma_idle ) {
-		// Restart dma at DMA completion
-		dma_more = true;// Restart upon completion
-	} else	{
-		prime = true;	// Start from idle
+	if ( pixmap_dirty.pages || sendq.pages ) {
+		if ( sendq.pages )
+			++oled_stats.coalesced;
+		++oled_stats.submitted;
+		dirty_merge(&sendq,&pixmap_dirty);
+		pixmap_dirty.pages = 0;
+		sendq_line = start_line;
+		t_submit = dwt_read_cycle_counter();
+		pending = true;
+		if ( dma_idle ) {
+			dma_idle = false;
+			prime = true;	// Start from idle
+		}
 	}
 	taskEXIT_CRITICAL();
 
 	if ( prime )
-		start_dma();	// Start from idle
+		xTaskNotifyGive(h_spidma);
+}
+
+/*********************************************************************
+ * Return the frame counters, optionally resetting them
+ *********************************************************************/
+
+void
+oled_frame_stats(struct s_oled_stats *stats,bool reset) {
+
+	taskENTER_CRITICAL();
+	*stats = oled_stats;
+	if ( reset )
+		memset(&oled_stats,0,sizeof oled_stats);
+	taskEXIT_CRITICAL();
+}
+
+/*********************************************************************
+ * Select how frames are sent, from the next frame on
+ *********************************************************************/
+
+void
+oled_set_mode(enum OledMode mode) {
+
+	oled_mode = mode;
+}
+
+/*********************************************************************
+ * Set the display start line (0 to 63) for frames submitted from
+ * now on. Row y of the pixmap (as drawn by meter.c) then appears on
+ * display row (y + line) % 64.
+ *********************************************************************/
+
+void
+oled_set_start_line(unsigned line) {
+
+	start_line = line & 0x3F;
 }
 
 /*********************************************************************
@@ -230,24 +472,69 @@ oled_init(void) {
 static void
 pummel_test(struct Meter *m1) {
 	TickType_t t0 = xTaskGetTickCount();
-	double v = 0.0;
-	double incr = 0.05;
+	struct s_oled_stats st;
+	int mv = 0;
+	int incr = 50;
 
-	meter_set_value(m1,v);
+	meter_set_value(m1,mv);
 	meter_update();
+	oled_frame_stats(&st,true);
 	while ( (xTaskGetTickCount() - t0) < 5000 ) {
 		vTaskDelay(6);
-		v += incr;
-		if ( v > 3.3 ) {
-			incr = -0.05;
-			v = 3.3;
-		} else if ( v < 0.0 ) {
-			v = 0.0;
-			incr = 0.05;
+		mv += incr;
+		if ( mv > 3300 ) {
+			incr = -50;
+			mv = 3300;
+		} else if ( mv < 0 ) {
+			mv = 0;
+			incr = 50;
 		}
-		meter_set_value(m1,v);
+		meter_set_value(m1,mv);
 		meter_update();
 	}
+	oled_frame_stats(&st,false);
+	std_printf("%u submitted, %u coalesced, %u frames (%u/s)\n"
+		"%u bytes/frame, %u DMA/frame, latency %u us avg, %u us max\n",
+		(unsigned)st.submitted,
+		(unsigned)st.coalesced,
+		(unsigned)st.frames,
+		(unsigned)st.frames / 5,
+		(unsigned)(st.frames ? st.bytes / st.frames : 0),
+		(unsigned)(st.frames ? st.bursts / st.frames : 0),
+		(unsigned)(st.frames ? st.lat_sum_us / st.frames : 0),
+		(unsigned)st.lat_max_us);
+}
+
+/*********************************************************************
+ * Scroll a log through the console as fast as frames are sent, then
+ * return the display to the meter
+ *********************************************************************/
+
+static void
+console_test(struct Meter *m1) {
+	TickType_t t0;
+	struct s_oled_stats st;
+	char buf[40];
+	unsigned lines = 0;
+
+	console_init();
+	oled_frame_stats(&st,true);
+	t0 = xTaskGetTickCount();
+	while ( (xTaskGetTickCount() - t0) < 5000 ) {
+		mini_snprintf(buf,sizeof buf,"%u: tick %u\n",lines++,(unsigned)xTaskGetTickCount());
+		console_puts(buf);
+		taskYIELD();
+	}
+	oled_frame_stats(&st,false);
+	std_printf("%u lines (%u/s), %u frames, %u bytes/frame, %u DMA/frame\n",
+		lines,lines / 5,
+		(unsigned)st.frames,
+		(unsigned)(st.frames ? st.bytes / st.frames : 0),
+		(unsigned)(st.frames ? st.bursts / st.frames : 0));
+
+	oled_set_start_line(0);
+	meter_redraw(m1);
+	meter_update();
 }
 
 /*********************************************************************
@@ -258,7 +545,9 @@ static void
 monitor_task(void *arg __attribute((unused))) {
 	struct Meter m1;
 	bool menuf = true;
-	float v = 1.3;
+	int mv = 1300;
+	static const char *modes[] = { "paged", "full frame", "circular" };
+	enum OledMode mode = OLED_PAGED;
 	char ch;
 	
 	(void)std_getc();
@@ -266,8 +555,9 @@ monitor_task(void *arg __attribute((unused))) {
 
 	oled_init();
 	dma_init();
-	meter_init(&m1,3.5);
-	meter_set_value(&m1,v);
+	dwt_enable_cycle_counter();		// Frame latency
+	meter_init(&m1,3500);
+	meter_set_value(&m1,mv);
 	meter_update();
 
 	for (;;) {
@@ -282,6 +572,8 @@ monitor_task(void *arg __attribute((unused))) {
 				"  + .. increase by 0.1 volts\n"
 				"  - .. decrease by 0.1 volts\n"
 				"  p .. Meter pummel test\n"
+				"  c .. Console scrolling test\n"
+				"  m .. Next OLED mode (paged, full, circular)\n"
 			);
 		}
 		menuf = false;
@@ -300,45 +592,59 @@ monitor_task(void *arg __attribute((unused))) {
 			menuf = true;
 			break;		
 		case '+':
-			v += 0.1;
-			meter_set_value(&m1,v);
+			mv += 100;
+			meter_set_value(&m1,mv);
 			meter_update();
 			break;
 		case '-':
-			v -= 0.1;
-			meter_set_value(&m1,v);
+			mv -= 100;
+			meter_set_value(&m1,mv);
 			meter_update();
 			break;
 		case '0':
-			v = 0.0;
-			meter_set_value(&m1,v);
+			mv = 0;
+			meter_set_value(&m1,mv);
 			meter_update();
 			break;
 		case '1':
-			v = 1.0;
-			meter_set_value(&m1,v);
+			mv = 1000;
+			meter_set_value(&m1,mv);
 			meter_update();
 			break;
 		case '2':
-			v = 2.0;
-			meter_set_value(&m1,v);
+			mv = 2000;
+			meter_set_value(&m1,mv);
 			meter_update();
 			break;
 		case '3':
-			v = 3.0;
-			meter_set_value(&m1,v);
+			mv = 3000;
+			meter_set_value(&m1,mv);
 			meter_update();
 			break;
 		case '4':
-			v = 3.5;
-			meter_set_value(&m1,v);
+			mv = 3500;
+			meter_set_value(&m1,mv);
 			meter_update();
 			break;
+		case 'M':
+			mode = mode == OLED_CIRCULAR ? OLED_PAGED : (enum OledMode)(mode + 1);
+			oled_set_mode(mode);
+			std_printf("OLED mode: %s\n",modes[mode]);
+			// Resend the whole display in the new mode:
+			oled_frame_begin();
+			oled_dirty_all();
+			oled_frame_submit();
+			break;
 		case 'P':
 			std_printf("Meter pummel test..\n");
 			pummel_test(&m1);
 			std_printf("Test ended.\n");
 			break;
+		case 'C':
+			std_printf("Console scrolling test..\n");
+			console_test(&m1);
+			std_printf("Test ended.\n");
+			break;
 		default:
 			std_printf(" ???\n");
 			menuf = true;
@@ -410,7 +716,8 @@ main(void) {
 
 	// DMA
 	rcc_periph_clock_enable(RCC_DMA1);
-	nvic_set_priority(NVIC_DMA1_CHANNEL3_IRQ,0);
+	// Masked by taskENTER_CRITICAL(), which guards the frame swap:
+	nvic_set_priority(NVIC_DMA1_CHANNEL3_IRQ,configMAX_SYSCALL_INTERRUPT_PRIORITY);
 	nvic_enable_irq(NVIC_DMA1_CHANNEL3_IRQ);
 
 	usb_start(1,1);
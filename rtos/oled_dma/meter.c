@@ -3,21 +3,31 @@
 // Date: Wed Dec  6 22:51:32 2017   (C) ve3wwg@gmail.com
 ///////////////////////////////////////////////////////////////////////
 
-#include <math.h>
 #include <string.h>
 
 #include "ugui.h"
 #include "meter.h"
 #include "miniprintf.h"
 #include "oled.h"
+#include "glyph.h"
 
 #define ABS(x) (x < 0 ? -(x) : (x))
 #define SGN(x) (x < 0 ? -1 : 1)
 
 static UG_GUI gui;
-static float Pi = 3.14159265;
+static uint8_t dial[OLED_PAGES*OLED_COLS];	// Pre-rendered background
 static uint8_t dummy;
-uint8_t pixmap[128*64/8];
+struct s_dirty pixmap_dirty;
+
+void
+oled_dirty_all(void) {
+
+	for ( unsigned ux=0; ux<OLED_PAGES; ++ux ) {
+		pixmap_dirty.lo[ux] = 0;
+		pixmap_dirty.hi[ux] = OLED_COLS - 1;
+	}
+	pixmap_dirty.pages = 0xFF;
+}
 
 static uint8_t *
 to_pixel(short x,short y,unsigned *bitno) {
@@ -42,17 +52,22 @@ draw_point(short x,short y,short pen) {
 
 	unsigned bitno;
 	uint8_t *byte = to_pixel(x,y,&bitno);
-	uint8_t mask = 1 << bitno;
+	uint8_t mask = 1 << bitno, b;
 	
 	switch ( pen ) {
 	case 0:
-		*byte &= ~mask;
+		b = *byte & ~mask;
 		break;
 	case 1:
-		*byte |= mask;
+		b = *byte | mask;
 		break;
 	default:
-		*byte ^= mask;
+		b = *byte ^ mask;
+	}
+	if ( b != *byte ) {
+		// Only changed bytes need be sent to the display
+		*byte = b;
+		oled_mark_dirty((63 - y) / 8,x);
 	}
 }
 
@@ -87,12 +102,295 @@ local_draw_point(UG_S16 x,UG_S16 y,UG_COLOR c) {
 	draw_point(x,y,ug_to_pen(c));
 }
 
+/*********************************************************************
+ * Accelerated uGUI drivers for the page ordered pixmap. Display row
+ * r = 63 - y is bit r % 8 of the byte for column x in page r / 8, so
+ * a pen is applied to a byte as (byte & keep) ^ flip.
+ *********************************************************************/
+
+static void
+pen_masks(int pen,uint8_t mask,uint8_t *keep,uint8_t *flip) {
+
+	switch ( pen ) {
+	case 0:
+		*keep = ~mask;
+		*flip = 0;
+		break;
+	case 1:
+		*keep = ~mask;
+		*flip = mask;
+		break;
+	default:
+		*keep = 0xFF;
+		*flip = mask;
+	}
+}
+
+static UG_RESULT
+fill_frame(UG_S16 x1,UG_S16 y1,UG_S16 x2,UG_S16 y2,UG_COLOR c) {
+	int pen = ug_to_pen(c);
+	unsigned r1, r2, lo, hi;
+	uint8_t mask, keep, flip, b, *row;
+	UG_S16 t;
+
+	if ( x2 < x1 ) {
+		t = x1;
+		x1 = x2;
+		x2 = t;
+	}
+	if ( y2 < y1 ) {
+		t = y1;
+		y1 = y2;
+		y2 = t;
+	}
+	if ( x1 < 0 )
+		x1 = 0;
+	if ( x2 > OLED_COLS - 1 )
+		x2 = OLED_COLS - 1;
+	if ( y1 < 0 )
+		y1 = 0;
+	if ( y2 > 63 )
+		y2 = 63;
+	if ( x1 > x2 || y1 > y2 )
+		return UG_RESULT_OK;		// Nothing visible
+
+	r1 = 63 - y2;
+	r2 = 63 - y1;
+	for ( unsigned pg = r1 / 8; pg <= r2 / 8; ++pg ) {
+		mask = 0xFF;
+		if ( pg == r1 / 8 )
+			mask &= 0xFF << r1 % 8;
+		if ( pg == r2 / 8 )
+			mask &= 0xFF >> (7 - r2 % 8);
+		pen_masks(pen,mask,&keep,&flip);
+
+		row = &pixmap[pg * OLED_COLS];
+		lo = OLED_COLS;
+		hi = 0;
+		for ( unsigned x = x1; x <= (unsigned)x2; ++x ) {
+			b = (row[x] & keep) ^ flip;
+			if ( b != row[x] ) {
+				row[x] = b;
+				if ( lo == OLED_COLS )
+					lo = x;
+				hi = x;
+			}
+		}
+		if ( lo < OLED_COLS ) {
+			oled_mark_dirty(pg,lo);
+			oled_mark_dirty(pg,hi);
+		}
+	}
+	return UG_RESULT_OK;
+}
+
+/*********************************************************************
+ * Lines: spans go to fill_frame(), others follow uGUI's Bresenham
+ * steps exactly, moving a byte pointer and bit mask. Lines leaving
+ * the screen are left to uGUI, which clips each pixel.
+ *********************************************************************/
+
+static UG_RESULT
+draw_line(UG_S16 x1,UG_S16 y1,UG_S16 x2,UG_S16 y2,UG_COLOR c) {
+	UG_S16 dx = x2 - x1, dy = y2 - y1;
+	UG_S16 dxabs = ABS(dx), dyabs = ABS(dy);
+	UG_S16 sgndx = dx > 0 ? 1 : -1, sgndy = dy > 0 ? 1 : -1;
+	UG_S16 ex = dyabs >> 1, ey = dxabs >> 1, x = x1;
+	unsigned r = 63 - y1, pg = r / 8;
+	uint8_t *byte, mask, keep, flip, b;
+	int pen = ug_to_pen(c);
+
+	if ( x1 == x2 || y1 == y2 )
+		return fill_frame(x1,y1,x2,y2,c);
+
+	if ( x1 < 0 || x1 >= OLED_COLS || x2 < 0 || x2 >= OLED_COLS
+	  || y1 < 0 || y1 >= 64 || y2 < 0 || y2 >= 64 )
+		return UG_RESULT_FAIL;
+
+	byte = &pixmap[pg * OLED_COLS + x];
+	mask = 1 << r % 8;
+
+	for ( UG_S16 n=0; ; ++n ) {
+		pen_masks(pen,mask,&keep,&flip);
+		b = (*byte & keep) ^ flip;
+		if ( b != *byte ) {
+			*byte = b;
+			oled_mark_dirty(pg,x);
+		}
+		if ( n >= (dxabs >= dyabs ? dxabs : dyabs) )
+			break;
+
+		if ( dxabs >= dyabs ) {
+			ey += dyabs;
+			if ( ey >= dxabs ) {
+				ey -= dxabs;
+				r -= sgndy;
+			}
+			x += sgndx;
+			byte += sgndx;
+		} else	{
+			ex += dxabs;
+			if ( ex >= dyabs ) {
+				ex -= dyabs;
+				x += sgndx;
+				byte += sgndx;
+			}
+			r -= sgndy;
+		}
+		if ( r / 8 != pg ) {
+			byte += ((int)(r / 8) - (int)pg) * OLED_COLS;
+			pg = r / 8;
+		}
+		mask = 1 << r % 8;
+	}
+	return UG_RESULT_OK;
+}
+
+/*********************************************************************
+ * Text: uGUI pushes the pixels of a character cell in raster order
+ *********************************************************************/
+
+static struct {
+	UG_S16		x1, x2;		// Columns of the area
+	UG_S16		x, y;		// Next pixel
+	uint8_t		*row;		// Page of row y, or null if off screen
+	uint8_t		mask;		// Bit of row y
+	unsigned	pg;		// Page of row y
+} area;
+
+static void
+area_row(void) {
+	unsigned r = 63 - area.y;
+
+	if ( area.y < 0 || area.y >= 64 ) {
+		area.row = 0;
+		return;
+	}
+	area.pg = r / 8;
+	area.row = &pixmap[area.pg * OLED_COLS];
+	area.mask = 1 << r % 8;
+}
+
+static void
+area_pixel(UG_COLOR c) {
+	uint8_t keep, flip, b;
+
+	if ( area.row && area.x >= 0 && area.x < OLED_COLS ) {
+		pen_masks(ug_to_pen(c),area.mask,&keep,&flip);
+		b = (area.row[area.x] & keep) ^ flip;
+		if ( b != area.row[area.x] ) {
+			area.row[area.x] = b;
+			oled_mark_dirty(area.pg,area.x);
+		}
+	}
+	if ( ++area.x > area.x2 ) {
+		area.x = area.x1;
+		++area.y;
+		area_row();
+	}
+}
+
+static void *
+fill_area(UG_S16 x1,UG_S16 y1,UG_S16 x2,UG_S16 y2 __attribute((unused))) {
+
+	area.x1 = area.x = x1;
+	area.x2 = x2;
+	area.y = y1;
+	area_row();
+	return (void *)area_pixel;
+}
+
+/*********************************************************************
+ * Q15 trig: sin(k * pi / 256) for k = 0 to 128 (quarter wave)
+ *********************************************************************/
+
+static const int16_t sin_q15[129] = {
+	    0,   402,   804,  1206,  1608,  2009,  2410,  2811,
+	 3212,  3612,  4011,  4410,  4808,  5205,  5602,  5998,
+	 6393,  6786,  7179,  7571,  7962,  8351,  8739,  9126,
+	 9512,  9896, 10278, 10659, 11039, 11417, 11793, 12167,
+	12539, 12910, 13279, 13645, 14010, 14372, 14732, 15090,
+	15446, 15800, 16151, 16499, 16846, 17189, 17530, 17869,
+	18204, 18537, 18868, 19195, 19519, 19841, 20159, 20475,
+	20787, 21096, 21403, 21705, 22005, 22301, 22594, 22884,
+	23170, 23452, 23731, 24007, 24279, 24547, 24811, 25072,
+	25329, 25582, 25832, 26077, 26319, 26556, 26790, 27019,
+	27245, 27466, 27683, 27896, 28105, 28310, 28510, 28706,
+	28898, 29085, 29268, 29447, 29621, 29791, 29956, 30117,
+	30273, 30424, 30571, 30714, 30852, 30985, 31113, 31237,
+	31356, 31470, 31580, 31685, 31785, 31880, 31971, 32057,
+	32137, 32213, 32285, 32351, 32412, 32469, 32521, 32567,
+	32609, 32646, 32678, 32705, 32728, 32745, 32757, 32765,
+	32767,
+};
+
+// Angles are in units of pi/256, from 0 to 256 (half circle)
+
+static int
+sin_q(unsigned a) {
+	return a <= 128 ? sin_q15[a] : sin_q15[256 - a];
+}
+
+static int
+cos_q(unsigned a) {
+	return a <= 128 ? sin_q15[128 - a] : -sin_q15[a - 128];
+}
+
+// r * q (Q15), rounded
+static int
+qmul(int r,int q) {
+	return (r * q + (1 << 14)) >> 15;
+}
+
+/*********************************************************************
+ * Restore the rectangle x1,y1 to x2,y2 from the dial, in whole page
+ * bytes, marking only the bytes that change
+ *********************************************************************/
+
+static void
+restore(short x1,short y1,short x2,short y2) {
+	unsigned r1, r2, lo, hi, off;
+
+	if ( x1 < 0 )
+		x1 = 0;
+	if ( x2 > OLED_COLS - 1 )
+		x2 = OLED_COLS - 1;
+	if ( y1 < 0 )
+		y1 = 0;
+	if ( y2 > 63 )
+		y2 = 63;
+	if ( x1 > x2 || y1 > y2 )
+		return;
+
+	r1 = 63 - y2;
+	r2 = 63 - y1;
+	for ( unsigned pg = r1 / 8; pg <= r2 / 8; ++pg ) {
+		lo = OLED_COLS;
+		hi = 0;
+		for ( unsigned x = x1; x <= (unsigned)x2; ++x ) {
+			off = pg * OLED_COLS + x;
+			if ( pixmap[off] != dial[off] ) {
+				pixmap[off] = dial[off];
+				if ( lo == OLED_COLS )
+					lo = x;
+				hi = x;
+			}
+		}
+		if ( lo < OLED_COLS ) {
+			oled_mark_dirty(pg,lo);
+			oled_mark_dirty(pg,hi);
+		}
+	}
+}
+
 void
-meter_init(struct Meter *m,float range) {
+meter_init(struct Meter *m,int range) {
 
-	memset(pixmap,0,128*64/8);
+	oled_frame_begin();
+	memset(pixmap,0,OLED_PAGES*OLED_COLS);
+	oled_dirty_all();
 
-	m->value = 0.0;
+	m->value = 0;
 	m->rd = 6;
 	m->cr = 40;
 	m->dx = 1;
@@ -101,6 +399,9 @@ meter_init(struct Meter *m,float range) {
 	m->range = range;
 
 	UG_Init(&gui,local_draw_point,128,64);
+	UG_DriverRegister(DRIVER_FILL_FRAME,(void *)fill_frame);
+	UG_DriverRegister(DRIVER_DRAW_LINE,(void *)draw_line);
+	UG_DriverRegister(DRIVER_FILL_AREA,(void *)fill_area);
 	m->cx = 128 / 2;
 	m->cy = 64 - 1;
 	m->ocr = m->cr + m->rd;
@@ -112,56 +413,63 @@ meter_init(struct Meter *m,float range) {
 
 static void
 ticks(struct Meter *m,int t) {
-	float theta = (t * Pi)/8.0;
+	unsigned a = t * 32;		// t * pi / 8
 	int x1, y1, x2, y2, x, y;
-	float incr = m->range / 8;
 	int fm, fr;
 	char buf[16];
 
-	x1 = m->icr * cos(theta);
-	y1 = m->icr * sin(theta);
-	x2 = m->ocr * cos(theta);
-	y2 = m->ocr * sin(theta);
+	x1 = qmul(m->icr,cos_q(a));
+	y1 = qmul(m->icr,sin_q(a));
+	x2 = qmul(m->ocr,cos_q(a));
+	y2 = qmul(m->ocr,sin_q(a));
 
 	UG_DrawLine(m->cx-x1,m->cy-y1,x=m->cx-x2,y=m->cy-y2,pen_to_ug(2));
 	if ( t != 4 ) {
-		fm = incr * t * 10.0;
+		fm = m->range * t / 800;	// Tenths of a volt
 		fr = fm % 10;
 		fm /= 10;
 		mini_snprintf(buf,sizeof buf,"%d.%1d",fm,fr);
-		UG_PutString(x-m->tw,y-m->dy,buf);
+		glyph_puts(&GLYPH_4X6,x-m->tw,y-m->dy,buf,pen_to_ug(0),pen_to_ug(1));
 
 		UG_DrawLine(m->cx+x1,m->cy-y1,x=m->cx+x2,y=m->cy-y2,pen_to_ug(2));
 
-		fm = incr * (8 - t) * 10.0;
+		fm = m->range * (8 - t) / 800;
 		fr = fm % 10;
 		fm /= 10;
 		mini_snprintf(buf,sizeof buf,"%d.%1d",fm,fr);
-		UG_PutString(x+3,y-m->dy,buf);
+		glyph_puts(&GLYPH_4X6,x+3,y-m->dy,buf,pen_to_ug(0),pen_to_ug(1));
 	}
 }
 
+/*********************************************************************
+ * Render the static dial, and keep it as the background layer that
+ * meter_set_value() erases to
+ *********************************************************************/
+
 void
 meter_redraw(struct Meter *m) {
 
+	oled_frame_begin();
 	UG_FillScreen(pen_to_ug(1));
 	UG_FillCircle(m->cx,m->cy,m->cr,pen_to_ug(0));
 	UG_DrawCircle(m->cx,m->cy,m->icr,pen_to_ug(1));
-	UG_FontSelect(&FONT_4X6);
-	UG_FontSetHSpace(0);
 
 	for ( int x=0; x<=4; ++x )
 		ticks(m,x);
 	UG_FillFrame(0,0,127,15,pen_to_ug(1));
+	memcpy(dial,pixmap,sizeof dial);
+
+	m->px1 = m->px2 = -1;		// No pointer
+	m->tlen = 0;			// No readout
 	meter_set_value(m,m->value);
 }
 
 static void
-draw_pointer(struct Meter *m,float v,int pen) {
+draw_pointer(struct Meter *m,int pen) {
 	int pr = m->cr-m->rd-2;		// Pointer radius
-	float theta = v / m->range * Pi;
-	int x2 = pr * cos(theta);
-	int y2 = pr * sin(theta);
+	unsigned a = m->value * 256 / m->range;
+	int x2 = qmul(pr,cos_q(a));
+	int y2 = qmul(pr,sin_q(a));
 	int dy = y2 < 5 ? 1 : 0;
 
 	for ( int x=0; x < 3; ++x ) {
@@ -170,33 +478,46 @@ draw_pointer(struct Meter *m,float v,int pen) {
 		if ( x > 0 && m->cy+dy >= m->cy )
 			UG_DrawLine(m->cx+x,m->cy+dy,m->cx-x2,m->cy-y2,pen_to_ug(pen));
 	}
+
+	// Bounds, for the next erase:
+	m->px1 = m->cx-x2 < m->cx-2 ? m->cx-x2 : m->cx-2;
+	m->px2 = m->cx-x2 > m->cx+2 ? m->cx-x2 : m->cx+2;
+	m->py1 = m->cy-y2;
+	m->py2 = m->cy+dy;
 }
 
+/*********************************************************************
+ * Set the meter to mv millivolts. Only the old and new pointer, and
+ * the readout, are redrawn.
+ *********************************************************************/
+
 void
-meter_set_value(struct Meter *m,float v) {
+meter_set_value(struct Meter *m,int mv) {
 	char buf[16];
-	int fm, fr;
-
-	draw_pointer(m,m->value,0);
-	UG_FillFrame(0,0,127,15,pen_to_ug(1));
-	m->value = v > m->range ? m->range : v;
-	if ( m->value < 0.0 )
-		m->value = 0.0;
-
-	draw_pointer(m,m->value,1);
-	UG_FontSelect(&FONT_8X12);
-	UG_FontSetHSpace(0);
-
-	fm = m->value * 100.0;
-	fr = fm % 100;
-	fm /= 100;
-	int slen = mini_snprintf(buf,sizeof buf,"%d.%02d Volts",fm,fr);
-	UG_PutString(m->cx-8*slen/2,2,buf);
+	int cv, slen, x;
+
+	oled_frame_begin();
+	if ( m->px1 <= m->px2 )
+		restore(m->px1,m->py1,m->px2,m->py2);	// Erase pointer
+	m->value = mv > m->range ? m->range : mv;
+	if ( m->value < 0 )
+		m->value = 0;
+
+	draw_pointer(m,1);
+
+	cv = m->value / 10;		// Hundredths
+	slen = mini_snprintf(buf,sizeof buf,"%d.%02d Volts",cv/100,cv%100);
+	x = m->cx-8*slen/2;
+	if ( m->tlen && (x != m->tx || slen != m->tlen) )
+		restore(m->tx,2,m->tx+8*m->tlen-1,2+12-1);
+	glyph_puts(&GLYPH_8X12,x,2,buf,pen_to_ug(0),pen_to_ug(1));
+	m->tx = x;
+	m->tlen = slen;
 }
 
 void
 meter_update(void) {
-	spi_dma_xmit_pixmap();
+	oled_frame_submit();
 }
 
 // End meter.c
@@ -7,8 +7,8 @@
 #define METER_HPP
 
 struct Meter {
-	float		range;
-	float		value;		// Meter value (volts)
+	int		range;		// Full scale (millivolts)
+	int		value;		// Meter value (millivolts)
 	short		cx, cy;		// Center
 	short		rd;		// Radius difference
 	short		cr;		// Circle radius
@@ -16,11 +16,14 @@ struct Meter {
 	short		dx;		// Tick delta x
 	short		dy;		// Tick delta y
 	short		tw;		// Label text width
+	short		px1, px2;	// Pointer drawn: columns
+	short		py1, py2;	// and rows
+	short		tx, tlen;	// Readout drawn: x and length
 };
 
-void meter_init(struct Meter *m,float range);
+void meter_init(struct Meter *m,int range);
 void meter_redraw(struct Meter *m);
-void meter_set_value(struct Meter *m,float v);
+void meter_set_value(struct Meter *m,int mv);
 void meter_update(void);
 
 #endif // METER_HPP
@@ -6,9 +6,62 @@
 #ifndef OLED_H
 #define OLED_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OLED_PAGES	8
+#define OLED_COLS	128
+
+// Pages and column ranges of the pixmap changed since the last send
+struct s_dirty {
+	uint8_t		pages;			// Bit mask of dirty pages
+	uint8_t		lo[OLED_PAGES];		// First dirty column of page
+	uint8_t		hi[OLED_PAGES];		// Last dirty column of page
+};
+
+extern struct s_dirty pixmap_dirty;
+extern uint8_t *pixmap;			// Frame being drawn
+
+// How frames are sent (oled_set_mode)
+enum OledMode {
+	OLED_PAGED,			// Dirty page windows, page mode
+	OLED_FULL,			// 1K per frame, horizontal mode
+	OLED_CIRCULAR			// Continuous circular DMA refresh
+};
+
+// Frame counters (oled_frame_stats)
+struct s_oled_stats {
+	uint32_t	submitted;		// oled_frame_submit() calls
+	uint32_t	coalesced;		// Replaced before being sent
+	uint32_t	frames;			// Frames sent
+	uint32_t	bursts;			// DMA transfers
+	uint32_t	bytes;			// Bytes on the wire
+	uint32_t	lat_us;			// Last submit to sent
+	uint32_t	lat_max_us;		// Worst latency
+	uint32_t	lat_sum_us;		// For average over frames
+};
+
+static inline void
+oled_mark_dirty(unsigned pageno,unsigned colno) {
+	uint8_t bit = 1 << pageno;
+
+	if ( !(pixmap_dirty.pages & bit) ) {
+		pixmap_dirty.lo[pageno] = pixmap_dirty.hi[pageno] = colno;
+		pixmap_dirty.pages |= bit;
+	} else if ( colno < pixmap_dirty.lo[pageno] )
+		pixmap_dirty.lo[pageno] = colno;
+	else if ( colno > pixmap_dirty.hi[pageno] )
+		pixmap_dirty.hi[pageno] = colno;
+}
+
+void oled_dirty_all(void);
 void oled_command(uint8_t byte);
 void oled_command2(uint8_t byte,uint8_t byte2);
-void spi_dma_xmit_pixmap(void);
+void oled_frame_begin(void);
+void oled_frame_submit(void);
+void oled_frame_stats(struct s_oled_stats *stats,bool reset);
+void oled_set_mode(enum OledMode mode);
+void oled_set_start_line(unsigned line);
 
 #endif // OLED_H
 
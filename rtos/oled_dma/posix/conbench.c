@@ -0,0 +1,116 @@
+/* conbench.c -- Scroll a long log through the OLED console
+ * Warren W. Gay VE3WWG
+ *
+ * Writes n log lines with console_puts(), the frames going to the
+ * simulated SSD1306 (hostoled.c). The panel must then show the last
+ * CONSOLE_LINES lines exactly as a console that did not scroll.
+ * Reports SPI bytes, commands and wire time per line, and the lines
+ * per second the SPI link allows (1.125 MHz, as main.c), in page
+ * mode (one page per line) and full frame mode (1K per line).
+ *
+ * Usage: conbench [-n lines]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "meter.h"
+#include "console.h"
+#include "hostoled.h"
+#include "ssd1306sim.h"
+
+static uint8_t scrolled[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH];
+static uint8_t expected[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH];
+
+static void
+log_line(char *buf,unsigned size,unsigned ux) {
+
+	// Some lines wrap, some are empty:
+	if ( ux % 13 == 12 )
+		snprintf(buf,size,"\n");
+	else if ( ux % 7 == 3 )
+		snprintf(buf,size,"%u: a longer line, wrapping past %u columns\n",ux,CONSOLE_COLS);
+	else	snprintf(buf,size,"%u: tick %u, %u mV\n",ux,ux * 37 % 1000,ux * 113 % 3500);
+}
+
+/*********************************************************************
+ * Log n lines in one mode
+ *********************************************************************/
+
+static unsigned
+run(enum OledMode mode,const char *name,unsigned n) {
+	struct s_ssd1306sim_stats st;
+	char buf[80];
+	unsigned first, rows, len, fails = 0;
+	double us;
+
+	oled_set_mode(mode);
+	console_init();
+	ssd1306sim_stats(&st,true);
+
+	host_elapsed_us();
+	for ( unsigned ux=0; ux<n; ++ux ) {
+		log_line(buf,sizeof buf,ux);
+		console_puts(buf);
+	}
+	us = host_elapsed_us();
+	ssd1306sim_stats(&st,true);
+	ssd1306sim_screen(scrolled);
+
+	// The last screen full, from a cleared console:
+	for ( first=n, rows=0; first > 0 && rows < CONSOLE_LINES; ) {
+		log_line(buf,sizeof buf,--first);
+		len = strlen(buf) - 1;
+		rows += len ? (len + CONSOLE_COLS - 1) / CONSOLE_COLS : 1;
+	}
+	console_init();
+	for ( unsigned ux=first; ux<n; ++ux ) {
+		log_line(buf,sizeof buf,ux);
+		console_puts(buf);
+	}
+	ssd1306sim_screen(expected);
+	if ( memcmp(scrolled,expected,sizeof expected) ) {
+		printf("%s: scrolled display differs\n",name);
+		++fails;
+	}
+
+	printf("%-12s %8.1f %8.1f %8.1f %10.1f %10.0f %10.2f\n",name,
+		(double)st.bytes / n,(double)st.commands / n,(double)st.selects / n,
+		st.wire_ns / 1e3 / n,1e9 * n / st.wire_ns,us / n);
+	return fails;
+}
+
+int
+main(int argc,char **argv) {
+	struct Meter m;
+	unsigned n = 2000, fails = 0;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"n:h")) != -1 ) {
+		switch ( optch ) {
+		case 'n':
+			n = strtoul(optarg,0,10);
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-n lines]\n",argv[0]);
+			return 2;
+		}
+	}
+	if ( n < CONSOLE_LINES )
+		n = CONSOLE_LINES;
+
+	hostoled_open();
+	meter_init(&m,3500);			// uGUI and its drivers
+
+	printf("%u log lines\n\n",n);
+	printf("%-12s %8s %8s %8s %10s %10s %10s\n","Mode","Bytes","Cmds","Xfers",
+		"Wire us","Lines/s","Host us");
+	fails += run(OLED_PAGED,"paged",n);
+	fails += run(OLED_FULL,"full frame",n);
+
+	printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End conbench.c
@@ -0,0 +1,137 @@
+/* hostoled.c -- Host stand-ins for the oled_dma frame functions
+ * Warren W. Gay VE3WWG
+ *
+ * One frame buffer, no DMA: oled_frame_submit() sends the byte
+ * stream that spidma_task (main.c) would, for the current mode, to
+ * the simulated SSD1306 (libwwg/posix/ssd1306sim.c), and clears the
+ * dirty windows.
+ */
+#include <string.h>
+#include <time.h>
+
+#include "hostoled.h"
+#include "ssd1306sim.h"
+
+static uint8_t fbuf[OLED_PAGES*OLED_COLS];
+uint8_t *pixmap = fbuf;
+
+static struct s_hostoled_stats stats;
+static enum OledMode oled_mode = OLED_PAGED;
+static enum OledMode mode = OLED_PAGED;	// As set up in the SSD1306
+static uint8_t start_line = 0;
+static uint8_t line = 0;		// As set up in the SSD1306
+
+/*********************************************************************
+ * Reset the simulated controller, and initialize it as oled_init()
+ *********************************************************************/
+
+void
+hostoled_open(void) {
+	static const uint8_t cmds[] = {
+		0xAE, 0x00, 0x10, 0x40, 0x81, 0xCF, 0xA1, 0xA6, 
+		0xA8, 0x3F, 0xD3, 0x00, 0xD5, 0x80, 0xD9, 0xF1, 
+		0xDA, 0x12, 0xDB, 0x40, 0x8D, 0x14, 0xAF };
+	struct s_ssd1306sim_cfg cfg;
+
+	ssd1306sim_defaults(&cfg);
+	cfg.spi_hz = 72000000 / 64;		// As main.c
+	ssd1306sim_open(&cfg);
+	ssd1306sim_write(false,cmds,sizeof cmds);
+	oled_mode = mode = OLED_PAGED;
+	start_line = line = 0;
+}
+
+void
+oled_set_mode(enum OledMode new_mode) {
+	oled_mode = new_mode;
+}
+
+void
+oled_set_start_line(unsigned new_line) {
+	start_line = new_line & 0x3F;
+}
+
+void
+oled_frame_begin(void) {
+}
+
+void
+oled_frame_submit(void) {
+	static uint8_t cmds[] = {
+		0x20, 0x02,	// 0: Page mode
+		0x40,		// 2: Display start line
+		0xD3, 0x00,	// 3: Display offset
+		0xB0,		// 5: Page #
+		0x00,		// 6: Lo col
+		0x10		// 7: Hi Col
+	};
+	static uint8_t hcmds[] = {
+		0x20, 0x00,		// Horizontal mode
+		0x40,			// Display start line
+		0xD3, 0x00,		// Display offset
+		0x21, 0x00, 0x7F,	// Columns 0 to 127
+		0x22, 0x00, 0x07	// Pages 0 to 7
+	};
+	bool first = true;
+	unsigned lo, hi;
+
+	if ( !pixmap_dirty.pages )
+		return;				// Nothing is sent
+
+	if ( oled_mode != mode || start_line != line ) {
+		mode = oled_mode;
+		line = start_line;
+		cmds[2] = hcmds[2] = 0x40 | line;
+		if ( mode != OLED_PAGED )
+			ssd1306sim_write(false,hcmds,sizeof hcmds);
+	}
+
+	for ( unsigned px=0; px<OLED_PAGES; ++px ) {
+		if ( !(pixmap_dirty.pages & (1 << px)) )
+			continue;
+		lo = pixmap_dirty.lo[px];
+		hi = pixmap_dirty.hi[px];
+		stats.bytes += hi - lo + 1;
+		if ( mode == OLED_PAGED ) {
+			cmds[5] = 0xB0 | px;
+			cmds[6] = lo & 0x0F;
+			cmds[7] = 0x10 | lo >> 4;
+			if ( first )
+				ssd1306sim_write(false,&cmds[0],8);
+			else	ssd1306sim_write(false,&cmds[5],3);
+			ssd1306sim_write(true,&pixmap[px * OLED_COLS + lo],hi - lo + 1);
+			first = false;
+		}
+	}
+	if ( mode != OLED_PAGED )
+		ssd1306sim_write(true,pixmap,OLED_PAGES*OLED_COLS);
+
+	pixmap_dirty.pages = 0;
+	++stats.frames;
+}
+
+void
+hostoled_stats(struct s_hostoled_stats *st,bool reset) {
+
+	*st = stats;
+	if ( reset )
+		memset(&stats,0,sizeof stats);
+}
+
+/*********************************************************************
+ * Microseconds since the previous call
+ *********************************************************************/
+
+double
+host_elapsed_us(void) {
+	static struct timespec t0;
+	struct timespec t1;
+	double us;
+
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+	us = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+	t0 = t1;
+	return us;
+}
+
+// End hostoled.c
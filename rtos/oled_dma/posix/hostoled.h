@@ -0,0 +1,22 @@
+/* hostoled.h -- Host stand-ins for the oled_dma frame functions
+ * Warren W. Gay VE3WWG
+ */
+#ifndef HOSTOLED_H
+#define HOSTOLED_H
+
+#include <stdint.h>
+
+#include "oled.h"
+
+struct s_hostoled_stats {
+	uint32_t	frames;		// oled_frame_submit() calls
+	uint32_t	bytes;		// Dirty window bytes submitted
+};
+
+void hostoled_open(void);
+void hostoled_stats(struct s_hostoled_stats *stats,bool reset);
+double host_elapsed_us(void);
+
+#endif // HOSTOLED_H
+
+// End hostoled.h
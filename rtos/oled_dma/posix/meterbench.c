@@ -0,0 +1,332 @@
+/* meterbench.c -- Time and check the meter drawing code on the host
+ * Warren W. Gay VE3WWG
+ *
+ * Draws the meter of oled_dma (meter.c + ugui.c) with uGUI's per
+ * pixel callback only, and again with the accelerated drivers that
+ * meter_init() registers. Checks that both give the same pixmap and
+ * dirty windows, step by step, and reports the time for a full
+ * meter_redraw() and for a pointer move (meter_set_value()), which
+ * must leave the same pixmap as a full redraw.
+ *
+ * Then checks glyph_puts() against UG_PutString() at every y and a
+ * range of x, over a patterned pixmap, and reports characters drawn
+ * per millisecond by each.
+ *
+ * Finally sweeps the pointer in each oled_set_mode() mode, with the
+ * frames sent to the simulated SSD1306: its RAM must follow the
+ * pixmap, and the panel must match golden/meter-NNNN.pgm (NNNN: mV)
+ * in every mode. Reports SPI bytes, commands and transfers per frame.
+ *
+ * Usage: meterbench [-n redraws] [-g]
+ *
+ *	-g	Rewrite the golden images
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ugui.h"
+#include "meter.h"
+#include "glyph.h"
+#include "hostoled.h"
+#include "ssd1306sim.h"
+
+#define STEPS	200			// Pointer moves checked
+
+struct s_run {
+	uint8_t		pix[STEPS+1][OLED_PAGES*OLED_COLS];
+	struct s_dirty	dirty[STEPS+1];
+	double		redraw_us;	// Per meter_redraw()
+	double		move_us;	// Per meter_set_value()
+};
+
+static void
+drivers(bool on) {
+	static const UG_U8 types[] = { DRIVER_FILL_FRAME, DRIVER_DRAW_LINE, DRIVER_FILL_AREA };
+
+	for ( unsigned ux=0; ux<sizeof types; ++ux ) {
+		if ( on )
+			UG_DriverEnable(types[ux]);
+		else	UG_DriverDisable(types[ux]);
+	}
+}
+
+/*********************************************************************
+ * Draw the meter, then sweep the pointer, recording each step
+ *********************************************************************/
+
+static void
+run(struct s_run *r,struct Meter *m,bool accel,unsigned n) {
+	int mv = 0, incr = 50;
+
+	drivers(accel);
+	memset(pixmap,0,OLED_PAGES*OLED_COLS);
+	pixmap_dirty.pages = 0;
+	m->value = 0;
+	meter_redraw(m);
+	memcpy(r->pix[0],pixmap,sizeof r->pix[0]);
+	r->dirty[0] = pixmap_dirty;
+	meter_update();
+
+	for ( unsigned ux=1; ux<=STEPS; ++ux ) {
+		mv += incr;
+		if ( mv > 3300 ) {
+			incr = -50;
+			mv = 3300;
+		} else if ( mv < 0 ) {
+			mv = 0;
+			incr = 50;
+		}
+		meter_set_value(m,mv);
+		memcpy(r->pix[ux],pixmap,sizeof r->pix[ux]);
+		r->dirty[ux] = pixmap_dirty;
+		meter_update();
+	}
+
+	host_elapsed_us();
+	for ( unsigned ux=0; ux<n; ++ux )
+		meter_redraw(m);
+	r->redraw_us = host_elapsed_us() / n;
+
+	for ( unsigned ux=0; ux<n; ++ux )
+		meter_set_value(m,(ux % 66) * 50);
+	r->move_us = host_elapsed_us() / n;
+	meter_update();
+}
+
+/*********************************************************************
+ * A pointer move must leave the same pixmap as a full redraw
+ *********************************************************************/
+
+static unsigned
+move_check(struct Meter *m) {
+	static uint8_t moved[OLED_PAGES*OLED_COLS];
+	unsigned fails = 0;
+
+	for ( int mv=-100; mv<=m->range+100; mv += 37 ) {
+		meter_set_value(m,mv);
+		memcpy(moved,pixmap,sizeof moved);
+		meter_redraw(m);
+		if ( memcmp(moved,pixmap,sizeof moved) && ++fails <= 5 )
+			printf("meter_set_value(%d) differs from meter_redraw()\n",mv);
+		meter_set_value(m,(mv * 7) % m->range);
+	}
+	meter_update();
+	return fails;
+}
+
+static bool
+same_dirty(const struct s_dirty *a,const struct s_dirty *b) {
+
+	if ( a->pages != b->pages )
+		return false;
+	for ( unsigned px=0; px<OLED_PAGES; ++px )
+		if ( (a->pages & (1 << px)) && (a->lo[px] != b->lo[px] || a->hi[px] != b->hi[px]) )
+			return false;
+	return true;
+}
+
+/*********************************************************************
+ * Sweep the pointer with frames going to the simulated SSD1306
+ *********************************************************************/
+
+static unsigned
+frame_check(struct Meter *m,enum OledMode mode,bool regen) {
+	static const char *names[] = { "OLED_PAGED", "OLED_FULL", "OLED_CIRCULAR" };
+	static uint8_t screen[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH];
+	static uint8_t golden[SSD1306SIM_HEIGHT][SSD1306SIM_WIDTH];
+	struct s_ssd1306sim_stats st, sum;
+	unsigned fails = 0, frames = 0;
+	char path[64];
+
+	hostoled_open();
+	oled_set_mode(mode);
+	meter_redraw(m);
+	oled_dirty_all();
+	meter_update();
+	ssd1306sim_stats(&st,true);
+	memset(&sum,0,sizeof sum);
+
+	for ( int mv=0; mv<=m->range; mv += 50 ) {
+		meter_set_value(m,mv);
+		meter_update();
+		ssd1306sim_stats(&st,true);
+		sum.bytes += st.bytes;
+		sum.wire_ns += st.wire_ns;
+		sum.commands += st.commands;
+		sum.selects += st.selects;
+		sum.unknown += st.unknown;
+		++frames;
+
+		if ( memcmp(ssd1306sim_ram(),pixmap,OLED_PAGES*OLED_COLS) && ++fails <= 5 )
+			printf("%s, %d mV: SSD1306 RAM differs from pixmap\n",names[mode],mv);
+
+		if ( mv % 1250 && mv != m->range )
+			continue;
+		snprintf(path,sizeof path,"golden/meter-%04d.pgm",mv);
+		if ( regen ) {
+			if ( mode == OLED_PAGED && ssd1306sim_write_pgm(path,1) )
+				++fails;
+			continue;
+		}
+		ssd1306sim_screen(screen);
+		if ( ssd1306sim_read_pgm(path,golden) ) {
+			printf("%s: missing or unreadable (make golden)\n",path);
+			++fails;
+		} else if ( memcmp(screen,golden,sizeof screen) ) {
+			printf("%s, %d mV: panel differs from %s\n",names[mode],mv,path);
+			++fails;
+		}
+	}
+	if ( sum.unknown )
+		++fails;
+
+	printf("%-16s %10.1f %10.1f %10.1f %10.3f\n",names[mode],
+		(double)sum.bytes / frames,(double)sum.commands / frames,
+		(double)sum.selects / frames,sum.wire_ns / 1e6 / frames);
+	return fails;
+}
+
+/*********************************************************************
+ * Text: glyph_puts() against uGUI
+ *********************************************************************/
+
+static void
+pattern(void) {
+
+	for ( unsigned ux=0; ux<OLED_PAGES*OLED_COLS; ++ux )
+		pixmap[ux] = ux * 0x9D ^ ux >> 3;
+	pixmap_dirty.pages = 0;
+}
+
+static void
+ug_text(const struct s_glyphfont *f,UG_S16 x,UG_S16 y,const char *s,UG_COLOR fc,UG_COLOR bc) {
+
+	UG_FontSelect(f->ug);
+	UG_FontSetHSpace(0);
+	UG_SetForecolor(fc);
+	UG_SetBackcolor(bc);
+	UG_PutString(x,y,(char *)s);
+}
+
+static unsigned
+text_check(const struct s_glyphfont *f,const char *s) {
+	static const UG_COLOR colours[][2] = {
+		{ C_BLACK, C_WHITE }, { C_WHITE, C_BLACK }, { C_WHITE, C_WHITE }
+	};
+	static uint8_t want[OLED_PAGES*OLED_COLS];
+	struct s_dirty wdirty;
+	unsigned fails = 0;
+
+	for ( unsigned cx=0; cx<sizeof colours/sizeof colours[0]; ++cx ) {
+		for ( UG_S16 y=-2; y<=64; ++y ) {
+			for ( UG_S16 x=-1; x<=40; x += 3 ) {
+				pattern();
+				ug_text(f,x,y,s,colours[cx][0],colours[cx][1]);
+				memcpy(want,pixmap,sizeof want);
+				wdirty = pixmap_dirty;
+
+				pattern();
+				glyph_puts(f,x,y,s,colours[cx][0],colours[cx][1]);
+				if ( memcmp(want,pixmap,sizeof want) || !same_dirty(&wdirty,&pixmap_dirty) ) {
+					if ( ++fails <= 5 )
+						printf("%ux%u \"%s\" at %d,%d: differs from uGUI\n",
+							f->width,f->height,s,x,y);
+				}
+			}
+		}
+	}
+	pixmap_dirty.pages = 0;
+	return fails;
+}
+
+static void
+text_bench(const struct s_glyphfont *f,const char *s,unsigned n) {
+	UG_S16 ya = 64 - f->height - 8, yu = ya - 3;	// Page aligned, not
+	unsigned len = strlen(s);
+	double us[4];
+
+	for ( unsigned tx=0; tx<4; ++tx ) {
+		drivers(tx == 1);
+		host_elapsed_us();
+		for ( unsigned ux=0; ux<n; ++ux ) {
+			if ( tx < 2 )
+				ug_text(f,2,yu,s,C_BLACK,C_WHITE);
+			else	glyph_puts(f,2,tx == 2 ? ya : yu,s,C_BLACK,C_WHITE);
+		}
+		us[tx] = host_elapsed_us();
+	}
+	drivers(true);
+	pixmap_dirty.pages = 0;
+
+	printf("%2ux%-2u %-14s %10.0f %10.0f %10.0f %10.0f\n",
+		f->width,f->height,"chars/ms",
+		n * len * 1e3 / us[0],n * len * 1e3 / us[1],
+		n * len * 1e3 / us[2],n * len * 1e3 / us[3]);
+}
+
+int
+main(int argc,char **argv) {
+	static struct s_run plain, accel;
+	struct Meter m;
+	unsigned n = 2000, fails = 0;
+	bool opt_g = false;
+	int optch;
+
+	while ( (optch = getopt(argc,argv,"n:gh")) != -1 ) {
+		switch ( optch ) {
+		case 'n':
+			n = strtoul(optarg,0,10);
+			break;
+		case 'g':
+			opt_g = true;
+			break;
+		default:
+			fprintf(stderr,"Usage: %s [-n redraws] [-g]\n",argv[0]);
+			return 2;
+		}
+	}
+	if ( !n )
+		n = 1;
+
+	hostoled_open();
+	meter_init(&m,3500);
+	run(&plain,&m,false,n);
+	run(&accel,&m,true,n);
+
+	for ( unsigned ux=0; ux<=STEPS; ++ux ) {
+		if ( memcmp(plain.pix[ux],accel.pix[ux],sizeof plain.pix[ux]) ) {
+			printf("Step %u: pixmaps differ\n",ux);
+			++fails;
+		}
+		if ( !same_dirty(&plain.dirty[ux],&accel.dirty[ux]) ) {
+			printf("Step %u: dirty windows differ\n",ux);
+			++fails;
+		}
+	}
+
+	fails += move_check(&m);
+
+	printf("%-24s %12s %12s\n","","Per pixel","Accelerated");
+	printf("%-24s %9.2f us %9.2f us  (%.1fx)\n","meter_redraw()",
+		plain.redraw_us,accel.redraw_us,plain.redraw_us / accel.redraw_us);
+	printf("%-24s %9.2f us %9.2f us  (%.1fx)\n","meter_set_value()",
+		plain.move_us,accel.move_us,plain.move_us / accel.move_us);
+	printf("%-24s %12.0f %12.0f\n","Updates/s",1e6 / plain.move_us,1e6 / accel.move_us);
+
+	fails += text_check(&GLYPH_8X12,"3.30 Volts");
+	fails += text_check(&GLYPH_4X6,"0.4 !~");
+	printf("\n%-20s %10s %10s %10s %10s\n","Text","Per pixel","FILL_AREA","Aligned","Unaligned");
+	text_bench(&GLYPH_8X12,"3.30 Volts",n * 10);
+	text_bench(&GLYPH_4X6,"0.4 1.3 2.2",n * 10);
+
+	printf("\n%-16s %10s %10s %10s %10s\n","Frames","SPI bytes","Commands","Transfers","Wire ms");
+	for ( int mode=OLED_PAGED; mode<=OLED_CIRCULAR; ++mode )
+		fails += frame_check(&m,(enum OledMode)mode,opt_g);
+
+	printf("\n%s (%u failures)\n",fails ? "FAILED" : "PASSED",fails);
+	return fails ? 1 : 0;
+}
+
+// End meterbench.c
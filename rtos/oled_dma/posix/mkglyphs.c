@@ -0,0 +1,62 @@
+/* mkglyphs.c -- Transpose uGUI fonts into column bytes for glyph.c
+ * Warren W. Gay VE3WWG
+ *
+ * Usage: mkglyphs > ../glyphs.c
+ *
+ * uGUI stores a 1BPP font by rows, LSB leftmost. glyph.c wants each
+ * column as (height+7)/8 bytes, LSB first, with glyph row j in bit
+ * height-1-j, since the pixmap's rows run bottom up.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ugui.h"
+
+#define FIRST	0x20		// Printable ASCII only
+#define LAST	0x7E
+
+static void
+transpose(const char *name,const char *ugname,const UG_FONT *f) {
+	unsigned w = f->char_width, h = f->char_height;
+	unsigned bn = (w + 7) / 8, nb = (h + 7) / 8;
+	const unsigned char *g;
+	uint32_t bits;
+
+	if ( f->font_type != FONT_TYPE_1BPP || f->widths || h > 16 || f->start_char > FIRST || f->end_char < LAST ) {
+		fprintf(stderr,"%s: Not a fixed width 1BPP font of 16 rows or less\n",ugname);
+		exit(1);
+	}
+
+	printf("static const uint8_t %s_cols[] = {",name);
+	for ( unsigned ch=FIRST; ch<=LAST; ++ch ) {
+		g = f->p + (ch - f->start_char) * h * bn;
+		printf("\n\t");
+		for ( unsigned cx=0; cx<w; ++cx ) {
+			bits = 0;
+			for ( unsigned ry=0; ry<h; ++ry )
+				if ( g[ry * bn + cx / 8] & (1 << cx % 8) )
+					bits |= 1u << (h - 1 - ry);
+			for ( unsigned bx=0; bx<nb; ++bx, bits >>= 8 )
+				printf("0x%02X, ",(unsigned)(bits & 0xFF));
+		}
+		printf("// '%c'",ch);
+	}
+	printf("\n};\n\n");
+	printf("const struct s_glyphfont %s = { %u, %u, 0x%02X, 0x%02X, &%s, %s_cols };\n\n",
+		name,w,h,FIRST,LAST,ugname,name);
+}
+
+int
+main(void) {
+
+	printf("///////////////////////////////////////////////////////////////////////\n");
+	printf("// glyphs.c -- Generated by posix/mkglyphs from ugui.c: do not edit\n");
+	printf("///////////////////////////////////////////////////////////////////////\n\n");
+	printf("#include \"glyph.h\"\n\n");
+	transpose("GLYPH_4X6","FONT_4X6",&FONT_4X6);
+	transpose("GLYPH_8X12","FONT_8X12",&FONT_8X12);
+	printf("// End glyphs.c\n");
+	return 0;
+}
+
+// End mkglyphs.c
@@ -19,9 +19,12 @@
 #include "mcuio.h"
 #include "miniprintf.h"
 #include "winbond.h"
+#include "generated.overlay.h"
 
 /*********************************************************************
- * Overlayed functions
+ * Overlayed functions: mkoverlay.sh generates the overlay table,
+ * the name_stub() functions and the linker script fragment from
+ * these prototypes.
  *********************************************************************/
 
 int fee(int arg) __attribute__((noinline,section(".ov_fee")));
@@ -29,85 +32,6 @@ int fie(int arg) __attribute__((noinline,section(".ov_fie")));
 int foo(int arg) __attribute__((noinline,section(".ov_foo")));
 int fum(int arg) __attribute__((noinline,section(".ov_fum")));
 
-/*********************************************************************
- * Overlay Table
- *********************************************************************/
-
-typedef struct {
-	short		regionx;// Overlay region index
-	void		*vma;	// Overlay's mapped address
-	char		*start;	// Load start address
-	char		*stop;	// Load stop address
-	unsigned long	size;	// Size in bytes
-	void		*func;	// Function pointer
-} s_overlay;
-
-#define N_REGIONS	1	// # of overlay regions in RAM
-#define N_OVLY		4	// Total # of overlays (in all regions)
-
-#define OVERLAY(region,ov,sym)	{ region, &ov, &__load_start_ ## sym, &__load_stop_ ## sym, 0, sym }
-#define LOADREF(sym) __load_start_ ## sym, __load_stop_ ## sym 
-
-extern unsigned long overlay1;	// Provides address of overlay region 1
-
-// Function load addresses
-extern char LOADREF(fee), LOADREF(fie), LOADREF(foo), LOADREF(fum);
-
-// Overlay table:
-static s_overlay overlays[N_OVLY] = {
-	OVERLAY(0,overlay1,fee),
-	OVERLAY(0,overlay1,fie),
-	OVERLAY(0,overlay1,foo),
-	OVERLAY(0,overlay1,fum)
-};
-
-// Overlay cache:
-static s_overlay *cur_overlay[N_REGIONS] = { 0 };
-
-/*********************************************************************
- * Overlay lookup: Returns func ptr, after copying code if necessary
- *********************************************************************/
-
-static void *
-module_lookup(void *module) {
-	unsigned regionx;		// Overlay region index
-	s_overlay *ovl = 0;		// Table struct ptr
-
-	std_printf("module_lookup(%p):\n",module);
-
-	for ( unsigned ux=0; ux<N_OVLY; ++ux ) {
-		if ( overlays[ux].start == module ) {
-			regionx = overlays[ux].regionx;
-			ovl = &overlays[ux];
-			break;
-		}
-	}
-
-	if ( !ovl )
-		return 0;		// Not found
-
-	if ( !cur_overlay[regionx] || cur_overlay[regionx] != ovl ) {
-		if ( ovl->size == 0 )
-			ovl->size = (char *)ovl->stop - (char *)ovl->start;
-		cur_overlay[regionx] = ovl;
-
-		std_printf("Reading %u from SPI at 0x%04X into 0x%04X\n",
-			(unsigned)ovl->size,
-			(unsigned)ovl->start,
-			(unsigned)ovl->vma);
-
-		w25_read_data(SPI1,(unsigned)ovl->start,ovl->vma,ovl->size);
-
-		std_printf("Returned...\n");
-		std_printf("Read %u bytes: %02X %02X %02X...\n",
-			(unsigned)ovl->size,
-			((uint8_t*)ovl->vma)[0],
-			((uint8_t*)ovl->vma)[1],
-			((uint8_t*)ovl->vma)[2]);
-	}
-	return ovl->func;
-}
-
 /*********************************************************************
  * Overlay function fee()
  *********************************************************************/
@@ -157,38 +81,6 @@ fum(int arg) {
 	return arg + 0x3000;
 }
 
-/*********************************************************************
- * Stub functions for calling the overlay functions:
- *********************************************************************/
-
-static int
-fee_stub(int arg) {
-	int (*feep)(int arg) = module_lookup(&__load_start_fee);
-
-	return feep(arg);
-}
-
-static int
-fie_stub(int arg) {
-	int (*fiep)(int arg) = module_lookup(&__load_start_fie);
-
-	return fiep(arg);
-}
-
-static int
-foo_stub(int arg) {
-	int (*foop)(int arg) = module_lookup(&__load_start_foo);
-
-	return foop(arg);
-}
-
-static int
-fum_stub(int arg) {
-	int (*fump)(int arg) = module_lookup(&__load_start_fum);
-
-	return fump(arg);
-}
-
 /*********************************************************************
  * Launch a bunch of overlay calls and return the result:
  *********************************************************************/
@@ -196,6 +88,7 @@ fum_stub(int arg) {
 static int 
 calls(int arg) {
 
+	overlay_prefetch(ovl_table[OVL_fee].start);	// Loads while we print
 	std_printf("fang(0x%04X)\n",arg);
 	arg = fee_stub(arg);
 	arg = fie_stub(arg);
@@ -219,24 +112,35 @@ task1(void *args __attribute((unused))) {
 			r = std_getc();
 		} while ( r != 'R' && r != 'r' );
 
-		// Dump the overlay table:
-		std_printf("OVERLAY TABLE:\n");
-		for ( unsigned ux=0; ux<N_OVLY; ++ux ) {
-			std_printf("[%u] { regionx=%u, vma=%p, start=%p, stop=%p, size=%u, func=%p }\n",
-				ux, 
-				overlays[ux].regionx,
-				overlays[ux].vma,
-				overlays[ux].start,
-				overlays[ux].stop,
-				(unsigned)overlays[ux].size,
-				overlays[ux].func);
-		}
-
 		gpio_toggle(GPIOC,GPIO13);	// Toggle LED
 
 		r = calls(0x0001);		// Exercise overlays
 		std_printf("calls(0xA) returned 0x%04X\n",r);
 		std_printf("\nIt worked!!\n");
+
+		// Dump the overlay table:
+		std_printf("OVERLAY TABLE:\n");
+		for ( unsigned ux=0; ux<OVL_COUNT; ++ux ) {
+			std_printf("[%u] { regions=%X, vma=%p, start=%p, size=%u, entry=%p, loads=%u, hits=%u, prefetches=%u, stall=%u }\n",
+				ux, 
+				(unsigned)ovl_table[ux].regions,
+				ovl_table[ux].vma,
+				ovl_table[ux].start,
+				(unsigned)ovl_table[ux].size,
+				ovl_table[ux].entry,
+				(unsigned)ovl_table[ux].loads,
+				(unsigned)ovl_table[ux].hits,
+				(unsigned)ovl_table[ux].prefetches,
+				(unsigned)ovl_table[ux].stall);
+		}
+		std_printf("overlay_verify() found %u damaged\n",overlay_verify());
+		for ( unsigned ux=0; ux<ovl_nregions; ++ux )
+			std_printf("Region %u at %p, %u bytes: %u loads, %u restored, %u damaged\n",
+				ux,ovl_regions[ux].vma,
+				(unsigned)ovl_regions[ux].size,
+				(unsigned)ovl_regions[ux].loads,
+				(unsigned)ovl_regions[ux].restores,
+				(unsigned)ovl_regions[ux].corrupt);
 	}
 }
 
@@ -255,6 +159,7 @@ main(void) {
 	std_set_device(mcu_usb);			// Use USB for std I/O
 
 	w25_spi_setup(SPI1,true,true,true,SPI_CR1_BAUDRATE_FPCLK_DIV_256);
+	overlay_init(SPI1,ovl_regions,ovl_nregions,ovl_table,OVL_COUNT,ovl_build);
 
 	xTaskCreate(task1,"task1",100,NULL,1,NULL);
 	vTaskStartScheduler();
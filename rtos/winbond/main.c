@@ -20,6 +20,7 @@
 #include "mcuio.h"
 #include "miniprintf.h"
 #include "intelhex.h"
+#include "winbond.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -29,157 +30,21 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/spi.h>
 
-#define W25_CMD_MANUF_DEVICE	0x90
-#define W25_CMD_JEDEC_ID	0x9F
-#define W25_CMD_WRITE_EN	0x06
-#define W25_CMD_WRITE_DI	0x04
-#define W25_CMD_READ_SR1	0x05
-#define W25_CMD_READ_SR2	0x35
-#define W25_CMD_CHIP_ERASE	0xC7
-#define W25_CMD_READ_DATA	0x03
-#define W25_CMD_FAST_READ	0x0B
-#define W25_CMD_WRITE_DATA	0x02
-#define W25_CMD_READ_UID	0x4B
-#define W25_CMD_PWR_ON		0xAB
-#define W25_CMD_PWR_OFF		0xB9
-#define W25_CMD_ERA_SECTOR	0x20
-#define W25_CMD_ERA_32K		0x52
-#define W25_CMD_ERA_64K		0xD8
-
-#define DUMMY			0x00
-
-#define W25_SR1_BUSY		0x01
-#define W25_SR1_WEL		0x02
-
-static const char *cap[3] = {
-	"W25X16",	// 14
-	"W25X32",	// 15
-	"W25X64"	// 16
-};	
-
-static uint8_t
-w25_read_sr1(uint32_t spi) {
-	uint8_t sr1;
-
-	spi_enable(spi);
-	spi_xfer(spi,W25_CMD_READ_SR1);
-	sr1 = spi_xfer(spi,DUMMY);
-	spi_disable(spi);
-	return sr1;
-}
-
-static uint8_t
-w25_read_sr2(uint32_t spi) {
-	uint8_t sr1;
-
-	spi_enable(spi);
-	spi_xfer(spi,W25_CMD_READ_SR2);
-	sr1 = spi_xfer(spi,DUMMY);
-	spi_disable(spi);
-	return sr1;
-}
-
-static void
-w25_wait(uint32_t spi) {
-
-	while ( w25_read_sr1(spi) & W25_SR1_BUSY )
-		taskYIELD();
-}
+/*********************************************************************
+ * Chip erase, with messages
+ *********************************************************************/
 
 static bool
-w25_is_wprotect(uint32_t spi) {
-
-	w25_wait(spi);
-	return !(w25_read_sr1(spi) & W25_SR1_WEL);
-}
-
-static void
-w25_write_en(uint32_t spi,bool en) {
-
-	w25_wait(spi);
-
-	spi_enable(spi);
-	spi_xfer(spi,en ? W25_CMD_WRITE_EN : W25_CMD_WRITE_DI);
-	spi_disable(spi);
-
-	w25_wait(spi);
-}
-
-static uint16_t
-w25_manuf_device(uint32_t spi) {
-	uint16_t info;
-
-	w25_wait(spi);
-	spi_enable(spi);
-	spi_xfer(spi,W25_CMD_MANUF_DEVICE);	// Byte 1
-	spi_xfer(spi,DUMMY);			// Dummy1 (2)
-	spi_xfer(spi,DUMMY);			// Dummy2 (3)
-	spi_xfer(spi,0x00);			// Byte 4
-	info = spi_xfer(spi,DUMMY) << 8;	// Byte 5
-	info |= spi_xfer(spi,DUMMY);		// Byte 6
-	spi_disable(spi);
-	return info;
-}
-
-static uint32_t
-w25_JEDEC_ID(uint32_t spi) {
-	uint32_t info;
-
-	w25_wait(spi);
-	spi_enable(spi);
-	spi_xfer(spi,W25_CMD_JEDEC_ID);
-	info = spi_xfer(spi,DUMMY);		 // Manuf.
-	info = (info << 8) | spi_xfer(spi,DUMMY);// Memory Type
-	info = (info << 8) | spi_xfer(spi,DUMMY);// Capacity
-	spi_disable(spi);
-
-	return info;
-}
-
-static void
-w25_read_uid(uint32_t spi,void *buf,uint16_t bytes) {
-	uint8_t *udata = (uint8_t*)buf;
-
-	if ( bytes > 8 )
-		bytes = 8;
-	else if ( bytes <= 0 )
-		return;
-
-	w25_wait(spi);
-	spi_enable(spi);
-	spi_xfer(spi,W25_CMD_READ_UID);
-	for ( uint8_t ux=0; ux<4; ++ux )
-		spi_xfer(spi,DUMMY);
-	for ( uint8_t ux=0; ux<bytes; ++ux )
-		udata[ux] = spi_xfer(spi,DUMMY);
-	spi_disable(spi);
-}
-
-static void
-w25_power(uint32_t spi,bool on) {
-
-	if ( !on )
-		w25_wait(spi);
-	spi_enable(spi);
-	spi_xfer(spi,on ? W25_CMD_PWR_ON : W25_CMD_PWR_OFF);
-	spi_disable(spi);
-}
-
-static bool
-w25_chip_erase(uint32_t spi) {
+chip_erase(uint32_t spi) {
 
 	if ( w25_is_wprotect(spi) ) {
 		std_printf("Not Erased! Chip is not write enabled.\n");
 		return false;
 	}
 
-	spi_enable(spi);
-	spi_xfer(spi,W25_CMD_CHIP_ERASE);
-	spi_disable(spi);
-
 	std_printf("Erasing chip..\n");
 
-	if ( !w25_is_wprotect(spi) ) {
+	if ( !w25_chip_erase(spi) ) {
 		std_printf("Not Erased! Chip erase failed.\n");
 		return false;
 	}
@@ -188,93 +53,50 @@ w25_chip_erase(uint32_t spi) {
 	return true;
 }
 
-static uint32_t		// New address is returned
-w25_read_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
-	uint8_t *udata = (uint8_t*)data;
-
-	w25_wait(spi);
-
-	spi_enable(spi);
-	spi_xfer(spi,W25_CMD_FAST_READ);
-	spi_xfer(spi,addr >> 16);
-	spi_xfer(spi,(addr >> 8) & 0xFF);
-	spi_xfer(spi,addr & 0xFF);
-	spi_xfer(spi,DUMMY);
-
-	for ( ; bytes-- > 0; ++addr )
-		*udata++ = spi_xfer(spi,DUMMY);
-
-	spi_disable(spi);
-	return addr;	
-}
-
-static unsigned		// New address is returned
-w25_write_data(uint32_t spi,uint32_t addr,void *data,uint32_t bytes) {
-	uint8_t *udata = (uint8_t*)data;
-
-	w25_write_en(spi,true);
-	w25_wait(spi);
-
-	if ( w25_is_wprotect(spi) ) {
-		std_printf("Write disabled.\n");
-		return 0xFFFFFFFF;	// Indicate error
-	}
-
-	while ( bytes > 0 ) {
-		spi_enable(spi);
-		spi_xfer(spi,W25_CMD_WRITE_DATA);
-		spi_xfer(spi,addr >> 16);
-		spi_xfer(spi,(addr >> 8) & 0xFF);
-		spi_xfer(spi,addr & 0xFF);
-		while ( bytes > 0 ) {
-			spi_xfer(spi,*udata++);
-			--bytes;
-			if ( (++addr & 0xFF) == 0x00 )
-				break;
-		}
-		spi_disable(spi);
-	
-		if ( bytes > 0 )
-			w25_write_en(spi,true); // More to write
-	}
-	return addr;	
-}
+/*********************************************************************
+ * Erase sector/block, with messages
+ *********************************************************************/
 
 static void
-w25_erase_block(uint32_t spi,uint32_t addr,uint8_t cmd) {
-	const char *what;
+erase_block(uint32_t spi,uint32_t addr,uint8_t cmd,const char *what) {
 	
 	if ( w25_is_wprotect(spi) ) {
 		std_printf("Write protected. Erase not performed.\n");
 		return;
 	}
 
-	switch ( cmd ) {
-	case W25_CMD_ERA_SECTOR:
-		what = "sector";
-		addr &= ~(4*1024-1);
-		break;
-	case W25_CMD_ERA_32K:
-		what = "32K block";
-		addr &= ~(32*1024-1);
-		break;
-	case W25_CMD_ERA_64K:
-		what = "64K block";
-		addr &= ~(64*1024-1);
-		break;
-	default:
-		return;	// Should not happen
-	}
+	if ( w25_erase_block(spi,addr,cmd) )
+		std_printf("%s erased, containing %06X\n",what,(unsigned)addr);
+	else	std_printf("%s FAILED.\n",what);
+}
 
-	spi_enable(spi);
-	spi_xfer(spi,cmd);
-	spi_xfer(spi,addr >> 16);
-	spi_xfer(spi,(addr >> 8) & 0xFF);
-	spi_xfer(spi,addr & 0xFF);
-	spi_disable(spi);
+/*********************************************************************
+ * Display the device descriptor (from SFDP when available)
+ *********************************************************************/
 
-	std_printf("%s erased, starting at %06X\n",
-		what,(unsigned)addr);
+static void
+device_info(uint32_t spi) {
+	const struct s_w25dev *dev = w25_device(spi);
+
+	std_printf("JEDEC ID $%06X, %s\n",
+		(unsigned)dev->jedec_id,
+		dev->sfdp ? "configured from SFDP" : "no SFDP (defaults)");
+	std_printf("Capacity %u KB, page %u bytes, %u-byte addresses\n",
+		(unsigned)(dev->capacity / 1024),
+		dev->page_size,
+		dev->addr_bytes);
+	for ( unsigned ux=0; ux<W25_N_ERASE; ++ux ) {
+		if ( !dev->erase[ux].size )
+			continue;
+		std_printf("Erase %uK: cmd $%02X, typical %u ms\n",
+			(unsigned)(dev->erase[ux].size / 1024),
+			dev->erase[ux].cmd,
+			dev->erase[ux].typ_ms);
+	}
+	if ( dev->chip_ms )
+		std_printf("Chip erase typical %u ms, page program %u us\n",
+			(unsigned)dev->chip_ms,
+			dev->page_us);
 }
 
 static void
@@ -291,7 +113,7 @@ flash_status(void) {
 }
 
 static unsigned
-get_data24(const char *prompt) {
+get_addr(const char *prompt) {
 	unsigned v = 0u, count = 0u;
 	char ch;
 
@@ -321,10 +143,10 @@ get_data24(const char *prompt) {
 				continue;
 			}
 		}
-		if ( ++count > 6 )
+		if ( ++count >= 8 )
 			break;
 	}
-	return v & 0xFFFFFF;
+	return v;
 }
 
 static unsigned
@@ -397,7 +219,6 @@ dump_page(uint32_t spi,uint32_t addr) {
 
 static void
 erase(uint32_t spi,uint32_t addr) {
-	const char *what;
 	char ch;
 
 	if ( w25_is_wprotect(spi) ) {
@@ -422,28 +243,20 @@ erase(uint32_t spi,uint32_t addr) {
 
 	switch ( ch ) {
 	case 's':
-		w25_erase_block(spi,addr,W25_CMD_ERA_SECTOR);
-		what = "Sector";
+		erase_block(spi,addr,W25_CMD_ERA_SECTOR,"Sector");
 		break;
 	case 'b':
-		w25_erase_block(spi,addr,W25_CMD_ERA_32K);
-		what = "32K block";
+		erase_block(spi,addr,W25_CMD_ERA_32K,"32K block");
 		break;
 	case 'z':
-		w25_erase_block(spi,addr,W25_CMD_ERA_64K);
-		what = "64K block";
+		erase_block(spi,addr,W25_CMD_ERA_64K,"64K block");
 		break;
 	case 'c':
-		w25_chip_erase(SPI1);
-		return;
+		chip_erase(spi);
+		break;
 	default:
 		std_printf("Erase CANCELLED.\n");
-		return;
 	}
-
-	if ( w25_is_wprotect(spi) )
-		std_printf("%s erased.\n",what);
-	else	std_printf("%s FAILED.\n",what);
 }
 
 static void
@@ -524,14 +337,14 @@ load_ihex(uint32_t spi) {
  */
 static void
 monitor_task(void *arg __attribute((unused))) {
-	int ch, devx;
+	int ch;
 	unsigned addr = 0u;
 	uint8_t data = 0, idbuf[8];
 	uint32_t info;
-	const char *device;
 	bool menuf = true;
 	
 	std_printf("\nMonitor Task Started.\n");
+	w25_init(SPI1);
 
 	for (;;) {
 		if ( menuf ) {
@@ -542,6 +355,7 @@ monitor_task(void *arg __attribute((unused))) {
 				"  a ... Set address\n"
 				"  d ... Dump page\n"
 				"  e ... Erase (Sector/Block/64K/Chip)\n"
+				"  f ... SFDP device parameters\n"
 				"  i ... Manufacture/Device info\n"
 				"  h ... Ready to load Intel hex\n"
 				"  j ... JEDEC ID info\n"
@@ -575,27 +389,23 @@ monitor_task(void *arg __attribute((unused))) {
 		case '1':
 			w25_power(SPI1,1);
 			break;
+		case 'F':
+			w25_init(SPI1);
+			device_info(SPI1);
+			break;
 		case 'I':
 			info = w25_manuf_device(SPI1);
-			devx = (int)(info & 0xFF)-0x14;
-			if ( devx < 3 )
-				device = cap[devx];
-			else	device = "unknown";
-			std_printf("Manufacturer $%02X Device $%02X (%s)\n",
+			std_printf("Manufacturer $%02X Device $%02X (%u KB)\n",
 				(uint16_t)info>>8,(uint16_t)info&0xFF,
-				device);
+				(unsigned)(w25_device(SPI1)->capacity / 1024));
 			break;
 		case 'J':
 			info = w25_JEDEC_ID(SPI1);
-			devx = (int)(info & 0xFF)-0x15;	// Offset is 1 higher here
-			if ( devx < 3 )
-				device = cap[devx];
-			else	device = "unknown";
-			std_printf("Manufacturer $%02X Type $%02X Capacity $%02X (%s)\n",
+			std_printf("Manufacturer $%02X Type $%02X Capacity $%02X (%u KB)\n",
 				(uint16_t)(info>>16),
 				(uint16_t)((info>>8)&0xFF),
 				(uint16_t)(info&0xFF),
-				device);
+				(unsigned)(w25_device(SPI1)->capacity / 1024));
 			break;
 		case 'U':
 			w25_read_uid(SPI1,idbuf,sizeof idbuf);
@@ -611,7 +421,7 @@ monitor_task(void *arg __attribute((unused))) {
 			erase(SPI1,addr);
 			break;
 		case 'A':
-			addr = get_data24("Address");
+			addr = get_addr("Address");
 			std_printf("\nAddress: %06X\n",addr);
 			break;
 		case 'D':